@@ -30,6 +30,7 @@ class AstridConsole(cmd.Cmd):
     prompt = '^_- '
     intro = 'Astrid Console'
     instruments = {}
+    render_workers = {}
     dac = None
     adc = None
     seq = None
@@ -170,15 +171,62 @@ to be restarted to take effect.
             else:
                 print('seq is already stopped')
 
+    def start_renderer(self, instrument):
+        rcmd = './build/astrid-renderer "orc/%s.py" "%s"' % (instrument, instrument)
+        env = dict(os.environ)
+        if instrument in self.render_workers:
+            env['ASTRID_RENDER_WORKERS'] = str(self.render_workers[instrument])
+
+        try:
+            print(rcmd)
+            self.instruments[instrument] = subprocess.Popen(rcmd, shell=True, env=env)
+        except Exception as e:
+            print('Could not start renderer: %s' % e)
+            print(traceback.format_exc())
+            return False
+
+        return True
+
+    def help_w(self):
+        txt = """
+Render instrument ding with 4 worker processes
+
+    ^_- w ding 4
+
+Show the worker counts that have been set
+
+    ^_- w
+
+Each worker loads its own copy of the instrument and 
+they all read from its play queue, so that many voices 
+can render at once. A running instrument is restarted 
+to take the new count. Instruments without a count 
+use ASTRID_RENDER_WORKERS from the environment, or 1.
+        """
+        print(txt)
+
+    def do_w(self, cmd):
+        parts = cmd.split()
+        if len(parts) == 0:
+            print(self.render_workers)
+            return
+
+        if len(parts) != 2 or not parts[1].isdigit():
+            print('Invalid arguments. Usage: \n  w <instrument_name> <workers>')
+            return
+
+        instrument, workers = parts[0], int(parts[1])
+        self.render_workers[instrument] = workers
+
+        if instrument in self.instruments:
+            self.instruments[instrument].terminate()
+            self.instruments[instrument].wait()
+            del self.instruments[instrument]
+            self.start_renderer(instrument)
+
     def do_l(self, instrument):
         if instrument not in self.instruments:
-            try:
-                rcmd = './build/astrid-renderer "orc/%s.py" "%s"' % (instrument, instrument)
-                print(rcmd)
-                self.instruments[instrument] = subprocess.Popen(rcmd, shell=True)
-            except Exception as e:
-                print('Could not start renderer: %s' % e)
-                print(traceback.format_exc())
+            if not self.start_renderer(instrument):
                 return
 
     def do_t(self, cmd):
@@ -190,13 +238,7 @@ to be restarted to take effect.
             params = ' ' + ' '.join(parts)
 
         if instrument not in self.instruments:
-            try:
-                rcmd = './build/astrid-renderer "orc/%s.py" "%s"' % (instrument, instrument)
-                print(rcmd)
-                self.instruments[instrument] = subprocess.Popen(rcmd, shell=True)
-            except Exception as e:
-                print('Could not start renderer: %s' % e)
-                print(traceback.format_exc())
+            if not self.start_renderer(instrument):
                 return
 
         try:
@@ -253,13 +295,7 @@ to be restarted to take effect.
             params = ' ' + ' '.join(parts)
 
         if instrument not in self.instruments:
-            try:
-                rcmd = './build/astrid-renderer "orc/%s.py" "%s"' % (instrument, instrument)
-                print(rcmd)
-                self.instruments[instrument] = subprocess.Popen(rcmd, shell=True)
-            except Exception as e:
-                print('Could not start renderer: %s' % e)
-                print(traceback.format_exc())
+            if not self.start_renderer(instrument):
                 return
 
         try:
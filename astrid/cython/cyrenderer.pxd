@@ -1,6 +1,6 @@
 #cython: language_level=3
 
-from libc.stdint cimport uint16_t
+from libc.stdint cimport uint16_t, uint32_t
 from pippi.soundbuffer cimport SoundBuffer
 
 
@@ -72,6 +72,41 @@ cdef extern from "astrid.h":
         char msg[LPMAXMSG]
         char instrument_name[LPMAXNAME]
 
+    ctypedef struct lpslab_header_t:
+        size_t numblocks
+        size_t blocks_used
+        size_t high_water
+        size_t failed_allocs
+
+    ctypedef struct lpslab_t:
+        int shmid
+        lpslab_header_t * header
+        char * data
+
+    ctypedef struct lpslab_desc_t:
+        size_t offset
+        size_t length
+        int channels
+        int samplerate
+        int is_looping
+        size_t onset
+        lpmsg_t msg
+
+    cdef enum LPParamTypes:
+        LPPARAM_GAIN,
+        LPPARAM_PAN,
+        LPPARAM_CUTOFF,
+        NUM_LPPARAMTYPES
+
+    ctypedef struct lpparam_t:
+        double timestamp
+        size_t voice_id
+        unsigned int type
+        lpfloat_t value
+
+    ctypedef struct lpparamstream_t:
+        int shmid
+
     ctypedef struct lpmidievent_t:
         double onset
         double length
@@ -80,8 +115,20 @@ cdef extern from "astrid.h":
         char velocity
         char channel
 
+    ctypedef struct lpadcbuf_t:
+        int channels
+        int samplerate
+
+    ctypedef struct lpadcview_t:
+        const float * segments[2]
+        size_t lengths[2]
+        size_t start
+
     int lpadc_create()
     int lpadc_destroy()
+    lpadcbuf_t * lpadc_attach(int shmid)
+    int lpadc_view(lpadcbuf_t * adc, size_t offset, size_t size, lpadcview_t * view)
+    int lpadc_view_is_valid(lpadcbuf_t * adc, lpadcview_t * view)
     int lpadc_write_block(float * block, size_t blocksize_in_samples, int adc_shmid)
     int lpadc_read_sample(size_t pos, lpfloat_t * sample, int adc_shmid)
     int lpadc_read_block_of_samples(size_t offset, size_t size, lpfloat_t (*out)[LPADCBUFSAMPLES], int adc_shmid)
@@ -90,12 +137,23 @@ cdef extern from "astrid.h":
 
     int send_message(lpmsg_t msg)
 
+    int lpslab_open(lpslab_t * slab)
+    int lpslab_alloc(lpslab_t * slab, size_t length, int channels, size_t * offset)
+    int lpslab_free(lpslab_t * slab, size_t offset, size_t length, int channels)
+    void lpslab_handoff(lpslab_t * slab, size_t offset, size_t length, int channels)
+    int lpslab_send(lpslab_desc_t desc)
+
+    int lpparamstream_open(lpparamstream_t * ps)
+    int lpparamstream_push(lpparamstream_t * ps, lpparam_t param)
+    int lpparam_type_from_name(char * name)
+
     int midi_triggerq_open()
     int midi_triggerq_schedule(int qfd, lpmidievent_t t)
     int midi_triggerq_close(int qfd)
 
     int lpmidi_setcc(int device_id, int cc, int value)
     int lpmidi_getcc(int device_id, int cc)
+    int lpmidi_readcc(int device_id, int cc, int * value, uint32_t * seq, double * timestamp)
     int lpmidi_setnote(int device_id, int note, int velocity)
     int lpmidi_getnote(int device_id, int note)
 
@@ -119,6 +177,7 @@ cdef class EventTriggerFactory:
 cdef class MidiEventListenerProxy:
     cpdef float cc(self, int cc, int device_id=*)
     cpdef int cci(self, int cc, int device_id=*)
+    cpdef tuple ccstate(self, int cc, int device_id=*)
     cpdef float note(self, int note, int device_id=*)
     cpdef int notei(self, int note, int device_id=*)
 
@@ -12,7 +12,6 @@ import importlib.util
 import os
 from pathlib import Path
 import platform
-import struct
 import subprocess
 import threading
 
@@ -36,59 +35,121 @@ if not logger.handlers:
 _redis = redis.StrictRedis(host='localhost', port=6379, db=0)
 bus = _redis.pubsub()
 
-cdef lpfloat_t[LPADCBUFSAMPLES] adc_block
+cdef lpslab_t slab
+cdef bint slab_is_open = False
 
-cdef bytes serialize_buffer(SoundBuffer buf, size_t onset, int is_looping, lpmsg_t * msg):
-    cdef bytearray strbuf
-    cdef size_t audiosize, length, msgsize
-    cdef int channels, samplerate
-    cdef unsigned char[:] msgview
+cdef lpparamstream_t paramstream
+cdef bint paramstream_is_open = False
 
-    msgsize = sizeof(lpmsg_t)
+cdef int send_param(size_t voice_id, str name, double value, double delay):
+    """ Queue a parameter change for a playing voice 
+        on the DAC's parameter streams
+    """
+    global paramstream_is_open
+    cdef lpparam_t param
+    cdef double now = 0
+    cdef bytes bname = name.encode('ascii')
+    cdef int paramtype = lpparam_type_from_name(bname)
 
-    channels = <int>buf.channels
-    samplerate = <int>buf.samplerate
-    length = <size_t>len(buf)
+    if paramtype < 0:
+        logger.error('cyrenderer: unknown voice parameter %s' % name)
+        return -1
 
-    # size of audio data 
-    audiosize = length * channels * sizeof(lpfloat_t)
+    if not paramstream_is_open:
+        if lpparamstream_open(&paramstream) < 0:
+            logger.error('cyrenderer: could not attach to the parameter streams. Is the DAC running?')
+            return -1
+        paramstream_is_open = True
+
+    lpscheduler_get_now_seconds(&now)
 
-    strbuf = bytearray()
+    param.timestamp = now + delay
+    param.voice_id = voice_id
+    param.type = <unsigned int>paramtype
+    param.value = value
 
-    strbuf += struct.pack('N', audiosize)
-    strbuf += struct.pack('N', length)
-    strbuf += struct.pack('i', channels)
-    strbuf += struct.pack('i', samplerate)
-    strbuf += struct.pack('i', is_looping)
-    strbuf += struct.pack('N', onset)
+    if lpparamstream_push(&paramstream, param) < 0:
+        logger.error('cyrenderer: could not queue %s change for voice %d' % (name, voice_id))
+        return -1
 
+    return 0
+
+cdef int send_buffer(SoundBuffer buf, size_t onset, int is_looping, lpmsg_t * msg):
+    """ Write the buffer straight into the DAC's shared 
+        memory slab and send its descriptor to the DAC
+    """
+    global slab_is_open
+    cdef lpslab_desc_t desc
+    cdef lpfloat_t * out
+    cdef double[:,:] frames = buf.frames
+    cdef size_t i, length
+    cdef int c, channels
+
+    if not slab_is_open:
+        if lpslab_open(&slab) < 0:
+            logger.error('cyrenderer: could not attach to the buffer slab. Is the DAC running?')
+            return -1
+        slab_is_open = True
+
+    channels = <int>buf.channels
+    length = <size_t>len(buf)
+
+    if lpslab_alloc(&slab, length, channels, &desc.offset) < 0:
+        logger.error('cyrenderer: no room in the buffer slab for %d frames' % length)
+        return -1
+
+    out = <lpfloat_t *>(slab.data + desc.offset)
     for i in range(length):
         for c in range(channels):
-            strbuf += struct.pack('d', buf.frames[i,c])
+            out[i * channels + c] = frames[i,c]
 
-    msgview = <unsigned char[:msgsize]>(<unsigned char *>msg)
-    for i in range(msgsize):
-        strbuf.append(msgview[i])
+    desc.length = length
+    desc.channels = channels
+    desc.samplerate = <int>buf.samplerate
+    desc.is_looping = is_looping
+    desc.onset = onset
+    desc.msg = msg[0]
 
-    return bytes(strbuf)
+    # The DAC frees the blocks from here on
+    lpslab_handoff(&slab, desc.offset, length, channels)
+    if lpslab_send(desc) < 0:
+        lpslab_free(&slab, desc.offset, length, channels)
+        return -1
+
+    return 0
 
 cdef SoundBuffer read_from_adc(int adc_shmid, double length, double offset=0, int channels=2, int samplerate=48000):
-    cdef size_t i
-    cdef int c
+    cdef lpadcbuf_t * adc
+    cdef lpadcview_t view
+    cdef size_t i, pos, missing
+    cdef int s
 
     cdef SoundBuffer snd = SoundBuffer(length=length, channels=channels, samplerate=samplerate)
+    cdef double[:,:] frames = snd.frames
     cdef size_t length_in_frames = len(snd)
     cdef size_t offset_in_frames = <size_t>(offset * samplerate)
 
-    if lpadc_read_block_of_samples(offset_in_frames * channels, length_in_frames * channels, &adc_block, adc_shmid) < 0:
-        logger.error('cyrenderer ADC read: failed to read %d frames at offset %d from ADC' % (length_in_frames, offset_in_frames))
+    adc = lpadc_attach(adc_shmid)
+    if adc == NULL:
+        logger.error('cyrenderer ADC read: could not attach to the ADC')
         return snd
 
-    for i in range(length_in_frames):
-        for c in range(channels):
-            snd.frames[i,c] = adc_block[i * channels + c]
+    # Copy straight out of the capture ring, and 
+    # start over if the ADC laps the copy
+    while True:
+        if lpadc_view(adc, offset_in_frames * channels, length_in_frames * channels, &view) < 0:
+            logger.error('cyrenderer ADC read: failed to read %d frames at offset %d from ADC' % (length_in_frames, offset_in_frames))
+            return snd
 
-    return snd
+        missing = length_in_frames * channels - view.lengths[0] - view.lengths[1]
+        pos = missing
+        for s in range(2):
+            for i in range(view.lengths[s]):
+                frames[pos // channels, pos % channels] = view.segments[s][i]
+                pos += 1
+
+        if lpadc_view_is_valid(adc, &view):
+            return snd
 
 """ TODO
 cdef class AstridMessage:
@@ -155,6 +216,17 @@ cdef class MidiEventListenerProxy:
     cpdef int cci(self, int cc, int device_id=0):
         return lpmidi_getcc(device_id, cc)
 
+    cpdef tuple ccstate(self, int cc, int device_id=0):
+        """ The raw CC value with the number of times it 
+            has been set and the time it was last set, 
+            for noticing when a knob has moved
+        """
+        cdef int value = 0
+        cdef uint32_t seq = 0
+        cdef double timestamp = 0
+        lpmidi_readcc(device_id, cc, &value, &seq, &timestamp)
+        return value, seq, timestamp
+
     cpdef float note(self, int note, int device_id=0):
         cdef int velocity = lpmidi_getnote(device_id, note)
         return float(velocity) / 127
@@ -252,6 +324,13 @@ cdef class EventContext:
         self.vid = voice_id
         self.adc_shmid = adc_shmid
 
+    def automate(self, str param, double value, double delay=0):
+        """ Change the gain, pan or lowpass cutoff of this voice 
+            while it plays. The DAC applies the change `delay` 
+            seconds from now, on the next block it mixes.
+        """
+        return send_param(self.vid, param, value, delay)
+
     def adc(self, length=1, offset=0, channels=2):
         return read_from_adc(self.adc_shmid, length, offset=offset, channels=channels)
 
@@ -417,7 +496,7 @@ cdef int render_event(object instrument, lpmsg_t * msg):
         msg=msgstr,
         sounds=instrument.sounds,
         cache=instrument.cache,
-        voice_id=0,
+        voice_id=msg.voice_id,
         adc_shmid=instrument.adc_shmid,
     )
 
@@ -436,8 +515,8 @@ cdef int render_event(object instrument, lpmsg_t * msg):
 
             try:
                 for snd in generator:
-                    bufstr = serialize_buffer(snd, onset, loop, msg)
-                    _redis.publish('astridbuffers', bufstr)
+                    if send_buffer(snd, onset, loop, msg) < 0:
+                        logger.error('Could not send %s buffer to the DAC' % ctx.instrument_name)
 
             except Exception as e:
                 logger.exception('Error during %s generator render: %s' % (ctx.instrument_name, e))
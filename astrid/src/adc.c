@@ -73,6 +73,13 @@ int main() {
         return 1;
     }
 
+    /* Map the ring now, so the audio callback 
+     * never has to make a syscall to write to it */
+    if(lpadc_attach(adc_shmid) == NULL) {
+        perror("Could not attach to adcbuf shared memory");
+        return 1;
+    }
+
     /* Set up the miniaudio device context */
     ma_context audio_device_context;
     if (ma_context_init(NULL, 0, NULL, &audio_device_context) != MA_SUCCESS) {
@@ -77,6 +77,12 @@ int lpsessiondb_create(sqlite3 ** db) {
         return -1;
     }
 
+    /* Voices are updated by id on every render */
+    if(sqlite3_exec(*db, "create index voices_id on voices (id);", lpsessiondb_callback_debug, 0, &err) != SQLITE_OK) {
+        syslog(LOG_ERR, "Could not index sessiondb voices. Error: %s\n", sqlite3_errmsg(*db));
+        return -1;
+    }
+
     /* Set WAL mode */
     if(sqlite3_exec(*db, "pragma journal_mode=WAL;", lpsessiondb_callback_debug, 0, &err) != SQLITE_OK) {
         syslog(LOG_ERR, "Could not set sessiondb WAL mode. Error: %s\n", sqlite3_errmsg(*db));
@@ -88,127 +94,230 @@ int lpsessiondb_create(sqlite3 ** db) {
 
 int lpsessiondb_insert_voice(lpmsg_t msg) {
     sqlite3 * db;
-    char * err = 0;
-    char * sql;
-    size_t sqlsize;
+    sqlite3_stmt * stmt;
     struct timespec ts;
     long long now;
+    int rc;
 
-    char * _sql = "insert into voices (created, started, last_render, ended, active, timestamp, \
-                   id, instrument_name, params, render_count) \
-                   values (%lld, NULL, NULL, NULL, 0, %f, %d, \"%s\", \"%s\", 0);";
+    char * sql = "insert into voices (created, started, last_render, ended, active, timestamp, \
+                  id, instrument_name, params, render_count) \
+                  values (?1, NULL, NULL, NULL, 0, ?2, ?3, ?4, ?5, 0);";
 
     clock_gettime(CLOCK_MONOTONIC, &ts);
     now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
 
-    /* Prepare the sql unsafely */
-    sqlsize = snprintf(NULL, 0, _sql, now, msg.timestamp, (int)msg.voice_id, msg.instrument_name, msg.msg)+1;
-    sql = calloc(1, sqlsize);
-    if(snprintf(sql, sqlsize, _sql, now, msg.timestamp, (int)msg.voice_id, msg.instrument_name, msg.msg) < 0) {
-        syslog(LOG_ERR, "Could not concat sql for insert. Error: %s\n", strerror(errno));
+    /* Open the sessiondb for writing */
+    if(lpsessiondb_open_for_writing(&db) < 0) return -1;
+
+    /* The DAC's writer may be mid-commit */
+    sqlite3_busy_timeout(db, 1000);
+
+    if(sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "Could not prepare voice insert. Error: %s\n", sqlite3_errmsg(db));
+        lpsessiondb_close(db);
         return -1;
     }
 
-    /* Open the sessiondb for writing */
-    lpsessiondb_open_for_writing(&db);
+    sqlite3_bind_int64(stmt, 1, now);
+    sqlite3_bind_double(stmt, 2, msg.timestamp);
+    sqlite3_bind_int(stmt, 3, (int)msg.voice_id);
+    sqlite3_bind_text(stmt, 4, msg.instrument_name, strnlen(msg.instrument_name, LPMAXNAME), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, msg.msg, strnlen(msg.msg, LPMAXMSG), SQLITE_STATIC);
 
     /* Insert the voice */
-    if(sqlite3_exec(db, sql, lpsessiondb_callback_debug, 0, &err) != SQLITE_OK) {
-        syslog(LOG_ERR, "Could not exec sql statement: %s. Error: %s\n", sql, strerror(errno));
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE) {
+        syslog(LOG_ERR, "Could not insert voice %d. Error: %s\n", (int)msg.voice_id, sqlite3_errmsg(db));
+        lpsessiondb_close(db);
         return -1;
     }
 
     return lpsessiondb_close(db);
 }
 
-int lpsessiondb_mark_voice_active(sqlite3 * db, int voice_id) {
-    char * err = 0;
-    char * sql;
-    size_t sqlsize;
-    struct timespec ts;
-    long long now;
+/* Write everything queued so far in one transaction. The 
+ * records are only handed back to the producer once the 
+ * commit succeeds: if the db stays busy past the timeout 
+ * the batch is rolled back and -1 returned, so it can be 
+ * retried on the next tick. A record that fails for any 
+ * other reason is skipped and counted as dropped. */
+static int lpsessiondb_writer_flush(lpsessiondb_writer_t * w) {
+    lpsessiondb_record_t * r;
+    sqlite3_stmt * stmt;
+    size_t head, tail, written, dropped;
+    int rc;
 
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    head = atomic_load_explicit(&w->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+    if(head == tail) return 0;
 
-    /* Prepare the sql unsafely */
-    sqlsize = snprintf(NULL, 0, "update voices set active=1, started=%lld, last_render=%lld, render_count=1 where id=%d;", now, now, voice_id)+1;
-    sql = calloc(1, sqlsize);
-    if(snprintf(sql, sqlsize, "update voices set active=1, started=%lld, last_render=%lld, render_count=1 where id=%d;", now, now, voice_id) < 0) {
-        syslog(LOG_ERR, "Could not concat sql for update. Error: %s\n", strerror(errno));
+    if(sqlite3_exec(w->db, "begin;", NULL, NULL, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "lpsessiondb_writer_flush could not begin transaction. Error: %s\n", sqlite3_errmsg(w->db));
         return -1;
     }
 
-    /* Mark the voice as active */
-    if(sqlite3_exec(db, sql, lpsessiondb_callback_debug, 0, &err) != SQLITE_OK) {
-        syslog(LOG_ERR, "Could not exec sql statement: %s. Error: %s\n", sql, strerror(errno));
+    written = 0;
+    dropped = 0;
+    for(; head != tail; head++) {
+        r = &w->records[head & (ASTRID_SESSIONDB_RINGSIZE-1)];
+        stmt = w->stmts[r->type];
+
+        sqlite3_bind_int64(stmt, 1, r->timestamp);
+        sqlite3_bind_int(stmt, 2, r->voice_id);
+        sqlite3_bind_int64(stmt, 3, (sqlite3_int64)r->count);
+
+        rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+
+        if(rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            syslog(LOG_WARNING, "lpsessiondb_writer_flush: sessiondb is busy, retrying the batch next tick\n");
+            sqlite3_exec(w->db, "rollback;", NULL, NULL, NULL);
+            return -1;
+        }
+
+        if(rc != SQLITE_DONE) {
+            syslog(LOG_ERR, "lpsessiondb_writer_flush could not update voice %d. Error: %s\n", r->voice_id, sqlite3_errmsg(w->db));
+            dropped += 1;
+        } else {
+            written += 1;
+        }
+    }
+
+    if(sqlite3_exec(w->db, "commit;", NULL, NULL, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "lpsessiondb_writer_flush could not commit, retrying the batch next tick. Error: %s\n", sqlite3_errmsg(w->db));
+        sqlite3_exec(w->db, "rollback;", NULL, NULL, NULL);
         return -1;
     }
 
+    /* Committed: the slots can go back to the producer */
+    atomic_store_explicit(&w->head, head, memory_order_release);
+
+    atomic_fetch_add_explicit(&w->written, written, memory_order_relaxed);
+    atomic_fetch_add_explicit(&w->dropped, dropped, memory_order_relaxed);
+    atomic_fetch_add_explicit(&w->commits, 1, memory_order_relaxed);
+
     return 0;
 }
 
-int lpsessiondb_increment_voice_render_count(sqlite3 * db, int voice_id, size_t count) {
-    char * err = 0;
-    char * sql;
-    size_t sqlsize;
-    struct timespec ts;
-    long long now;
-
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+static void * lpsessiondb_writer_thread(void * arg) {
+    lpsessiondb_writer_t * w = (lpsessiondb_writer_t *)arg;
+    size_t head, tail;
+    int is_running;
 
-    sqlsize = snprintf(NULL, 0, "update voices set active=1, last_render=%lld, render_count=%ld where id=%d;", now, count, voice_id)+1;
-    if((sql = calloc(1, sqlsize)) == NULL) {
-        syslog(LOG_ERR, "lpsessiondb_increment_voice_render_count Could not alloc space for sql query. Error: (%d) %s\n", errno, strerror(errno));
-        return -1;
+    while(1) {
+        /* Flush once more after a stop, so nothing queued is lost */
+        is_running = atomic_load(&w->is_running);
+        if(lpsessiondb_writer_flush(w) < 0 && !is_running) {
+            head = atomic_load_explicit(&w->head, memory_order_relaxed);
+            tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+            atomic_fetch_add_explicit(&w->dropped, tail - head, memory_order_relaxed);
+            syslog(LOG_ERR, "Sessiondb writer stopped with %zu records it could not write\n", tail - head);
+        }
+        if(!is_running) break;
+        usleep((useconds_t)ASTRID_SESSIONDB_COMMIT_MS * 1000);
     }
 
-    if(snprintf(sql, sqlsize, "update voices set active=1, last_render=%lld, render_count=%ld where id=%d;", now, count, voice_id) < 0) {
-        syslog(LOG_ERR, "lpsessiondb_increment_voice_render_count Could not concat sql for update. Error: (%d) %s\n", errno, strerror(errno));
-        return -1;
+    return NULL;
+}
+
+int lpsessiondb_writer_start(lpsessiondb_writer_t * w, sqlite3 * db) {
+    int i;
+    const char * sql[NUM_LPSESSIONDB_RECORD_TYPES] = {
+        "update voices set active=1, started=?1, last_render=?1, render_count=?3 where id=?2;",
+        "update voices set active=1, last_render=?1, render_count=?3 where id=?2;",
+        "update voices set active=0, ended=?1, last_render=?1, render_count=?3 where id=?2;",
+    };
+
+    w->db = db;
+    atomic_store(&w->head, 0);
+    atomic_store(&w->tail, 0);
+    atomic_store(&w->overflows, 0);
+    atomic_store(&w->dropped, 0);
+    atomic_store(&w->written, 0);
+    atomic_store(&w->commits, 0);
+
+    /* WAL keeps readers like astrid-voicestatus off the writer's back, 
+     * and only syncing on checkpoints is safe there */
+    if(sqlite3_exec(db, "pragma synchronous=NORMAL;", NULL, NULL, NULL) != SQLITE_OK) {
+        syslog(LOG_WARNING, "Could not relax sessiondb synchronous mode. Error: %s\n", sqlite3_errmsg(db));
+    }
+    sqlite3_busy_timeout(db, 1000);
+
+    for(i=0; i < NUM_LPSESSIONDB_RECORD_TYPES; i++) {
+        if(sqlite3_prepare_v3(db, sql[i], -1, SQLITE_PREPARE_PERSISTENT, &w->stmts[i], NULL) != SQLITE_OK) {
+            syslog(LOG_ERR, "Could not prepare sessiondb statement: %s. Error: %s\n", sql[i], sqlite3_errmsg(db));
+            while(i-- > 0) sqlite3_finalize(w->stmts[i]);
+            return -1;
+        }
     }
 
-    /* Mark the voice as active */
-    if(sqlite3_exec(db, sql, lpsessiondb_callback_debug, 0, &err) != SQLITE_OK) {
-        syslog(LOG_ERR, "lpsessiondb_increment_voice_render_count Could not exec sql statement: %s. Error: (%d) %s\n", sql, errno, strerror(errno));
+    atomic_store(&w->is_running, 1);
+    if(pthread_create(&w->thread, NULL, lpsessiondb_writer_thread, (void *)w) != 0) {
+        syslog(LOG_ERR, "Could not start sessiondb writer thread. Error: %s\n", strerror(errno));
+        atomic_store(&w->is_running, 0);
+        for(i=0; i < NUM_LPSESSIONDB_RECORD_TYPES; i++) sqlite3_finalize(w->stmts[i]);
         return -1;
     }
 
     return 0;
 }
 
-int lpsessiondb_mark_voice_stopped(sqlite3 * db, int voice_id, size_t count) {
-    char * err = 0;
-    char * sql;
-    size_t sqlsize;
-    struct timespec ts;
-    long long now;
+void lpsessiondb_writer_stop(lpsessiondb_writer_t * w) {
+    int i;
 
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    if(!atomic_exchange(&w->is_running, 0)) return;
 
-    /* Prepare the sql unsafely */
-    sqlsize = snprintf(NULL, 0, "update voices set active=0, ended=%lld, last_render=%lld, render_count=%ld where id=%d;", now, now, count, voice_id)+1;
-    if((sql = calloc(1, sqlsize)) == NULL) {
-        syslog(LOG_ERR, "lpsessiondb_mark_voice_stopped Could not alloc space for sql query. Error: (%d) %s\n", errno, strerror(errno));
-        return -1;
+    if(pthread_join(w->thread, NULL) != 0) {
+        syslog(LOG_ERR, "Error while attempting to join with sessiondb writer thread\n");
     }
 
-    if(snprintf(sql, sqlsize, "update voices set active=0, ended=%lld, last_render=%lld, render_count=%ld where id=%d;", now, now, count, voice_id) < 0) {
-        syslog(LOG_ERR, "lpsessiondb_mark_voice_stopped Could not concat sql for update. Error: (%d) %s\n", errno, strerror(errno));
-        return -1;
+    for(i=0; i < NUM_LPSESSIONDB_RECORD_TYPES; i++) {
+        sqlite3_finalize(w->stmts[i]);
+        w->stmts[i] = NULL;
     }
+}
+
+/* Queue a voice update without touching sqlite. Only 
+ * one thread may push to a writer. */
+int lpsessiondb_writer_push(lpsessiondb_writer_t * w, int type, int voice_id, size_t count) {
+    lpsessiondb_record_t * r;
+    struct timespec ts;
+    size_t head, tail;
+
+    tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&w->head, memory_order_acquire);
 
-    /* Mark the voice as stopped */
-    if(sqlite3_exec(db, sql, lpsessiondb_callback_debug, 0, &err) != SQLITE_OK) {
-        syslog(LOG_ERR, "lpsessiondb_mark_voice_stopped Could not exec sql statement: %s. Error: (%d) %s\n", sql, errno, strerror(errno));
+    if(tail - head >= ASTRID_SESSIONDB_RINGSIZE) {
+        atomic_fetch_add_explicit(&w->overflows, 1, memory_order_relaxed);
         return -1;
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    r = &w->records[tail & (ASTRID_SESSIONDB_RINGSIZE-1)];
+    r->type = type;
+    r->voice_id = voice_id;
+    r->count = count;
+    r->timestamp = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    atomic_store_explicit(&w->tail, tail + 1, memory_order_release);
+
     return 0;
 }
 
+int lpsessiondb_mark_voice_active(lpsessiondb_writer_t * w, int voice_id) {
+    return lpsessiondb_writer_push(w, LPSESSIONDB_VOICE_ACTIVE, voice_id, 1);
+}
+
+int lpsessiondb_increment_voice_render_count(lpsessiondb_writer_t * w, int voice_id, size_t count) {
+    return lpsessiondb_writer_push(w, LPSESSIONDB_VOICE_RENDERED, voice_id, count);
+}
+
+int lpsessiondb_mark_voice_stopped(lpsessiondb_writer_t * w, int voice_id, size_t count) {
+    return lpsessiondb_writer_push(w, LPSESSIONDB_VOICE_STOPPED, voice_id, count);
+}
+
 #endif
 
 /* THREAD SAFE
@@ -774,210 +883,428 @@ int lpipc_buffer_destroy(char * id_path) {
     return 0;
 }
 
+/* SHARED MEMORY
+ * ADC CAPTURE RING
+ * ****************/
+
+/* Every ring this process has mapped. Entries are only 
+ * ever pushed onto the head, and their mappings are never 
+ * detached, so a pointer handed out by lpadc_attach stays 
+ * valid for readers in any thread. */
+typedef struct lpadcmap_t {
+    int shmid;
+    lpadcbuf_t * adc;
+    struct lpadcmap_t * next;
+} lpadcmap_t;
+
+static _Atomic(lpadcmap_t *) lpadc_maps = NULL;
+
+static lpadcbuf_t * lpadc_find(lpadcmap_t * map, int shmid) {
+    for(; map != NULL; map = map->next) {
+        if(map->shmid == shmid) return map->adc;
+    }
+    return NULL;
+}
+
 int lpadc_create() {
+    lpadcbuf_t * adc;
     int shmid;
 
-    /* Initialize the shared memory buffer and semaphore for the ADC */
-    if((shmid = lpipc_buffer_create(LPADC_BUFFER_PATH, LPADCBUFFRAMES, ASTRID_CHANNELS, ASTRID_SAMPLERATE)) < 0) {
-        syslog(LOG_ERR, "lpadc_create Could not create ADC buffer shared mem\n");
+    /* If the lock file exists, reuse the ring from a previous session */
+    if(access(LPADC_BUFFER_PATH, F_OK) == 0) {
+        if((shmid = lpipc_getid(LPADC_BUFFER_PATH)) < 0) {
+            syslog(LOG_ERR, "lpadc_create failed to look up shmid in lock file: %s. Error: %s\n", LPADC_BUFFER_PATH, strerror(errno));
+            return -1;
+        }
+        syslog(LOG_INFO, "lpadc_create The lockfile (%s) exists, returning shmid %d\n", LPADC_BUFFER_PATH, shmid);
+        return shmid;
+    }
+
+    /* A new segment is zero filled, so the ring starts out silent */
+    if((shmid = shmget(IPC_PRIVATE, sizeof(lpadcbuf_t), IPC_CREAT | LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "lpadc_create shmget. Error: %s\n", strerror(errno));
         return -1;
     }
 
+    if(lpipc_setid(LPADC_BUFFER_PATH, shmid) < 0) {
+        syslog(LOG_ERR, "lpadc_create failed to store token to path %s. Error: %s\n", LPADC_BUFFER_PATH, strerror(errno));
+        return -1;
+    }
+
+    if((adc = lpadc_attach(shmid)) == NULL) return -1;
+    adc->channels = ASTRID_CHANNELS;
+    adc->samplerate = ASTRID_SAMPLERATE;
+
     return shmid;
 }
 
-int lpadc_write_block(const void * block, size_t blocksize_in_samples, int shmid) {
-    size_t write_pos, insert_pos;
-    size_t i;
-    lpipc_buffer_t * adcbuf;
-    float * blockp;
-    float sample = 0;
+/* Map the ADC ring into this process. The mapping is kept 
+ * for the life of the process, so only the first call for 
+ * a given shmid makes any syscalls. Safe to call from any 
+ * thread: if two threads race to map the same ring, the 
+ * loser detaches its own unpublished mapping. */
+lpadcbuf_t * lpadc_attach(int shmid) {
+    lpadcmap_t * map, * head;
+    lpadcbuf_t * adc;
+    void * shmaddr;
 
-    blockp = (float *)block;
+    head = atomic_load_explicit(&lpadc_maps, memory_order_acquire);
+    if((adc = lpadc_find(head, shmid)) != NULL) return adc;
 
-    /* Aquire a lock on the buffer */
-    if(lpipc_buffer_aquire(LPADC_BUFFER_PATH, &adcbuf, shmid) < 0) {
-        syslog(LOG_ERR, "Could not aquire ADC buffer shm for update\n");
-        return -1;
+    shmaddr = shmat(shmid, NULL, 0);
+    if(shmaddr == (void *)-1) {
+        syslog(LOG_ERR, "lpadc_attach shmat. Could not attach to shm %d. Error: %s\n", shmid, strerror(errno));
+        return NULL;
+    }
+
+    if((map = (lpadcmap_t *)calloc(1, sizeof(lpadcmap_t))) == NULL) {
+        syslog(LOG_ERR, "lpadc_attach could not allocate mapping entry. Error: %s\n", strerror(errno));
+        shmdt(shmaddr);
+        return NULL;
+    }
+    map->shmid = shmid;
+    map->adc = (lpadcbuf_t *)shmaddr;
+    map->next = head;
+
+    /* On failure head is reloaded: check whether the 
+     * newer entries already map this ring before retrying */
+    while(!atomic_compare_exchange_weak_explicit(&lpadc_maps, &head, map, memory_order_acq_rel, memory_order_acquire)) {
+        if((adc = lpadc_find(head, shmid)) != NULL) {
+            shmdt(shmaddr);
+            free(map);
+            return adc;
+        }
+        map->next = head;
     }
 
-    write_pos = adcbuf->pos;
+    return map->adc;
+}
 
-    /* Copy the block of samples */
-    for(i=0; i < blocksize_in_samples; i++) {
-        insert_pos = (write_pos+i) % LPADCBUFSAMPLES;
-        sample = *blockp++;
-        adcbuf->data[insert_pos] = sample;
-    }
+int lpadc_write_block(const void * block, size_t blocksize_in_samples, int shmid) {
+    lpadcbuf_t * adc;
+    size_t write_pos, insert_pos, first;
+
+    if((adc = lpadc_attach(shmid)) == NULL) return -1;
 
-    /* Increment the write position */
-    write_pos += blocksize_in_samples;
-    while(write_pos >= LPADCBUFSAMPLES) {
-        write_pos -= LPADCBUFSAMPLES;
+    /* Only keep the newest samples of an oversized block */
+    if(blocksize_in_samples > LPADCBUFSAMPLES) {
+        block = (const float *)block + (blocksize_in_samples - LPADCBUFSAMPLES);
+        blocksize_in_samples = LPADCBUFSAMPLES;
     }
 
-    /* Store the new write position */
-    adcbuf->pos = write_pos;
+    write_pos = atomic_load_explicit(&adc->write_pos, memory_order_relaxed);
+
+    /* Warn readers off the samples about to be overwritten */
+    atomic_store_explicit(&adc->reserve_pos, write_pos + blocksize_in_samples, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    insert_pos = write_pos % LPADCBUFSAMPLES;
+    first = LPADCBUFSAMPLES - insert_pos;
+    if(first > blocksize_in_samples) first = blocksize_in_samples;
+
+    memcpy(adc->data + insert_pos, block, first * sizeof(float));
+    memcpy(adc->data, (const float *)block + first, (blocksize_in_samples - first) * sizeof(float));
+
+    atomic_store_explicit(&adc->write_pos, write_pos + blocksize_in_samples, memory_order_release);
+
+    return 0;
+}
 
-    syslog(LOG_DEBUG, "adc write pos: %.2f%%\n", ((double)write_pos / LPADCBUFSAMPLES) * 100);
+/* Point a view at the `size` samples ending `offset` samples 
+ * before the newest one written. Samples from before the 
+ * ADC started are left out of the view and counted as 
+ * silence by the caller. Returns -1 if the request reaches 
+ * further back than the ring holds. */
+int lpadc_view(lpadcbuf_t * adc, size_t offset, size_t size, lpadcview_t * view) {
+    size_t write_pos, start, end, pos, first;
 
-    /* Release the lock on the ADC buffer shm */
-    if(lpipc_buffer_release(LPADC_BUFFER_PATH, (void *)adcbuf) < 0) {
-        syslog(LOG_ERR, "Could not release ADC buffer shm after update\n");
+    if(offset + size > LPADCBUFSAMPLES) {
+        syslog(LOG_ERR, "lpadc_view cannot read %ld samples at offset %ld from a ring of %d\n", size, offset, LPADCBUFSAMPLES);
         return -1;
     }
 
+    write_pos = atomic_load_explicit(&adc->write_pos, memory_order_acquire);
+    end = (write_pos > offset) ? write_pos - offset : 0;
+    start = (end > size) ? end - size : 0;
+
+    view->start = start;
+    pos = start % LPADCBUFSAMPLES;
+    first = LPADCBUFSAMPLES - pos;
+    if(first > end - start) first = end - start;
+
+    view->segments[0] = adc->data + pos;
+    view->lengths[0] = first;
+    view->segments[1] = adc->data;
+    view->lengths[1] = (end - start) - first;
+
     return 0;
 }
 
+/* True if the writer has not begun to overwrite any 
+ * of the samples in the view since it was taken */
+int lpadc_view_is_valid(lpadcbuf_t * adc, lpadcview_t * view) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&adc->reserve_pos, memory_order_relaxed) <= view->start + LPADCBUFSAMPLES;
+}
+
 int lpadc_read_block_of_samples(size_t offset, size_t size, lpfloat_t (*out)[LPADCBUFSAMPLES], int shmid) {
-    size_t write_pos, read_pos, copy_pos;
-    size_t i;
-    lpipc_buffer_t * adcbuf;
-    lpfloat_t sample;
-    int nonzero;
+    lpadcbuf_t * adc;
+    lpadcview_t view;
+    lpfloat_t * outp;
+    size_t i, missing;
+    int s, tries;
+
+    if((adc = lpadc_attach(shmid)) == NULL) return -1;
+
+    for(tries=0; tries < 3; tries++) {
+        if(lpadc_view(adc, offset, size, &view) < 0) return -1;
+
+        /* Pad with silence for any samples from before the ADC started */
+        missing = size - view.lengths[0] - view.lengths[1];
+        outp = *out;
+        for(i=0; i < missing; i++) {
+            *outp++ = 0;
+        }
 
-    /* Aquire a lock on the buffer */
-    if(lpipc_buffer_aquire(LPADC_BUFFER_PATH, &adcbuf, shmid) < 0) {
-        syslog(LOG_ERR, "Could not aquire ADC buffer shm for update\n");
-        return -1;
+        for(s=0; s < 2; s++) {
+            for(i=0; i < view.lengths[s]; i++) {
+                *outp++ = view.segments[s][i];
+            }
+        }
+
+        if(lpadc_view_is_valid(adc, &view)) return 0;
     }
 
-    /* Determine the read position */
-    write_pos = adcbuf->pos;
-    read_pos = write_pos - offset - size-1;
+    syslog(LOG_ERR, "lpadc_read_block_of_samples the ADC kept overwriting the samples being read\n");
+    return -1;
+}
 
-    /* Copy the block */
-    nonzero = 0;
-    for(i=0; i < size; i++) {
-        copy_pos = (read_pos+i) % LPADCBUFSAMPLES;
-        sample = adcbuf->data[copy_pos];
-        if(sample != 0) nonzero = 1;
-        (*out)[i] = sample;
+int lpadc_read_sample(size_t offset, lpfloat_t * sample, int adc_shmid) {
+    lpadcbuf_t * adc;
+    lpadcview_t view;
+
+    if((adc = lpadc_attach(adc_shmid)) == NULL) return -1;
+
+    do {
+        if(lpadc_view(adc, offset, 1, &view) < 0) return -1;
+        *sample = (view.lengths[0] > 0) ? view.segments[0][0] : 0;
+    } while(!lpadc_view_is_valid(adc, &view));
+
+    return 0;
+}
+
+int lpadc_destroy() {
+    int shmid;
+
+    if((shmid = lpipc_getid(LPADC_BUFFER_PATH)) < 0) {
+        syslog(LOG_ERR, "lpadc_destroy Could not get shmid %s. Error: %s\n", LPADC_BUFFER_PATH, strerror(errno));
+        return -1;
     }
 
-    if(nonzero == 0) {
-        syslog(LOG_ERR, "ADC read all zeros\n");
+    if(shmctl(shmid, IPC_RMID, NULL) < 0) {
+        syslog(LOG_ERR, "lpadc_destroy shmctl. Error: %s\n", strerror(errno));
+        return -1;
     }
 
-    /* Release the lock on the ADC buffer shm */
-    if(lpipc_buffer_release(LPADC_BUFFER_PATH, (void *)adcbuf) < 0) {
-        syslog(LOG_ERR, "Could not release ADC buffer shm after update\n");
+    if(lpipc_destroyid(LPADC_BUFFER_PATH) < 0) {
+        syslog(LOG_ERR, "lpadc_destroy failed to destroy %s. Error: %s\n", LPADC_BUFFER_PATH, strerror(errno));
         return -1;
     }
 
     return 0;
 }
 
+/* MIDI STATUS IPC
+ * GETTERS & SETTERS
+ * ****************/
+static _Atomic(lpmidistate_t *) lpmidi_state = NULL;
 
-int lpadc_read_sample(size_t offset, lpfloat_t * sample, int adc_shmid) {
-    size_t write_pos;
-    lpipc_buffer_t * adcbuf;
+/* Map the shared MIDI state table into this process 
+ * the first time it is needed */
+static lpmidistate_t * lpmidi_state_attach() {
+    lpmidistate_t * state, * expected;
+    int fd;
 
-    /* Aquire a lock on the buffer */
-    if(lpipc_buffer_aquire(LPADC_BUFFER_PATH, &adcbuf, adc_shmid) < 0) {
-        syslog(LOG_ERR, "Could not aquire ADC buffer shm for reading\n");
-        return -1;
+    if((state = atomic_load_explicit(&lpmidi_state, memory_order_acquire)) != NULL) return state;
+
+    if((fd = shm_open(ASTRID_MIDI_STATE_NAME, O_RDWR | O_CREAT, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "lpmidi_state_attach could not open %s. Error: %s\n", ASTRID_MIDI_STATE_NAME, strerror(errno));
+        return NULL;
     }
 
-    write_pos = adcbuf->pos;
+    /* A new object is zero filled, so every value starts at 0 */
+    if(ftruncate(fd, sizeof(lpmidistate_t)) < 0) {
+        syslog(LOG_ERR, "lpmidi_state_attach could not size %s. Error: %s\n", ASTRID_MIDI_STATE_NAME, strerror(errno));
+        close(fd);
+        return NULL;
+    }
 
-    /* Copy the sample */
-    write_pos = write_pos - offset;
-    write_pos = write_pos % (LPADCBUFSAMPLES-1);
-    memcpy(sample, adcbuf->data + (write_pos * sizeof(lpfloat_t)), sizeof(lpfloat_t));
+    state = (lpmidistate_t *)mmap(NULL, sizeof(lpmidistate_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(state == MAP_FAILED) {
+        syslog(LOG_ERR, "lpmidi_state_attach could not map %s. Error: %s\n", ASTRID_MIDI_STATE_NAME, strerror(errno));
+        return NULL;
+    }
 
-    /* Release the lock on the ADC buffer shm */
-    if(lpipc_buffer_release(LPADC_BUFFER_PATH, (void *)adcbuf) < 0) {
-        syslog(LOG_ERR, "Could not release ADC buffer shm after update\n");
-        return -1;
+    /* Another thread may have attached in the meantime */
+    expected = NULL;
+    if(!atomic_compare_exchange_strong(&lpmidi_state, &expected, state)) {
+        munmap(state, sizeof(lpmidistate_t));
+        return expected;
     }
 
-    return 0;
+    return state;
 }
 
-int lpadc_destroy() {
-    if(lpipc_buffer_destroy(LPADC_BUFFER_PATH) < 0) {
-        syslog(LOG_ERR, "Could not destroy ADC buffer\n");
+/* Unmap the shared MIDI state and remove its name, so the 
+ * next session starts from a zeroed table. Processes which 
+ * still have it mapped keep their own view until they exit. */
+int lpmidi_state_destroy(void) {
+    lpmidistate_t * state;
+
+    if((state = atomic_exchange(&lpmidi_state, NULL)) != NULL) {
+        munmap(state, sizeof(lpmidistate_t));
+    }
+
+    if(shm_unlink(ASTRID_MIDI_STATE_NAME) < 0 && errno != ENOENT) {
+        syslog(LOG_ERR, "lpmidi_state_destroy could not unlink %s. Error: %s\n", ASTRID_MIDI_STATE_NAME, strerror(errno));
         return -1;
     }
 
     return 0;
 }
 
-/* MIDI STATUS IPC
- * GETTERS & SETTERS
- * ****************/
-int lpmidi_setcc(int device_id, int cc, int value) {
-    char * cc_path;
-    size_t path_length;
+/* Getters may be polled every block, so an out of range 
+ * device or index is only logged the first time */
+static atomic_flag lpmidi_range_logged = ATOMIC_FLAG_INIT;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_CCBASE_PATH, device_id, cc) + 1;
-    cc_path = (char *)calloc(1, path_length);
-    snprintf(cc_path, path_length,  ASTRID_MIDI_CCBASE_PATH, device_id, cc);
+static lpmidislot_t * lpmidi_slot(int device_id, int index, int is_note) {
+    lpmidistate_t * state;
 
-    if(lpipc_setid(cc_path, value) < 0) {
-        syslog(LOG_ERR, "Could not store %d for MIDI CC %d from device %d\n", value, cc, device_id);
-        return -1;
+    if(device_id < 0 || device_id >= ASTRID_MIDI_MAXDEVICES || index < 0 || index > 127) {
+        if(!atomic_flag_test_and_set(&lpmidi_range_logged)) {
+            syslog(LOG_ERR, "lpmidi: no slot for %s %d on device %d, ignoring out of range devices and indexes from now on\n", is_note ? "note" : "CC", index, device_id);
+        }
+        return NULL;
+    }
+
+    if((state = lpmidi_state_attach()) == NULL) return NULL;
+
+    return is_note ? &state->notes[device_id][index] : &state->cc[device_id][index];
+}
+
+static void lpmidi_slot_write(lpmidislot_t * slot, int value) {
+    uint64_t current, claimed;
+    uint32_t seq;
+    double now = 0;
+    int spins;
+
+    lpscheduler_get_now_seconds(&now);
+
+    current = atomic_load_explicit(&slot->state, memory_order_relaxed);
+    for(;;) {
+        /* Wait for another writer's claim, up to the spin bound. 
+         * Yield so a writer preempted mid-claim can finish. */
+        for(spins=0; ((current >> 32) & 1) && spins < ASTRID_MIDI_SLOT_SPINS; spins++) {
+            sched_yield();
+            current = atomic_load_explicit(&slot->state, memory_order_relaxed);
+        }
+
+        /* Claim the slot by making the sequence odd, or take over 
+         * a dead writer's claim by moving it on to the next odd one. 
+         * Readers still see the previous value while it is claimed. */
+        seq = (uint32_t)(current >> 32);
+        claimed = ((uint64_t)(seq + ((seq & 1) ? 2 : 1)) << 32) | (current & 0xffffffff);
+        if(!atomic_compare_exchange_weak_explicit(&slot->state, &current, claimed, memory_order_acquire, memory_order_relaxed)) {
+            continue;
+        }
+
+        atomic_store_explicit(&slot->timestamp, now, memory_order_relaxed);
+
+        /* A writer stalled past the spin bound finds its claim 
+         * taken over by a later write, and leaves that one in place */
+        atomic_compare_exchange_strong_explicit(&slot->state, &claimed, 
+            ((uint64_t)((uint32_t)(claimed >> 32) + 1) << 32) | (uint32_t)value, 
+            memory_order_release, memory_order_relaxed);
+        return;
+    }
+}
+
+static void lpmidi_slot_read(lpmidislot_t * slot, int * value, uint32_t * seq, double * timestamp) {
+    uint64_t before, after;
+    double ts;
+    int spins;
+
+    for(spins=0;; spins++) {
+        before = atomic_load_explicit(&slot->state, memory_order_acquire);
+        ts = atomic_load_explicit(&slot->timestamp, memory_order_acquire);
+        after = atomic_load_explicit(&slot->state, memory_order_relaxed);
+        if(before != after) continue;
+        if(!((before >> 32) & 1) || spins >= ASTRID_MIDI_SLOT_SPINS) break;
+        sched_yield();
     }
 
-    free(cc_path);
+    if(value != NULL) *value = (int)(uint32_t)before;
+    if(seq != NULL) *seq = (uint32_t)(before >> 32) / 2;
+    if(timestamp != NULL) *timestamp = ts;
+}
+
+int lpmidi_setcc(int device_id, int cc, int value) {
+    lpmidislot_t * slot;
+
+    if((slot = lpmidi_slot(device_id, cc, 0)) == NULL) return -1;
+
+    lpmidi_slot_write(slot, value);
 
     return 0;
 }
 
 int lpmidi_getcc(int device_id, int cc) {
-    char * cc_path;
-    size_t path_length;
-    int value;
+    lpmidislot_t * slot;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_CCBASE_PATH, device_id, cc) + 1;
-    cc_path = (char *)calloc(1, path_length);
-    snprintf(cc_path, path_length,  ASTRID_MIDI_CCBASE_PATH, device_id, cc);
+    if((slot = lpmidi_slot(device_id, cc, 0)) == NULL) return 0;
 
-    value = lpipc_getid(cc_path);
-    if(value < 0) {
-        value = 0;
-        lpipc_setid(cc_path, value); 
-    }
+    return (int)(uint32_t)atomic_load_explicit(&slot->state, memory_order_relaxed);
+}
+
+/* Read a CC value along with how many times it has 
+ * been set and when it was last set */
+int lpmidi_readcc(int device_id, int cc, int * value, uint32_t * seq, double * timestamp) {
+    lpmidislot_t * slot;
+
+    if((slot = lpmidi_slot(device_id, cc, 0)) == NULL) return -1;
 
-    return value;
+    lpmidi_slot_read(slot, value, seq, timestamp);
+
+    return 0;
 }
 
 int lpmidi_setnote(int device_id, int note, int velocity) {
-    char * note_path;
-    size_t path_length;
+    lpmidislot_t * slot;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_NOTEBASE_PATH, device_id, note) + 1;
-    note_path = (char *)calloc(1, path_length);
-    snprintf(note_path, path_length,  ASTRID_MIDI_NOTEBASE_PATH, device_id, note);
-
-    if(lpipc_setid(note_path, velocity) < 0) {
-        syslog(LOG_ERR, "Could not store velocity %d for MIDI note %d from device %d\n", velocity, note, device_id);
-        return -1;
-    }
+    if((slot = lpmidi_slot(device_id, note, 1)) == NULL) return -1;
 
-    free(note_path);
+    lpmidi_slot_write(slot, velocity);
 
     return 0;
 }
 
 int lpmidi_getnote(int device_id, int note) {
-    char * note_path;
-    size_t path_length;
-    int value;
+    lpmidislot_t * slot;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_NOTEBASE_PATH, device_id, note) + 1;
-    note_path = (char *)calloc(1, path_length);
-    snprintf(note_path, path_length,  ASTRID_MIDI_NOTEBASE_PATH, device_id, note);
+    if((slot = lpmidi_slot(device_id, note, 1)) == NULL) return 0;
 
-    value = lpipc_getid(note_path);
-    if(value < 0) {
-        value = 0;
-        lpipc_setid(note_path, value); 
-    }
+    return (int)(uint32_t)atomic_load_explicit(&slot->state, memory_order_relaxed);
+}
+
+int lpmidi_readnote(int device_id, int note, int * velocity, uint32_t * seq, double * timestamp) {
+    lpmidislot_t * slot;
 
-    return value;
+    if((slot = lpmidi_slot(device_id, note, 1)) == NULL) return -1;
+
+    lpmidi_slot_read(slot, velocity, seq, timestamp);
+
+    return 0;
 }
 
 /* MIDI trigger maps for noteon 
@@ -1177,126 +1504,443 @@ int lpmidi_trigger_notemap(int device_id, int note) {
 }
 
 
-/* BUFFER
- * SERIALIZATION
- * *************/
-char * serialize_buffer(lpbuffer_t * buf, lpmsg_t * msg) {
-    size_t strsize, audiosize, offset;
-    char * str;
+/* SHARED MEMORY
+ * BUFFER SLAB
+ * ***********/
+static size_t lpslab_data_offset() {
+    /* The audio area starts on the first block 
+     * boundry after the block table */
+    return ((sizeof(lpslab_header_t) / ASTRID_SLAB_BLOCKSIZE) + 1) * ASTRID_SLAB_BLOCKSIZE;
+}
+
+static size_t lpslab_numblocks(size_t length, int channels) {
+    size_t size = length * channels * sizeof(lpfloat_t);
+    return (size + ASTRID_SLAB_BLOCKSIZE - 1) / ASTRID_SLAB_BLOCKSIZE;
+}
 
-    audiosize = buf->length * buf->channels * sizeof(lpfloat_t);
+static int lpslab_attach(lpslab_t * slab, int oflag) {
+    char * semname;
+    char * shmaddr;
 
-    strsize =  0;
-    strsize += sizeof(size_t);  /* audio len     */
-    strsize += sizeof(int);     /* channels   */
-    strsize += sizeof(int);     /* samplerate */
-    strsize += sizeof(int);     /* is_looping */
-    strsize += sizeof(size_t);  /* onset      */
-    strsize += audiosize;       /* audio data */
-    strsize += sizeof(lpmsg_t); /* message */
+    /* Construct the sempahore name by stripping the /tmp prefix */
+    semname = ASTRID_SLAB_PATH + 4;
 
-    /* initialize string buffer */
-    str = calloc(1, strsize);
+    if((slab->lock = sem_open(semname, oflag, LPIPC_PERMS, 1)) == SEM_FAILED) {
+        syslog(LOG_ERR, "lpslab_attach failed to open semaphore %s. Error: %s\n", semname, strerror(errno));
+        return -1;
+    }
 
-    offset = 0;
+    shmaddr = (char *)shmat(slab->shmid, NULL, 0);
+    if(shmaddr == (void *)-1) {
+        syslog(LOG_ERR, "lpslab_attach shmat. Could not attach to shm. Error: %s\n", strerror(errno));
+        sem_close(slab->lock);
+        return -1;
+    }
 
-    memcpy(str + offset, &audiosize, sizeof(size_t));
-    offset += sizeof(size_t);
+    slab->header = (lpslab_header_t *)shmaddr;
+    slab->data = shmaddr + lpslab_data_offset();
 
-    memcpy(str + offset, &buf->length, sizeof(size_t));
-    offset += sizeof(size_t);
+    return 0;
+}
 
-    memcpy(str + offset, &buf->channels, sizeof(int));
-    offset += sizeof(int);
+/* Create the slab, or attach to the one left by a 
+ * previous session. Only the DAC calls this: it owns 
+ * the block table and clears it on startup, since any 
+ * buffers it held before a restart are gone. */
+int lpslab_create(lpslab_t * slab) {
+    if(access(ASTRID_SLAB_PATH, F_OK) == 0) {
+        if((slab->shmid = lpipc_getid(ASTRID_SLAB_PATH)) < 0) {
+            syslog(LOG_ERR, "lpslab_create failed to look up shmid in lock file: %s. Error: %s\n", ASTRID_SLAB_PATH, strerror(errno));
+            return -1;
+        }
+        syslog(LOG_INFO, "lpslab_create The lockfile (%s) exists, attaching to shmid %d\n", ASTRID_SLAB_PATH, slab->shmid);
+    } else {
+        slab->shmid = shmget(IPC_PRIVATE, lpslab_data_offset() + ASTRID_SLAB_SIZE, IPC_CREAT | LPIPC_PERMS);
+        if(slab->shmid < 0) {
+            syslog(LOG_ERR, "lpslab_create shmget. Error: %s\n", strerror(errno));
+            return -1;
+        }
 
-    memcpy(str + offset, &buf->samplerate, sizeof(int));
-    offset += sizeof(int);
+        if(lpipc_setid(ASTRID_SLAB_PATH, slab->shmid) < 0) {
+            syslog(LOG_ERR, "lpslab_create failed to store token to path %s. Error: %s\n", ASTRID_SLAB_PATH, strerror(errno));
+            return -1;
+        }
+    }
 
-    memcpy(str + offset, &buf->is_looping, sizeof(int));
-    offset += sizeof(int);
+    if(lpslab_attach(slab, O_CREAT) < 0) {
+        syslog(LOG_ERR, "lpslab_create could not attach to the slab\n");
+        return -1;
+    }
 
-    memcpy(str + offset, &buf->onset, sizeof(size_t));
-    offset += sizeof(size_t);
+    if(sem_wait(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_create failed to lock the slab. Error: %s\n", strerror(errno));
+        return -1;
+    }
 
-    memcpy(str + offset, buf->data, audiosize);
-    offset += audiosize;
+    memset(slab->header, 0, sizeof(lpslab_header_t));
+    slab->header->numblocks = ASTRID_SLAB_NUMBLOCKS;
 
-    memcpy(str + offset, msg, sizeof(lpmsg_t));
-    offset += sizeof(lpmsg_t);
+    if(sem_post(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_create failed to unlock the slab. Error: %s\n", strerror(errno));
+        return -1;
+    }
 
-    return str;
+    return 0;
 }
 
-lpbuffer_t * deserialize_buffer(char * str, lpmsg_t * msg) {
-    size_t audiosize, offset, length, onset;
-    int channels, samplerate, is_looping;
-    lpbuffer_t * buf;
-    lpfloat_t * audio;
+/* Attach to the slab created by the DAC */
+int lpslab_open(lpslab_t * slab) {
+    if((slab->shmid = lpipc_getid(ASTRID_SLAB_PATH)) < 0) {
+        syslog(LOG_ERR, "lpslab_open could not read shm IPC ID. Is the DAC running? Error: %s\n", strerror(errno));
+        return -1;
+    }
 
-    offset = 0;
+    return lpslab_attach(slab, 0);
+}
 
-    memcpy(&audiosize, str + offset, sizeof(size_t));
-    offset += sizeof(size_t);
+int lpslab_close(lpslab_t * slab) {
+    if(shmdt(slab->header) < 0) {
+        syslog(LOG_ERR, "lpslab_close failed to detach shared memory. Error: (%d) %s\n", errno, strerror(errno));
+        return -1;
+    }
 
-    memcpy(&length, str + offset, sizeof(size_t));
-    offset += sizeof(size_t);
+    if(sem_close(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_close sem_close Could not close semaphore\n");
+        return -1;
+    }
 
-    memcpy(&channels, str + offset, sizeof(int));
-    offset += sizeof(int);
+    slab->header = NULL;
+    slab->data = NULL;
 
-    memcpy(&samplerate, str + offset, sizeof(int));
-    offset += sizeof(int);
+    return 0;
+}
 
-    memcpy(&is_looping, str + offset, sizeof(int));
-    offset += sizeof(int);
+int lpslab_destroy(lpslab_t * slab) {
+    if(slab->header != NULL && lpslab_close(slab) < 0) return -1;
+    return lpipc_buffer_destroy(ASTRID_SLAB_PATH);
+}
 
-    memcpy(&onset, str + offset, sizeof(size_t));
-    offset += sizeof(size_t);
+/* Find a contiguous run of free blocks for a buffer, 
+ * searching from just past the last allocation so the 
+ * slab is used round robin. Returns the byte offset of 
+ * the run in the audio area. */
+int lpslab_alloc(lpslab_t * slab, size_t length, int channels, size_t * offset) {
+    lpslab_header_t * h = slab->header;
+    size_t nblocks, run, i, b;
+    int found = 0;
 
-    audio = calloc(1, audiosize);
-    memcpy(audio, str + offset, audiosize);
-    offset += audiosize;
+    nblocks = lpslab_numblocks(length, channels);
+    if(nblocks == 0) nblocks = 1;
 
-    memcpy(msg, str + offset, sizeof(lpmsg_t));
-    offset += sizeof(lpmsg_t);
+    if(sem_wait(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_alloc failed to lock the slab. Error: %s\n", strerror(errno));
+        return -1;
+    }
 
-    buf = calloc(1, sizeof(lpbuffer_t));
+    run = 0;
+    b = 0;
+    for(i=0; i < h->numblocks; i++) {
+        b = (h->rover + i) % h->numblocks;
 
-    buf->length = length;
-    buf->channels = channels;
-    buf->samplerate = samplerate;
-    buf->is_looping = is_looping;
-    buf->data = audio;
-    buf->onset = onset;
+        /* Runs can't wrap around the end of the slab */
+        if(b == 0) run = 0;
 
-    buf->phase = 0.f;
-    buf->pos = 0;
-    buf->boundry = length-1;
-    buf->range = length;
+        if(h->blocks[b]) {
+            run = 0;
+            continue;
+        }
 
-    return buf;
-}
+        run += 1;
+        if(run == nblocks) {
+            found = 1;
+            break;
+        }
+    }
 
-/* MESSAGE
- * QUEUES
- * ******/
-#ifdef ASTRID_USE_FIFO_QUEUES
-int astrid_playq_open(char * instrument_name) {
-    int qfd;
-    ssize_t qname_length;
-    char qname[LPMAXQNAME] = {0};
+    if(!found) {
+        h->failed_allocs += 1;
+        sem_post(slab->lock);
+        syslog(LOG_ERR, "lpslab_alloc could not find %ld free blocks for a buffer of %ld frames (%ld of %ld blocks used)\n", nblocks, length, h->blocks_used, h->numblocks);
+        return -1;
+    }
 
-    qname_length = snprintf(NULL, 0, "%s-%s", LPPLAYQ, instrument_name) + 1;
-    qname_length = (LPMAXQNAME >= qname_length) ? LPMAXQNAME : qname_length;
-    snprintf(qname, qname_length, "%s-%s", LPPLAYQ, instrument_name);
+    b = b + 1 - nblocks;
+    memset(h->blocks + b, 1, nblocks);
+    for(i=0; i < nblocks; i++) h->owners[b + i] = getpid();
+    h->rover = (b + nblocks) % h->numblocks;
+    h->blocks_used += nblocks;
+    if(h->blocks_used > h->high_water) h->high_water = h->blocks_used;
 
-    umask(0);
-    if(mkfifo(qname, S_IRUSR | S_IWUSR | S_IWGRP) == -1 && errno != EEXIST) {
-        syslog(LOG_ERR, "astrid_playq_open mkfifo: Error creating play queue FIFO. Error: %s\n", strerror(errno));
+    if(sem_post(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_alloc failed to unlock the slab. Error: %s\n", strerror(errno));
         return -1;
     }
 
-    if((qfd = open(qname, O_RDWR)) < 0) {
+    *offset = b * ASTRID_SLAB_BLOCKSIZE;
+
+    return 0;
+}
+
+int lpslab_free(lpslab_t * slab, size_t offset, size_t length, int channels) {
+    lpslab_header_t * h = slab->header;
+    size_t nblocks;
+
+    nblocks = lpslab_numblocks(length, channels);
+    if(nblocks == 0) nblocks = 1;
+
+    if(sem_wait(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_free failed to lock the slab. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(h->blocks + (offset / ASTRID_SLAB_BLOCKSIZE), 0, nblocks);
+    memset(h->owners + (offset / ASTRID_SLAB_BLOCKSIZE), 0, nblocks * sizeof(pid_t));
+    h->blocks_used -= nblocks;
+
+    if(sem_post(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_free failed to unlock the slab. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Give a rendered buffer's blocks to the DAC. Call it just 
+ * before sending the descriptor: from then on the blocks 
+ * are freed by the DAC, and lpslab_reclaim leaves them be. 
+ * Only the owning renderer writes its blocks' owners while 
+ * it is alive, so this doesn't need the lock. */
+void lpslab_handoff(lpslab_t * slab, size_t offset, size_t length, int channels) {
+    size_t nblocks, i, b;
+
+    nblocks = lpslab_numblocks(length, channels);
+    if(nblocks == 0) nblocks = 1;
+
+    b = offset / ASTRID_SLAB_BLOCKSIZE;
+    for(i=0; i < nblocks; i++) slab->header->owners[b + i] = 0;
+}
+
+/* Free every block still held by a renderer that has 
+ * exited. Returns the number of blocks freed. */
+size_t lpslab_reclaim(lpslab_t * slab, pid_t pid) {
+    lpslab_header_t * h = slab->header;
+    size_t b, freed = 0;
+
+    if(pid <= 0) return 0;
+
+    if(sem_wait(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_reclaim failed to lock the slab. Error: %s\n", strerror(errno));
+        return 0;
+    }
+
+    for(b=0; b < h->numblocks; b++) {
+        if(!h->blocks[b] || h->owners[b] != pid) continue;
+        h->blocks[b] = 0;
+        h->owners[b] = 0;
+        freed += 1;
+    }
+    h->blocks_used -= freed;
+
+    if(sem_post(slab->lock) < 0) {
+        syslog(LOG_ERR, "lpslab_reclaim failed to unlock the slab. Error: %s\n", strerror(errno));
+    }
+
+    return freed;
+}
+
+/* Wrap a buffer described on the buffer queue without 
+ * copying: the returned lpbuffer_t points into the slab 
+ * and must be returned with lpslab_free, not destroyed. */
+lpbuffer_t * lpslab_tolpbuffer(lpslab_t * slab, lpslab_desc_t * desc) {
+    lpbuffer_t * buf;
+
+    if(desc->offset + (desc->length * desc->channels * sizeof(lpfloat_t)) > ASTRID_SLAB_SIZE) {
+        syslog(LOG_ERR, "lpslab_tolpbuffer descriptor runs past the end of the slab (offset %ld, length %ld)\n", desc->offset, desc->length);
+        return NULL;
+    }
+
+    if((buf = (lpbuffer_t *)calloc(1, sizeof(lpbuffer_t))) == NULL) {
+        syslog(LOG_ERR, "lpslab_tolpbuffer could not allocate buffer. Error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    buf->data = (lpfloat_t *)(slab->data + desc->offset);
+    buf->length = desc->length;
+    buf->channels = desc->channels;
+    buf->samplerate = desc->samplerate;
+    buf->is_looping = desc->is_looping;
+    buf->onset = desc->onset;
+
+    buf->phase = 0.f;
+    buf->pos = 0;
+    buf->boundry = desc->length-1;
+    buf->range = desc->length;
+
+    return buf;
+}
+
+/* SHARED MEMORY
+ * PARAMETER STREAMS
+ * *****************/
+static int lpparamstream_attach(lpparamstream_t * ps, int oflag) {
+    char * semname;
+    void * shmaddr;
+
+    /* Construct the sempahore name by stripping the /tmp prefix */
+    semname = ASTRID_PARAMSTREAM_PATH + 4;
+
+    if((ps->lock = sem_open(semname, oflag, LPIPC_PERMS, 1)) == SEM_FAILED) {
+        syslog(LOG_ERR, "lpparamstream_attach failed to open semaphore %s. Error: %s\n", semname, strerror(errno));
+        return -1;
+    }
+
+    shmaddr = shmat(ps->shmid, NULL, 0);
+    if(shmaddr == (void *)-1) {
+        syslog(LOG_ERR, "lpparamstream_attach shmat. Could not attach to shm. Error: %s\n", strerror(errno));
+        sem_close(ps->lock);
+        return -1;
+    }
+
+    ps->rings = (lpparamring_t *)shmaddr;
+
+    return 0;
+}
+
+/* Create the parameter streams, or attach to the ones 
+ * left by a previous session. Like the slab, only the DAC 
+ * calls this, and it empties every ring on startup. */
+int lpparamstream_create(lpparamstream_t * ps) {
+    if(access(ASTRID_PARAMSTREAM_PATH, F_OK) == 0) {
+        if((ps->shmid = lpipc_getid(ASTRID_PARAMSTREAM_PATH)) < 0) {
+            syslog(LOG_ERR, "lpparamstream_create failed to look up shmid in lock file: %s. Error: %s\n", ASTRID_PARAMSTREAM_PATH, strerror(errno));
+            return -1;
+        }
+    } else {
+        ps->shmid = shmget(IPC_PRIVATE, sizeof(lpparamring_t) * ASTRID_PARAMSTREAM_VOICES, IPC_CREAT | LPIPC_PERMS);
+        if(ps->shmid < 0) {
+            syslog(LOG_ERR, "lpparamstream_create shmget. Error: %s\n", strerror(errno));
+            return -1;
+        }
+
+        if(lpipc_setid(ASTRID_PARAMSTREAM_PATH, ps->shmid) < 0) {
+            syslog(LOG_ERR, "lpparamstream_create failed to store token to path %s. Error: %s\n", ASTRID_PARAMSTREAM_PATH, strerror(errno));
+            return -1;
+        }
+    }
+
+    if(lpparamstream_attach(ps, O_CREAT) < 0) {
+        syslog(LOG_ERR, "lpparamstream_create could not attach to the parameter streams\n");
+        return -1;
+    }
+
+    if(sem_wait(ps->lock) < 0) {
+        syslog(LOG_ERR, "lpparamstream_create failed to lock the parameter streams. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(ps->rings, 0, sizeof(lpparamring_t) * ASTRID_PARAMSTREAM_VOICES);
+
+    if(sem_post(ps->lock) < 0) {
+        syslog(LOG_ERR, "lpparamstream_create failed to unlock the parameter streams. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Attach to the parameter streams created by the DAC */
+int lpparamstream_open(lpparamstream_t * ps) {
+    if((ps->shmid = lpipc_getid(ASTRID_PARAMSTREAM_PATH)) < 0) {
+        syslog(LOG_ERR, "lpparamstream_open could not read shm IPC ID. Is the DAC running? Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return lpparamstream_attach(ps, 0);
+}
+
+int lpparamstream_close(lpparamstream_t * ps) {
+    if(shmdt(ps->rings) < 0) {
+        syslog(LOG_ERR, "lpparamstream_close failed to detach shared memory. Error: (%d) %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    if(sem_close(ps->lock) < 0) {
+        syslog(LOG_ERR, "lpparamstream_close sem_close Could not close semaphore\n");
+        return -1;
+    }
+
+    ps->rings = NULL;
+
+    return 0;
+}
+
+/* Queue a parameter change for a voice. Producers are 
+ * serialized by the semaphore, and the audio thread 
+ * only ever reads the tail. Returns -1 if the voice's 
+ * ring is full. */
+int lpparamstream_push(lpparamstream_t * ps, lpparam_t param) {
+    lpparamring_t * r;
+    size_t head, tail;
+
+    if(param.type >= NUM_LPPARAMTYPES) {
+        syslog(LOG_ERR, "lpparamstream_push unknown parameter type %d\n", (int)param.type);
+        return -1;
+    }
+
+    r = ps->rings + (param.voice_id % ASTRID_PARAMSTREAM_VOICES);
+
+    if(sem_wait(ps->lock) < 0) {
+        syslog(LOG_ERR, "lpparamstream_push failed to lock the parameter streams. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if(tail - head >= ASTRID_PARAMSTREAM_RINGSIZE) {
+        atomic_fetch_add_explicit(&r->overflows, 1, memory_order_relaxed);
+        sem_post(ps->lock);
+        return -1;
+    }
+
+    r->params[tail & (ASTRID_PARAMSTREAM_RINGSIZE-1)] = param;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+    if(sem_post(ps->lock) < 0) {
+        syslog(LOG_ERR, "lpparamstream_push failed to unlock the parameter streams. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int lpparam_type_from_name(char * name) {
+    if(strcmp(name, "gain") == 0) return LPPARAM_GAIN;
+    if(strcmp(name, "pan") == 0) return LPPARAM_PAN;
+    if(strcmp(name, "cutoff") == 0) return LPPARAM_CUTOFF;
+    return -1;
+}
+
+/* MESSAGE
+ * QUEUES
+ * ******/
+#ifdef ASTRID_USE_FIFO_QUEUES
+int astrid_playq_open(char * instrument_name) {
+    int qfd;
+    ssize_t qname_length;
+    char qname[LPMAXQNAME] = {0};
+
+    qname_length = snprintf(NULL, 0, "%s-%s", LPPLAYQ, instrument_name) + 1;
+    qname_length = (LPMAXQNAME >= qname_length) ? LPMAXQNAME : qname_length;
+    snprintf(qname, qname_length, "%s-%s", LPPLAYQ, instrument_name);
+
+    umask(0);
+    if(mkfifo(qname, S_IRUSR | S_IWUSR | S_IWGRP) == -1 && errno != EEXIST) {
+        syslog(LOG_ERR, "astrid_playq_open mkfifo: Error creating play queue FIFO. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if((qfd = open(qname, O_RDWR)) < 0) {
         syslog(LOG_ERR, "astrid_playq_open open: Error opening play queue FIFO. Error: %s\n", strerror(errno));
         return -1;
     };
@@ -1326,6 +1970,9 @@ int astrid_playq_read(int qfd, lpmsg_t * msg) {
         return astrid_playq_read(qfd, msg);
     }
 
+    /* Nothing waiting on a nonblocking queue, or another worker got there first */
+    if(read_result < 0 && errno == EAGAIN) return -1;
+
     if(read_result < 0) {
         syslog(LOG_INFO, "The play queue (%d) failed to read from the fifo. Error: (%d) %s\n", qfd, errno, strerror(errno));
         return -1;
@@ -1339,6 +1986,62 @@ int astrid_playq_read(int qfd, lpmsg_t * msg) {
     return 0;
 }
 
+int astrid_playq_set_nonblocking(int qfd) {
+    int flags;
+
+    if((flags = fcntl(qfd, F_GETFL)) == -1 || fcntl(qfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        syslog(LOG_ERR, "astrid_playq_set_nonblocking fcntl: Error setting O_NONBLOCK on play queue FIFO. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Worker queues are plain pipes, created before the workers 
+ * are forked so every worker inherits both ends of each. */
+int astrid_workerq_create(char * instrument_name __attribute__((unused)), int worker __attribute__((unused)), lpworkerq_t * q) {
+    int fds[2];
+
+    if(pipe(fds) == -1) {
+        syslog(LOG_ERR, "astrid_workerq_create pipe: Error creating worker queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    q->readfd = fds[0];
+    q->writefd = fds[1];
+
+    if(astrid_playq_set_nonblocking(q->readfd) < 0 || astrid_playq_set_nonblocking(q->writefd) < 0) {
+        astrid_workerq_destroy(q);
+        return -1;
+    }
+
+    return 0;
+}
+
+int astrid_workerq_send(lpworkerq_t * q, lpmsg_t * msg) {
+    /* Writes of up to PIPE_BUF bytes are atomic, so messages 
+     * from several workers never interleave. A full pipe 
+     * fails with EAGAIN and is left to the caller. */
+    if(write(q->writefd, msg, sizeof(lpmsg_t)) != sizeof(lpmsg_t)) {
+        if(errno != EAGAIN) syslog(LOG_ERR, "astrid_workerq_send write: Error writing to worker queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int astrid_workerq_read(lpworkerq_t * q, lpmsg_t * msg) {
+    return astrid_playq_read(q->readfd, msg);
+}
+
+int astrid_workerq_destroy(lpworkerq_t * q) {
+    int result = 0;
+    if(q->readfd >= 0 && close(q->readfd) == -1) result = -1;
+    if(q->writefd >= 0 && close(q->writefd) == -1) result = -1;
+    q->readfd = q->writefd = -1;
+    return result;
+}
+
 int send_play_message(lpmsg_t msg) {
     char qname[LPMAXQNAME] = {0};
     ssize_t qname_length;
@@ -1436,6 +2139,76 @@ int astrid_msgq_read(int qfd, lpmsg_t * msg) {
 
     return 0;
 }
+
+int lpslab_send(lpslab_desc_t desc) {
+    int qfd;
+
+    umask(0);
+    if(mkfifo(ASTRID_BUFFERQ_PATH, S_IRUSR | S_IWUSR | S_IWGRP) == -1 && errno != EEXIST) {
+        syslog(LOG_ERR, "lpslab_send mkfifo: Error creating named pipe. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if((qfd = open(ASTRID_BUFFERQ_PATH, O_WRONLY)) < 0) {
+        syslog(LOG_ERR, "lpslab_send open: Could not open buffer q. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(write(qfd, &desc, sizeof(lpslab_desc_t)) != sizeof(lpslab_desc_t)) {
+        syslog(LOG_ERR, "lpslab_send write: Could not write to buffer q. Error: %s\n", strerror(errno));
+        close(qfd);
+        return -1;
+    }
+
+    if(close(qfd) == -1) {
+        syslog(LOG_ERR, "lpslab_send close: Error closing buffer q. Error: %s\n", strerror(errno));
+        return -1; 
+    }
+
+    return 0;
+}
+
+int astrid_bufferq_open() {
+    int qfd;
+
+    umask(0);
+    if(mkfifo(ASTRID_BUFFERQ_PATH, S_IRUSR | S_IWUSR | S_IWGRP) == -1 && errno != EEXIST) {
+        syslog(LOG_ERR, "astrid_bufferq_open mkfifo: Error creating buffer queue FIFO. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if((qfd = open(ASTRID_BUFFERQ_PATH, O_RDWR)) < 0) {
+        syslog(LOG_ERR, "astrid_bufferq_open open: Error opening buffer queue FIFO. Error: %s\n", strerror(errno));
+        return -1;
+    };
+
+    return qfd;
+}
+
+int astrid_bufferq_close(int qfd) {
+    if(close(qfd) == -1) {
+        syslog(LOG_ERR, "astrid_bufferq_close close: Error closing buffer queue FIFO. Error: %s\n", strerror(errno));
+        return -1; 
+    }
+
+    return 0;
+}
+
+int astrid_bufferq_read(int qfd, lpslab_desc_t * desc) {
+    ssize_t read_result;
+    read_result = read(qfd, desc, sizeof(lpslab_desc_t));
+    if(read_result == 0) {
+        syslog(LOG_DEBUG, "The buffer queue (%d) has been closed. (EOF)\n", qfd);
+        return -1;
+    }
+
+    if(read_result != sizeof(lpslab_desc_t)) {
+        syslog(LOG_INFO, "The buffer queue (%d) returned %d bytes. Expecting sizeof(lpslab_desc_t)==%d\n", qfd, (int)read_result, (int)sizeof(lpslab_desc_t));
+        return -1;
+    }
+
+    return 0;
+}
 #else
 int send_play_message(lpmsg_t msg) {
     mqd_t mqd;
@@ -1531,6 +2304,8 @@ int astrid_playq_read(mqd_t mqd, lpmsg_t * msg) {
     msgp = (char *)msg;
 
     if((read_result = mq_receive(mqd, msgp, sizeof(lpmsg_t), &msg_priority)) < 0) {
+        /* Nothing waiting on a nonblocking queue, or another worker got there first */
+        if(errno == EAGAIN) return -1;
         syslog(LOG_ERR, "astrid_playq_read mq_receive: Error allocing during message read. Error: %s\n", strerror(errno));
         return -1;
     }
@@ -1538,6 +2313,72 @@ int astrid_playq_read(mqd_t mqd, lpmsg_t * msg) {
     return 0;
 }
 
+int astrid_playq_set_nonblocking(mqd_t mqd) {
+    struct mq_attr attr = {0};
+
+    attr.mq_flags = O_NONBLOCK;
+    if(mq_setattr(mqd, &attr, NULL) == -1) {
+        syslog(LOG_ERR, "astrid_playq_set_nonblocking mq_setattr: Error setting O_NONBLOCK on play queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Worker queues are created before the workers are forked 
+ * so every worker inherits a descriptor for each, then 
+ * unlinked right away: they need no name after that, and 
+ * a crashed renderer can't leave stale messages behind 
+ * for the next one to pick up. */
+int astrid_workerq_create(char * instrument_name, int worker, lpworkerq_t * q) {
+    mqd_t mqd;
+    ssize_t qname_length;
+    char qname[LPMAXQNAME] = {0};
+    struct mq_attr attr;
+
+    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
+    attr.mq_msgsize = sizeof(lpmsg_t);
+
+    qname_length = snprintf(NULL, 0, "%s-%s-w%d", LPPLAYQ, instrument_name, worker) + 1;
+    qname_length = (LPMAXQNAME >= qname_length) ? LPMAXQNAME : qname_length;
+    snprintf(qname, qname_length, "%s-%s-w%d", LPPLAYQ, instrument_name, worker);
+
+    mq_unlink(qname);
+    if((mqd = mq_open(qname, O_CREAT | O_EXCL | O_RDWR | O_NONBLOCK, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
+        syslog(LOG_ERR, "astrid_workerq_create mq_open: Error opening worker queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(mq_unlink(qname) == -1) {
+        syslog(LOG_ERR, "astrid_workerq_create mq_unlink: Error unlinking worker queue. Error: %s\n", strerror(errno));
+    }
+
+    q->readfd = q->writefd = (int)mqd;
+
+    return 0;
+}
+
+int astrid_workerq_send(lpworkerq_t * q, lpmsg_t * msg) {
+    /* A full queue fails with EAGAIN and is left to the caller */
+    if(mq_send((mqd_t)q->writefd, (char *)msg, sizeof(lpmsg_t), 0) < 0) {
+        if(errno != EAGAIN) syslog(LOG_ERR, "astrid_workerq_send mq_send: Error writing to worker queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int astrid_workerq_read(lpworkerq_t * q, lpmsg_t * msg) {
+    return astrid_playq_read((mqd_t)q->readfd, msg);
+}
+
+int astrid_workerq_destroy(lpworkerq_t * q) {
+    int result = 0;
+    if(q->readfd >= 0 && mq_close((mqd_t)q->readfd) == -1) result = -1;
+    q->readfd = q->writefd = -1;
+    return result;
+}
+
 mqd_t astrid_msgq_open() {
     mqd_t mqd;
     struct mq_attr attr;
@@ -1577,9 +2418,71 @@ int astrid_msgq_read(mqd_t mqd, lpmsg_t * msg) {
 
     return 0;
 }
-#endif
 
-int astrid_get_playback_device_id() {
+int lpslab_send(lpslab_desc_t desc) {
+    mqd_t mqd;
+    struct mq_attr attr;
+
+    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
+    attr.mq_msgsize = sizeof(lpslab_desc_t);
+
+    if((mqd = mq_open(ASTRID_BUFFERQ_PATH, O_CREAT | O_WRONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
+        syslog(LOG_ERR, "lpslab_send mq_open: Error opening buffer queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if(mq_send(mqd, (char *)(&desc), sizeof(lpslab_desc_t), 0) < 0) {
+        syslog(LOG_ERR, "lpslab_send mq_send: Error during buffer descriptor write. Error: %s\n", strerror(errno));
+        mq_close(mqd);
+        return -1;
+    }
+
+    if(mq_close(mqd) == -1) {
+        syslog(LOG_ERR, "lpslab_send close: Error closing buffer queue. Error: %s\n", strerror(errno));
+        return -1; 
+    }
+
+    return 0;
+}
+
+mqd_t astrid_bufferq_open() {
+    mqd_t mqd;
+    struct mq_attr attr;
+
+    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
+    attr.mq_msgsize = sizeof(lpslab_desc_t);
+
+    if((mqd = mq_open(ASTRID_BUFFERQ_PATH, O_CREAT | O_RDONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
+        syslog(LOG_ERR, "astrid_bufferq_open mq_open: Error opening buffer queue. Error: %s\n", strerror(errno));
+        return (mqd_t) -1;
+    }
+
+    return mqd;
+}
+
+int astrid_bufferq_close(mqd_t mqd) {
+    if(mq_close(mqd) == -1) {
+        syslog(LOG_ERR, "astrid_bufferq_close close: Error closing buffer queue. Error: %s\n", strerror(errno));
+        return -1; 
+    }
+
+    return 0;
+}
+
+int astrid_bufferq_read(mqd_t mqd, lpslab_desc_t * desc) {
+    ssize_t read_result;
+    unsigned int msg_priority;
+
+    if((read_result = mq_receive(mqd, (char *)desc, sizeof(lpslab_desc_t), &msg_priority)) < 0) {
+        syslog(LOG_ERR, "astrid_bufferq_read mq_receive: Error reading buffer descriptor. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+int astrid_get_playback_device_id() {
     int device_id;
 
     /* If the default device isn't set, then 
@@ -1757,6 +2660,65 @@ int lpscheduler_get_now_seconds(double * now) {
     return 0;
 }
 
+/* Count how late something happened, in seconds */
+void lpjitterhist_add(lpjitterhist_t * h, double lateness) {
+    double us;
+    int b;
+
+    if(lateness < 0) lateness = 0;
+
+    h->count += 1;
+    h->total += lateness;
+    if(lateness > h->max) h->max = lateness;
+
+    us = lateness * 1000000;
+    for(b=0; b < ASTRID_JITTER_BUCKETS-1; b++) {
+        if(us < (double)(1 << b)) break;
+    }
+    h->buckets[b] += 1;
+}
+
+static void lpjitterhist_bucket_label(int b, char * label, size_t size) {
+    double us = (double)(1 << b);
+
+    if(b == ASTRID_JITTER_BUCKETS-1) {
+        snprintf(label, size, ">= %.0fms", (1 << (b-1)) / 1000.);
+    } else if(us < 1000) {
+        snprintf(label, size, "< %.0fus", us);
+    } else {
+        snprintf(label, size, "< %.0fms", us / 1000.);
+    }
+}
+
+void lpjitterhist_print(lpjitterhist_t * h, char * name, FILE * out) {
+    char label[32];
+    int b;
+
+    fprintf(out, "%s: %ld events, avg %.1fus, max %.1fus\n", name, h->count, (h->count > 0) ? h->total / h->count * 1000000 : 0, h->max * 1000000);
+    for(b=0; b < ASTRID_JITTER_BUCKETS; b++) {
+        if(h->buckets[b] == 0) continue;
+        lpjitterhist_bucket_label(b, label, sizeof(label));
+        fprintf(out, "    %10s %8ld  %5.1f%%\n", label, h->buckets[b], h->buckets[b] * 100. / h->count);
+    }
+}
+
+/* Log the non-empty buckets on one line */
+void lpjitterhist_log(lpjitterhist_t * h, char * name) {
+    char line[1024], label[32];
+    size_t pos;
+    int b;
+
+    pos = 0;
+    line[0] = '\0';
+    for(b=0; b < ASTRID_JITTER_BUCKETS && pos < sizeof(line); b++) {
+        if(h->buckets[b] == 0) continue;
+        lpjitterhist_bucket_label(b, label, sizeof(label));
+        pos += snprintf(line + pos, sizeof(line) - pos, " [%s: %ld]", label, h->buckets[b]);
+    }
+
+    syslog(LOG_INFO, "%s jitter: %ld events, avg %.1fus, max %.1fus%s\n", name, h->count, (h->count > 0) ? h->total / h->count * 1000000 : 0, h->max * 1000000, line);
+}
+
 void scheduler_get_now(struct timespec * now) {
     clock_gettime(CLOCK_MONOTONIC_RAW, now);
 }
@@ -1856,104 +2818,132 @@ int ll_count(lpevent_t * head) {
     return count;
 }
 
-/* Add event to the tail of the waiting queue */
-static inline void start_waiting(lpscheduler_t * s, lpevent_t * e) {
-    lpevent_t * current;
+/* The waiting queue is a binary min-heap of events 
+ * ordered by onset, so scheduling is O(log n) and 
+ * finding the next due event is O(1). */
+static inline void scheduler_waiting_swap(lpscheduler_t * s, size_t a, size_t b) {
+    lpevent_t * tmp;
+    tmp = s->waiting_queue[a];
+    s->waiting_queue[a] = s->waiting_queue[b];
+    s->waiting_queue[b] = tmp;
+}
 
-    if(s->waiting_queue_head == NULL) {
-        s->waiting_queue_head = e;
-    } else {
-        current = s->waiting_queue_head;
-        while(current->next != NULL) {
-            current = (lpevent_t *)current->next;        
-        }
-        current->next = (void *)e;
+static inline void scheduler_waiting_sift_up(lpscheduler_t * s, size_t i) {
+    size_t parent;
+
+    while(i > 0) {
+        parent = (i - 1) / 2;
+        if(s->waiting_queue[parent]->onset <= s->waiting_queue[i]->onset) break;
+        scheduler_waiting_swap(s, parent, i);
+        i = parent;
     }
-} 
+}
 
-static inline void start_playing(lpscheduler_t * s, lpevent_t * e) {
-    lpevent_t * current;
-    lpevent_t * prev;
+static inline void scheduler_waiting_sift_down(lpscheduler_t * s, size_t i) {
+    size_t left, right, smallest;
 
-    /* Remove from the waiting queue */
-    if(s->waiting_queue_head == NULL) {
-        printf("Cannot move this event. There is nothing in the waiting queue!\n");
-    }
+    while(1) {
+        left = i * 2 + 1;
+        right = left + 1;
+        smallest = i;
 
-    prev = NULL;
-    current = s->waiting_queue_head;
-    while(current != e && current->next != NULL) {
-        prev = current;
-        current = (lpevent_t *)current->next;
-    }
-    if(prev) {
-        prev->next = current->next;
-    } else {
-        s->waiting_queue_head = (lpevent_t *)current->next;
+        if(left < s->num_waiting && s->waiting_queue[left]->onset < s->waiting_queue[smallest]->onset) smallest = left;
+        if(right < s->num_waiting && s->waiting_queue[right]->onset < s->waiting_queue[smallest]->onset) smallest = right;
+        if(smallest == i) break;
+
+        scheduler_waiting_swap(s, smallest, i);
+        i = smallest;
     }
+}
 
-    current->next = NULL;
+/* Add event to the waiting queue. Returns -1 if the queue is full */
+static inline int start_waiting(lpscheduler_t * s, lpevent_t * e) {
+    if(s->num_waiting >= s->waiting_queue_size) return -1;
 
-    /* Add to the tail of the playing queue */
-    if(s->playing_stack_head == NULL) {
-        s->playing_stack_head = e;
-    } else {
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            current = (lpevent_t *)current->next;
-        }
-        current->next = (void *)e;
-    }
+    e->next = NULL;
+    s->waiting_queue[s->num_waiting] = e;
+    scheduler_waiting_sift_up(s, s->num_waiting);
+    s->num_waiting += 1;
+
+    return 0;
+} 
+
+/* Remove the earliest event from the waiting queue */
+static inline lpevent_t * scheduler_pop_waiting(lpscheduler_t * s) {
+    lpevent_t * e;
+
+    if(s->num_waiting == 0) return NULL;
+
+    e = s->waiting_queue[0];
+    s->num_waiting -= 1;
+    s->waiting_queue[0] = s->waiting_queue[s->num_waiting];
+    scheduler_waiting_sift_down(s, 0);
+
+    return e;
+}
+
+/* Push onto the head of the playing stack */
+static inline void start_playing(lpscheduler_t * s, lpevent_t * e) {
+    e->next = (void *)s->playing_stack_head;
+    s->playing_stack_head = e;
 }
 
 static inline void stop_playing(lpscheduler_t * s, lpevent_t * e) {
     lpevent_t * current;
-    lpevent_t * prev;
-
-    /* Remove from the playing stack */
-    if(s->playing_stack_head == NULL) {
-        syslog(LOG_CRIT, "Cannot move this event. There is nothing in the waiting queue!\n");
-        return;
-    }
 
-    prev = NULL;
-    current = s->playing_stack_head;
-    while(current != e && current->next != NULL) {
-        prev = current;
-        current = (lpevent_t *)current->next;
-    }
+    /* Push onto the head of the nursery. The nursery 
+     * is only ever emptied all at once by an atomic 
+     * exchange in scheduler_cleanup_nursery, so a 
+     * compare-and-swap push is safe from the audio thread. */
+    current = atomic_load(&s->nursery_head);
+    do {
+        e->next = (void *)current;
+    } while(!atomic_compare_exchange_weak(&s->nursery_head, &current, e));
+}
 
-    if(prev) {
-        prev->next = current->next;
-    } else {
-        s->playing_stack_head = (lpevent_t *)current->next;
-    }
+static size_t scheduler_event_pool_size() {
+    char * size_env;
+    long size;
 
-    current->next = NULL;
+    size_env = getenv("ASTRID_EVENT_POOL_SIZE");
+    if(size_env == NULL) return ASTRID_EVENTPOOL_SIZE;
 
-    /* Add to the tail of the garbage stack */
-    if(s->nursery_head == NULL) {
-        s->nursery_head = e;
-    } else {
-        current = s->nursery_head;
-        while(current->next != NULL) {
-            current = (lpevent_t *)current->next;
-        }
-        current->next = (void *)e;
+    size = atol(size_env);
+    if(size <= 0 || size >= UINT32_MAX) {
+        syslog(LOG_WARNING, "Ignoring invalid ASTRID_EVENT_POOL_SIZE (%s), using %d events\n", size_env, ASTRID_EVENTPOOL_SIZE);
+        return ASTRID_EVENTPOOL_SIZE;
     }
+
+    return (size_t)size;
 }
 
 lpscheduler_t * scheduler_create(int realtime, int channels, lpfloat_t samplerate) {
     lpscheduler_t * s;
+    size_t pool_size;
 
     s = (lpscheduler_t *)LPMemoryPool.alloc(1, sizeof(lpscheduler_t));
     s->now = (struct timespec *)LPMemoryPool.alloc(1, sizeof(struct timespec));
 
     s->realtime = realtime;
 
-    s->waiting_queue_head = NULL;
+    /* Every event comes from the pool, so a waiting 
+     * queue the same size as the pool never fills up */
+    pool_size = scheduler_event_pool_size();
+    if(lpeventpool_init(&s->pool, pool_size) < 0) {
+        syslog(LOG_ERR, "scheduler_create: could not preallocate %ld events\n", pool_size);
+    }
+
+    s->waiting_queue = (lpevent_t **)LPMemoryPool.alloc(pool_size, sizeof(lpevent_t *));
+    s->waiting_queue_size = pool_size;
+    s->num_waiting = 0;
     s->playing_stack_head = NULL;
     s->nursery_head = NULL;
+    s->release_buffer = NULL;
+    s->reclaim_is_running = 0;
+    s->params = NULL;
+    s->voices = NULL;
+    s->voice_runs_at_rest = 0;
+    s->voice_runs_ramped = 0;
 
     s->samplerate = samplerate;
     s->channels = channels;
@@ -1972,36 +2962,30 @@ lpscheduler_t * scheduler_create(int realtime, int channels, lpfloat_t samplerat
 /* look for events waiting to be scheduled */
 static inline void scheduler_update(lpscheduler_t * s) {
     lpevent_t * current;
-    void * next;
-    if(s->waiting_queue_head != NULL) {
-        current = s->waiting_queue_head;
-        while(current->next != NULL) {
-            next = current->next;
-            if(s->ticks >= current->onset) {
-                start_playing(s, current);
-            }
-            current = (lpevent_t *)next;
-        }
-        if(s->ticks >= current->onset) {
-            start_playing(s, current);
-        }
+    lpevent_t * prev;
+    lpevent_t * next;
+
+    /* Only the events at the top of the heap can be due */
+    while(s->num_waiting > 0 && s->ticks >= s->waiting_queue[0]->onset) {
+        start_playing(s, scheduler_pop_waiting(s));
     }
 
     /* look for events that have finished playing */
-    if(s->playing_stack_head != NULL) {
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            next = current->next;
-            if(current->pos >= current->buf->length-1) {
-                stop_playing(s, current);
-            }
-            current = (lpevent_t *)next;
-        }
+    prev = NULL;
+    current = s->playing_stack_head;
+    while(current != NULL) {
+        next = (lpevent_t *)current->next;
         if(current->pos >= current->buf->length-1) {
+            if(prev) {
+                prev->next = (void *)next;
+            } else {
+                s->playing_stack_head = next;
+            }
             stop_playing(s, current);
+        } else {
+            prev = current;
         }
-
-
+        current = next;
     }
 }
 
@@ -2053,9 +3037,13 @@ static inline void scheduler_advance_buffers(lpscheduler_t * s) {
 }
 
 void scheduler_debug(lpscheduler_t * s) {
-    if(s->waiting_queue_head) {
-        printf("%d waiting\n", ll_count(s->waiting_queue_head));
-        ll_display(s->waiting_queue_head);
+    size_t i;
+
+    if(s->num_waiting > 0) {
+        printf("%d waiting\n", (int)s->num_waiting);
+        for(i=0; i < s->num_waiting; i++) {
+            printf("    e%d onset: %d pos: %d length: %d\n", (int)s->waiting_queue[i]->id, (int)s->waiting_queue[i]->onset, (int)s->waiting_queue[i]->pos, (int)s->waiting_queue[i]->buf->length);
+        }
     } else {
         printf("none waiting\n");
     }
@@ -2075,9 +3063,59 @@ void scheduler_debug(lpscheduler_t * s) {
     }
 }
 
+static inline void voicectl_claim(lpvoicectl_t * ctl, size_t voice_id) {
+    ctl->voice_id = voice_id;
+    ctl->is_active = 1;
+    ctl->gain_from = ctl->gain_to = 1.f;
+    ctl->pan_from = ctl->pan_to = 0.5f;
+    ctl->gain_tick = ctl->pan_tick = 0;
+    ctl->lpf_coeff = 1.f;
+}
+
+/* Point an event at the parameters of its voice's slot, 
+ * taking the slot over if it last held another voice. */
+static inline void scheduler_resolve_voice(lpscheduler_t * s, lpevent_t * e) {
+    lpvoicectl_t * ctl;
+    int c;
+
+    e->ctl = NULL;
+    if(!e->has_voice || s->voices == NULL || s->channels > ASTRID_PARAM_MAXCHANNELS) return;
+
+    ctl = s->voices + (e->voice_id % ASTRID_PARAMSTREAM_VOICES);
+    if(!ctl->is_active || ctl->voice_id != e->voice_id) {
+        voicectl_claim(ctl, e->voice_id);
+    }
+
+    for(c=0; c < s->channels; c++) {
+        e->lpf[c] = 0.f;
+    }
+
+    e->ctl = ctl;
+}
+
+/* Move any events posted by another thread into the 
+ * waiting queue. Onsets are relative to the tick at 
+ * which the event is drained. */
+static inline void scheduler_drain_inbox(lpscheduler_t * s) {
+    lpevent_t * e;
+
+    while(s->num_waiting < s->waiting_queue_size && (e = lpeventring_pop(&s->inbox)) != NULL) {
+        s->event_count += 1;
+        e->id = s->event_count;
+        e->onset = s->ticks + e->onset;
+        e->pos = 0;
+        e->next = NULL;
+        scheduler_resolve_voice(s, e);
+        start_waiting(s, e);
+    }
+}
+
 void lpscheduler_tick(lpscheduler_t * s) {
     //scheduler_debug(s);
 
+    /* Pick up events posted from the buffer feed */
+    scheduler_drain_inbox(s);
+
     /* Move buffers to proper lists */
     scheduler_update(s);
 
@@ -2096,30 +3134,404 @@ void lpscheduler_tick(lpscheduler_t * s) {
     }
 }
 
+/* Returns the number of ticks until the next waiting
+ * event is due, clamped to the given maximum. */
+static inline size_t scheduler_ticks_until_next_onset(lpscheduler_t * s, size_t max_ticks) {
+    size_t onset;
+
+    if(s->num_waiting == 0) return max_ticks;
+
+    onset = s->waiting_queue[0]->onset;
+    if(onset > s->ticks && onset - s->ticks < max_ticks) {
+        return onset - s->ticks;
+    }
+
+    return max_ticks;
+}
+
+static inline lpfloat_t voicectl_ramp(lpfloat_t from, lpfloat_t to, size_t start, size_t tick) {
+    if(tick <= start) return from;
+    if(tick >= start + ASTRID_PARAM_RAMPFRAMES) return to;
+    return from + (to - from) * (lpfloat_t)(tick - start) / ASTRID_PARAM_RAMPFRAMES;
+}
+
+static inline void scheduler_apply_param(lpscheduler_t * s, lpvoicectl_t * ctl, lpparam_t * p, size_t tick) {
+    lpfloat_t value = p->value;
+
+    switch(p->type) {
+        case LPPARAM_GAIN:
+            ctl->gain_from = voicectl_ramp(ctl->gain_from, ctl->gain_to, ctl->gain_tick, tick);
+            ctl->gain_to = value;
+            ctl->gain_tick = tick;
+            break;
+
+        case LPPARAM_PAN:
+            if(value < 0) value = 0;
+            if(value > 1) value = 1;
+            ctl->pan_from = voicectl_ramp(ctl->pan_from, ctl->pan_to, ctl->pan_tick, tick);
+            ctl->pan_to = value;
+            ctl->pan_tick = tick;
+            break;
+
+        case LPPARAM_CUTOFF:
+            if(value <= 0 || value >= s->samplerate / 2) {
+                ctl->lpf_coeff = 1.f;
+            } else {
+                ctl->lpf_coeff = 1.f - exp(-2.f * PI * value / s->samplerate);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Apply the changes queued in a voice slot that fall on or 
+ * before the given tick, each at the tick it was stamped for, 
+ * and return the tick of the next one, clamped to `until`. 
+ * Voice IDs only grow, so changes for a voice older than the 
+ * one holding the slot are dropped. A change for a newer voice 
+ * hands it the slot when `claim` is set, and otherwise waits 
+ * in the ring for the end of the block. */
+static inline size_t scheduler_update_voice(lpscheduler_t * s, size_t slot, size_t tick, size_t until, int claim) {
+    lpvoicectl_t * ctl;
+    lpparamring_t * r;
+    lpparam_t * p;
+    size_t head, tail, param_tick;
+    double offset;
+
+    ctl = s->voices + slot;
+    r = s->params + slot;
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    while(head != tail) {
+        p = r->params + (head & (ASTRID_PARAMSTREAM_RINGSIZE-1));
+        if(ctl->is_active && p->voice_id < ctl->voice_id) {
+            head += 1;
+            continue;
+        }
+
+        /* Map the timestamp to a tick in this block */
+        offset = (p->timestamp - s->block_seconds) * s->samplerate;
+        param_tick = (offset > 0) ? s->block_tick + (size_t)offset : s->block_tick;
+        if(param_tick > tick) {
+            if(param_tick < until) until = param_tick;
+            break;
+        }
+
+        if(!ctl->is_active || p->voice_id != ctl->voice_id) {
+            if(!claim) break;
+            voicectl_claim(ctl, p->voice_id);
+        }
+
+        scheduler_apply_param(s, ctl, p, param_tick);
+        head += 1;
+    }
+
+    atomic_store_explicit(&r->head, head, memory_order_release);
+
+    return until;
+}
+
+/* Mix a run of frames from an event whose voice has 
+ * parameter streams. Each frame goes through a one pole 
+ * lowpass and then the voice gain and pan. The pan is a 
+ * balance control, since buffers arrive already stereo: 
+ * centered, it leaves them untouched. The run is split 
+ * at every queued change so each takes effect on the 
+ * frame it was timestamped for. */
+static inline void scheduler_mix_voice(lpscheduler_t * s, lpevent_t * e, float * out, size_t nframes) {
+    lpvoicectl_t * ctl = e->ctl;
+    lpfloat_t * data;
+    lpfloat_t sample, gain, pan, coeff;
+    lpfloat_t pangain[ASTRID_PARAM_MAXCHANNELS];
+    size_t i, start, end;
+    int c, bufchannels;
+
+    bufchannels = e->buf->channels;
+    data = e->buf->data + e->pos * bufchannels;
+    for(c=0; c < s->channels; c++) {
+        pangain[c] = 1.f;
+    }
+
+    start = 0;
+    while(start < nframes) {
+        end = scheduler_update_voice(s, e->voice_id % ASTRID_PARAMSTREAM_VOICES, s->ticks + start, s->ticks + nframes, 0) - s->ticks;
+        coeff = ctl->lpf_coeff;
+
+        for(i=start; i < end; i++) {
+            gain = voicectl_ramp(ctl->gain_from, ctl->gain_to, ctl->gain_tick, s->ticks + i);
+            if(s->channels == 2) {
+                pan = voicectl_ramp(ctl->pan_from, ctl->pan_to, ctl->pan_tick, s->ticks + i);
+                pangain[0] = (pan > 0.5f) ? 2.f * (1.f - pan) : 1.f;
+                pangain[1] = (pan < 0.5f) ? 2.f * pan : 1.f;
+            }
+
+            for(c=0; c < s->channels; c++) {
+                sample = data[i * bufchannels + (c % bufchannels)];
+                if(coeff < 1.f) {
+                    e->lpf[c] += coeff * (sample - e->lpf[c]);
+                    sample = e->lpf[c];
+                }
+                out[i * s->channels + c] += (float)(sample * gain * pangain[c]);
+            }
+        }
+
+        start = end;
+    }
+}
+
+/* True when a ramp has reached the rest value, or never left it */
+static inline int voicectl_at_rest(lpfloat_t from, lpfloat_t to, size_t start, size_t tick, lpfloat_t rest) {
+    return to == rest && (from == rest || tick >= start + ASTRID_PARAM_RAMPFRAMES);
+}
+
+/* A voice with unity gain, centered pan and an open filter, 
+ * and no changes queued in its slot, mixes exactly like a 
+ * plain buffer, so it can skip the per frame path. */
+static inline int scheduler_voice_at_rest(lpscheduler_t * s, lpevent_t * e) {
+    lpvoicectl_t * ctl = e->ctl;
+    lpparamring_t * r;
+
+    if(ctl->lpf_coeff < 1.f) return 0;
+    if(!voicectl_at_rest(ctl->gain_from, ctl->gain_to, ctl->gain_tick, s->ticks, 1.f)) return 0;
+    if(s->channels == 2 && !voicectl_at_rest(ctl->pan_from, ctl->pan_to, ctl->pan_tick, s->ticks, 0.5f)) return 0;
+
+    r = s->params + (e->voice_id % ASTRID_PARAMSTREAM_VOICES);
+    return atomic_load_explicit(&r->head, memory_order_relaxed) == atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+/* Add a run of frames from a buffer to the output, 
+ * mapping its channels onto the output channels */
+static inline void scheduler_mix_buffer(lpscheduler_t * s, lpevent_t * e, float * out, size_t nframes) {
+    lpfloat_t * data;
+    size_t i, nsamples;
+    int c, bufchannels;
+
+    bufchannels = e->buf->channels;
+    data = e->buf->data + e->pos * bufchannels;
+
+    if(bufchannels == s->channels) {
+        nsamples = nframes * s->channels;
+        for(i=0; i < nsamples; i++) {
+            out[i] += (float)data[i];
+        }
+    } else {
+        for(i=0; i < nframes; i++) {
+            for(c=0; c < s->channels; c++) {
+                out[i * s->channels + c] += (float)data[i * bufchannels + (c % bufchannels)];
+            }
+        }
+    }
+}
+
+/* Drain every voice slot up to the end of the block, so 
+ * changes reach voices between renders or before their 
+ * first one, and only changes due in a later block stay 
+ * queued in the rings. */
+static inline void scheduler_update_voices(lpscheduler_t * s) {
+    size_t v;
+
+    if(s->params == NULL || s->ticks == 0) return;
+
+    for(v=0; v < ASTRID_PARAMSTREAM_VOICES; v++) {
+        scheduler_update_voice(s, v, s->ticks - 1, s->ticks, 1);
+    }
+}
+
+/* Mix a contiguous run of frames from every playing
+ * buffer into the output block. Buffers that complete
+ * partway through the run only contribute the frames
+ * they have left, and are moved to the nursery on the
+ * next call to scheduler_update. */
+static inline void scheduler_mix_block(lpscheduler_t * s, float * out, size_t nframes) {
+    lpevent_t * current;
+    size_t n, remaining;
+
+    current = s->playing_stack_head;
+    while(current != NULL) {
+        /* Matches lpscheduler_tick: the final frame
+         * at length-1 is never mixed. */
+        remaining = (current->pos + 1 < current->buf->length) ? current->buf->length - 1 - current->pos : 0;
+        n = (nframes < remaining) ? nframes : remaining;
+
+        /* A newer voice may have claimed the slot since the event started */
+        if(current->ctl != NULL && current->ctl->voice_id == current->voice_id) {
+            if(scheduler_voice_at_rest(s, current)) {
+                s->voice_runs_at_rest += 1;
+                scheduler_mix_buffer(s, current, out, n);
+            } else {
+                s->voice_runs_ramped += 1;
+                scheduler_mix_voice(s, current, out, n);
+            }
+        } else {
+            scheduler_mix_buffer(s, current, out, n);
+        }
+
+        current->pos += nframes;
+        current = (lpevent_t *)current->next;
+    }
+}
+
+/* Render a block of interleaved frames from the scheduler.
+ *
+ * Onsets and completions are resolved once per run of
+ * frames instead of once per frame: the block is split
+ * only where a waiting event becomes due, so onsets stay
+ * sample accurate while each playing buffer is mixed with
+ * a tight contiguous loop. */
+void lpscheduler_process_block(lpscheduler_t * s, float * out, size_t nframes) {
+    size_t done, run;
+
+    memset(out, 0, sizeof(float) * nframes * s->channels);
+
+    /* Parameter timestamps are placed relative to 
+     * the time the block started rendering */
+    if(s->params != NULL) {
+        s->block_tick = s->ticks;
+        lpscheduler_get_now_seconds(&s->block_seconds);
+    }
+
+    /* Pick up events posted from the buffer feed */
+    scheduler_drain_inbox(s);
+
+    done = 0;
+    while(done < nframes) {
+        /* Move buffers to proper lists */
+        scheduler_update(s);
+
+        /* Mix up to the next onset or the end of the block */
+        run = scheduler_ticks_until_next_onset(s, nframes - done);
+        scheduler_mix_block(s, out + done * s->channels, run);
+
+        s->ticks += run;
+        done += run;
+    }
+
+    scheduler_update_voices(s);
+
+    if(s->realtime == 1) {
+        scheduler_get_now(s->now);
+    } else {
+        scheduler_increment_timespec_by_ns(s->now, s->tick_ns * nframes);
+    }
+}
+
+/* Schedule an event directly. This must be called from 
+ * the thread which runs the scheduler: other threads 
+ * should use lpscheduler_post_event instead. */
 void scheduler_schedule_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay) {
     lpevent_t * e;
 
-    if(s->nursery_head != NULL) {
-        e = s->nursery_head;
-        s->nursery_head = (void *)e->next;
-        e->next = NULL; 
-    } else {
-        e = (lpevent_t *)LPMemoryPool.alloc(1, sizeof(lpevent_t));
-        s->event_count += 1;
-        e->id = s->event_count;
-        e->onset = 0;
-        e->callback_onset = 0;
+    if((e = lpeventpool_get(&s->pool)) == NULL) {
+        syslog(LOG_ERR, "scheduler_schedule_event: event pool is exhausted (%ld events), dropping event\n", s->pool.size);
+        return;
     }
 
+    s->event_count += 1;
+    e->id = s->event_count;
     e->buf = buf;
     e->pos = 0;
     e->onset = s->ticks + delay;
+    e->has_voice = 0;
+    e->ctl = NULL;
 
     start_waiting(s, e);
 }
 
+/* Schedule a buffer from another thread. The event is 
+ * taken from the pool here, on the caller's thread, and 
+ * handed to the audio thread through the inbox ring. 
+ * Returns -1 if the pool or the ring is full. */
+int lpscheduler_post_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay) {
+    lpevent_t * e;
+
+    if((e = lpeventpool_get(&s->pool)) == NULL) return -1;
+
+    e->buf = buf;
+    e->pos = 0;
+    e->onset = delay; /* relative until drained */
+    e->has_voice = 0;
+
+    if(lpeventring_push(&s->inbox, e) < 0) {
+        lpeventpool_put(&s->pool, e);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Like lpscheduler_post_event, for a buffer belonging to 
+ * a voice whose parameter streams should be applied to it */
+int lpscheduler_post_voice_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay, size_t voice_id) {
+    lpevent_t * e;
+
+    if((e = lpeventpool_get(&s->pool)) == NULL) return -1;
+
+    e->buf = buf;
+    e->pos = 0;
+    e->onset = delay; /* relative until drained */
+    e->has_voice = 1;
+    e->voice_id = voice_id;
+
+    if(lpeventring_push(&s->inbox, e) < 0) {
+        lpeventpool_put(&s->pool, e);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Apply the parameter streams to the voices this scheduler 
+ * plays. Call before the audio thread starts. */
+void lpscheduler_attach_params(lpscheduler_t * s, lpparamstream_t * ps) {
+    if(s->voices == NULL) {
+        s->voices = (lpvoicectl_t *)LPMemoryPool.alloc(ASTRID_PARAMSTREAM_VOICES, sizeof(lpvoicectl_t));
+    }
+    s->params = ps->rings;
+}
+
+int lpeventring_push(lpeventring_t * r, lpevent_t * e) {
+    size_t head, tail, fill;
+
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if(tail - head >= ASTRID_EVENTRING_SIZE) {
+        atomic_fetch_add_explicit(&r->overflows, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    r->events[tail & (ASTRID_EVENTRING_SIZE-1)] = e;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&r->pushed, 1, memory_order_relaxed);
+
+    fill = tail + 1 - head;
+    if(fill > atomic_load_explicit(&r->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&r->high_water, fill, memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+lpevent_t * lpeventring_pop(lpeventring_t * r) {
+    size_t head, tail;
+    lpevent_t * e;
+
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if(head == tail) return NULL;
+
+    e = r->events[head & (ASTRID_EVENTRING_SIZE-1)];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    return e;
+}
+
 int scheduler_count_waiting(lpscheduler_t * s) {
-    return ll_count(s->waiting_queue_head);
+    return (int)s->num_waiting;
 }
 
 int scheduler_count_playing(lpscheduler_t * s) {
@@ -2139,56 +3551,152 @@ int scheduler_is_playing(lpscheduler_t * s) {
 }
 
 void scheduler_destroy(lpscheduler_t * s) {
-    /* Loop over queues and free buffers, events */
+    /* Every event lives in the pool, so freeing the 
+     * pool frees them all. Buffers still waiting or 
+     * playing belong to the caller. */
+    scheduler_stop_reclaimer(s);
+
+    lpeventpool_destroy(&s->pool);
+    if(s->voices != NULL) LPMemoryPool.free(s->voices);
+    LPMemoryPool.free(s->waiting_queue);
+    LPMemoryPool.free(s->current_frame);
+    LPMemoryPool.free(s->now);
+    LPMemoryPool.free(s);
+}
+
+void scheduler_cleanup_nursery(lpscheduler_t * s) {
+    /* Take the whole nursery at once, free its buffers 
+     * and return its events to the pool */
     lpevent_t * current;
     lpevent_t * next;
 
-    if(s->waiting_queue_head) {
-        current = s->waiting_queue_head;
-        while(current->next != NULL) {
-            next = (lpevent_t *)current->next;
-            LPMemoryPool.free(current);
-            current = (lpevent_t *)next;        
+    current = atomic_exchange(&s->nursery_head, NULL);
+    while(current != NULL) {
+        next = (lpevent_t *)current->next;
+        if(current->buf != NULL) {
+            if(s->release_buffer != NULL) {
+                s->release_buffer(current->buf);
+            } else {
+                LPBuffer.destroy(current->buf);
+            }
+            current->buf = NULL;
         }
-        LPMemoryPool.free(current);
+        lpeventpool_put(&s->pool, current);
+        current = next;
     }
+}
 
-    if(s->playing_stack_head) {
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            next = (lpevent_t *)current->next;
-            LPMemoryPool.free(current);
-            current = (lpevent_t *)next;        
-        }
-        LPMemoryPool.free(current);
+/* The reclaim thread frees finished buffers and recycles 
+ * their events, so the audio thread never frees memory */
+static void * scheduler_reclaim(void * arg) {
+    lpscheduler_t * s = (lpscheduler_t *)arg;
+
+    while(atomic_load(&s->reclaim_is_running)) {
+        scheduler_cleanup_nursery(s);
+        usleep((useconds_t)ASTRID_RECLAIM_INTERVAL);
     }
 
-    if(s->nursery_head) {
-        current = s->nursery_head;
-        while(current->next != NULL) {
-            next = (lpevent_t *)current->next;
-            LPMemoryPool.free(current);
-            current = (lpevent_t *)next;        
-        }
-        LPMemoryPool.free(current);
+    scheduler_cleanup_nursery(s);
+
+    return NULL;
+}
+
+int scheduler_start_reclaimer(lpscheduler_t * s) {
+    atomic_store(&s->reclaim_is_running, 1);
+    if(pthread_create(&s->reclaim_thread, NULL, scheduler_reclaim, s) != 0) {
+        syslog(LOG_ERR, "scheduler_start_reclaimer: could not start reclaim thread. Error: %s\n", strerror(errno));
+        atomic_store(&s->reclaim_is_running, 0);
+        return -1;
     }
-    LPMemoryPool.free(s->current_frame);
-    LPMemoryPool.free(s);
+
+    return 0;
 }
 
-void scheduler_cleanup_nursery(lpscheduler_t * s) {
-    /* Loop over nursey and free buffers */
-    lpevent_t * current;
+void scheduler_stop_reclaimer(lpscheduler_t * s) {
+    if(!atomic_exchange(&s->reclaim_is_running, 0)) return;
 
-    if(s->nursery_head != NULL) {
-        current = s->nursery_head;
-        while(current->next != NULL) {
-            if(current->buf != NULL) {
-                LPBuffer.destroy(current->buf);
-                current->buf = NULL;
-            }
-            current = (lpevent_t *)current->next;        
+    if(pthread_join(s->reclaim_thread, NULL) != 0) {
+        syslog(LOG_ERR, "scheduler_stop_reclaimer: error while joining reclaim thread\n");
+    }
+}
+
+int lpeventpool_init(lpeventpool_t * pool, size_t size) {
+    size_t i;
+
+    pool->size = 0;
+    atomic_store(&pool->freelist, 0);
+    atomic_store(&pool->in_use, 0);
+    atomic_store(&pool->high_water, 0);
+    atomic_store(&pool->exhausted, 0);
+
+    if((pool->events = (lpevent_t *)LPMemoryPool.alloc(size, sizeof(lpevent_t))) == NULL) {
+        return -1;
+    }
+
+    /* Thread every event onto the freelist in order */
+    for(i=0; i < size; i++) {
+        atomic_store(&pool->events[i].next_free, (i + 1 < size) ? (uint32_t)(i + 2) : 0);
+    }
+
+    pool->size = size;
+    atomic_store(&pool->freelist, (size > 0) ? 1 : 0);
+
+    return 0;
+}
+
+void lpeventpool_destroy(lpeventpool_t * pool) {
+    if(pool->events != NULL) LPMemoryPool.free(pool->events);
+    pool->events = NULL;
+    pool->size = 0;
+}
+
+/* Take an event off the freelist, or return NULL 
+ * and count the exhaustion if the pool is empty */
+lpevent_t * lpeventpool_get(lpeventpool_t * pool) {
+    uint64_t head, next;
+    uint32_t index;
+    size_t in_use;
+    lpevent_t * e;
+
+    head = atomic_load_explicit(&pool->freelist, memory_order_acquire);
+    do {
+        index = (uint32_t)(head & UINT32_MAX);
+        if(index == 0) {
+            atomic_fetch_add_explicit(&pool->exhausted, 1, memory_order_relaxed);
+            return NULL;
         }
+        next = (((head >> 32) + 1) << 32) | atomic_load_explicit(&pool->events[index-1].next_free, memory_order_relaxed);
+    } while(!atomic_compare_exchange_weak_explicit(&pool->freelist, &head, next, memory_order_acquire, memory_order_acquire));
+
+    in_use = atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed) + 1;
+    if(in_use > atomic_load_explicit(&pool->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&pool->high_water, in_use, memory_order_relaxed);
     }
+
+    e = &pool->events[index-1];
+    e->buf = NULL;
+    e->next = NULL;
+    e->callback = NULL;
+    e->callback_onset = 0;
+    e->callback_fired = 0;
+
+    return e;
+}
+
+void lpeventpool_put(lpeventpool_t * pool, lpevent_t * e) {
+    uint64_t head, next;
+    uint32_t index;
+
+    index = (uint32_t)(e - pool->events) + 1;
+
+    /* Count the event as returned before it is visible on the 
+     * freelist, so in_use never runs past the pool size */
+    atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_relaxed);
+
+    head = atomic_load_explicit(&pool->freelist, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&e->next_free, (uint32_t)(head & UINT32_MAX), memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | index;
+    } while(!atomic_compare_exchange_weak_explicit(&pool->freelist, &head, next, memory_order_release, memory_order_relaxed));
 }
 
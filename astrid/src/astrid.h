@@ -32,6 +32,25 @@
 
 #define ASTRID_MQ_MAXMSG 10
 
+/* Capacity of the lock-free ring used to hand new
+ * events from the buffer feed to the audio thread.
+ * Must be a power of two. */
+#ifndef ASTRID_EVENTRING_SIZE
+#define ASTRID_EVENTRING_SIZE 1024
+#endif
+
+/* Default number of events preallocated by the scheduler.
+ * Set ASTRID_EVENT_POOL_SIZE in the environment to change 
+ * it at runtime. */
+#ifndef ASTRID_EVENTPOOL_SIZE
+#define ASTRID_EVENTPOOL_SIZE 4096
+#endif
+
+/* How often the reclaim thread frees finished buffers, in usec */
+#ifndef ASTRID_RECLAIM_INTERVAL
+#define ASTRID_RECLAIM_INTERVAL 10000
+#endif
+
 /* queue paths */
 #ifdef ASTRID_USE_FIFO_QUEUES
 #define LPPLAYQ "/tmp/astridq" /* the path prefix used for instrument play queues */
@@ -44,10 +63,22 @@
 
 #define ASTRID_SESSIONDB_PATH "/tmp/astrid_session.db"
 #define ASTRID_MIDI_TRIGGERQ_PATH "/tmp/astrid-miditriggerq"
-#define ASTRID_MIDI_CCBASE_PATH "/tmp/astrid-mididevice%d-cc%d"
-#define ASTRID_MIDI_NOTEBASE_PATH "/tmp/astrid-mididevice%d-note%d"
+#ifndef ASTRID_MIDI_STATE_NAME
+#define ASTRID_MIDI_STATE_NAME "/astrid-midistate"
+#endif
 #define ASTRID_MIDIMAP_NOTEBASE_PATH "/tmp/astrid-midimap-device%d-note%d"
 
+/* Number of devices in the shared MIDI state table */
+#ifndef ASTRID_MIDI_MAXDEVICES
+#define ASTRID_MIDI_MAXDEVICES 16
+#endif
+
+/* How many times a MIDI state slot can be found claimed 
+ * before the writer holding it is taken to have died */
+#ifndef ASTRID_MIDI_SLOT_SPINS
+#define ASTRID_MIDI_SLOT_SPINS 1000
+#endif
+
 #define PLAY_MESSAGE 'p'
 #define TRIGGER_MESSAGE 't'
 #define STOP_MESSAGE 's'
@@ -85,6 +116,105 @@
 
 #define ASTRID_DEVICEID_PATH "/tmp/astrid_device_id"
 
+/* Shared memory slab for rendered buffers. The slab's
+ * semaphore is named by stripping the /tmp prefix from
+ * the id path, like the other shared memory buffers. */
+#define ASTRID_SLAB_PATH "/tmp/astrid-slab"
+#ifdef ASTRID_USE_FIFO_QUEUES
+#define ASTRID_BUFFERQ_PATH "/tmp/astrid-bufferq"
+#else
+#define ASTRID_BUFFERQ_PATH "/astrid-bufferq"
+#endif
+
+/* Size in bytes of the audio area of the slab */
+#ifndef ASTRID_SLAB_SIZE
+#define ASTRID_SLAB_SIZE ((size_t)512 * 1024 * 1024)
+#endif
+
+/* Buffers are allocated in whole blocks of this many bytes */
+#ifndef ASTRID_SLAB_BLOCKSIZE
+#define ASTRID_SLAB_BLOCKSIZE 16384
+#endif
+
+#define ASTRID_SLAB_NUMBLOCKS (ASTRID_SLAB_SIZE / ASTRID_SLAB_BLOCKSIZE)
+
+/* Shared memory rings of timestamped parameter changes 
+ * the DAC applies to playing voices, named the same way 
+ * as the slab. Voices hash into the ring table by ID. */
+#define ASTRID_PARAMSTREAM_PATH "/tmp/astrid-paramstream"
+
+#ifndef ASTRID_PARAMSTREAM_VOICES
+#define ASTRID_PARAMSTREAM_VOICES 256
+#endif
+
+/* Must be a power of two */
+#ifndef ASTRID_PARAMSTREAM_RINGSIZE
+#define ASTRID_PARAMSTREAM_RINGSIZE 64
+#endif
+
+/* Gain and pan changes glide to their new value 
+ * over this many frames to avoid zipper noise */
+#ifndef ASTRID_PARAM_RAMPFRAMES
+#define ASTRID_PARAM_RAMPFRAMES 32
+#endif
+
+/* Voice processing is skipped for schedulers 
+ * with more output channels than this */
+#define ASTRID_PARAM_MAXCHANNELS 8
+
+/* Upper bound on the number of renderer worker processes 
+ * per instrument. Set ASTRID_RENDER_WORKERS in the environment 
+ * to choose how many run. */
+#ifndef ASTRID_MAX_RENDER_WORKERS
+#define ASTRID_MAX_RENDER_WORKERS 32
+#endif
+
+/* Number of slots in the table that pins voices to workers. 
+ * Voices hash into it by ID, and a new voice takes over its 
+ * slot from whichever voice held it before. */
+#define ASTRID_RENDER_AFFINITY_SLOTS 1024
+
+/* How many renders a worker does between latency reports */
+#ifndef ASTRID_RENDER_STATS_INTERVAL
+#define ASTRID_RENDER_STATS_INTERVAL 100
+#endif
+
+/* How many messages the sequencer sends between jitter reports */
+#ifndef ASTRID_SEQ_STATS_INTERVAL
+#define ASTRID_SEQ_STATS_INTERVAL 100
+#endif
+
+/* Records the DAC can queue for the session db writer 
+ * before it falls behind. Must be a power of two */
+#ifndef ASTRID_SESSIONDB_RINGSIZE
+#define ASTRID_SESSIONDB_RINGSIZE 4096
+#endif
+
+/* How often the session db writer commits what is queued */
+#ifndef ASTRID_SESSIONDB_COMMIT_MS
+#define ASTRID_SESSIONDB_COMMIT_MS 50
+#endif
+
+/* How often the DAC reports the session db write rate */
+#ifndef ASTRID_SESSIONDB_STATS_SECONDS
+#define ASTRID_SESSIONDB_STATS_SECONDS 10
+#endif
+
+/* Hash buckets in the sequencer's voice and instrument 
+ * indexes, and how many queue nodes its slab grows by */
+#ifndef ASTRID_SEQ_INDEX_BUCKETS
+#define ASTRID_SEQ_INDEX_BUCKETS 1024
+#endif
+
+#ifndef ASTRID_SEQ_SLAB_CHUNK
+#define ASTRID_SEQ_SLAB_CHUNK 256
+#endif
+
+/* Jitter histograms count lateness in power of two 
+ * microsecond buckets: under 1us, under 2us, under 4us... 
+ * with the last bucket catching everything over ~4 seconds */
+#define ASTRID_JITTER_BUCKETS 24
+
 /* This struct is required for historical reasons by POSIX to be defined 
  * for system V semaphores. Astrid uses them for voice ID assignment. */
 union semun {
@@ -107,6 +237,13 @@ enum LPMessageTypes {
     NUM_LPMESSAGETYPES
 };
 
+enum LPParamTypes {
+    LPPARAM_GAIN,   /* Linear gain */
+    LPPARAM_PAN,    /* 0 is hard left, 1 is hard right */
+    LPPARAM_CUTOFF, /* One pole lowpass cutoff in hz, 0 to bypass */
+    NUM_LPPARAMTYPES
+};
+
 typedef struct lpcounter_t {
     int shmid;
     int semid;
@@ -125,13 +262,48 @@ typedef struct lpmsg_t {
     char instrument_name[LPMAXNAME];
 } lpmsg_t;
 
+/* A message waiting in the sequencer's priority queue. 
+ * Besides its heap position, each node is linked into 
+ * the hash chains for its voice ID and its instrument 
+ * name, so stops only visit the nodes they remove. */
 typedef struct lpmsgpq_node_t {
     double timestamp;
-    lpmsg_t * msg;
     size_t pos;
+    struct lpmsgpq_node_t * voice_prev;
+    struct lpmsgpq_node_t * voice_next;
+    struct lpmsgpq_node_t * instrument_prev;
+    struct lpmsgpq_node_t * instrument_next;
+    size_t instrument_bucket;
+    lpmsg_t msg;
 } lpmsgpq_node_t;
 
 
+/* The last value seen for one CC or note of a MIDI device. 
+ * `state` packs a sequence number above the value in its 
+ * low 32 bits, so reading the value is a single load. A 
+ * writer makes the sequence odd while it updates the 
+ * timestamp and even again when it stores the new value, 
+ * so readers that need the value and timestamp together 
+ * can retry instead of waiting on a lock. A claim still 
+ * held after ASTRID_MIDI_SLOT_SPINS tries belongs to a 
+ * writer that died mid-write: writers take it over, and 
+ * readers return the last value stored before it. If 
+ * the writer was only stalled, its write is dropped in 
+ * favor of the later one, though its timestamp may 
+ * still land on the later value. */
+typedef struct lpmidislot_t {
+    _Atomic uint64_t state;
+    _Atomic double timestamp; /* In the clock of lpscheduler_get_now_seconds */
+} lpmidislot_t;
+
+/* Shared by every astrid process through a POSIX 
+ * shared memory object, created zeroed by whichever 
+ * process touches it first. */
+typedef struct lpmidistate_t {
+    lpmidislot_t cc[ASTRID_MIDI_MAXDEVICES][128];
+    lpmidislot_t notes[ASTRID_MIDI_MAXDEVICES][128];
+} lpmidistate_t;
+
 /* When instrument scripts produce MIDI triggers, 
  * they schedule them (with the onset value, which 
  * is relative to *now*) by sending this struct over 
@@ -145,6 +317,53 @@ typedef struct lpmidievent_t {
     char channel;
 } lpmidievent_t;
 
+/* A parameter change for one voice. The timestamp is 
+ * in the clock of lpscheduler_get_now_seconds: the DAC 
+ * applies the change at the matching frame of the block 
+ * it is mixing, or at the start of the next block if the 
+ * time has already passed. */
+typedef struct lpparam_t {
+    double timestamp;
+    size_t voice_id;
+    uint32_t type;
+    lpfloat_t value;
+} lpparam_t;
+
+/* One voice slot's ring of pending parameter changes. 
+ * The DAC's audio thread is the only consumer and owns 
+ * the head. Producers in other processes take the stream's 
+ * semaphore to push, so the audio thread never waits. */
+typedef struct lpparamring_t {
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    _Atomic size_t overflows;
+    lpparam_t params[ASTRID_PARAMSTREAM_RINGSIZE];
+} lpparamring_t;
+
+/* Per-process handle to the attached parameter streams */
+typedef struct lpparamstream_t {
+    int shmid;
+    sem_t * lock;
+    lpparamring_t * rings;
+} lpparamstream_t;
+
+/* The DAC's view of the parameters of the voice in 
+ * one slot. Gain and pan ramps are stored as a start 
+ * value, a target and the tick the ramp started on, 
+ * so any number of events for the same voice can read 
+ * them at any tick without advancing shared state. */
+typedef struct lpvoicectl_t {
+    size_t voice_id;
+    int is_active;
+    lpfloat_t gain_from;
+    lpfloat_t gain_to;
+    size_t gain_tick;
+    lpfloat_t pan_from;
+    lpfloat_t pan_to;
+    size_t pan_tick;
+    lpfloat_t lpf_coeff; /* 1 bypasses the lowpass */
+} lpvoicectl_t;
+
 /* These events are what is stored in the 
  * scheduler's linked lists where it tracks 
  * which buffers are queued, playing, and 
@@ -160,8 +379,40 @@ typedef struct lpevent_t {
     lpmsg_t msg;
     size_t callback_onset;
     int callback_fired;
+    _Atomic uint32_t next_free; /* index + 1 of the next free event in the pool */
+    int has_voice;
+    size_t voice_id;
+    lpvoicectl_t * ctl; /* Resolved when the event is drained from the inbox */
+    lpfloat_t lpf[ASTRID_PARAM_MAXCHANNELS];
 } lpevent_t;
 
+/* Fixed pool of events with an intrusive lock-free 
+ * freelist. The head packs an ABA tag in its high 32 
+ * bits and the index + 1 of the first free event in 
+ * its low 32 bits, so events can be taken and returned 
+ * from any thread without locks or allocation. */
+typedef struct lpeventpool_t {
+    lpevent_t * events;
+    size_t size;
+    _Atomic uint64_t freelist;
+    _Atomic size_t in_use;
+    _Atomic size_t high_water;
+    _Atomic size_t exhausted;
+} lpeventpool_t;
+
+/* Bounded single-producer / single-consumer ring of
+ * events. The producer (the buffer feed thread) owns
+ * the tail and the consumer (the audio thread) owns 
+ * the head, so neither side ever blocks or allocates. */
+typedef struct lpeventring_t {
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    _Atomic size_t pushed;
+    _Atomic size_t overflows;
+    _Atomic size_t high_water;
+    lpevent_t * events[ASTRID_EVENTRING_SIZE];
+} lpeventring_t;
+
 typedef struct lpscheduler_t {
     lpfloat_t * current_frame;
     int channels;
@@ -174,22 +425,60 @@ typedef struct lpscheduler_t {
     size_t event_count;
     size_t numzeros;
     lpfloat_t last_sum;
-    lpevent_t * waiting_queue_head;
+    lpevent_t ** waiting_queue; /* min-heap ordered by onset */
+    size_t num_waiting;
+    size_t waiting_queue_size;
     lpevent_t * playing_stack_head;
-    lpevent_t * nursery_head;
+    _Atomic(lpevent_t *) nursery_head;
+    lpeventring_t inbox;
+    lpeventpool_t pool;
+    void (*release_buffer)(lpbuffer_t * buf); /* frees finished buffers when set, instead of LPBuffer.destroy */
+    pthread_t reclaim_thread;
+    _Atomic int reclaim_is_running;
+    lpparamring_t * params; /* Parameter streams to apply to voices, when set */
+    lpvoicectl_t * voices;
+    size_t block_tick;
+    double block_seconds;
+    size_t voice_runs_at_rest; /* runs of voice frames mixed with the plain add */
+    size_t voice_runs_ramped; /* runs of voice frames mixed frame by frame */
 } lpscheduler_t;
 
 void scheduler_schedule_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay);
 void lpscheduler_tick(lpscheduler_t * s);
+void lpscheduler_process_block(lpscheduler_t * s, float * out, size_t nframes);
 lpscheduler_t * scheduler_create(int, int, lpfloat_t);
 void scheduler_destroy(lpscheduler_t * s);
 int lpscheduler_get_now_seconds(double * now);
 void scheduler_cleanup_nursery(lpscheduler_t * s);
+int lpscheduler_post_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay);
+int lpscheduler_post_voice_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay, size_t voice_id);
+void lpscheduler_attach_params(lpscheduler_t * s, lpparamstream_t * ps);
+int scheduler_start_reclaimer(lpscheduler_t * s);
+void scheduler_stop_reclaimer(lpscheduler_t * s);
+
+int lpeventpool_init(lpeventpool_t * pool, size_t size);
+void lpeventpool_destroy(lpeventpool_t * pool);
+lpevent_t * lpeventpool_get(lpeventpool_t * pool);
+void lpeventpool_put(lpeventpool_t * pool, lpevent_t * e);
+
+int lpeventring_push(lpeventring_t * r, lpevent_t * e);
+lpevent_t * lpeventring_pop(lpeventring_t * r);
 
 int lpcounter_create(lpcounter_t * c);
 int lpcounter_read_and_increment(lpcounter_t * c);
 int lpcounter_destroy(lpcounter_t * c);
 
+typedef struct lpjitterhist_t {
+    size_t count;
+    double total; /* Seconds */
+    double max;
+    size_t buckets[ASTRID_JITTER_BUCKETS];
+} lpjitterhist_t;
+
+void lpjitterhist_add(lpjitterhist_t * h, double lateness);
+void lpjitterhist_print(lpjitterhist_t * h, char * name, FILE * out);
+void lpjitterhist_log(lpjitterhist_t * h, char * name);
+
 typedef struct lpdacctx_t {
     lpscheduler_t * s;
     int channels;
@@ -212,6 +501,109 @@ typedef struct lpipc_buffer_t {
     lpfloat_t data[];
 } lpipc_buffer_t;
 
+/* The ADC capture ring. The capture callback is the only 
+ * writer and never blocks: it stores the end of the block 
+ * it is about to write in reserve_pos, copies the block in 
+ * at most two segments, then publishes it by advancing 
+ * write_pos. Both count samples written since the ring was 
+ * created, so readers can tell when the writer has lapped 
+ * the samples they were copying, and retry. */
+typedef struct lpadcbuf_t {
+    _Atomic size_t write_pos;
+    _Atomic size_t reserve_pos;
+    int channels;
+    int samplerate;
+    float data[LPADCBUFSAMPLES];
+} lpadcbuf_t;
+
+/* A zero-copy view of a run of samples in the ADC ring, 
+ * in at most two segments where it wraps around the end. 
+ * Check it with lpadc_view_is_valid after reading. */
+typedef struct lpadcview_t {
+    const float * segments[2];
+    size_t lengths[2];
+    size_t start; /* Position of the first sample since the ring was created */
+} lpadcview_t;
+
+/* Renderers write their buffers straight into one large 
+ * shared memory slab and send only a small descriptor to 
+ * the DAC on the buffer queue, which plays the audio in 
+ * place. The slab is carved into fixed size blocks and 
+ * each buffer takes a contiguous run of them. The block 
+ * table lives at the start of the segment and is guarded 
+ * by a named semaphore: renderers take it to allocate, 
+ * and the scheduler's reclaim thread takes it to free 
+ * finished buffers. The audio callback never touches it. 
+ *
+ * Each allocated block records the pid of the renderer 
+ * that holds it until lpslab_handoff passes it on to the 
+ * DAC, just before the descriptor is sent. When a worker 
+ * dies mid render the renderer's parent frees whatever it 
+ * still held with lpslab_reclaim. A worker that dies 
+ * between the handoff and the send, or while holding the 
+ * slab lock, still leaks its blocks (or the lock). */
+typedef struct lpslab_header_t {
+    size_t numblocks;
+    size_t rover;
+    size_t blocks_used;
+    size_t high_water;
+    size_t failed_allocs;
+    unsigned char blocks[ASTRID_SLAB_NUMBLOCKS];
+    pid_t owners[ASTRID_SLAB_NUMBLOCKS];
+} lpslab_header_t;
+
+/* Per-process handle to the attached slab */
+typedef struct lpslab_t {
+    int shmid;
+    sem_t * lock;
+    lpslab_header_t * header;
+    char * data;
+} lpslab_t;
+
+typedef struct lpslab_desc_t {
+    size_t offset; /* Byte offset of the audio in the slab */
+    size_t length; /* In frames */
+    int channels;
+    int samplerate;
+    int is_looping;
+    size_t onset;
+    lpmsg_t msg;
+} lpslab_desc_t;
+
+/* A renderer worker's private queue, which other workers 
+ * use to forward messages for the voices it owns and to 
+ * pass on reloads and shutdowns. On Linux an mqd_t is a 
+ * file descriptor, so both kinds of queue can be polled 
+ * alongside the instrument's play queue. */
+typedef struct lpworkerq_t {
+    int readfd;
+    int writefd;
+} lpworkerq_t;
+
+typedef struct lprenderworker_t {
+    pid_t pid;
+    lpworkerq_t q;
+    _Atomic size_t renders;
+    _Atomic size_t forwarded;   /* Messages passed on to the worker owning the voice */
+    _Atomic size_t overflows;   /* Forwards that found the owner's queue full */
+    _Atomic size_t reloads;
+    _Atomic uint64_t total_latency; /* nsec from dequeue to render done */
+    _Atomic uint64_t max_latency;
+} lprenderworker_t;
+
+/* Shared between all the renderer workers of one instrument. 
+ * It is mapped before the workers are forked, so it needs no 
+ * name and goes away with the last of them. Each affinity 
+ * slot packs the voice ID above the owning worker's index + 1 
+ * in its low byte, and is claimed with a CAS. */
+typedef struct lprenderpool_t {
+    int numworkers;
+    _Atomic int is_running;
+    _Atomic size_t reload_generation;
+    _Atomic uint64_t affinity[ASTRID_RENDER_AFFINITY_SLOTS];
+    lprenderworker_t workers[ASTRID_MAX_RENDER_WORKERS];
+} lprenderpool_t;
+
 typedef struct lpastridctx_t {
     lpscheduler_t * s;
     int channels;
@@ -225,8 +617,22 @@ typedef struct lpastridctx_t {
 
 
 
-char * serialize_buffer(lpbuffer_t * buf, lpmsg_t * msg); 
-lpbuffer_t * deserialize_buffer(char * str, lpmsg_t * msg); 
+int lpslab_create(lpslab_t * slab);
+int lpslab_open(lpslab_t * slab);
+int lpslab_close(lpslab_t * slab);
+int lpslab_destroy(lpslab_t * slab);
+int lpslab_alloc(lpslab_t * slab, size_t length, int channels, size_t * offset);
+int lpslab_free(lpslab_t * slab, size_t offset, size_t length, int channels);
+void lpslab_handoff(lpslab_t * slab, size_t offset, size_t length, int channels);
+size_t lpslab_reclaim(lpslab_t * slab, pid_t pid);
+lpbuffer_t * lpslab_tolpbuffer(lpslab_t * slab, lpslab_desc_t * desc);
+int lpslab_send(lpslab_desc_t desc);
+
+int lpparamstream_create(lpparamstream_t * ps);
+int lpparamstream_open(lpparamstream_t * ps);
+int lpparamstream_close(lpparamstream_t * ps);
+int lpparamstream_push(lpparamstream_t * ps, lpparam_t param);
+int lpparam_type_from_name(char * name);
 
 int parse_message_from_args(int argc, int arg_offset, char * argv[], lpmsg_t * msg);
 
@@ -239,20 +645,35 @@ int get_play_message(char * instrument_name, lpmsg_t * msg);
 int astrid_playq_open(char * instrument_name);
 int astrid_playq_read(int qfd, lpmsg_t * msg);
 int astrid_playq_close(int qfd);
+int astrid_playq_set_nonblocking(int qfd);
 
 int astrid_msgq_open();
 int astrid_msgq_close(int qfd);
 int astrid_msgq_read(int qfd, lpmsg_t * msg);
+
+int astrid_bufferq_open();
+int astrid_bufferq_close(int qfd);
+int astrid_bufferq_read(int qfd, lpslab_desc_t * desc);
 #else
 mqd_t astrid_playq_open(char * instrument_name);
 int astrid_playq_read(mqd_t mqd, lpmsg_t * msg);
 int astrid_playq_close(mqd_t mqd);
+int astrid_playq_set_nonblocking(mqd_t mqd);
 
 mqd_t astrid_msgq_open();
 int astrid_msgq_close(mqd_t mqd);
 int astrid_msgq_read(mqd_t mqd, lpmsg_t * msg);
+
+mqd_t astrid_bufferq_open();
+int astrid_bufferq_close(mqd_t mqd);
+int astrid_bufferq_read(mqd_t mqd, lpslab_desc_t * desc);
 #endif
 
+int astrid_workerq_create(char * instrument_name, int worker, lpworkerq_t * q);
+int astrid_workerq_send(lpworkerq_t * q, lpmsg_t * msg);
+int astrid_workerq_read(lpworkerq_t * q, lpmsg_t * msg);
+int astrid_workerq_destroy(lpworkerq_t * q);
+
 
 /* TODO add POSIX message queues for these too */
 int midi_triggerq_open();
@@ -261,8 +682,11 @@ int midi_triggerq_close(int qfd);
 
 int lpmidi_setcc(int device_id, int cc, int value);
 int lpmidi_getcc(int device_id, int cc);
+int lpmidi_readcc(int device_id, int cc, int * value, uint32_t * seq, double * timestamp);
 int lpmidi_setnote(int device_id, int note, int velocity);
 int lpmidi_getnote(int device_id, int note);
+int lpmidi_readnote(int device_id, int note, int * velocity, uint32_t * seq, double * timestamp);
+int lpmidi_state_destroy(void);
 
 int lpmidi_add_msg_to_notemap(int device_id, int note, lpmsg_t msg);
 int lpmidi_remove_msg_from_notemap(int device_id, int note, int index);
@@ -274,6 +698,9 @@ int astrid_get_capture_device_id();
 
 int lpadc_create();
 int lpadc_destroy();
+lpadcbuf_t * lpadc_attach(int shmid);
+int lpadc_view(lpadcbuf_t * adc, size_t offset, size_t size, lpadcview_t * view);
+int lpadc_view_is_valid(lpadcbuf_t * adc, lpadcview_t * view);
 int lpadc_write_block(const void * block, size_t blocksize, int shmid);
 int lpadc_read_sample(size_t offset, lpfloat_t * sample, int shmid);
 int lpadc_read_block_of_samples(size_t offset, size_t size, lpfloat_t (*out)[LPADCBUFSAMPLES], int shmid);
@@ -295,14 +722,55 @@ void lptimeit_since(struct timespec * start);
 
 #ifdef LPSESSIONDB
 #include <sqlite3.h>
+
+enum LPSessionDBRecordTypes {
+    LPSESSIONDB_VOICE_ACTIVE,
+    LPSESSIONDB_VOICE_RENDERED,
+    LPSESSIONDB_VOICE_STOPPED,
+    NUM_LPSESSIONDB_RECORD_TYPES
+};
+
+/* A voice update waiting to be written, stamped 
+ * with CLOCK_MONOTONIC nanoseconds when queued */
+typedef struct lpsessiondb_record_t {
+    int type;
+    int voice_id;
+    size_t count;
+    long long timestamp;
+} lpsessiondb_record_t;
+
+/* Writes voice updates to the session db from its own thread.
+ * The DAC's buffer feed is the only producer and owns the 
+ * tail of the record ring, the writer owns the head. Every 
+ * ASTRID_SESSIONDB_COMMIT_MS the writer drains the ring 
+ * through prepared statements in a single transaction. 
+ * Records pushed onto a full ring count as overflows, and 
+ * records the db rejected count as dropped. */
+typedef struct lpsessiondb_writer_t {
+    sqlite3 * db;
+    sqlite3_stmt * stmts[NUM_LPSESSIONDB_RECORD_TYPES];
+    pthread_t thread;
+    _Atomic int is_running;
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    _Atomic size_t overflows;
+    _Atomic size_t dropped;
+    _Atomic size_t written;
+    _Atomic size_t commits;
+    lpsessiondb_record_t records[ASTRID_SESSIONDB_RINGSIZE];
+} lpsessiondb_writer_t;
+
 int lpsessiondb_create(sqlite3 ** db);
 int lpsessiondb_open_for_writing(sqlite3 ** db);
 int lpsessiondb_open_for_reading(sqlite3 ** db);
 int lpsessiondb_close(sqlite3 * db);
 int lpsessiondb_insert_voice(lpmsg_t msg);
-int lpsessiondb_mark_voice_active(sqlite3 * db, int voice_id);
-int lpsessiondb_increment_voice_render_count(sqlite3 * db, int voice_id, size_t count);
-int lpsessiondb_mark_voice_stopped(sqlite3 * db, int voice_id, size_t count);
+int lpsessiondb_writer_start(lpsessiondb_writer_t * w, sqlite3 * db);
+void lpsessiondb_writer_stop(lpsessiondb_writer_t * w);
+int lpsessiondb_writer_push(lpsessiondb_writer_t * w, int type, int voice_id, size_t count);
+int lpsessiondb_mark_voice_active(lpsessiondb_writer_t * w, int voice_id);
+int lpsessiondb_increment_voice_render_count(lpsessiondb_writer_t * w, int voice_id, size_t count);
+int lpsessiondb_mark_voice_stopped(lpsessiondb_writer_t * w, int voice_id, size_t count);
 #endif
 
 
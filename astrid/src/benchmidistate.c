@@ -0,0 +1,135 @@
+#include "astrid.h"
+
+/* Measures reads and writes of the shared MIDI state
+ * table while writer threads hammer the same CC, and
+ * checks that every write is counted. Then leaves a
+ * slot claimed the way a writer dying mid-write would,
+ * and checks that reads and writes of it still return.
+ * Also checks that out of range slots are refused and
+ * that lpmidi_state_destroy removes the table.
+ *
+ * Builds against its own shared memory name, so it can
+ * run next to a live session.
+ *
+ * Usage: astrid-benchmidistate [writers] [writes]
+ */
+
+#define BENCH_DEVICE 3
+#define BENCH_CC 74
+
+typedef struct bench_writer_t {
+    pthread_t thread;
+    int id;
+    size_t writes;
+} bench_writer_t;
+
+static _Atomic int writers_running = 0;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void * write_cc(void * arg) {
+    bench_writer_t * w = (bench_writer_t *)arg;
+    size_t i;
+
+    for(i=0; i < w->writes; i++) {
+        lpmidi_setcc(BENCH_DEVICE, BENCH_CC, (int)((w->id * 31 + i) % 128));
+    }
+
+    atomic_fetch_sub(&writers_running, 1);
+    return NULL;
+}
+
+int main(int argc, char * argv[]) {
+    bench_writer_t * writers;
+    lpmidistate_t * state;
+    uint64_t stale;
+    uint32_t seq, startseq;
+    double start, elapsed, ts;
+    size_t numreads, torn, writes, i;
+    int numwriters, value, failures, fd, w;
+
+    numwriters = (argc > 1) ? atoi(argv[1]) : 4;
+    writes = (argc > 2) ? (size_t)atol(argv[2]) : 1000000;
+    failures = 0;
+
+    lpmidi_state_destroy();
+
+    /* Contended writes with a reader polling alongside */
+    lpmidi_readcc(BENCH_DEVICE, BENCH_CC, NULL, &startseq, NULL);
+    writers = (bench_writer_t *)calloc(numwriters, sizeof(bench_writer_t));
+    atomic_store(&writers_running, numwriters);
+
+    start = now_ns();
+    for(w=0; w < numwriters; w++) {
+        writers[w].id = w;
+        writers[w].writes = writes;
+        pthread_create(&writers[w].thread, NULL, write_cc, &writers[w]);
+    }
+
+    numreads = torn = 0;
+    while(atomic_load(&writers_running) > 0) {
+        lpmidi_readcc(BENCH_DEVICE, BENCH_CC, &value, &seq, &ts);
+        if(value < 0 || value > 127) torn += 1;
+        numreads += 1;
+    }
+
+    for(w=0; w < numwriters; w++) {
+        pthread_join(writers[w].thread, NULL);
+    }
+    elapsed = now_ns() - start;
+
+    lpmidi_readcc(BENCH_DEVICE, BENCH_CC, &value, &seq, &ts);
+    printf("%d writers, %ld writes each: %.1f nsec per write, %ld reads, %ld torn\n", numwriters, writes, elapsed / (writes * numwriters), numreads, torn);
+    printf("sequence advanced by %u, expected %ld\n", seq - startseq, writes * numwriters);
+    if(seq - startseq != writes * numwriters || torn > 0) failures += 1;
+
+    /* Claim a slot the way a writer does, and never release it */
+    if((fd = shm_open(ASTRID_MIDI_STATE_NAME, O_RDWR, LPIPC_PERMS)) < 0) {
+        printf("could not open %s: %s\n", ASTRID_MIDI_STATE_NAME, strerror(errno));
+        return 1;
+    }
+    state = (lpmidistate_t *)mmap(NULL, sizeof(lpmidistate_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    lpmidi_setcc(BENCH_DEVICE, BENCH_CC + 1, 42);
+    stale = atomic_load(&state->cc[BENCH_DEVICE][BENCH_CC + 1].state);
+    atomic_store(&state->cc[BENCH_DEVICE][BENCH_CC + 1].state, stale + (1ULL << 32));
+
+    start = now_ns();
+    lpmidi_readcc(BENCH_DEVICE, BENCH_CC + 1, &value, &seq, NULL);
+    elapsed = now_ns() - start;
+    printf("read of a dead writer's slot: %d after %.1f usec, expected 42\n", value, elapsed / 1000);
+    if(value != 42) failures += 1;
+
+    start = now_ns();
+    lpmidi_setcc(BENCH_DEVICE, BENCH_CC + 1, 43);
+    elapsed = now_ns() - start;
+    lpmidi_readcc(BENCH_DEVICE, BENCH_CC + 1, &value, &seq, NULL);
+    printf("write to a dead writer's slot: %d after %.1f usec, expected 43\n", value, elapsed / 1000);
+    if(value != 43) failures += 1;
+
+    munmap(state, sizeof(lpmidistate_t));
+
+    /* Out of range slots are refused, and only logged once */
+    start = now_ns();
+    for(i=0; i < 1000; i++) {
+        if(lpmidi_setcc(ASTRID_MIDI_MAXDEVICES, 0, 1) != -1 || lpmidi_readnote(0, 128, NULL, NULL, NULL) != -1) failures += 1;
+    }
+    elapsed = now_ns() - start;
+    printf("out of range: %.1f nsec per call\n", elapsed / 2000);
+
+    lpmidi_state_destroy();
+    if((fd = shm_open(ASTRID_MIDI_STATE_NAME, O_RDWR, LPIPC_PERMS)) >= 0 || errno != ENOENT) {
+        printf("%s still exists after lpmidi_state_destroy\n", ASTRID_MIDI_STATE_NAME);
+        failures += 1;
+    }
+
+    printf("%s\n", (failures == 0) ? "ok" : "FAILED");
+    free(writers);
+
+    return failures > 0;
+}
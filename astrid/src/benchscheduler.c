@@ -0,0 +1,274 @@
+#include "astrid.h"
+
+/* Compares the cost of the per-frame scheduler path
+ * (lpscheduler_tick) with the block mixer
+ * (lpscheduler_process_block) for increasing numbers
+ * of overlapping voices, and reports how much of each
+ * callback's time budget is used.
+ *
+ * Then mixes the same voices as plain events, as voices 
+ * with parameter streams left at rest, and as voices 
+ * whose gain ramps every block, to show at rest voices 
+ * take the plain mixer's path.
+ *
+ * Then stress tests the waiting queue with many pending
+ * events spread out over several minutes, the way a
+ * looping instrument pre-schedules its future events.
+ *
+ * Usage: astrid-benchscheduler [maxvoices] [pending]
+ */
+
+#define BENCH_BLOCKSIZE 256
+#define BENCH_SECONDS 2
+#define BENCH_VOICE_LENGTH (ASTRID_SAMPLERATE * 3)
+#define BENCH_MAX_ONSET (ASTRID_SAMPLERATE / 2)
+#define BENCH_PENDING_SPAN (ASTRID_SAMPLERATE * 60 * 10)
+#define BENCH_PENDING_LENGTH (ASTRID_SAMPLERATE / 10)
+#define BENCH_PENDING_SECONDS 30
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void tick_block(lpscheduler_t * s, float * out, size_t nframes) {
+    size_t i;
+    int c;
+
+    for(i=0; i < nframes; i++) {
+        lpscheduler_tick(s);
+        for(c=0; c < s->channels; c++) {
+            *out++ = (float)s->current_frame[c];
+        }
+    }
+}
+
+/* Renders numblocks from the scheduler and returns the average usec per callback */
+static double render_blocks(lpscheduler_t * s, lpparamstream_t * ps, int numvoices, float * out, size_t numblocks, int ramp) {
+    lpparam_t param = {0};
+    double start, elapsed;
+    size_t b;
+    int v;
+
+    elapsed = 0;
+    for(b=0; b < numblocks; b++) {
+        /* Move the gain of every voice at the start of each block */
+        if(ramp) {
+            param.type = LPPARAM_GAIN;
+            param.value = (b % 2 == 0) ? 0.5f : 1.f;
+            for(v=0; v < numvoices; v++) {
+                param.voice_id = v + 1;
+                lpparamstream_push(ps, param);
+            }
+        }
+
+        start = now_ns();
+        lpscheduler_process_block(s, out + (b % 2) * BENCH_BLOCKSIZE * ASTRID_CHANNELS, BENCH_BLOCKSIZE);
+        elapsed += now_ns() - start;
+    }
+
+    return elapsed / numblocks / 1000;
+}
+
+static void bench_voices(int numvoices) {
+    lpscheduler_t * schedulers[3];
+    lpparamstream_t streams[3];
+    sem_t locks[3];
+    lpbuffer_t ** voices;
+    float * outs[3];
+    double usec[3], maxdiff;
+    size_t numblocks, i, onset;
+    int v, k;
+
+    numblocks = (ASTRID_SAMPLERATE * BENCH_SECONDS) / BENCH_BLOCKSIZE;
+    voices = (lpbuffer_t **)calloc(numvoices, sizeof(lpbuffer_t *));
+
+    /* Plain events, voices at rest and ramping voices */
+    for(k=0; k < 3; k++) {
+        schedulers[k] = scheduler_create(0, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+        outs[k] = (float *)calloc(2 * BENCH_BLOCKSIZE * ASTRID_CHANNELS, sizeof(float));
+        sem_init(&locks[k], 0, 1);
+        streams[k].lock = &locks[k];
+        streams[k].rings = (lpparamring_t *)calloc(ASTRID_PARAMSTREAM_VOICES, sizeof(lpparamring_t));
+        if(k > 0) lpscheduler_attach_params(schedulers[k], &streams[k]);
+    }
+
+    for(v=0; v < numvoices; v++) {
+        voices[v] = LPBuffer.create(BENCH_VOICE_LENGTH, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+        for(i=0; i < BENCH_VOICE_LENGTH * ASTRID_CHANNELS; i++) {
+            voices[v]->data[i] = LPRand.rand(-0.01f, 0.01f);
+        }
+
+        onset = (size_t)LPRand.randint(0, BENCH_MAX_ONSET);
+        lpscheduler_post_event(schedulers[0], voices[v], onset);
+        lpscheduler_post_voice_event(schedulers[1], voices[v], onset, v + 1);
+        lpscheduler_post_voice_event(schedulers[2], voices[v], onset, v + 1);
+    }
+
+    for(k=0; k < 3; k++) {
+        usec[k] = render_blocks(schedulers[k], &streams[k], numvoices, outs[k], numblocks, k == 2);
+    }
+
+    /* The last block of the plain and at rest renders must match exactly */
+    maxdiff = 0;
+    for(i=0; i < 2 * BENCH_BLOCKSIZE * ASTRID_CHANNELS; i++) {
+        maxdiff = fmax(maxdiff, fabs(outs[0][i] - outs[1][i]));
+    }
+
+    printf("\n%d voices with parameter streams, usec per callback\n\n", numvoices);
+    printf("plain events:   %8.2f\n", usec[0]);
+    printf("voices at rest: %8.2f  %ld plain runs, %ld per frame runs, max diff %g\n", usec[1], schedulers[1]->voice_runs_at_rest, schedulers[1]->voice_runs_ramped, maxdiff);
+    printf("ramping voices: %8.2f  %ld plain runs, %ld per frame runs\n", usec[2], schedulers[2]->voice_runs_at_rest, schedulers[2]->voice_runs_ramped);
+
+    for(k=0; k < 3; k++) {
+        scheduler_destroy(schedulers[k]);
+        sem_destroy(&locks[k]);
+        free(streams[k].rings);
+        free(outs[k]);
+    }
+
+    for(v=0; v < numvoices; v++) {
+        LPBuffer.destroy(voices[v]);
+    }
+    free(voices);
+}
+
+static void bench_pending(size_t numpending) {
+    lpscheduler_t * tick_scheduler;
+    lpscheduler_t * block_scheduler;
+    lpbuffer_t * voice;
+    float out[BENCH_BLOCKSIZE * ASTRID_CHANNELS];
+    double start, elapsed, schedule_ns, tick_ns, block_ns, tick_max_ns, block_max_ns, budget_ns;
+    size_t numblocks, b, i, onset;
+    char pool_size[32];
+
+    numblocks = (ASTRID_SAMPLERATE * BENCH_PENDING_SECONDS) / BENCH_BLOCKSIZE;
+
+    /* Make room in the event pool for every pending event */
+    snprintf(pool_size, sizeof(pool_size), "%ld", numpending);
+    setenv("ASTRID_EVENT_POOL_SIZE", pool_size, 1);
+    budget_ns = (BENCH_BLOCKSIZE / (double)ASTRID_SAMPLERATE) * 1e9;
+
+    tick_scheduler = scheduler_create(0, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+    block_scheduler = scheduler_create(0, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+
+    /* Every event plays the same short buffer */
+    voice = LPBuffer.create(BENCH_PENDING_LENGTH, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+    for(i=0; i < BENCH_PENDING_LENGTH * ASTRID_CHANNELS; i++) {
+        voice->data[i] = LPRand.rand(-0.01f, 0.01f);
+    }
+
+    schedule_ns = 0;
+    for(i=0; i < numpending; i++) {
+        onset = (size_t)LPRand.randint(0, BENCH_PENDING_SPAN);
+        scheduler_schedule_event(tick_scheduler, voice, onset);
+
+        start = now_ns();
+        scheduler_schedule_event(block_scheduler, voice, onset);
+        schedule_ns += now_ns() - start;
+    }
+
+    tick_ns = block_ns = tick_max_ns = block_max_ns = 0;
+    for(b=0; b < numblocks; b++) {
+        start = now_ns();
+        tick_block(tick_scheduler, out, BENCH_BLOCKSIZE);
+        elapsed = now_ns() - start;
+        tick_ns += elapsed;
+        tick_max_ns = fmax(tick_max_ns, elapsed);
+
+        start = now_ns();
+        lpscheduler_process_block(block_scheduler, out, BENCH_BLOCKSIZE);
+        elapsed = now_ns() - start;
+        block_ns += elapsed;
+        block_max_ns = fmax(block_max_ns, elapsed);
+    }
+
+    printf("\n%ld pending events over %d minutes, %d seconds of playback\n\n", numpending, BENCH_PENDING_SPAN / ASTRID_SAMPLERATE / 60, BENCH_PENDING_SECONDS);
+    printf("schedule: %.1f nsec per event\n", schedule_ns / numpending);
+    printf("tick:     %.2f usec avg (%.2f%%), %.2f usec max per callback\n", tick_ns / numblocks / 1000, (tick_ns / numblocks / budget_ns) * 100, tick_max_ns / 1000);
+    printf("block:    %.2f usec avg (%.2f%%), %.2f usec max per callback\n", block_ns / numblocks / 1000, (block_ns / numblocks / budget_ns) * 100, block_max_ns / 1000);
+    printf("still waiting: %ld, pool high water: %ld\n", block_scheduler->num_waiting, atomic_load(&block_scheduler->pool.high_water));
+
+    scheduler_destroy(tick_scheduler);
+    scheduler_destroy(block_scheduler);
+    LPBuffer.destroy(voice);
+}
+
+int main(int argc, char * argv[]) {
+    lpscheduler_t * tick_scheduler;
+    lpscheduler_t * block_scheduler;
+    lpbuffer_t ** voices;
+    float tick_out[BENCH_BLOCKSIZE * ASTRID_CHANNELS];
+    float block_out[BENCH_BLOCKSIZE * ASTRID_CHANNELS];
+    double start, tick_ns, block_ns, budget_ns, maxdiff;
+    size_t numblocks, b, i, onset;
+    size_t numpending;
+    int numvoices, maxvoices, v;
+
+    maxvoices = (argc > 1) ? atoi(argv[1]) : 256;
+    numpending = (argc > 2) ? (size_t)atol(argv[2]) : 10000;
+    numblocks = (ASTRID_SAMPLERATE * BENCH_SECONDS) / BENCH_BLOCKSIZE;
+    budget_ns = (BENCH_BLOCKSIZE / (double)ASTRID_SAMPLERATE) * 1e9;
+
+    LPRand.seed(1);
+
+    printf("block size %d frames, callback budget %.1f usec\n\n", BENCH_BLOCKSIZE, budget_ns / 1000);
+    printf("%8s %14s %10s %14s %10s %9s %12s\n", "voices", "tick usec/cb", "tick %", "block usec/cb", "block %", "speedup", "max diff");
+
+    for(numvoices=8; numvoices <= maxvoices; numvoices *= 2) {
+        tick_scheduler = scheduler_create(0, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+        block_scheduler = scheduler_create(0, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+        voices = (lpbuffer_t **)calloc(numvoices, sizeof(lpbuffer_t *));
+
+        for(v=0; v < numvoices; v++) {
+            voices[v] = LPBuffer.create(BENCH_VOICE_LENGTH, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+            for(i=0; i < BENCH_VOICE_LENGTH * ASTRID_CHANNELS; i++) {
+                voices[v]->data[i] = LPRand.rand(-0.01f, 0.01f);
+            }
+
+            onset = (size_t)LPRand.randint(0, BENCH_MAX_ONSET);
+            scheduler_schedule_event(tick_scheduler, voices[v], onset);
+            scheduler_schedule_event(block_scheduler, voices[v], onset);
+        }
+
+        tick_ns = 0;
+        block_ns = 0;
+        maxdiff = 0;
+        for(b=0; b < numblocks; b++) {
+            start = now_ns();
+            tick_block(tick_scheduler, tick_out, BENCH_BLOCKSIZE);
+            tick_ns += now_ns() - start;
+
+            start = now_ns();
+            lpscheduler_process_block(block_scheduler, block_out, BENCH_BLOCKSIZE);
+            block_ns += now_ns() - start;
+
+            for(i=0; i < BENCH_BLOCKSIZE * ASTRID_CHANNELS; i++) {
+                maxdiff = fmax(maxdiff, fabs(tick_out[i] - block_out[i]));
+            }
+        }
+
+        tick_ns /= numblocks;
+        block_ns /= numblocks;
+
+        printf("%8d %14.2f %9.2f%% %14.2f %9.2f%% %8.1fx %12g\n",
+            numvoices,
+            tick_ns / 1000, (tick_ns / budget_ns) * 100,
+            block_ns / 1000, (block_ns / budget_ns) * 100,
+            tick_ns / block_ns, maxdiff
+        );
+
+        scheduler_destroy(tick_scheduler);
+        scheduler_destroy(block_scheduler);
+        for(v=0; v < numvoices; v++) {
+            LPBuffer.destroy(voices[v]);
+        }
+        free(voices);
+    }
+
+    bench_voices(maxvoices);
+    bench_pending(numpending);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+#include "astrid.h"
+
+/* Compares how late messages go out of the sequencer 
+ * when it polls the head of its queue every 500us, as 
+ * it used to, and when it sleeps on a timerfd until the 
+ * head timestamp. Prints a jitter histogram and the CPU 
+ * time used by each.
+ *
+ * Usage: astrid-benchseq [messages] [seconds]
+ */
+
+static int compare_timestamps(const void * a, const void * b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+/* Spread the messages out at random over the next few seconds */
+static void schedule(double * timestamps, size_t count, double seconds) {
+    double now;
+    size_t i;
+
+    lpscheduler_get_now_seconds(&now);
+    for(i=0; i < count; i++) {
+        timestamps[i] = now + 0.1 + LPRand.rand(0, seconds);
+    }
+    qsort(timestamps, count, sizeof(double), compare_timestamps);
+}
+
+static void bench_polling(double * timestamps, size_t count, lpjitterhist_t * h) {
+    double now;
+    size_t i;
+
+    i = 0;
+    while(i < count) {
+        lpscheduler_get_now_seconds(&now);
+        if(timestamps[i] > now) {
+            usleep((useconds_t)500);
+            continue;
+        }
+        lpjitterhist_add(h, now - timestamps[i]);
+        i += 1;
+    }
+}
+
+static void bench_timerfd(double * timestamps, size_t count, lpjitterhist_t * h) {
+    struct itimerspec its = {0};
+    uint64_t expirations;
+    double now, delay;
+    size_t i;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    i = 0;
+    while(i < count) {
+        lpscheduler_get_now_seconds(&now);
+        if(timestamps[i] > now) {
+            delay = timestamps[i] - now;
+            clock_gettime(CLOCK_MONOTONIC, &its.it_value);
+            its.it_value.tv_sec += (time_t)delay;
+            its.it_value.tv_nsec += (long)((delay - (time_t)delay) * 1e9);
+            if(its.it_value.tv_nsec >= 1000000000) {
+                its.it_value.tv_sec += 1;
+                its.it_value.tv_nsec -= 1000000000;
+            }
+            timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL);
+            if(read(fd, &expirations, sizeof(expirations)) < 0) break;
+            continue;
+        }
+        lpjitterhist_add(h, now - timestamps[i]);
+        i += 1;
+    }
+
+    close(fd);
+}
+
+int main(int argc, char * argv[]) {
+    lpjitterhist_t polling = {0}, timer = {0};
+    double * timestamps;
+    double seconds, cpu;
+    size_t count;
+
+    count = (argc > 1) ? (size_t)atoi(argv[1]) : 500;
+    seconds = (argc > 2) ? atof(argv[2]) : 5;
+
+    timestamps = (double *)LPMemoryPool.alloc(count, sizeof(double));
+    LPRand.seed(1);
+
+    printf("%ld messages over %.0f seconds\n\n", count, seconds);
+
+    schedule(timestamps, count, seconds);
+    cpu = cpu_seconds();
+    bench_polling(timestamps, count, &polling);
+    lpjitterhist_print(&polling, "500us polling", stdout);
+    printf("    cpu time %.3f sec\n\n", cpu_seconds() - cpu);
+
+    schedule(timestamps, count, seconds);
+    cpu = cpu_seconds();
+    bench_timerfd(timestamps, count, &timer);
+    lpjitterhist_print(&timer, "timerfd", stdout);
+    printf("    cpu time %.3f sec\n", cpu_seconds() - cpu);
+
+    LPMemoryPool.free(timestamps);
+
+    return 0;
+}
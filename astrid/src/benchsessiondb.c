@@ -0,0 +1,145 @@
+#include "astrid.h"
+
+/* Compares how long the DAC's buffer feed spends recording
+ * voice renders in the sessiondb when it runs an update
+ * per render itself, as it used to, and when it queues
+ * them for the writer thread. Checks that both leave the
+ * same render counts behind.
+ *
+ * Usage: astrid-benchsessiondb [voices] [renders]
+ */
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int insert_voices(sqlite3 * db, int voices) {
+    sqlite3_stmt * stmt;
+    int i;
+
+    sqlite3_exec(db, "delete from voices;", NULL, NULL, NULL);
+    sqlite3_exec(db, "begin;", NULL, NULL, NULL);
+    sqlite3_prepare_v2(db, "insert into voices (id, active, render_count) values (?1, 0, 0);", -1, &stmt, NULL);
+    for(i=0; i < voices; i++) {
+        sqlite3_bind_int(stmt, 1, i);
+        if(sqlite3_step(stmt) != SQLITE_DONE) {
+            printf("Could not insert voice %d: %s\n", i, sqlite3_errmsg(db));
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "commit;", NULL, NULL, NULL);
+
+    return 0;
+}
+
+static long long total_renders(sqlite3 * db) {
+    sqlite3_stmt * stmt;
+    long long total = -1;
+
+    sqlite3_prepare_v2(db, "select sum(render_count) from voices where active=1;", -1, &stmt, NULL);
+    if(sqlite3_step(stmt) == SQLITE_ROW) total = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+
+    return total;
+}
+
+/* One autocommitted update built with snprintf per render */
+static double bench_inline(sqlite3 * db, int voices, int renders) {
+    char sql[256];
+    double start, elapsed;
+    int i;
+
+    start = now_seconds();
+    for(i=0; i < renders; i++) {
+        snprintf(sql, sizeof(sql), "update voices set active=1, last_render=%d, render_count=%d where id=%d;", i, i / voices + 1, i % voices);
+        if(sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+            printf("Could not update voice %d: %s\n", i % voices, sqlite3_errmsg(db));
+        }
+    }
+    elapsed = now_seconds() - start;
+
+    printf("inline updates   %8.2f us per render  %lld renders recorded\n", elapsed / renders * 1e6, total_renders(db));
+    return elapsed;
+}
+
+static int push_render(lpsessiondb_writer_t * w, int i, int voices) {
+    if(i < voices) return lpsessiondb_mark_voice_active(w, i);
+    return lpsessiondb_increment_voice_render_count(w, i % voices, i / voices + 1);
+}
+
+static double bench_writer(sqlite3 * db, int voices, int renders) {
+    lpsessiondb_writer_t * w;
+    double start, t, pushing, flushed;
+    int i;
+
+    w = (lpsessiondb_writer_t *)calloc(1, sizeof(lpsessiondb_writer_t));
+    if(lpsessiondb_writer_start(w, db) < 0) {
+        printf("Could not start the sessiondb writer\n");
+        free(w);
+        return -1;
+    }
+
+    /* Renders arrive far faster than a real session here, so 
+     * wait out a full ring and only time the pushes that land */
+    pushing = 0;
+    start = now_seconds();
+    for(i=0; i < renders; i++) {
+        while(1) {
+            t = now_seconds();
+            if(push_render(w, i, voices) == 0) break;
+            sched_yield();
+        }
+        pushing += now_seconds() - t;
+    }
+
+    lpsessiondb_writer_stop(w);
+    flushed = now_seconds() - start;
+
+    printf("writer thread    %8.2f us per render  %lld renders recorded\n", pushing / renders * 1e6, total_renders(db));
+    printf("                 %8.2f us per render written, %zu commits, ring full %zu times, %zu dropped\n", 
+        flushed / renders * 1e6, 
+        atomic_load(&w->commits), 
+        atomic_load(&w->overflows),
+        atomic_load(&w->dropped)
+    );
+
+    free(w);
+    return pushing;
+}
+
+int main(int argc, char * argv[]) {
+    sqlite3 * db;
+    double inline_elapsed, writer_elapsed;
+    int voices, renders;
+
+    voices = (argc > 1) ? atoi(argv[1]) : 1000;
+    renders = (argc > 2) ? atoi(argv[2]) : 20000;
+
+    openlog("astrid-benchsessiondb", LOG_PID | LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    if(lpsessiondb_create(&db) < 0) {
+        printf("Could not create the sessiondb at %s\n", ASTRID_SESSIONDB_PATH);
+        return 1;
+    }
+
+    printf("%d voices, %d renders (expect %d recorded)\n\n", voices, renders, renders);
+
+    if(insert_voices(db, voices) < 0) return 1;
+    inline_elapsed = bench_inline(db, voices, renders);
+
+    if(insert_voices(db, voices) < 0) return 1;
+    writer_elapsed = bench_writer(db, voices, renders);
+
+    if(writer_elapsed > 0) printf("\n%.1fx less time on the buffer feed\n", inline_elapsed / writer_elapsed);
+
+    lpsessiondb_close(db);
+    unlink(ASTRID_SESSIONDB_PATH);
+
+    return 0;
+}
@@ -2,13 +2,15 @@
 #define MA_NO_ENCODING
 #define MA_NO_DECODING
 #include "miniaudio/miniaudio.h"
-#include <hiredis/hiredis.h>
 #include "astrid.h"
 
 
 static volatile int astrid_is_running = 1;
 lpscheduler_t * astrid_scheduler;
 sqlite3 * sessiondb;
+lpsessiondb_writer_t sessiondb_writer;
+lpslab_t slab;
+lpparamstream_t paramstream;
 
 /* Callback for SIGINT */
 void handle_shutdown(int sig __attribute__((unused))) {
@@ -16,109 +18,120 @@ void handle_shutdown(int sig __attribute__((unused))) {
 }
 
 
+/* Return a finished buffer's blocks to the slab.
+ * Called from the scheduler's reclaim thread while 
+ * it empties the nursery, never from the audio thread. */
+void release_slab_buffer(lpbuffer_t * buf) {
+    if(lpslab_free(&slab, (char *)buf->data - slab.data, buf->length, buf->channels) < 0) {
+        syslog(LOG_ERR, "DAC could not return buffer to the slab\n");
+    }
+    free(buf);
+}
+
 /* This callback runs in a thread started 
  * just before the audio callback is started.
  *
- * It waits on the buffer queue for new buffers, 
- * and then sends them to the scheduler.
+ * It waits on the buffer queue for descriptors of
+ * new buffers rendered into the shared slab, and 
+ * then sends them to the scheduler.
  */
 void * buffer_feed(__attribute__((unused)) void * arg) {
-    redisContext * redis_ctx;
-    redisReply * redis_reply;
     lpbuffer_t * buf;
+    lpslab_desc_t desc = {0};
     lpmsg_t msg = {0};
     double now, delay;
     size_t delay_frames;
 
-    struct timeval redis_timeout = {15, 0};
-    size_t callback_delay = 0;
+#ifdef ASTRID_USE_FIFO_QUEUES
+    int bufferq;
+#else
+    mqd_t bufferq;
+#endif
 
     syslog(LOG_INFO, "Buffer feed starting up...\n");
-    redis_ctx = redisConnectWithTimeout("127.0.0.1", 6379, redis_timeout);
-    if(redis_ctx == NULL) {
-        syslog(LOG_CRIT, "Could not start connection to redis.\n");
-        exit(1);
-    }
 
-    if(redis_ctx->err) {
-        syslog(LOG_CRIT, "There was a problem while connecting to redis. %s\n", redis_ctx->errstr);
+    /* This is the only thread reading 
+     * from the buffer queue. */
+    if((bufferq = astrid_bufferq_open()) == (mqd_t) -1) {
+        syslog(LOG_CRIT, "Could not open the buffer queue.\n");
         exit(1);
     }
 
-    /* Subscribe to the buffer queue. 
-     * This is the only thread subscribed
-     * to the buffer queue as a reader.
-     */
-    redis_reply = redisCommand(redis_ctx, "SUBSCRIBE astridbuffers");
-    if(redis_reply->str != NULL) printf("subscribe result: %s\n", redis_reply->str); 
-    freeReplyObject(redis_reply);
-
     /* Wait on buffers from the queue */
     syslog(LOG_INFO, "Waiting for buffers...\n");
-    while(astrid_is_running && redisGetReply(redis_ctx, (void *)&redis_reply) == REDIS_OK) {
-        if(redis_reply->type == REDIS_REPLY_ARRAY) {
-            if(redis_reply->element[2]->str[0] == 's') {
-                syslog(LOG_INFO, "Buffer feed got shutdown message\n");
-                syslog(LOG_INFO, "    message: %s\n", redis_reply->element[2]->str);
-                break;
-            }
+    while(astrid_is_running) {
+        if(astrid_bufferq_read(bufferq, &desc) < 0) {
+            if(errno == EINTR) continue;
+            syslog(LOG_ERR, "DAC could not read from the buffer queue. Error: (%d) %s\n", errno, strerror(errno));
+            break;
+        }
+
+        if(desc.msg.type == LPMSG_SHUTDOWN) {
+            syslog(LOG_INFO, "Buffer feed got shutdown message\n");
+            break;
+        }
+
+        /* Play the audio in place from the slab */
+        if((buf = lpslab_tolpbuffer(&slab, &desc)) == NULL) {
+            syslog(LOG_ERR, "DAC could not read buffer from the slab. Error: (%d) %s\n", errno, strerror(errno));
+            continue;
+        }
+        msg = desc.msg;
+
+        /* Increment the message count */
+        msg.count += 1;
+
+        /* Hand the buffer to the audio thread for playback. 
+         * If the inbox ring or the event pool is full, wait for 
+         * the audio thread to catch up: overflows and pool 
+         * exhaustions are counted in their stats. 
+         * Once posted the buffer belongs to the scheduler, so 
+         * only the descriptor is read from here on. */
+        while(lpscheduler_post_voice_event(astrid_scheduler, buf, desc.onset, desc.msg.voice_id) < 0) {
+            if(!astrid_is_running) break;
+            usleep((useconds_t)1000);
+        }
+
+        /* Mark the voice active on the first render and 
+         * increment the render count if looping. These only 
+         * queue the update for the sessiondb writer thread: 
+         * a full queue is counted and reported from main. */
+        if(msg.count == 1) {
+            lpsessiondb_mark_voice_active(&sessiondb_writer, msg.voice_id);
+        } else if(msg.count > 1 && desc.is_looping) {
+            lpsessiondb_increment_voice_render_count(&sessiondb_writer, msg.voice_id, msg.count);
+        }
 
-            if((buf = deserialize_buffer(redis_reply->element[2]->str, &msg)) == NULL) {
-                syslog(LOG_ERR, "DAC could not deserialize buffer. Error: (%d) %s\n", errno, strerror(errno));
+        /* If the buffer is flagged to loop, schedule the next render 
+         * by placing the message onto the message scheduling priority 
+         * queue with a timestamp for sending the render message 70% 
+         * into the buffer playback, with an onset delay for the buffer 
+         * making up the last 30%. TODO: measure jitter when scheduling 
+         * in regular intervals. */
+
+        if(desc.is_looping == 1) {
+            /* Get now to schedule the next render */
+            if(lpscheduler_get_now_seconds(&now) < 0) {
+                syslog(LOG_ERR, "Could not get now seconds for loop retriggering\n");
                 continue;
             }
 
-            /* Increment the message count */
-            msg.count += 1;
-
-            /* Schedule the buffer for playback */
-            scheduler_schedule_event(astrid_scheduler, buf, buf->onset);
-
-            /* Mark the voice active on the first render and 
-             * increment the render count if looping */
-            if(msg.count == 1) {
-                if(lpsessiondb_mark_voice_active(sessiondb, msg.voice_id) < 0) {
-                    syslog(LOG_ERR, "DAC could not mark voice active in sessiondb. Error: (%d) %s\n", errno, strerror(errno));
-                }
-            } else if(msg.count > 1 && buf->is_looping) {
-                if(lpsessiondb_increment_voice_render_count(sessiondb, msg.voice_id, msg.count) < 0) {
-                    syslog(LOG_ERR, "DAC could not increment voice render count in sessiondb. Error: (%d) %s\n", errno, strerror(errno));
-                }
-            }
+            delay_frames = (size_t)(desc.length * 0.7f);
+            delay = (delay_frames / (double)desc.samplerate);
+            msg.timestamp = now + delay;
+            msg.onset_delay = desc.length - delay_frames;
+            syslog(LOG_DEBUG, "scheduling next render with delay %f and onset_delay %ld\n", delay, msg.onset_delay);
 
-            /* If the buffer is flagged to loop, schedule the next render 
-             * by placing the message onto the message scheduling priority 
-             * queue with a timestamp for sending the render message 70% 
-             * into the buffer playback, with an onset delay for the buffer 
-             * making up the last 30%. TODO: measure jitter when scheduling 
-             * in regular intervals. */
-
-            if(buf->is_looping == 1) {
-                /* Get now to schedule the next render */
-                if(lpscheduler_get_now_seconds(&now) < 0) {
-                    syslog(LOG_ERR, "Could not get now seconds for loop retriggering\n");
-                    continue;
-                }
-
-                delay_frames = (size_t)(buf->length * 0.7f);
-                delay = (delay_frames / (double)buf->samplerate);
-                msg.timestamp = now + delay;
-                msg.onset_delay = buf->length - delay_frames;
-                syslog(LOG_DEBUG, "scheduling next render with delay %f and onset_delay %ld\n", delay, msg.onset_delay);
-
-                if(send_message(msg) < 0) {
-                    syslog(LOG_ERR, "Could not schedule message for loop retriggering\n");
-                    continue;
-                }
+            if(send_message(msg) < 0) {
+                syslog(LOG_ERR, "Could not schedule message for loop retriggering\n");
+                continue;
             }
-
         }
-        freeReplyObject(redis_reply);
     }
 
     syslog(LOG_INFO, "Buffer feed shutting down...\n");
 
-    if(redis_ctx != NULL) redisFree(redis_ctx); 
+    astrid_bufferq_close(bufferq);
     return 0;
 }
 
@@ -132,20 +145,12 @@ void miniaudio_callback(
     __attribute__((unused)) const void * pIn, 
           ma_uint32 count
 ) {
-    ma_uint32 i;
-    float * out;
-    int c;
     lpdacctx_t * ctx;
 
     ctx = (lpdacctx_t *)device->pUserData;
-    out = (float *)pOut;
 
-    for(i=0; i < count; i++) {
-        lpscheduler_tick(ctx->s);
-        for(c=0; c < ASTRID_CHANNELS; c++) {
-            *out++ = (float)ctx->s->current_frame[c];
-        }
-    }
+    /* Mix the whole block at once */
+    lpscheduler_process_block(ctx->s, (float *)pOut, (size_t)count);
 }
 
 int cleanup(
@@ -154,27 +159,14 @@ int cleanup(
     pthread_t buffer_feed_thread, 
     sqlite3 * sessiondb
 ) {
-    redisContext * redis_ctx;
-    redisReply * redis_reply;
-    struct timeval redis_timeout = {15, 0};
-
-    redis_ctx = redisConnectWithTimeout("127.0.0.1", 6379, redis_timeout);
-    if(redis_ctx == NULL) {
-        syslog(LOG_ERR, "Could not start connection to redis.\n");
-        exit(1);
-    }
-
-    if(redis_ctx->err) {
-        syslog(LOG_ERR, "There was a problem while connecting to redis. %s\n", redis_ctx->errstr);
-        exit(1);
-    }
+    lpslab_desc_t shutdown = {0};
 
     syslog(LOG_INFO, "Sending shutdown to buffer thread...\n");
     astrid_is_running = 0;
-    redis_reply = redisCommand(redis_ctx, "PUBLISH astridbuffers shutdown");
-    if(redis_reply->str != NULL) syslog(LOG_INFO, "astridbuffers shutdown result: %s\n", redis_reply->str); 
-    freeReplyObject(redis_reply);
-    if(redis_ctx != NULL) redisFree(redis_ctx); 
+    shutdown.msg.type = LPMSG_SHUTDOWN;
+    if(lpslab_send(shutdown) < 0) {
+        syslog(LOG_ERR, "Could not send shutdown to the buffer queue\n");
+    }
 
     syslog(LOG_DEBUG, "Joining with buffer thread...\n");
     if(pthread_join(buffer_feed_thread, NULL) != 0) {
@@ -187,6 +179,18 @@ int cleanup(
     syslog(LOG_INFO, "Cleaning up scheduler...\n");
     if(ctx != NULL) scheduler_destroy(ctx->s);
 
+    syslog(LOG_INFO, "Detaching buffer slab...\n");
+    if(slab.header != NULL) lpslab_close(&slab);
+
+    syslog(LOG_INFO, "Detaching parameter streams...\n");
+    if(paramstream.rings != NULL) lpparamstream_close(&paramstream);
+
+    syslog(LOG_INFO, "Removing MIDI state...\n");
+    lpmidi_state_destroy();
+
+    syslog(LOG_INFO, "Flushing sessiondb writer...\n");
+    lpsessiondb_writer_stop(&sessiondb_writer);
+
     syslog(LOG_INFO, "Closing sessiondb...\n");
     if(sessiondb != NULL) lpsessiondb_close(sessiondb);
 
@@ -206,6 +210,9 @@ int main() {
     lpcounter_t voice_id_counter;
     pthread_t buffer_feed_thread;
     int device_id;
+    size_t overflows, last_overflows, failed_allocs, last_failed_allocs, exhausted, last_exhausted;
+    size_t param_overflows, last_param_overflows, v;
+    size_t db_overflows, last_db_overflows, db_dropped, last_db_dropped, db_written, last_db_written, db_commits, last_db_commits, ticks;
     ma_uint32 playback_device_count, capture_device_count;
     ma_device playback;
     ma_device_info * playback_devices;
@@ -234,10 +241,12 @@ int main() {
      * 
      * The scheduler is shared between the miniaudio callback 
      * and astrid buffer feed threads. The buffer feed thread 
-     * may schedule buffers by adding them to the internal linked 
-     * list in the scheduler. The miniaudio callback may read from 
-     * the linked list, increment counts in playing buffers and 
-     * flag buffers as having playback completed. 
+     * posts new buffers onto the scheduler's lock-free inbox 
+     * ring, and the miniaudio callback drains the ring into 
+     * its internal linked lists at the start of each block. 
+     * Only the miniaudio callback touches those lists, except 
+     * for the nursery of completed events which the reclaim 
+     * thread empties atomically.
      **/
     astrid_scheduler = scheduler_create(1, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
     ctx = (lpdacctx_t*)LPMemoryPool.alloc(1, sizeof(lpdacctx_t));
@@ -245,6 +254,31 @@ int main() {
     ctx->channels = ASTRID_CHANNELS;
     ctx->samplerate = ASTRID_SAMPLERATE;
 
+    /* Set up the shared memory slab renderers write 
+     * their buffers into. Finished buffers go back to 
+     * the slab instead of being freed. */
+    if(lpslab_create(&slab) < 0) {
+        syslog(LOG_ERR, "Could not initialize the buffer slab. Error: %s\n", strerror(errno));
+        goto exit_with_error;
+    }
+    astrid_scheduler->release_buffer = release_slab_buffer;
+
+    /* Set up the parameter streams that carry gain, pan 
+     * and filter changes for playing voices. The audio 
+     * callback applies them to each block it mixes. */
+    if(lpparamstream_create(&paramstream) < 0) {
+        syslog(LOG_ERR, "Could not initialize the parameter streams. Error: %s\n", strerror(errno));
+        goto exit_with_error;
+    }
+    lpscheduler_attach_params(astrid_scheduler, &paramstream);
+
+    /* Finished buffers are freed and their events 
+     * recycled on the scheduler's reclaim thread */
+    if(scheduler_start_reclaimer(astrid_scheduler) < 0) {
+        syslog(LOG_ERR, "Could not start the scheduler reclaim thread\n");
+        goto exit_with_error;
+    }
+
     /* Set up shared memory IPC for voice IDs */
     if(lpcounter_create(&voice_id_counter) < 0) {
         syslog(LOG_ERR, "Could not initialize voice ID shared memory. Error: %s\n", strerror(errno));
@@ -268,6 +302,12 @@ int main() {
         goto exit_with_error;
     }
 
+    /* Start the sessiondb writer before anything can queue updates for it */
+    if(lpsessiondb_writer_start(&sessiondb_writer, sessiondb) < 0) {
+        syslog(LOG_ERR, "Could not start the sessiondb writer\n");
+        goto exit_with_error;
+    }
+
     /* Start buffer feed thread */
     if(pthread_create(&buffer_feed_thread, NULL, buffer_feed, ctx) != 0) {
         syslog(LOG_ERR, "Could not initialize buffer feed thread. Error: %s\n", strerror(errno));
@@ -312,10 +352,104 @@ int main() {
     ma_device_start(&playback);
 
     syslog(LOG_INFO, "Astrid DAC is starting...\n");
+    last_overflows = 0;
+    last_failed_allocs = 0;
+    last_exhausted = 0;
+    last_param_overflows = 0;
+    last_db_overflows = 0;
+    last_db_dropped = 0;
+    last_db_written = 0;
+    last_db_commits = 0;
+    ticks = 0;
     while(astrid_is_running) {
-        /* Twiddle thumbs & tidy up */
+        /* Twiddle thumbs */
         usleep((useconds_t)100000);
-        scheduler_cleanup_nursery(ctx->s);
+
+        /* Report inbox ring pressure so it can be sized under load */
+        overflows = atomic_load(&ctx->s->inbox.overflows);
+        if(overflows != last_overflows) {
+            syslog(LOG_WARNING, "DAC event inbox overflowed %ld times (pushed: %ld, high water: %ld of %d)\n", 
+                overflows, 
+                atomic_load(&ctx->s->inbox.pushed), 
+                atomic_load(&ctx->s->inbox.high_water), 
+                ASTRID_EVENTRING_SIZE
+            );
+            last_overflows = overflows;
+        }
+
+        /* Report renderers running out of room in the slab */
+        failed_allocs = slab.header->failed_allocs;
+        if(failed_allocs != last_failed_allocs) {
+            syslog(LOG_WARNING, "Buffer slab is full: %ld failed allocations (used: %ld, high water: %ld of %ld blocks)\n", 
+                failed_allocs, 
+                slab.header->blocks_used, 
+                slab.header->high_water, 
+                slab.header->numblocks
+            );
+            last_failed_allocs = failed_allocs;
+        }
+
+        /* Report event pool exhaustion so ASTRID_EVENT_POOL_SIZE can be tuned */
+        exhausted = atomic_load(&ctx->s->pool.exhausted);
+        if(exhausted != last_exhausted) {
+            syslog(LOG_WARNING, "DAC event pool was exhausted %ld times (in use: %ld, high water: %ld of %ld)\n", 
+                exhausted, 
+                atomic_load(&ctx->s->pool.in_use), 
+                atomic_load(&ctx->s->pool.high_water), 
+                ctx->s->pool.size
+            );
+            last_exhausted = exhausted;
+        }
+
+        /* Report parameter changes dropped because a voice's ring was full */
+        param_overflows = 0;
+        for(v=0; v < ASTRID_PARAMSTREAM_VOICES; v++) {
+            param_overflows += atomic_load(&paramstream.rings[v].overflows);
+        }
+        if(param_overflows != last_param_overflows) {
+            syslog(LOG_WARNING, "Parameter streams overflowed %ld times (%d changes per voice)\n", 
+                param_overflows, 
+                ASTRID_PARAMSTREAM_RINGSIZE
+            );
+            last_param_overflows = param_overflows;
+        }
+
+        /* Report voice updates dropped because the sessiondb writer fell behind */
+        db_overflows = atomic_load(&sessiondb_writer.overflows);
+        if(db_overflows != last_db_overflows) {
+            syslog(LOG_WARNING, "Sessiondb writer queue overflowed %zu times since the last report (%zu total, capacity: %d records)\n", 
+                db_overflows - last_db_overflows, 
+                db_overflows, 
+                ASTRID_SESSIONDB_RINGSIZE
+            );
+            last_db_overflows = db_overflows;
+        }
+
+        /* Report voice updates the sessiondb rejected */
+        db_dropped = atomic_load(&sessiondb_writer.dropped);
+        if(db_dropped != last_db_dropped) {
+            syslog(LOG_WARNING, "Sessiondb writer dropped %zu records since the last report (%zu total)\n", 
+                db_dropped - last_db_dropped, 
+                db_dropped
+            );
+            last_db_dropped = db_dropped;
+        }
+
+        /* Report the sessiondb write rate */
+        ticks += 1;
+        if(ticks % (ASTRID_SESSIONDB_STATS_SECONDS * 10) == 0) {
+            db_written = atomic_load(&sessiondb_writer.written);
+            db_commits = atomic_load(&sessiondb_writer.commits);
+            if(db_written != last_db_written) {
+                syslog(LOG_INFO, "Sessiondb writer: %.1f records/sec in %.1f commits/sec (%zu records total)\n", 
+                    (db_written - last_db_written) / (double)ASTRID_SESSIONDB_STATS_SECONDS, 
+                    (db_commits - last_db_commits) / (double)ASTRID_SESSIONDB_STATS_SECONDS, 
+                    db_written
+                );
+            }
+            last_db_written = db_written;
+            last_db_commits = db_commits;
+        }
     }
 
     return cleanup(&playback, ctx, buffer_feed_thread, sessiondb);
@@ -1,10 +1,13 @@
 #include "astrid.h"
 
 int main(int argc, char * argv[]) {
-    lpipc_buffer_t * buf;
+    lpadcbuf_t * adc;
+    lpadcview_t view;
     lpbuffer_t * out;
+    lpfloat_t * outp;
     char * out_path;
-    int adc_shmid;
+    size_t i;
+    int adc_shmid, s;
 
     if(argc != 3) {
         printf("Usage: %s <adc_shmid:int> <outpath.wav> (%d)\n", argv[0], argc);
@@ -15,18 +18,24 @@ int main(int argc, char * argv[]) {
     adc_shmid = atoi(argv[1]);
     out_path = argv[2];
 
-    if(lpipc_buffer_aquire(LPADC_BUFFER_PATH, &buf, adc_shmid) < 0) {
-        fprintf(stderr, "Could not aquire ADC buffer\n");
+    if((adc = lpadc_attach(adc_shmid)) == NULL) {
+        fprintf(stderr, "Could not attach to ADC buffer\n");
         return 1;
     }
 
-    lpipc_buffer_tolpbuffer(buf, &out);
-    LPSoundFile.write(out_path, out);
+    /* Copy out the whole ring, oldest samples first */
+    out = LPBuffer.create(LPADCBUFFRAMES, ASTRID_CHANNELS, ASTRID_SAMPLERATE);
+    do {
+        lpadc_view(adc, 0, LPADCBUFSAMPLES, &view);
+        outp = out->data + (LPADCBUFSAMPLES - view.lengths[0] - view.lengths[1]);
+        for(s=0; s < 2; s++) {
+            for(i=0; i < view.lengths[s]; i++) {
+                *outp++ = view.segments[s][i];
+            }
+        }
+    } while(!lpadc_view_is_valid(adc, &view));
 
-    if(lpipc_buffer_release(LPADC_BUFFER_PATH, (void *)buf) < 0) {
-        fprintf(stderr, "Could not release ADC buffer\n");
-        return 1;
-    }
+    LPSoundFile.write(out_path, out);
 
     printf("Saved ADC buffer to %s\n", out_path);
 
@@ -1,7 +1,7 @@
 #include "astrid.h"
 
 int main(int argc, char * argv[]) {
-    lpipc_buffer_t * buf;
+    lpadcbuf_t * adc;
     int position, channel, adc_shmid;
     size_t insert_pos;
     lpfloat_t sample;
@@ -14,21 +14,16 @@ int main(int argc, char * argv[]) {
     position = atoi(argv[2]);
     channel = atoi(argv[3]);
     sample = (lpfloat_t)atof(argv[4]);
-    insert_pos = (size_t)(position * channel);
+    insert_pos = (size_t)(position * ASTRID_CHANNELS + channel);
 
     printf("Writing %f to ADC buffer at position %d channel %d...\n", sample, position, channel);
 
-    if(lpipc_buffer_aquire(LPADC_BUFFER_PATH, &buf, adc_shmid) < 0) {
-        fprintf(stderr, "Could not aquire ADC buffer\n");
+    if((adc = lpadc_attach(adc_shmid)) == NULL) {
+        fprintf(stderr, "Could not attach to ADC buffer\n");
         return 1;
     }
 
-    memcpy(buf->data + (sizeof(lpfloat_t) * insert_pos), (char*)(&sample), sizeof(lpfloat_t));
-
-    if(lpipc_buffer_release(LPADC_BUFFER_PATH, (void *)buf) < 0) {
-        fprintf(stderr, "Could not release ADC buffer\n");
-        return 1;
-    }
+    adc->data[insert_pos % LPADCBUFSAMPLES] = (float)sample;
 
     printf("Wrote value to ADC buffer\n");
 
@@ -1,5 +1,7 @@
+#include <poll.h>
 #include <signal.h>
 #include <sys/syscall.h>
+#include <sys/wait.h>
 
 #include "cyrenderer.h"
 #include "astrid.h"
@@ -10,76 +12,117 @@ int astrid_channels = 2;
 char * instrument_fullpath; /* eg ../orc/ding.py */
 char * instrument_basename; /* eg ding           */
 
-void handle_shutdown(int sig __attribute__((unused))) {
-    astrid_is_running = 0;
-}
+/* Each worker is a forked process with its own embedded
+ * interpreter, so voices of the same instrument can render
+ * at the same time without contending for one GIL. The
+ * parent only starts the workers and waits on them. With
+ * a single worker the parent renders on its own, as the
+ * renderer always has. */
+static lprenderpool_t * pool;
+static int worker_index = -1; /* -1 in the parent */
 
-int main(int argc, char * argv[]) {
-    struct sigaction shutdown_action;
+void handle_shutdown(int sig __attribute__((unused))) {
+    int i;
 
-    char * _instrument_fullpath; 
-    char * _instrument_basename; 
-    size_t instrument_name_length;
-    char * astrid_pythonpath_env;
-    size_t astrid_pythonpath_length;
-    wchar_t * python_path;
+    astrid_is_running = 0;
+    if(pool == NULL) return;
 
-    char * _astrid_channels;
-    lpastridctx_t * ctx;
-    PyObject * pmodule;
+    atomic_store(&pool->is_running, 0);
 
-    if(argc != 3) {
-        syslog(LOG_ERR, "Error: invalid number of arguments to astrid renderer\n");
-        exit(1);
+    /* The parent passes the signal on to its workers */
+    if(worker_index < 0) {
+        for(i=0; i < pool->numworkers; i++) {
+            if(pool->workers[i].pid > 0) kill(pool->workers[i].pid, SIGTERM);
+        }
     }
+}
 
-    openlog("astrid-renderer", LOG_PID, LOG_USER);
+static uint64_t now_nsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
 
-#ifdef ASTRID_USE_FIFO_QUEUES
-    int playqd = -1;
-#else
-    mqd_t playqd = -1;
-#endif
+static void log_worker_stats(int index) {
+    lprenderworker_t * w = &pool->workers[index];
+    size_t renders = atomic_load(&w->renders);
 
-    lpmsg_t msg = {0};
+    syslog(LOG_INFO, "%s renderer worker %d: %ld renders, avg %.2f ms, max %.2f ms, %ld forwarded, %ld overflows, %ld reloads\n",
+        instrument_basename, index, renders,
+        (renders > 0) ? atomic_load(&w->total_latency) / (double)renders / 1e6 : 0,
+        atomic_load(&w->max_latency) / 1e6,
+        atomic_load(&w->forwarded), atomic_load(&w->overflows), atomic_load(&w->reloads)
+    );
+}
 
-    syslog(LOG_INFO, "Starting renderer...\n");
+static void record_latency(int index, uint64_t latency) {
+    lprenderworker_t * w = &pool->workers[index];
+    uint64_t max = atomic_load(&w->max_latency);
 
-    /* Setup sigint handler for graceful shutdown */
-    shutdown_action.sa_handler = handle_shutdown;
-    sigemptyset(&shutdown_action.sa_mask);
-    shutdown_action.sa_flags = SA_RESTART; /* Prevent open, read, write etc from EINTR */
+    atomic_fetch_add(&w->total_latency, latency);
+    while(latency > max && !atomic_compare_exchange_weak(&w->max_latency, &max, latency));
 
-    if(sigaction(SIGINT, &shutdown_action, NULL) == -1) {
-        syslog(LOG_ERR, "Could not init SIGINT signal handler.\n");
-        exit(1);
+    if(atomic_fetch_add(&w->renders, 1) % ASTRID_RENDER_STATS_INTERVAL == ASTRID_RENDER_STATS_INTERVAL - 1) {
+        log_worker_stats(index);
     }
+}
 
-    if(sigaction(SIGTERM, &shutdown_action, NULL) == -1) {
-        syslog(LOG_ERR, "Could not init SIGTERM signal handler.\n");
-        exit(1);
+/* Returns the worker that owns this voice, claiming it for
+ * the caller if no worker has seen it yet. Loops come back
+ * through the play queue with the same voice ID, so they
+ * keep rendering in the interpreter that started them. */
+static int claim_voice(size_t voice_id, int index) {
+    _Atomic uint64_t * slot = &pool->affinity[voice_id % ASTRID_RENDER_AFFINITY_SLOTS];
+    uint64_t claim = ((uint64_t)voice_id << 8) | (uint64_t)(index + 1);
+    uint64_t current = atomic_load(slot);
+
+    while(1) {
+        if((current & 0xff) != 0 && (current >> 8) == (claim >> 8)) return (int)(current & 0xff) - 1;
+        if(atomic_compare_exchange_weak(slot, &current, claim)) return index;
     }
+}
 
-    /* Get python path from env */
-    astrid_pythonpath_env = getenv("ASTRID_PYTHONPATH");
-    astrid_pythonpath_length = mbstowcs(NULL, astrid_pythonpath_env, 0);
-    python_path = calloc(astrid_pythonpath_length+1, sizeof(*python_path));
-    if(python_path == NULL) {
-        syslog(LOG_ERR, "Error: could not allocate memory for wide char path\n");
-        exit(1);
-    }
+/* Passes a message on to every other worker */
+static void broadcast(lpmsg_t * msg) {
+    int i;
 
-    if(mbstowcs(python_path, astrid_pythonpath_env, astrid_pythonpath_length) == (size_t) -1) {
-        syslog(LOG_ERR, "Error: Could not convert path to wchar_t\n");
-        exit(1);
+    for(i=0; i < pool->numworkers; i++) {
+        if(i == worker_index) continue;
+        if(astrid_workerq_send(&pool->workers[i].q, msg) < 0) {
+            /* A busy worker still sees reloads and shutdowns through the pool */
+            atomic_fetch_add(&pool->workers[worker_index].overflows, 1);
+        }
     }
+}
 
-    /* Set channels from env */
-    _astrid_channels = getenv("ASTRID_CHANNELS");
-    if(_astrid_channels != NULL) {
-        astrid_channels = atoi(_astrid_channels);
+static int reload_if_stale(size_t * reload_generation) {
+    size_t generation = atomic_load(&pool->reload_generation);
+    if(generation == *reload_generation) return 0;
+
+    if(astrid_reload_instrument(instrument_fullpath) < 0) {
+        PyErr_Print();
+        syslog(LOG_ERR, "Error while attempting to load astrid instrument\n");
+        return -1;
     }
-    astrid_channels = 2;
+
+    *reload_generation = generation;
+    atomic_fetch_add(&pool->workers[worker_index].reloads, 1);
+    return 0;
+}
+
+#ifdef ASTRID_USE_FIFO_QUEUES
+static int render_worker(int playqd, wchar_t * python_path) {
+#else
+static int render_worker(mqd_t playqd, wchar_t * python_path) {
+#endif
+    lpworkerq_t * workerq = &pool->workers[worker_index].q;
+    struct pollfd fds[2];
+    size_t reload_generation = 0;
+    uint64_t start;
+    int nfds, from_workerq, owner;
+    lpastridctx_t * ctx;
+    PyObject * pmodule;
+    lpmsg_t msg = {0};
 
     /* Setup context */
     ctx = (lpastridctx_t*)LPMemoryPool.alloc(1, sizeof(lpastridctx_t));
@@ -98,7 +141,7 @@ int main(int argc, char * argv[]) {
     /* Prepare cyrenderer module for import */
     if(PyImport_AppendInittab("cyrenderer", PyInit_cyrenderer) == -1) {
         syslog(LOG_ERR, "Error: could not extend in-built modules table for renderer\n");
-        exit(1);
+        return 1;
     }
 
     /* Set python program name */
@@ -115,87 +158,105 @@ int main(int argc, char * argv[]) {
     if(!pmodule) {
         PyErr_Print();
         syslog(LOG_ERR, "Error: could not import cython renderer module\n");
-        goto lprender_cleanup;
+        goto lpworker_cleanup;
     }
 
-    _instrument_fullpath = argv[1];
-    _instrument_basename = argv[2];
-    instrument_name_length = strlen(_instrument_basename);
-    instrument_fullpath = calloc(strlen(_instrument_fullpath)+1, sizeof(char));
-    instrument_basename = calloc(instrument_name_length+1, sizeof(char));
-    strcpy(instrument_fullpath, _instrument_fullpath);
-    strcpy(instrument_basename, _instrument_basename);
-
     /* Import python instrument module */
+    reload_generation = atomic_load(&pool->reload_generation);
     if(astrid_load_instrument(instrument_fullpath) < 0) {
         PyErr_Print();
         syslog(LOG_ERR, "Error while attempting to load astrid instrument\n");
-        goto lprender_cleanup;
+        goto lpworker_cleanup;
     }
 
-    syslog(LOG_INFO, "Astrid renderer... is now rendering!\n");
-
-#ifdef ASTRID_USE_FIFO_QUEUES
-    if((playqd = astrid_playq_open(instrument_basename)) < 0) {
-#else
-    if((playqd = astrid_playq_open(instrument_basename)) == (mqd_t) -1) {
-#endif
-        syslog(LOG_CRIT, "Could not open playq for instrument %s. Error: %s\n", instrument_basename, strerror(errno));
-        goto lprender_cleanup;
-    }
+    syslog(LOG_INFO, "Astrid renderer worker %d of %d... is now rendering!\n", worker_index, pool->numworkers);
 
+    /* Forwarded messages come first, then the shared play queue */
+    fds[0].fd = workerq->readfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = (int)playqd;
+    fds[1].events = POLLIN;
+    nfds = (pool->numworkers > 1) ? 2 : 1;
 
-    syslog(LOG_DEBUG, "Opened play queue for %s with fd %d\n", instrument_basename, playqd);
+    /* Start rendering! */
+    while(astrid_is_running && atomic_load(&pool->is_running)) {
+        if(reload_if_stale(&reload_generation) < 0) goto lpworker_cleanup;
 
-    memcpy(msg.instrument_name, instrument_basename, instrument_name_length);
+        syslog(LOG_DEBUG, "Waiting for %s playqueue messages...\n", instrument_basename);
+        syslog(LOG_DEBUG, "            %d (ctx.voice_id)\n", (int)ctx->voice_id);
+        if(poll(&fds[2 - nfds], nfds, -1) < 0) {
+            if(errno == EINTR) continue;
+            syslog(LOG_ERR, "%s renderer: Could not poll playq. Error: (%d) %s\n", instrument_basename, errno, strerror(errno));
+            goto lpworker_cleanup;
+        }
 
-    /* Start rendering! */
-    while(astrid_is_running) {
         msg.onset_delay = 0;
         memset(msg.msg, 0, LPMAXMSG);
 
-        syslog(LOG_DEBUG, "Waiting for %s playqueue messages...\n", instrument_basename);
-        syslog(LOG_DEBUG, "            %d (ctx.voice_id)\n", (int)ctx->voice_id);
-#ifdef ASTRID_USE_FIFO_QUEUES
-        if(astrid_playq_read(playqd, &msg) < 0) {
-#else
-        if(astrid_playq_read(playqd, &msg) == (mqd_t) -1) {
-#endif
+        from_workerq = (nfds == 2 && fds[0].revents & POLLIN);
+        if(from_workerq) {
+            if(astrid_workerq_read(workerq, &msg) < 0) continue;
+        } else if(astrid_playq_read(playqd, &msg) < 0) {
+            /* Another worker took it */
+            if(errno == EAGAIN) continue;
             syslog(LOG_ERR, "%s renderer: Could not read message from playq. Error: (%d) %s\n", instrument_basename, errno, strerror(errno));
-            goto lprender_cleanup;
+            goto lpworker_cleanup;
         }
+        start = now_nsec();
 
         syslog(LOG_DEBUG, "Renderer got %s message:\n", msg.instrument_name);
         syslog(LOG_DEBUG, "             %d (msg.voice_id)\n", (int)msg.voice_id);
         syslog(LOG_DEBUG, "             %d (msg.type)\n", (int)msg.type);
 
+        /* Hand voices another worker owns back to it. If its queue
+         * is full, render here rather than wait on a busy worker. */
+        if(!from_workerq && pool->numworkers > 1 && (msg.type == LPMSG_PLAY || msg.type == LPMSG_TRIGGER)) {
+            owner = claim_voice(msg.voice_id, worker_index);
+            if(owner != worker_index) {
+                if(astrid_workerq_send(&pool->workers[owner].q, &msg) == 0) {
+                    atomic_fetch_add(&pool->workers[worker_index].forwarded, 1);
+                    continue;
+                }
+                atomic_fetch_add(&pool->workers[worker_index].overflows, 1);
+            }
+        }
+
+        /* Pick up a reload another worker read before this message */
+        if(reload_if_stale(&reload_generation) < 0) goto lpworker_cleanup;
+
         switch(msg.type) {
             case LPMSG_PLAY:
                 if(astrid_schedule_python_render(&msg) < 0) {
                     PyErr_Print();
                     syslog(LOG_ERR, "CPython error during renderer loop\n");
-                    goto lprender_cleanup;
+                    goto lpworker_cleanup;
                 }
+                record_latency(worker_index, now_nsec() - start);
                 break;
 
             case LPMSG_LOAD:
-                if(astrid_reload_instrument(instrument_fullpath) < 0) {
-                    PyErr_Print();
-                    syslog(LOG_ERR, "Error while attempting to load astrid instrument\n");
-                    goto lprender_cleanup;
-                }
+                /* Whoever reads the load from the play queue bumps the
+                 * generation, and every worker reloads before it renders
+                 * again. The broadcast only wakes idle workers so they
+                 * reload now instead of on their next voice. */
+                if(from_workerq) break;
+                atomic_fetch_add(&pool->reload_generation, 1);
+                if(reload_if_stale(&reload_generation) < 0) goto lpworker_cleanup;
+                broadcast(&msg);
                 break;
 
             case LPMSG_TRIGGER:
                 if(astrid_schedule_python_triggers(&msg) < 0) {
                     PyErr_Print();
                     syslog(LOG_ERR, "CPython error during trigger planning loop\n");
-                    goto lprender_cleanup;
+                    goto lpworker_cleanup;
                 }
+                record_latency(worker_index, now_nsec() - start);
                 break;
 
             case LPMSG_SHUTDOWN:
-                astrid_is_running = 0;
+                atomic_store(&pool->is_running, 0);
+                if(!from_workerq) broadcast(&msg);
                 break;
 
             default:
@@ -205,16 +266,219 @@ int main(int argc, char * argv[]) {
         /* astrid_begin_python_stream(&msg) */
     }
 
+lpworker_cleanup:
+    syslog(LOG_INFO, "Astrid renderer worker %d shutting down...\n", worker_index);
+    log_worker_stats(worker_index);
+    Py_Finalize();
+    LPMemoryPool.free(ctx);
+    return 0;
+}
+
+/* Free any slab blocks a worker was still writing into 
+ * when it exited, so a crashed render doesn't leak them */
+static void reclaim_worker_blocks(int index, pid_t pid) {
+    lpslab_t slab;
+    size_t freed;
+
+    if(lpslab_open(&slab) < 0) return;
+
+    freed = lpslab_reclaim(&slab, pid);
+    if(freed > 0) {
+        syslog(LOG_WARNING, "%s renderer worker %d left %ld slab blocks behind, reclaimed them\n", instrument_basename, index, freed);
+    }
+
+    lpslab_close(&slab);
+}
+
+#ifdef ASTRID_USE_FIFO_QUEUES
+static pid_t start_worker(int index, int playqd, wchar_t * python_path) {
+#else
+static pid_t start_worker(int index, mqd_t playqd, wchar_t * python_path) {
+#endif
+    pid_t pid;
+
+    if((pid = fork()) < 0) {
+        syslog(LOG_ERR, "Could not fork renderer worker %d. Error: %s\n", index, strerror(errno));
+        return -1;
+    }
+
+    if(pid == 0) {
+        worker_index = index;
+        exit(render_worker(playqd, python_path));
+    }
+
+    pool->workers[index].pid = pid;
+    return pid;
+}
+
+int main(int argc, char * argv[]) {
+    struct sigaction shutdown_action;
+
+    char * _instrument_fullpath;
+    char * _instrument_basename;
+    size_t instrument_name_length;
+    char * astrid_pythonpath_env;
+    size_t astrid_pythonpath_length;
+    wchar_t * python_path;
+
+    char * _astrid_channels;
+    char * _astrid_render_workers;
+    int numworkers, numworkers_alive, status, i;
+    lprenderpool_t * _pool;
+    pid_t pid;
+
+    if(argc != 3 && argc != 4) {
+        syslog(LOG_ERR, "Error: invalid number of arguments to astrid renderer\n");
+        exit(1);
+    }
+
+    openlog("astrid-renderer", LOG_PID, LOG_USER);
+
+#ifdef ASTRID_USE_FIFO_QUEUES
+    int playqd = -1;
+#else
+    mqd_t playqd = -1;
+#endif
+
+    syslog(LOG_INFO, "Starting renderer...\n");
+
+    /* Setup sigint handler for graceful shutdown */
+    shutdown_action.sa_handler = handle_shutdown;
+    sigemptyset(&shutdown_action.sa_mask);
+    shutdown_action.sa_flags = SA_RESTART; /* Prevent open, read, write etc from EINTR */
+
+    if(sigaction(SIGINT, &shutdown_action, NULL) == -1) {
+        syslog(LOG_ERR, "Could not init SIGINT signal handler.\n");
+        exit(1);
+    }
+
+    if(sigaction(SIGTERM, &shutdown_action, NULL) == -1) {
+        syslog(LOG_ERR, "Could not init SIGTERM signal handler.\n");
+        exit(1);
+    }
+
+    /* Get python path from env */
+    astrid_pythonpath_env = getenv("ASTRID_PYTHONPATH");
+    astrid_pythonpath_length = mbstowcs(NULL, astrid_pythonpath_env, 0);
+    python_path = calloc(astrid_pythonpath_length+1, sizeof(*python_path));
+    if(python_path == NULL) {
+        syslog(LOG_ERR, "Error: could not allocate memory for wide char path\n");
+        exit(1);
+    }
+
+    if(mbstowcs(python_path, astrid_pythonpath_env, astrid_pythonpath_length) == (size_t) -1) {
+        syslog(LOG_ERR, "Error: Could not convert path to wchar_t\n");
+        exit(1);
+    }
+
+    /* Set channels from env */
+    _astrid_channels = getenv("ASTRID_CHANNELS");
+    if(_astrid_channels != NULL) {
+        astrid_channels = atoi(_astrid_channels);
+    }
+    astrid_channels = 2;
+
+    /* Set the number of workers from the optional
+     * third argument, or else from env */
+    numworkers = 1;
+    _astrid_render_workers = (argc == 4) ? argv[3] : getenv("ASTRID_RENDER_WORKERS");
+    if(_astrid_render_workers != NULL) {
+        numworkers = atoi(_astrid_render_workers);
+    }
+    numworkers = (numworkers < 1) ? 1 : (numworkers > ASTRID_MAX_RENDER_WORKERS) ? ASTRID_MAX_RENDER_WORKERS : numworkers;
+
+    _instrument_fullpath = argv[1];
+    _instrument_basename = argv[2];
+    instrument_name_length = strlen(_instrument_basename);
+    instrument_fullpath = calloc(strlen(_instrument_fullpath)+1, sizeof(char));
+    instrument_basename = calloc(instrument_name_length+1, sizeof(char));
+    strcpy(instrument_fullpath, _instrument_fullpath);
+    strcpy(instrument_basename, _instrument_basename);
+
+    /* Map the pool before forking so the workers share it */
+    pool = (lprenderpool_t *)mmap(NULL, sizeof(lprenderpool_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(pool == MAP_FAILED) {
+        syslog(LOG_ERR, "Could not map renderer pool. Error: %s\n", strerror(errno));
+        pool = NULL;
+        exit(1);
+    }
+
+    pool->numworkers = numworkers;
+    atomic_store(&pool->is_running, 1);
+    for(i=0; i < numworkers; i++) {
+        pool->workers[i].q.readfd = pool->workers[i].q.writefd = -1;
+        if(numworkers > 1 && astrid_workerq_create(instrument_basename, i, &pool->workers[i].q) < 0) {
+            goto lprender_cleanup;
+        }
+    }
+
+#ifdef ASTRID_USE_FIFO_QUEUES
+    if((playqd = astrid_playq_open(instrument_basename)) < 0) {
+#else
+    if((playqd = astrid_playq_open(instrument_basename)) == (mqd_t) -1) {
+#endif
+        syslog(LOG_CRIT, "Could not open playq for instrument %s. Error: %s\n", instrument_basename, strerror(errno));
+        goto lprender_cleanup;
+    }
+
+    /* Every worker polls the same play queue, and the ones
+     * that lose the race for a message must not block */
+    if(numworkers > 1 && astrid_playq_set_nonblocking(playqd) < 0) {
+        goto lprender_cleanup;
+    }
+
+    syslog(LOG_DEBUG, "Opened play queue for %s with fd %d\n", instrument_basename, playqd);
+
+    if(numworkers == 1) {
+        worker_index = 0;
+        render_worker(playqd, python_path);
+        goto lprender_cleanup;
+    }
+
+    syslog(LOG_INFO, "Starting %d renderer workers for %s\n", numworkers, instrument_basename);
+    numworkers_alive = numworkers;
+    for(i=0; i < numworkers; i++) {
+        if(start_worker(i, playqd, python_path) < 0) {
+            handle_shutdown(SIGTERM);
+            break;
+        }
+    }
+
+    /* Restart any worker that crashes while the pool is still
+     * running. One that exits on its own has already logged why,
+     * and would most likely fail the same way again. */
+    while((pid = wait(&status)) > 0 || errno == EINTR) {
+        if(pid <= 0) continue;
+
+        for(i=0; i < numworkers; i++) {
+            if(pool->workers[i].pid != pid) continue;
+            pool->workers[i].pid = 0;
+            reclaim_worker_blocks(i, pid);
+
+            if(WIFSIGNALED(status) && astrid_is_running && atomic_load(&pool->is_running)) {
+                syslog(LOG_ERR, "%s renderer worker %d was killed by signal %d, restarting it\n", instrument_basename, i, WTERMSIG(status));
+                start_worker(i, playqd, python_path);
+            } else if(astrid_is_running && atomic_load(&pool->is_running)) {
+                syslog(LOG_ERR, "%s renderer worker %d exited, %d workers left\n", instrument_basename, i, --numworkers_alive);
+            }
+        }
+    }
+
 lprender_cleanup:
     syslog(LOG_INFO, "Astrid renderer shutting down...\n");
-    Py_Finalize();
 #ifdef ASTRID_USE_FIFO_QUEUES
     if(playqd != -1) astrid_playq_close(playqd);
 #else
     if(playqd != (mqd_t) -1) astrid_playq_close(playqd);
 #endif
+    for(i=0; i < numworkers; i++) {
+        if(numworkers > 1) log_worker_stats(i);
+        astrid_workerq_destroy(&pool->workers[i].q);
+    }
+    _pool = pool;
+    pool = NULL;
+    munmap(_pool, sizeof(lprenderpool_t));
+    free(python_path);
     closelog();
     return 0;
 }
-
-
@@ -1,3 +1,10 @@
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#endif
+
 #include "astrid.h"
 #include "pqueue.h"
 
@@ -5,6 +12,117 @@
 static volatile int astrid_is_running = 1;
 pqueue_t * msgpq;
 
+/* The message feed and the scheduler thread both 
+ * touch the priority queue, so it is guarded by a lock */
+pthread_mutex_t msgpq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The scheduler thread sleeps until the timestamp of the 
+ * message at the head of the queue, and the feed wakes it 
+ * early when a new message takes over the head. On Linux 
+ * the wakeup is an eventfd and the sleep is a timerfd, 
+ * elsewhere a pipe and the poll timeout. */
+static int wake_readfd = -1;
+static int wake_writefd = -1;
+#if defined(__linux__)
+static int timerfd = -1;
+#endif
+
+static int seq_wait_create() {
+#if defined(__linux__)
+    if((wake_readfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        syslog(LOG_ERR, "seq_wait_create eventfd. Error: %s\n", strerror(errno));
+        return -1;
+    }
+    wake_writefd = wake_readfd;
+
+    if((timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        syslog(LOG_ERR, "seq_wait_create timerfd_create. Error: %s\n", strerror(errno));
+        return -1;
+    }
+#else
+    int fds[2];
+
+    if(pipe(fds) < 0) {
+        syslog(LOG_ERR, "seq_wait_create pipe. Error: %s\n", strerror(errno));
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    wake_readfd = fds[0];
+    wake_writefd = fds[1];
+#endif
+
+    return 0;
+}
+
+/* Wake the scheduler thread to look at the head of the queue again */
+static void seq_wake() {
+    uint64_t one = 1;
+
+    if(wake_writefd < 0) return;
+    if(write(wake_writefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        syslog(LOG_ERR, "seq_wake write. Error: %s\n", strerror(errno));
+    }
+}
+
+/* Sleep until the given timestamp (in the clock of 
+ * lpscheduler_get_now_seconds) or until woken. A 
+ * negative timestamp sleeps until woken. */
+static void seq_wait_until(double timestamp) {
+    struct pollfd fds[2];
+    uint64_t count;
+    double now, delay;
+    int nfds, timeout;
+
+    fds[0].fd = wake_readfd;
+    fds[0].events = POLLIN;
+    nfds = 1;
+    timeout = -1;
+
+    if(timestamp >= 0) {
+        lpscheduler_get_now_seconds(&now);
+        delay = timestamp - now;
+        if(delay <= 0) return;
+
+#if defined(__linux__)
+        /* Timers can't run on the raw monotonic clock the 
+         * timestamps use, so arm an absolute CLOCK_MONOTONIC 
+         * timer the same distance away. Any drift between 
+         * the clocks over one wait is far below a microsecond. */
+        struct itimerspec its = {0};
+        clock_gettime(CLOCK_MONOTONIC, &its.it_value);
+        its.it_value.tv_sec += (time_t)delay;
+        its.it_value.tv_nsec += (long)((delay - (time_t)delay) * 1e9);
+        if(its.it_value.tv_nsec >= 1000000000) {
+            its.it_value.tv_sec += 1;
+            its.it_value.tv_nsec -= 1000000000;
+        }
+
+        if(timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+            syslog(LOG_ERR, "seq_wait_until timerfd_settime. Error: %s\n", strerror(errno));
+            return;
+        }
+
+        fds[1].fd = timerfd;
+        fds[1].events = POLLIN;
+        nfds = 2;
+#else
+        timeout = (int)(delay * 1000) + 1;
+#endif
+    }
+
+    if(poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+        syslog(LOG_ERR, "seq_wait_until poll. Error: %s\n", strerror(errno));
+        return;
+    }
+
+    /* Drain the wakeups and timer expirations */
+    while(read(wake_readfd, &count, sizeof(count)) > 0);
+#if defined(__linux__)
+    if(nfds == 2) while(read(timerfd, &count, sizeof(count)) > 0);
+#endif
+}
+
 /* Callback for SIGINT */
 void handle_shutdown(int sig __attribute__((unused))) {
     lpmsg_t msg = {0};
@@ -18,9 +136,11 @@ void handle_shutdown(int sig __attribute__((unused))) {
     }
 }
 
-/* Message scheduler priority queue comparison callbacks */
+/* Message scheduler priority queue comparison callbacks: 
+ * libpqueue keeps the node it compares as lower at the 
+ * bottom, so the earliest timestamp sits at the head */
 static int msgpq_cmp_pri(double next, double curr) {
-    return (next < curr);
+    return (next > curr);
 }
 
 static double msgpq_get_pri(void * a) {
@@ -39,63 +159,222 @@ static void msgpq_set_pos(void * a, size_t pos) {
     ((lpmsgpq_node_t *)a)->pos = pos;
 }
 
-int msgpq_remove_nodes_by_voice_id(size_t voice_id) {
+/* Queue nodes are carved out of chunks of ASTRID_SEQ_SLAB_CHUNK 
+ * nodes and recycled through a free list threaded on voice_next, 
+ * so the feed never callocs a message per event. Chunks are 
+ * only released at shutdown. Everything below is called with 
+ * msgpq_lock held. */
+typedef struct msgpq_chunk_t {
+    struct msgpq_chunk_t * next;
+    lpmsgpq_node_t nodes[ASTRID_SEQ_SLAB_CHUNK];
+} msgpq_chunk_t;
+
+static msgpq_chunk_t * msgpq_chunks = NULL;
+static lpmsgpq_node_t * msgpq_freelist = NULL;
+
+/* Hash chains of the queued nodes for each voice ID and instrument */
+static lpmsgpq_node_t * voice_index[ASTRID_SEQ_INDEX_BUCKETS];
+static lpmsgpq_node_t * instrument_index[ASTRID_SEQ_INDEX_BUCKETS];
+
+static lpmsgpq_node_t * msgpq_node_alloc() {
+    msgpq_chunk_t * chunk;
     lpmsgpq_node_t * node;
-    lpmsg_t * msg;
-    void * d;
     size_t i;
 
-    for(i=0; i < msgpq->size; i++) {
-        d = msgpq->d[i];                
-        if(d == NULL) {
-            syslog(LOG_DEBUG, "STOP: d[%d] is NULL\n", (int)i);
-            continue;
+    if(msgpq_freelist == NULL) {
+        if((chunk = (msgpq_chunk_t *)calloc(1, sizeof(msgpq_chunk_t))) == NULL) {
+            syslog(LOG_ERR, "msgpq_node_alloc: could not grow the node slab. Error: %s\n", strerror(errno));
+            return NULL;
         }
 
-        node = (lpmsgpq_node_t *)d;
-        msg = node->msg;
-        if(msg->voice_id == voice_id) {
-            syslog(LOG_DEBUG, "STOP: removing node & freeing memory for voice id %ld\n", voice_id);
-            pqueue_remove(msgpq, d);
-            free(msg);
-            free(node);
+        chunk->next = msgpq_chunks;
+        msgpq_chunks = chunk;
+
+        for(i=0; i < ASTRID_SEQ_SLAB_CHUNK; i++) {
+            chunk->nodes[i].voice_next = msgpq_freelist;
+            msgpq_freelist = &chunk->nodes[i];
         }
     }
 
-    syslog(LOG_DEBUG, "STOP: msgpq size AFTER: %d\n", (int)msgpq->size);
+    node = msgpq_freelist;
+    msgpq_freelist = node->voice_next;
+    node->voice_next = NULL;
+    return node;
+}
+
+static void msgpq_node_free(lpmsgpq_node_t * node) {
+    node->voice_prev = NULL;
+    node->instrument_prev = NULL;
+    node->instrument_next = NULL;
+    node->voice_next = msgpq_freelist;
+    msgpq_freelist = node;
+}
+
+static void msgpq_slab_destroy() {
+    msgpq_chunk_t * chunk;
+
+    while(msgpq_chunks != NULL) {
+        chunk = msgpq_chunks;
+        msgpq_chunks = chunk->next;
+        free(chunk);
+    }
+
+    msgpq_freelist = NULL;
+}
+
+static size_t msgpq_voice_bucket(size_t voice_id) {
+    return voice_id % ASTRID_SEQ_INDEX_BUCKETS;
+}
+
+/* FNV-1a over the instrument name */
+static size_t msgpq_instrument_bucket(const char * name) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for(i=0; i < LPMAXNAME && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash % ASTRID_SEQ_INDEX_BUCKETS;
+}
+
+/* Copy a message into a new node, push it onto the 
+ * heap and link it into both indexes */
+static lpmsgpq_node_t * msgpq_add(lpmsg_t * msg) {
+    lpmsgpq_node_t * node, ** head;
+
+    if((node = msgpq_node_alloc()) == NULL) return NULL;
+
+    memcpy(&node->msg, msg, sizeof(lpmsg_t));
+    node->timestamp = msg->timestamp;
+
+    if(pqueue_insert(msgpq, (void *)node) < 0) {
+        msgpq_node_free(node);
+        return NULL;
+    }
+
+    head = &voice_index[msgpq_voice_bucket(node->msg.voice_id)];
+    node->voice_prev = NULL;
+    node->voice_next = *head;
+    if(*head != NULL) (*head)->voice_prev = node;
+    *head = node;
+
+    node->instrument_bucket = msgpq_instrument_bucket(node->msg.instrument_name);
+    head = &instrument_index[node->instrument_bucket];
+    node->instrument_prev = NULL;
+    node->instrument_next = *head;
+    if(*head != NULL) (*head)->instrument_prev = node;
+    *head = node;
+
+    return node;
+}
+
+/* Take a node off the heap, unlink it from both 
+ * indexes and return it to the slab */
+static void msgpq_remove(lpmsgpq_node_t * node) {
+    if(pqueue_remove(msgpq, (void *)node) < 0) {
+        syslog(LOG_ERR, "pqueue_remove: problem removing message from the pq\n");
+    }
+
+    if(node->voice_prev != NULL) {
+        node->voice_prev->voice_next = node->voice_next;
+    } else {
+        voice_index[msgpq_voice_bucket(node->msg.voice_id)] = node->voice_next;
+    }
+    if(node->voice_next != NULL) node->voice_next->voice_prev = node->voice_prev;
+
+    if(node->instrument_prev != NULL) {
+        node->instrument_prev->instrument_next = node->instrument_next;
+    } else {
+        instrument_index[node->instrument_bucket] = node->instrument_next;
+    }
+    if(node->instrument_next != NULL) node->instrument_next->instrument_prev = node->instrument_prev;
+
+    msgpq_node_free(node);
+}
+
+int msgpq_remove_nodes_by_voice_id(size_t voice_id) {
+    lpmsgpq_node_t * node, * next;
+    size_t count = 0;
+
+    node = voice_index[msgpq_voice_bucket(voice_id)];
+    while(node != NULL) {
+        next = node->voice_next;
+        if(node->msg.voice_id == voice_id) {
+            msgpq_remove(node);
+            count += 1;
+        }
+        node = next;
+    }
+
+    syslog(LOG_DEBUG, "STOP: removed %d nodes for voice id %ld, msgpq size AFTER: %d\n", (int)count, voice_id, (int)msgpq->size);
+
+    return 0;
+}
+
+int msgpq_remove_nodes_by_instrument(const char * instrument_name) {
+    lpmsgpq_node_t * node, * next;
+    size_t count = 0;
+
+    node = instrument_index[msgpq_instrument_bucket(instrument_name)];
+    while(node != NULL) {
+        next = node->instrument_next;
+        if(strncmp(node->msg.instrument_name, instrument_name, LPMAXNAME) == 0) {
+            msgpq_remove(node);
+            count += 1;
+        }
+        node = next;
+    }
+
+    syslog(LOG_DEBUG, "STOP: removed %d nodes for instrument %s, msgpq size AFTER: %d\n", (int)count, instrument_name, (int)msgpq->size);
 
     return 0;
 }
 
 /* Message scheduler priority queue thread handler */
 void * message_scheduler_pq(__attribute__((unused)) void * arg) {
+    lpjitterhist_t jitter = {0};
     lpmsg_t * msg;
+    lpmsg_t out;
     lpmsgpq_node_t * node;
+    char instrument_name[LPMAXNAME];
     void * d;
-    double now;
+    double now, timestamp;
 
     now = 0;
     syslog(LOG_DEBUG, " MPQ           STARTING\n");
 
+#if defined(__linux__)
+    /* Ask for timer wakeups without the default 50us of slack */
+    if(prctl(PR_SET_TIMERSLACK, 1UL) < 0) {
+        syslog(LOG_WARNING, "Could not set timer slack for the message scheduler. Error: %s\n", strerror(errno));
+    }
+#endif
+
     d = NULL;
     msg = NULL;
     node = NULL;
 
     while(astrid_is_running) {
+        pthread_mutex_lock(&msgpq_lock);
+
         /* peek into the queue */
         d = pqueue_peek(msgpq);
 
-        /* No messages have arrived */
+        /* No messages have arrived: sleep until one does */
         if(d == NULL) {
-            usleep((useconds_t)500);
+            pthread_mutex_unlock(&msgpq_lock);
+            seq_wait_until(-1);
             continue;
         }
 
         /* There is a message! */
         node = (lpmsgpq_node_t *)d;
-        msg = node->msg;
+        msg = &node->msg;
 
         if(msg->type == LPMSG_SHUTDOWN) {
+            pthread_mutex_unlock(&msgpq_lock);
             break;
         }
 
@@ -109,52 +388,69 @@ void * message_scheduler_pq(__attribute__((unused)) void * arg) {
         if(msg->type == LPMSG_STOP_VOICE) {
             if(msgpq_remove_nodes_by_voice_id(msg->voice_id) < 0) {
                 syslog(LOG_ERR, "Error removing voice %ld nodes from priority queue\n", msg->voice_id);
-                usleep((useconds_t)500);
-                continue;
+            } else {
+                syslog(LOG_INFO, "Got STOP_VOICE message... removed voice %ld nodes from pq\n", msg->voice_id);
             }
-
-            syslog(LOG_INFO, "Got STOP_VOICE message... removed voice %ld nodes from pq\n", msg->voice_id);
+            pthread_mutex_unlock(&msgpq_lock);
+            msg = NULL;
+            node = NULL;
             continue;
         }
 
         /* If this is a STOP_INSTRUMENT message, find all instrument events and remove them */
         if(msg->type == LPMSG_STOP_INSTRUMENT) {
-            syslog(LOG_INFO, "Got STOP_INSTRUMENT message... ignoring it\n");
+            memcpy(instrument_name, msg->instrument_name, LPMAXNAME);
+            if(msgpq_remove_nodes_by_instrument(instrument_name) < 0) {
+                syslog(LOG_ERR, "Error removing instrument %.*s nodes from priority queue\n", LPMAXNAME, instrument_name);
+            } else {
+                syslog(LOG_INFO, "Got STOP_INSTRUMENT message... removed instrument %.*s nodes from pq\n", LPMAXNAME, instrument_name);
+            }
+            pthread_mutex_unlock(&msgpq_lock);
+            msg = NULL;
+            node = NULL;
             continue;
         }
 
-        /* If msg timestamp is in the future, 
-         * sleep for a bit and then try again */
+        /* If msg timestamp is in the future, sleep until it 
+         * comes due or an earlier message arrives */
         if(msg->timestamp > now) {
-            usleep((useconds_t)500);
+            timestamp = msg->timestamp;
+            pthread_mutex_unlock(&msgpq_lock);
+            msg = NULL;
+            node = NULL;
+            seq_wait_until(timestamp);
             continue;
         }
 
+        /* Copy it out and take it off the pq before sending, 
+         * so the feed isn't held up while the send blocks */
+        memcpy(&out, msg, sizeof(lpmsg_t));
+        msgpq_remove(node);
+        pthread_mutex_unlock(&msgpq_lock);
+        msg = NULL;
+        node = NULL;
+
+        lpjitterhist_add(&jitter, now - out.timestamp);
+
         /* Send it along to the instrument message fifo */
-        if(send_play_message(*msg) < 0) {
+        if(send_play_message(out) < 0) {
             syslog(LOG_ERR, "Error sending play message from message priority queue\n");
-            usleep((useconds_t)500);
-            continue;
         }
 
-        /* And remove it from the pq */
-        if(pqueue_remove(msgpq, d) < 0) {
-            syslog(LOG_ERR, "pqueue_remove: problem removing message from the pq\n");
-            usleep((useconds_t)500);
+        if(jitter.count % ASTRID_SEQ_STATS_INTERVAL == 0) {
+            lpjitterhist_log(&jitter, "Message scheduler");
         }
-
-        /* TODO do this somewhere else maybe? */
-        free(msg);
-        free(node);
-        msg = NULL;
-        node = NULL;
     }
 
     syslog(LOG_INFO, "Message scheduler pq thread shutting down...\n");
-    /* Clean up the pq: TODO, check for orphan messages? */
+    lpjitterhist_log(&jitter, "Message scheduler");
+
+    /* Clean up the pq: the nodes still queued belong to the slab */
+    pthread_mutex_lock(&msgpq_lock);
     pqueue_free(msgpq);
-    if(msg != NULL) free(msg);
-    if(node != NULL) free(node);
+    msgpq = NULL;
+    msgpq_slab_destroy();
+    pthread_mutex_unlock(&msgpq_lock);
     return 0;
 }
 
@@ -165,7 +461,6 @@ void * message_feed(__attribute__((unused)) void * arg) {
     mqd_t qd;
 #endif
     lpmsg_t msg = {0};
-    lpmsg_t * msgout;
     lpmsgpq_node_t * d;
 
 #ifdef ASTRID_USE_FIFO_QUEUES
@@ -186,19 +481,20 @@ void * message_feed(__attribute__((unused)) void * arg) {
             continue;
         }
 
-        d = (lpmsgpq_node_t *)calloc(1, sizeof(lpmsgpq_node_t));
-        msgout = (lpmsg_t *)calloc(1, sizeof(lpmsg_t));
-        memcpy(msgout, &msg, sizeof(lpmsg_t));
-        d->msg = msgout;
-        d->timestamp = msg.timestamp;
-
         syslog(LOG_DEBUG, "lpmsg_t relay: Inserting message into pq for scheduling\n");
 
-        if(pqueue_insert(msgpq, (void *)d) < 0) {
+        pthread_mutex_lock(&msgpq_lock);
+        if(msgpq == NULL || (d = msgpq_add(&msg)) == NULL) {
+            pthread_mutex_unlock(&msgpq_lock);
             syslog(LOG_ERR, "Error while inserting message into pq during msgq loop: %s\n", strerror(errno));
             continue;
         }
 
+        /* Wake the scheduler if this message is now the 
+         * next one due, so it can sleep until it instead */
+        if(pqueue_peek(msgpq) == (void *)d) seq_wake();
+        pthread_mutex_unlock(&msgpq_lock);
+
         syslog(LOG_DEBUG, "lpmsg_t relay: msg.type %d\n", msg.type);
 
         /* Exit the loop on shutdown message after sending 
@@ -219,6 +515,7 @@ void * message_feed(__attribute__((unused)) void * arg) {
 
 int cleanup(pthread_t message_feed_thread, pthread_t message_scheduler_pq_thread) {
     astrid_is_running = 0;
+    seq_wake();
 
     syslog(LOG_DEBUG, "Joining with message thread...\n");
     if(pthread_join(message_feed_thread, NULL) != 0) {
@@ -279,6 +576,12 @@ int main() {
         }
     }
 
+    /* Set up the scheduler thread's sleep and wakeup */
+    if(seq_wait_create() < 0) {
+        syslog(LOG_ERR, "Could not initialize message scheduler wakeups\n");
+        goto exit_with_error;
+    }
+
     /* Create the message priority queue */
     if((msgpq = pqueue_init(100, msgpq_cmp_pri, msgpq_get_pri, msgpq_set_pri, msgpq_get_pos, msgpq_set_pos)) == NULL) {
         syslog(LOG_ERR, "Could not initialize message priority queue. Error: %s\n", strerror(errno));
@@ -0,0 +1,47 @@
+#include "astrid.h"
+
+/* Send a parameter change to a playing voice.
+ *
+ * Usage: astrid-setparam <voice_id> <gain|pan|cutoff> <value> [delay seconds]
+ */
+int main(int argc, char * argv[]) {
+    lpparamstream_t ps;
+    lpparam_t param = {0};
+    double now;
+    int type;
+
+    if(argc < 4) {
+        fprintf(stderr, "Usage: %s <voice_id> <gain|pan|cutoff> <value> [delay seconds]\n", argv[0]);
+        return 1;
+    }
+
+    if((type = lpparam_type_from_name(argv[2])) < 0) {
+        fprintf(stderr, "Unknown parameter %s\n", argv[2]);
+        return 1;
+    }
+
+    if(lpscheduler_get_now_seconds(&now) < 0) {
+        fprintf(stderr, "Could not get now seconds\n");
+        return 1;
+    }
+
+    param.voice_id = (size_t)atol(argv[1]);
+    param.type = (uint32_t)type;
+    param.value = (lpfloat_t)atof(argv[3]);
+    param.timestamp = now + ((argc > 4) ? atof(argv[4]) : 0);
+
+    if(lpparamstream_open(&ps) < 0) {
+        fprintf(stderr, "Could not open the parameter streams. Is the DAC running?\n");
+        return 1;
+    }
+
+    if(lpparamstream_push(&ps, param) < 0) {
+        fprintf(stderr, "Could not queue parameter change for voice %ld\n", param.voice_id);
+        lpparamstream_close(&ps);
+        return 1;
+    }
+
+    lpparamstream_close(&ps);
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+""" Times fft.process against fft.stft for the same 
+    spectral lowpass over a long sound. process() runs 
+    the callback on SoundBuffers once per block, stft() 
+    on batches of frames in numpy arrays.
+
+    Run with `python benchmarks/fft_stft.py [seconds]`
+"""
+import sys
+import timeit
+
+from pippi import dsp, fft, fx
+
+SECONDS = float(sys.argv[1]) if len(sys.argv) > 1 else 60
+SND = dsp.read('tests/sounds/guitar10s.wav')
+SND = dsp.join([SND] * int(SECONDS / SND.dur + 1)).cut(0, SECONDS)
+
+def process_lowpass(pos, real, imag):
+    mag, arg = fft.to_polar(real, imag)
+    mag = fx.lpf(mag, 1000)
+    return fft.to_xy(mag, arg)
+
+def stft_lowpass(pos, real, imag):
+    real[:,:,40:] = 0
+    imag[:,:,40:] = 0
+
+if __name__ == '__main__':
+    print('%0.1fs of %d channel audio\n' % (SND.dur, SND.channels))
+
+    elapsed = timeit.timeit(lambda: fft.process(SND, 0.04, callback=process_lowpass), number=1)
+    print('process, 40ms blocks:     %8.3f sec' % elapsed)
+
+    elapsed = timeit.timeit(lambda: fft.stft(SND, 2048), number=1)
+    print('stft 2048, no callback:   %8.3f sec' % elapsed)
+
+    for batchsize in (1, 16, 256):
+        elapsed = timeit.timeit(lambda: fft.stft(SND, 2048, callback=stft_lowpass, batchsize=batchsize), number=1)
+        print('stft 2048, batch of %-4d %8.3f sec' % (batchsize, elapsed))
@@ -0,0 +1,31 @@
+""" Times multiband.split and customsplit as the number of worker 
+    threads grows, and the cost of following moving band edges at 
+    different control block sizes.
+
+    Run with `python benchmarks/multiband_split.py`
+"""
+import os
+import timeit
+
+from pippi import dsp, multiband
+
+SND = dsp.read('tests/sounds/guitar10s.wav')
+
+if __name__ == '__main__':
+    print('split() into 3 semitone bands, %0.1fs of %d channel audio\n' % (SND.dur, SND.channels))
+
+    workers = 1
+    serial = None
+    while workers <= (os.cpu_count() or 1):
+        elapsed = timeit.timeit(lambda: multiband.split(SND, 3, workers=workers), number=1)
+        serial = serial or elapsed
+        print('%3d workers %8.3f sec  %5.2fx' % (workers, elapsed, serial / elapsed))
+        workers *= 2
+
+    # Band edges which sweep over the length of the sound
+    freqs = [ dsp.win('sine', f * 0.5, f * 1.5) for f in (200, 800, 3200) ]
+
+    print('\ncustomsplit() with moving band edges\n')
+    for blocksize in (1, 16, 64, 256):
+        elapsed = timeit.timeit(lambda: multiband.customsplit(SND, freqs, blocksize=blocksize), number=1)
+        print('blocksize %-4d %8.3f sec' % (blocksize, elapsed))
@@ -0,0 +1,86 @@
+""" Times the SoundDB nearest neighbour index against a full
+    table scan with the distance math done in python, on a
+    database of 100k synthetic sounds.
+
+    Run with `python benchmarks/sounddb_index.py [entries]`
+"""
+import math
+import sqlite3
+import sys
+import tempfile
+import timeit
+
+import numpy as np
+
+from pippi.sounddb import SoundDB, SOUND_COLUMNS, INDEX_DIMS
+
+ENTRIES = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+QUERIES = 100
+K = 50
+TARGET_DIMS = ('centroid_avg', 'flatness_avg', 'rolloff_avg')
+
+def synthetic_rows(rng, start, count):
+    # Clumps of similar sounds, like takes of the same source
+    clumps = rng.normal(0, 1, (64, len(INDEX_DIMS)))
+    stats = clumps[rng.integers(0, len(clumps), count)] + rng.normal(0, 0.2, (count, len(INDEX_DIMS)))
+    stats[:,INDEX_DIMS.index('centroid_avg')] = 2000 + stats[:,INDEX_DIMS.index('centroid_avg')] * 800
+    stats[:,INDEX_DIMS.index('flatness_avg')] = np.abs(stats[:,INDEX_DIMS.index('flatness_avg')]) * 0.1
+
+    rows = []
+    for i in range(count):
+        values = dict(zip(INDEX_DIMS, stats[i]))
+        values.update(filename='sound%d.wav' % (start + i), offset=0, channels=2, samplerate=48000, frame_offset=0, numframes=0)
+        rows += [ tuple(float(values[c]) if c in INDEX_DIMS else values[c] for c in SOUND_COLUMNS) ]
+
+    return rows
+
+def insert(path, rows):
+    db = sqlite3.connect(path)
+    with db:
+        db.executemany("INSERT INTO sounds (%s) VALUES (%s)" % (', '.join(SOUND_COLUMNS), ', '.join(['?']*len(SOUND_COLUMNS))), rows)
+    db.close()
+
+def scan(db, target):
+    # The full table scan a query needed before the index
+    rows = db.queryall('SELECT id, filename, offset, %s FROM sounds' % ', '.join(target.keys()))
+    stds = [ np.std([ row[3+i] for row in rows ]) for i in range(len(target)) ]
+    out = []
+    for row in rows:
+        d = 0
+        for i, v in enumerate(target.values()):
+            d += ((row[3+i] - v) / stds[i])**2
+        out += [ (row[0], row[1], row[2], math.sqrt(d)) ]
+    out.sort(key=lambda r: r[3])
+    return out[:K]
+
+if __name__ == '__main__':
+    rng = np.random.default_rng(1)
+
+    with tempfile.TemporaryDirectory() as dbpath:
+        SoundDB(dbname='bench', dbpath=dbpath)
+        insert('%s/bench' % dbpath, synthetic_rows(rng, 0, ENTRIES))
+        db = SoundDB(dbname='bench', dbpath=dbpath)
+
+        targets = [ { d: float(v) for d, v in zip(TARGET_DIMS, row) } for row in np.stack([
+            rng.normal(2000, 800, QUERIES),
+            np.abs(rng.normal(0, 0.1, QUERIES)),
+            rng.normal(0, 1, QUERIES),
+        ], 1) ]
+
+        print('%d sounds, %d queries for the %d nearest on %s\n' % (ENTRIES, QUERIES, K, ', '.join(TARGET_DIMS)))
+        print('build index: %0.3f sec' % timeit.timeit(lambda: db.build_index(), number=1))
+
+        elapsed = timeit.timeit(lambda: scan(db, targets[0]), number=1)
+        print('full scan:   %8.3f ms per query' % (elapsed * 1000))
+
+        exact = [ set(r[0] for r in db.nearest(t, K, nprobe=ENTRIES)) for t in targets ]
+        for nprobe in (1, 4, 8, 16, 32, ENTRIES):
+            elapsed = timeit.timeit(lambda: [ db.nearest(t, K, nprobe=nprobe) for t in targets ], number=1)
+            recall = np.mean([ len(exact[i] & set(r[0] for r in db.nearest(t, K, nprobe=nprobe))) / K for i, t in enumerate(targets) ])
+            print('nprobe %-6s %8.3f ms per query, recall %0.3f' % ('all' if nprobe == ENTRIES else nprobe, elapsed / QUERIES * 1000, recall))
+
+        # New sounds are appended to the index when the db is next opened or written to
+        del db
+        insert('%s/bench' % dbpath, synthetic_rows(rng, ENTRIES, 1000))
+        elapsed = timeit.timeit(lambda: SoundDB(dbname='bench', dbpath=dbpath), number=1)
+        print('\nreopen and index 1000 new sounds: %0.3f sec' % elapsed)
@@ -16,6 +16,8 @@ int SR;
 lpphasorosc_t * osc1;
 lpphasorosc_t * osc2;
 lpfloat_t lpfy = 0.f;
+lpfloat_t block1[BS];
+lpfloat_t block2[BS];
 
 unsigned char DSY_SDRAM_BSS pool[POOLSIZE];
 
@@ -23,11 +25,15 @@ void callback(AudioHandle::InterleavingInputBuffer  in,
               AudioHandle::InterleavingOutputBuffer out,
               size_t                                size) {
     lpfloat_t outL, outR, sample;
+    size_t frames = size / 2;
     hw.ProcessAllControls();
 
+    LPPhasorOsc.process_block(osc1, block1, frames, NULL, NULL);
+    LPPhasorOsc.process_block(osc2, block2, frames, NULL, NULL);
+
     for(size_t i = 0; i < size; i += 2) {
-        sample = LPPhasorOsc.process(osc1) * 0.2;
-        sample += LPPhasorOsc.process(osc2) * 0.2;
+        sample = block1[i/2] * 0.2;
+        sample += block2[i/2] * 0.2;
 
         sample = LPFX.lpf1(sample * 0.5f, &lpfy, 80.f, SR);
 
@@ -41,6 +47,7 @@ void callback(AudioHandle::InterleavingInputBuffer  in,
 
 int main(void) {
     hw.Init();
+    hw.SetAudioBlockSize(BS);
     SR = (int)hw.AudioSampleRate();
 
     LPMemoryPool.init((unsigned char *)pool, POOLSIZE);
@@ -21,6 +21,8 @@ lptableosc_t * env;
 lpbuffer_t * win;
 lpbuffer_t * lfo;
 lpfloat_t lpfy = 0.f;
+lpfloat_t block1[BS];
+lpfloat_t block2[BS];
 
 // Hook me up to the logic input 
 // of a solenoid circuit... or something else.
@@ -33,6 +35,7 @@ void callback(AudioHandle::InterleavingInputBuffer  in,
               AudioHandle::InterleavingOutputBuffer out,
               size_t                                size) {
     lpfloat_t sample, amp;
+    size_t frames = size / 2;
 
     hw.ProcessAllControls();
 
@@ -42,9 +45,12 @@ void callback(AudioHandle::InterleavingInputBuffer  in,
     if(env->gate == 1) sole.Toggle();
     //sole.Write(env->gate == 1);
 
+    LPPhasorOsc.process_block(osc1, block1, frames, NULL, NULL);
+    LPPhasorOsc.process_block(osc2, block2, frames, NULL, NULL);
+
     for(size_t i = 0; i < size; i += 2) {
-        sample = LPPhasorOsc.process(osc1) * 0.2;
-        sample += LPPhasorOsc.process(osc2) * 0.2;
+        sample = block1[i/2] * 0.2;
+        sample += block2[i/2] * 0.2;
         sample = lpzapgremlins(LPFX.lpf1(sample * 0.5f, &lpfy, 80.f, SR));
         sample *= amp;
 
@@ -16,13 +16,14 @@ lpfloat_t logistic(lpfloat_t low, lpfloat_t high) {
 
 int main() {
     lpfloat_t freqdrift, minfreq, maxfreq, basefreq;
-    lpfloat_t a, ampdrift, sample, pos;
-    size_t i, c, p, length;
+    lpfloat_t ampdrift;
+    size_t i, p, length;
     lpbuffer_t * out;
 
     lpbuffer_t * freq[PARTIALS];
     lpbuffer_t * amp[PARTIALS];
-    lpsineosc_t * osc[PARTIALS];
+    lpfloat_t times[BS];
+    lposcbank_t * bank;
 
     /* LPRand is used internally for window selection.
      * Every call to LPWindow.create("rnd", BS) invokes 
@@ -38,6 +39,13 @@ int main() {
     length = 10 * SR;
     basefreq = 60.f;
 
+    /* The curves are stretched over the whole render */
+    for(i=0; i < BS; i++) {
+        times[i] = (lpfloat_t)i / BS * length;
+    }
+
+    bank = LPOscBank.create(PARTIALS, SR);
+
     /* Make an LFO table to use as a frequency curve for the osc */
     for(i=0; i < PARTIALS; i++) {
         freq[i] = LPWindow.create(WIN_RND, BS);
@@ -48,33 +56,23 @@ int main() {
         amp[i] = LPWindow.create(WIN_RND, BS);
         LPBuffer.scale(amp[i], 0, 1, 0.f, LPRand.rand(ampdrift * 0.1, ampdrift));
 
-        osc[i] = LPSineOsc.create();
-        osc[i]->phase = LPRand.rand(0.f, 1.f); /* scramble phase */
-        osc[i]->samplerate = SR;
-        osc[i]->freq = freq[i]->data[0];
+        /* scramble phase */
+        LPOscBank.set_partial(bank, i, freq[i]->data[0], amp[i]->data[0], LPRand.rand(0.f, 1.f));
+        LPOscBank.set_envelope(bank, i, LPOSCBANK_FREQ, times, freq[i]->data, BS);
+        LPOscBank.set_envelope(bank, i, LPOSCBANK_AMP, times, amp[i]->data, BS);
     }
 
-    out = LPBuffer.create(length, CHANNELS, SR);
-    for(i=0; i < length; i++) {
-        pos = (lpfloat_t)i/length;
-        for(p=0; p < PARTIALS; p++) {
-            osc[p]->freq = LPInterpolation.linear_pos(freq[p], pos);
-            a = LPInterpolation.linear_pos(amp[p], pos);
-            sample = LPSineOsc.process(osc[p]) * a;
-            for(c=0; c < CHANNELS; c++) {
-                out->data[i * CHANNELS + c] += sample;
-            }
-        }
-    }
+    /* All the partials are rendered together, a block at a time */
+    out = LPOscBank.render(bank, length, CHANNELS);
 
     LPSoundFile.write("renders/additive-synthesis-out.wav", out);
 
     for(p=0; p < PARTIALS; p++) {
-        LPSineOsc.destroy(osc[p]);
         LPBuffer.destroy(freq[p]);
         LPBuffer.destroy(amp[p]);
     }
 
+    LPOscBank.destroy(bank);
     LPBuffer.destroy(out);
 
     return 0;
@@ -0,0 +1,161 @@
+#include "pippi.h"
+#include <time.h>
+
+/* Measures the throughput of the buffer arithmetic
+ * kernels in GB/s for every kernel set this CPU
+ * supports, and checks each set against the scalar
+ * reference.
+ *
+ * Usage: bench_bufferops [samples]
+ */
+
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_MAXSETS 8
+
+enum {
+    BENCH_MULTIPLY,
+    BENCH_ADD,
+    BENCH_MULTIPLY_SCALAR,
+    BENCH_SCALE,
+    BENCH_CLIP,
+    BENCH_MIN,
+    BENCH_MAX,
+    BENCH_MAG,
+    BENCH_TO_FLOAT32,
+    BENCH_TO_INT16,
+    BENCH_TO_INT24,
+    BENCH_ADD_SINES,
+    NUM_BENCH_OPS
+};
+
+static const char * opnames[] = { "multiply", "add", "multiply_scalar", "scale", "clip", "min", "max", "mag", "to_float32", "to_int16", "to_int24", "add_sines" };
+
+/* Bytes read and written per sample */
+static const size_t opbytes[] = { 
+    3 * sizeof(lpfloat_t), 
+    3 * sizeof(lpfloat_t), 
+    2 * sizeof(lpfloat_t), 
+    2 * sizeof(lpfloat_t), 
+    2 * sizeof(lpfloat_t), 
+    sizeof(lpfloat_t), 
+    sizeof(lpfloat_t), 
+    sizeof(lpfloat_t), 
+    sizeof(lpfloat_t) + sizeof(float), 
+    sizeof(lpfloat_t) + sizeof(int16_t), 
+    sizeof(lpfloat_t) + sizeof(int32_t), 
+    2 * sizeof(lpfloat_t) 
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static lpfloat_t run_op(const lpsimd_kernels_t * k, int op, lpfloat_t * a, const lpfloat_t * b, void * out, size_t n) {
+    switch(op) {
+        case BENCH_MULTIPLY: k->multiply(a, b, n); break;
+        case BENCH_ADD: k->add(a, b, n); break;
+        case BENCH_MULTIPLY_SCALAR: k->multiply_scalar(a, n, 1.0001f); break;
+        case BENCH_SCALE: k->scale(a, n, -1.f, 2.f, 2.f, -1.f); break;
+        case BENCH_CLIP: k->clip(a, n, -0.5f, 0.5f); break;
+        case BENCH_MIN: return k->min(a, n);
+        case BENCH_MAX: return k->max(a, n);
+        case BENCH_MAG: return k->mag(a, n);
+        case BENCH_TO_FLOAT32: k->to_float32(a, (float *)out, n); break;
+        case BENCH_TO_INT16: k->to_int16(a, (int16_t *)out, n); break;
+        case BENCH_TO_INT24: k->to_int24(a, (int32_t *)out, n); break;
+        case BENCH_ADD_SINES: k->add_sines(a, n, 0.3f, 0.01f, 1e-7f, 0.5f, 1e-6f); break;
+    }
+    return 0;
+}
+
+static void fill(lpfloat_t * a, lpfloat_t * b, size_t n) {
+    size_t i;
+    LPRand.seed(1);
+    for(i=0; i < n; i++) {
+        /* A little past full scale so the conversions clip */
+        a[i] = LPRand.rand(-1.1f, 1.1f);
+        b[i] = LPRand.rand(0.99f, 1.01f);
+    }
+}
+
+/* Largest difference between two converted outputs */
+static double outdiff(int op, const void * out, const void * ref, size_t n) {
+    double diff = 0;
+    size_t i;
+
+    for(i=0; i < n; i++) {
+        switch(op) {
+            case BENCH_TO_FLOAT32: diff = fmax(diff, fabs((double)((const float *)out)[i] - ((const float *)ref)[i])); break;
+            case BENCH_TO_INT16: diff = fmax(diff, abs(((const int16_t *)out)[i] - ((const int16_t *)ref)[i])); break;
+            case BENCH_TO_INT24: diff = fmax(diff, abs(((const int32_t *)out)[i] - ((const int32_t *)ref)[i])); break;
+            default: return 0;
+        }
+    }
+
+    return diff;
+}
+
+int main(int argc, char * argv[]) {
+    const lpsimd_kernels_t * sets[BENCH_MAXSETS];
+    lpfloat_t * a, * b, * ref;
+    int32_t * out, * refout;
+    lpfloat_t refval, val;
+    double diff;
+    double start, elapsed, bytes;
+    size_t n, i, iterations;
+    int numsets, s, op;
+
+    n = (argc > 1) ? (size_t)atol(argv[1]) : (1 << 20);
+    numsets = lpsimd_list(sets, BENCH_MAXSETS);
+
+    a = (lpfloat_t *)calloc(n, sizeof(lpfloat_t));
+    b = (lpfloat_t *)calloc(n, sizeof(lpfloat_t));
+    ref = (lpfloat_t *)calloc(n, sizeof(lpfloat_t));
+    out = (int32_t *)calloc(n, sizeof(int32_t));
+    refout = (int32_t *)calloc(n, sizeof(int32_t));
+
+    printf("%ld samples of %ld bytes, dispatching to %s\n\n", n, sizeof(lpfloat_t), lpsimd_kernels()->name);
+    printf("%-16s", "op");
+    for(s=0; s < numsets; s++) printf(" %10s GB/s", sets[s]->name);
+    printf(" %12s\n", "max diff");
+
+    for(op=0; op < NUM_BENCH_OPS; op++) {
+        printf("%-16s", opnames[op]);
+
+        /* One pass of the scalar reference to compare against */
+        fill(ref, b, n);
+        refval = run_op(&LPSIMDScalar, op, ref, b, refout, n);
+
+        diff = 0;
+        for(s=0; s < numsets; s++) {
+            fill(a, b, n);
+            val = run_op(sets[s], op, a, b, out, n);
+            diff = fmax(diff, fabs(val - refval));
+            diff = fmax(diff, outdiff(op, out, refout, n));
+            for(i=0; i < n; i++) diff = fmax(diff, fabs(a[i] - ref[i]));
+
+            iterations = 0;
+            start = now_seconds();
+            do {
+                run_op(sets[s], op, a, b, out, n);
+                iterations += 1;
+                elapsed = now_seconds() - start;
+            } while(elapsed < BENCH_MIN_SECONDS);
+
+            bytes = (double)iterations * n * opbytes[op];
+            printf(" %15.2f", bytes / elapsed / 1e9);
+        }
+
+        printf(" %12g\n", diff);
+    }
+
+    free(a);
+    free(b);
+    free(ref);
+    free(out);
+    free(refout);
+
+    return 0;
+}
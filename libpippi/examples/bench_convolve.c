@@ -0,0 +1,133 @@
+#include "pippi.h"
+#include <time.h>
+
+/* Compares the direct form LPFX.convolve with the
+ * partitioned LPSpectral.convolve, then measures the
+ * streaming convolver at DAC block sizes.
+ *
+ * The direct form is too slow to run at full size,
+ * so both run on a short source and impulse first to
+ * check they agree, and the direct form time for the
+ * full size is extrapolated from that.
+ *
+ * Usage: bench_convolve [source seconds] [impulse seconds]
+ */
+
+#define BENCH_SAMPLERATE 48000
+#define BENCH_CHANNELS 2
+#define BENCH_SHORT_SOURCE (BENCH_SAMPLERATE / 2)
+#define BENCH_SHORT_IMPULSE (BENCH_SAMPLERATE / 4)
+#define BENCH_STREAM_SECONDS 2
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static lpbuffer_t * make_noise(size_t length, int decay) {
+    lpbuffer_t * buf;
+    size_t i;
+    int c;
+
+    buf = LPBuffer.create(length, BENCH_CHANNELS, BENCH_SAMPLERATE);
+    for(i=0; i < length; i++) {
+        for(c=0; c < BENCH_CHANNELS; c++) {
+            buf->data[i * BENCH_CHANNELS + c] = LPRand.rand(-1.f, 1.f);
+            if(decay) buf->data[i * BENCH_CHANNELS + c] *= exp(-6.f * i / length);
+        }
+    }
+
+    return buf;
+}
+
+int main(int argc, char * argv[]) {
+    lpbuffer_t * src, * impulse, * direct, * spectral;
+    lpconvolver_t * conv;
+    lpfloat_t * in, * out;
+    double start, direct_time, spectral_time, elapsed, maxelapsed, budget, maxdiff;
+    double source_seconds, impulse_seconds;
+    size_t blocksize, numblocks, b, i;
+
+    source_seconds = (argc > 1) ? atof(argv[1]) : 10;
+    impulse_seconds = (argc > 2) ? atof(argv[2]) : 3;
+
+    LPRand.seed(1);
+
+    /* Short run of both to check they agree */
+    src = make_noise(BENCH_SHORT_SOURCE, 0);
+    impulse = make_noise(BENCH_SHORT_IMPULSE, 1);
+
+    direct = LPBuffer.create(src->length + impulse->length + 1, BENCH_CHANNELS, BENCH_SAMPLERATE);
+    start = now_seconds();
+    LPFX.convolve(src, impulse, direct);
+    direct_time = now_seconds() - start;
+
+    start = now_seconds();
+    spectral = LPSpectral.convolve(src, impulse);
+    spectral_time = now_seconds() - start;
+
+    maxdiff = 0;
+    for(i=0; i < direct->length * BENCH_CHANNELS; i++) {
+        maxdiff = fmax(maxdiff, fabs(direct->data[i] - spectral->data[i]));
+    }
+
+    printf("%.2fs source * %.2fs impulse, %d channels\n", (double)BENCH_SHORT_SOURCE / BENCH_SAMPLERATE, (double)BENCH_SHORT_IMPULSE / BENCH_SAMPLERATE, BENCH_CHANNELS);
+    printf("direct:      %10.3f sec\n", direct_time);
+    printf("partitioned: %10.3f sec (%.0fx), max diff %g\n\n", spectral_time, direct_time / spectral_time, maxdiff);
+
+    LPBuffer.destroy(src);
+    LPBuffer.destroy(impulse);
+    LPBuffer.destroy(direct);
+    LPBuffer.destroy(spectral);
+
+    /* Full size, with the direct form extrapolated */
+    src = make_noise((size_t)(source_seconds * BENCH_SAMPLERATE), 0);
+    impulse = make_noise((size_t)(impulse_seconds * BENCH_SAMPLERATE), 1);
+
+    start = now_seconds();
+    spectral = LPSpectral.convolve(src, impulse);
+    spectral_time = now_seconds() - start;
+
+    direct_time *= ((double)src->length / BENCH_SHORT_SOURCE) * ((double)impulse->length / BENCH_SHORT_IMPULSE);
+
+    printf("%.2fs source * %.2fs impulse, %d channels\n", source_seconds, impulse_seconds, BENCH_CHANNELS);
+    printf("direct:      %10.3f sec (extrapolated)\n", direct_time);
+    printf("partitioned: %10.3f sec (%.0fx)\n\n", spectral_time, direct_time / spectral_time);
+
+    LPBuffer.destroy(spectral);
+
+    /* Streaming at DAC block sizes with the full impulse */
+    printf("%10s %12s %14s %14s %10s\n", "blocksize", "partitions", "usec/block", "max usec", "budget %");
+    for(blocksize=64; blocksize <= 4096; blocksize *= 4) {
+        conv = LPConvolver.create(impulse, blocksize, BENCH_CHANNELS);
+        in = (lpfloat_t *)calloc(blocksize * BENCH_CHANNELS, sizeof(lpfloat_t));
+        out = (lpfloat_t *)calloc(blocksize * BENCH_CHANNELS, sizeof(lpfloat_t));
+
+        numblocks = (BENCH_STREAM_SECONDS * BENCH_SAMPLERATE) / blocksize;
+        budget = (double)blocksize / BENCH_SAMPLERATE;
+        elapsed = maxelapsed = 0;
+        for(b=0; b < numblocks; b++) {
+            for(i=0; i < blocksize * BENCH_CHANNELS; i++) {
+                in[i] = src->data[(b * blocksize * BENCH_CHANNELS + i) % (src->length * BENCH_CHANNELS)];
+            }
+
+            start = now_seconds();
+            LPConvolver.process(conv, in, out);
+            start = now_seconds() - start;
+            elapsed += start;
+            maxelapsed = fmax(maxelapsed, start);
+        }
+
+        printf("%10ld %12ld %14.2f %14.2f %9.2f%%\n", blocksize, conv->numpartitions, elapsed / numblocks * 1e6, maxelapsed * 1e6, (elapsed / numblocks / budget) * 100);
+
+        LPConvolver.destroy(conv);
+        free(in);
+        free(out);
+    }
+
+    LPBuffer.destroy(src);
+    LPBuffer.destroy(impulse);
+
+    return 0;
+}
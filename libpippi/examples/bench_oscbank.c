@@ -0,0 +1,81 @@
+#include "pippi.h"
+#include <time.h>
+
+/* Renders an additive voice through LPOscBank and through
+ * one LPSineOsc per partial, checks they agree, and reports
+ * how much faster than realtime each one runs.
+ *
+ * Usage: bench_oscbank [partials] [seconds]
+ */
+
+#define BENCH_SAMPLERATE 48000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char * argv[]) {
+    lposcbank_t * bank;
+    lpsineosc_t ** oscs;
+    lpbuffer_t * ref, * out;
+    lpfloat_t freq, amp, phase, maxdiff;
+    size_t numpartials, length, i, p;
+    double start, elapsed, seconds;
+
+    numpartials = (argc > 1) ? (size_t)atoi(argv[1]) : 1000;
+    seconds = (argc > 2) ? atof(argv[2]) : 10;
+    length = (size_t)(seconds * BENCH_SAMPLERATE);
+
+    LPRand.seed(888);
+
+    bank = LPOscBank.create(numpartials, BENCH_SAMPLERATE);
+    oscs = (lpsineosc_t **)LPMemoryPool.alloc(numpartials, sizeof(lpsineosc_t *));
+    for(p=0; p < numpartials; p++) {
+        freq = 30.f * (p+1) * LPRand.rand(0.99f, 1.01f);
+        while(freq > BENCH_SAMPLERATE / 2) freq -= BENCH_SAMPLERATE / 2;
+        amp = 1.f / numpartials;
+        phase = LPRand.rand(0.f, 1.f);
+
+        LPOscBank.set_partial(bank, p, freq, amp, phase);
+
+        oscs[p] = LPSineOsc.create();
+        oscs[p]->samplerate = BENCH_SAMPLERATE;
+        oscs[p]->freq = freq;
+        oscs[p]->phase = phase;
+    }
+
+    printf("%zu partials, %.0f seconds at %d\n\n", numpartials, seconds, BENCH_SAMPLERATE);
+
+    ref = LPBuffer.create(length, 1, BENCH_SAMPLERATE);
+    start = now_seconds();
+    for(i=0; i < length; i++) {
+        for(p=0; p < numpartials; p++) {
+            ref->data[i] += LPSineOsc.process(oscs[p]) / numpartials;
+        }
+    }
+    elapsed = now_seconds() - start;
+    printf("LPSineOsc per partial  %8.3f sec  %6.2fx realtime\n", elapsed, seconds / elapsed);
+
+    start = now_seconds();
+    out = LPOscBank.render(bank, length, 1);
+    elapsed = now_seconds() - start;
+
+    maxdiff = 0;
+    for(i=0; i < length; i++) {
+        if(fabs(out->data[i] - ref->data[i]) > maxdiff) maxdiff = fabs(out->data[i] - ref->data[i]);
+    }
+    printf("LPOscBank              %8.3f sec  %6.2fx realtime  maxdiff %g\n", elapsed, seconds / elapsed, maxdiff);
+
+    for(p=0; p < numpartials; p++) {
+        LPSineOsc.destroy(oscs[p]);
+    }
+
+    LPMemoryPool.free(oscs);
+    LPOscBank.destroy(bank);
+    LPBuffer.destroy(ref);
+    LPBuffer.destroy(out);
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "pippi.h"
+#include <time.h>
+
+/* Compares the per-sample process calls of each oscillator
+ * against their process_block variants at a few block sizes,
+ * with a frequency and amplitude block filled for every
+ * call, and checks that both paths agree.
+ *
+ * Usage: bench_oscs [seconds]
+ */
+
+#define BENCH_SAMPLERATE 48000
+#define BENCH_MAXBLOCK 1024
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char * name, size_t blocksize, size_t length, double elapsed, double baseline, double maxdiff) {
+    if(blocksize == 0) {
+        printf("%-8s per-sample   %8.2f ns/frame\n", name, elapsed / length * 1e9);
+    } else {
+        printf("%-8s block %-6zu %8.2f ns/frame  %5.2fx  maxdiff %g\n", name, blocksize, elapsed / length * 1e9, baseline / elapsed, maxdiff);
+    }
+}
+
+/* Morphs between wavetables under a single window, so the 
+ * burst table advances once per pulse. Seeding here gives 
+ * both paths the same saturation draws. */
+static lppulsarosc_t * make_pulsar(void) {
+    lppulsarosc_t * p = LPPulsarOsc.create();
+    p->samplerate = BENCH_SAMPLERATE;
+    p->saturation = 0.8f;
+    p->pulsewidth = 0.6f;
+    p->wts = LPWavetable.create_stack(4, WT_SINE, WT_SQUARE, WT_TRI, WT_SINE);
+    p->wts->pos = 0.3f;
+    p->wins = LPWindow.create_stack(1, WIN_HANN);
+    p->burst = LPArray.create_from(4, 1, 1, 0, 1);
+    LPRand.seed(1);
+    return p;
+}
+
+int main(int argc, char * argv[]) {
+    lpfloat_t * freq, * amp, * ref, * out;
+    lpbuffer_t * table;
+    lpsineosc_t * sine;
+    lpphasorosc_t * phasor;
+    lptukeyosc_t * tukey;
+    lptableosc_t * tableosc;
+    lppulsarosc_t * pulsar;
+    size_t length, i, j, n, b;
+    size_t blocksizes[] = {1, 64, 256, BENCH_MAXBLOCK};
+    double start, baseline, elapsed, maxdiff, seconds;
+
+    seconds = (argc > 1) ? atof(argv[1]) : 60;
+    length = (size_t)(seconds * BENCH_SAMPLERATE);
+
+    freq = (lpfloat_t *)LPMemoryPool.alloc(length, sizeof(lpfloat_t));
+    amp = (lpfloat_t *)LPMemoryPool.alloc(length, sizeof(lpfloat_t));
+    ref = (lpfloat_t *)LPMemoryPool.alloc(length, sizeof(lpfloat_t));
+    out = (lpfloat_t *)LPMemoryPool.alloc(length, sizeof(lpfloat_t));
+
+    /* A slow vibrato and tremolo so the control blocks change every frame */
+    for(i=0; i < length; i++) {
+        freq[i] = 220.f + 20.f * sin(PI2 * i / (lpfloat_t)BENCH_SAMPLERATE);
+        amp[i] = 0.5f + 0.25f * sin(PI2 * 0.3f * i / (lpfloat_t)BENCH_SAMPLERATE);
+    }
+
+    table = LPWindow.create(WIN_SINE, 4096);
+
+    printf("%.0f seconds at %d\n\n", seconds, BENCH_SAMPLERATE);
+
+#define BENCH_OSC(NAME, FACTORY, MAKE, FREQFIELD) \
+    do { \
+        NAME = MAKE; \
+        start = now_seconds(); \
+        for(i=0; i < length; i++) { \
+            NAME->FREQFIELD = freq[i]; \
+            ref[i] = FACTORY.process(NAME) * amp[i]; \
+        } \
+        baseline = now_seconds() - start; \
+        FACTORY.destroy(NAME); \
+        report(#NAME, 0, length, baseline, baseline, 0); \
+        for(b=0; b < sizeof(blocksizes) / sizeof(size_t); b++) { \
+            NAME = MAKE; \
+            start = now_seconds(); \
+            for(i=0; i < length; i += n) { \
+                n = (length - i < blocksizes[b]) ? length - i : blocksizes[b]; \
+                FACTORY.process_block(NAME, out + i, n, freq + i, amp + i); \
+            } \
+            elapsed = now_seconds() - start; \
+            FACTORY.destroy(NAME); \
+            maxdiff = 0; \
+            for(j=0; j < length; j++) { \
+                if(fabs(out[j] - ref[j]) > maxdiff) maxdiff = fabs(out[j] - ref[j]); \
+            } \
+            report(#NAME, blocksizes[b], length, elapsed, baseline, maxdiff); \
+        } \
+        printf("\n"); \
+    } while(0)
+
+    BENCH_OSC(sine, LPSineOsc, LPSineOsc.create(), freq);
+    BENCH_OSC(phasor, LPPhasorOsc, LPPhasorOsc.create(), freq);
+    BENCH_OSC(tukey, LPTukeyOsc, LPTukeyOsc.create(), freq);
+    BENCH_OSC(tableosc, LPTableOsc, LPTableOsc.create(table), freq);
+    BENCH_OSC(pulsar, LPPulsarOsc, make_pulsar(), freq);
+
+#undef BENCH_OSC
+
+    LPBuffer.destroy(table);
+    LPMemoryPool.free(freq);
+    LPMemoryPool.free(amp);
+    LPMemoryPool.free(ref);
+    LPMemoryPool.free(out);
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "pippi.h"
+#include "dr_libs/dr_wav.h"
+#include <time.h>
+#include <unistd.h>
+
+/* Writes an hour of stereo audio, rendered one second
+ * at a time, with the old per-sample float path and
+ * with the block writer in each format, with and
+ * without the background writer thread.
+ *
+ * Usage: bench_soundfile_write [seconds] [directory]
+ */
+
+#define BENCH_SAMPLERATE 48000
+#define BENCH_CHANNELS 2
+#define BENCH_BUFSIZE 1024
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Stands in for the work of rendering each block */
+static void render_block(lpbuffer_t * block, size_t offset) {
+    size_t i;
+    int c;
+
+    for(i=0; i < block->length; i++) {
+        for(c=0; c < block->channels; c++) {
+            block->data[i * block->channels + c] = sin(2 * PI * (220 + c * 110) * (offset + i) / BENCH_SAMPLERATE) * 0.9f;
+        }
+    }
+}
+
+/* The per-sample float path write_soundfile used before the block writer */
+static void write_legacy(const char * path, size_t seconds, lpbuffer_t * block) {
+    float tmpbuf[BENCH_BUFSIZE * BENCH_CHANNELS];
+    drwav_data_format format;
+    drwav wav;
+    size_t s, i;
+    int c, count;
+
+    format.container = drwav_container_riff;
+    format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+    format.channels = BENCH_CHANNELS;
+    format.sampleRate = BENCH_SAMPLERATE;
+    format.bitsPerSample = 32;
+    drwav_init_file_write(&wav, path, &format, NULL);
+
+    for(s=0; s < seconds; s++) {
+        render_block(block, s * block->length);
+        count = 0;
+        for(i=0; i < block->length; i++) {
+            for(c=0; c < BENCH_CHANNELS; c++) {
+                tmpbuf[count * BENCH_CHANNELS + c] = (float)block->data[i * BENCH_CHANNELS + c];
+            }
+            count++;
+            if(count >= BENCH_BUFSIZE) {
+                drwav_write_pcm_frames(&wav, BENCH_BUFSIZE, tmpbuf);
+                count = 0;
+            }
+        }
+        if(count != 0) drwav_write_pcm_frames(&wav, count, tmpbuf);
+    }
+
+    drwav_uninit(&wav);
+}
+
+static void write_blocks(const char * path, size_t seconds, lpbuffer_t * block, int format, int threaded) {
+    lpsoundfile_writer_t * writer;
+    size_t s;
+
+    writer = LPSoundFile.create_writer(path, BENCH_CHANNELS, BENCH_SAMPLERATE, format, threaded);
+    for(s=0; s < seconds; s++) {
+        render_block(block, s * block->length);
+        LPSoundFile.write_frames(writer, block);
+    }
+    if(LPSoundFile.close_writer(writer) < 0) printf("Could not write %s\n", path);
+}
+
+static void report(const char * name, const char * path, double elapsed, size_t seconds) {
+    FILE * fp;
+    long size;
+
+    fp = fopen(path, "rb");
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fclose(fp);
+
+    printf("%-24s %8.2f sec %10.1f MB/s %8.0fx realtime %10.1f MB\n", name, elapsed, size / elapsed / 1e6, seconds / elapsed, size / 1e6);
+}
+
+/* Reads the first block back and compares it to a fresh render */
+static double check(const char * path, lpbuffer_t * block) {
+    lpsoundfile_stream_t * stream;
+    lpbuffer_t * readback;
+    double maxdiff = 0;
+    size_t i;
+
+    stream = LPSoundFile.open(path);
+    readback = LPBuffer.create(block->length, BENCH_CHANNELS, BENCH_SAMPLERATE);
+    LPSoundFile.read_frames_into(stream, readback, block->length);
+    render_block(block, 0);
+    for(i=0; i < block->length * BENCH_CHANNELS; i++) {
+        maxdiff = fmax(maxdiff, fabs(readback->data[i] - block->data[i]));
+    }
+    LPSoundFile.close(stream);
+    LPBuffer.destroy(readback);
+
+    return maxdiff;
+}
+
+int main(int argc, char * argv[]) {
+    static const char * formatnames[] = { "float32", "int24", "int16" };
+    char path[4096], name[64];
+    lpbuffer_t * block;
+    double start, elapsed, maxdiff;
+    size_t seconds, s;
+    int format, threaded;
+
+    seconds = (argc > 1) ? (size_t)atol(argv[1]) : 3600;
+    snprintf(path, sizeof(path), "%s/bench_soundfile_write.wav", (argc > 2) ? argv[2] : "/tmp");
+
+    block = LPBuffer.create(BENCH_SAMPLERATE, BENCH_CHANNELS, BENCH_SAMPLERATE);
+
+    /* Just the rendering, to separate it from the writing */
+    start = now_seconds();
+    for(s=0; s < seconds; s++) render_block(block, s * block->length);
+    printf("%ld seconds of %d channel audio at %d, rendering alone takes %.2f sec\n\n", seconds, BENCH_CHANNELS, BENCH_SAMPLERATE, now_seconds() - start);
+
+    start = now_seconds();
+    write_legacy(path, seconds, block);
+    elapsed = now_seconds() - start;
+    report("per-sample float32", path, elapsed, seconds);
+    unlink(path);
+
+    for(format=0; format < NUM_SOUNDFILE_FORMATS; format++) {
+        for(threaded=0; threaded < 2; threaded++) {
+            start = now_seconds();
+            write_blocks(path, seconds, block, format, threaded);
+            elapsed = now_seconds() - start;
+
+            snprintf(name, sizeof(name), "block %s%s", formatnames[format], (threaded) ? " threaded" : "");
+            report(name, path, elapsed, seconds);
+
+            maxdiff = check(path, block);
+            if(maxdiff > 1.f / (1 << (format == SOUNDFILE_INT16 ? 14 : 22))) {
+                printf("  readback differs by %g\n", maxdiff);
+            }
+
+            unlink(path);
+        }
+    }
+
+    LPBuffer.destroy(block);
+
+    return 0;
+}
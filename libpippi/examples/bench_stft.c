@@ -0,0 +1,114 @@
+#include "pippi.h"
+#include <time.h>
+
+/* Checks that LPSTFT reconstructs its input when the 
+ * spectrum is left alone, then times an offline render 
+ * with a spectral gate callback and the streaming 
+ * process call at a few window sizes.
+ *
+ * Usage: bench_stft [source seconds]
+ */
+
+#define BENCH_SAMPLERATE 48000
+#define BENCH_CHANNELS 2
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Zero every bin below a fixed magnitude */
+static void gate(lpstft_t * stft, size_t frame, void * ctx) {
+    lpfloat_t threshold = *(lpfloat_t *)ctx;
+    size_t i;
+
+    (void)frame;
+
+    for(i=0; i < stft->numbins * stft->channels; i++) {
+        if(sqrt(stft->real[i] * stft->real[i] + stft->imag[i] * stft->imag[i]) < threshold) {
+            stft->real[i] = 0;
+            stft->imag[i] = 0;
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    lpbuffer_t * src, * out;
+    lpstft_t * stft;
+    lpfloat_t * in, * block, threshold;
+    double start, elapsed, maxelapsed, budget, maxdiff, source_seconds;
+    size_t winsize, hopsize, numblocks, latency, b, i;
+
+    source_seconds = (argc > 1) ? atof(argv[1]) : 60;
+
+    LPRand.seed(1);
+
+    src = LPBuffer.create((size_t)(source_seconds * BENCH_SAMPLERATE), BENCH_CHANNELS, BENCH_SAMPLERATE);
+    for(i=0; i < src->length * BENCH_CHANNELS; i++) {
+        src->data[i] = LPRand.rand(-1.f, 1.f);
+    }
+
+    printf("%.0fs source, %d channels, hop of winsize/4\n\n", source_seconds, BENCH_CHANNELS);
+    printf("%10s %12s %12s %14s %14s %10s\n", "winsize", "render sec", "max diff", "usec/hop", "max usec", "budget %");
+
+    for(winsize=256; winsize <= 8192; winsize *= 4) {
+        hopsize = winsize / 4;
+        stft = LPSTFT.create(winsize, hopsize, BENCH_CHANNELS);
+
+        /* Identity: no callback */
+        out = LPSTFT.render(stft, src, 0);
+        maxdiff = 0;
+        for(i=0; i < src->length * BENCH_CHANNELS; i++) {
+            maxdiff = fmax(maxdiff, fabs(src->data[i] - out->data[i]));
+        }
+        LPBuffer.destroy(out);
+
+        threshold = 0.5f * winsize / 8.f;
+        stft->callback = gate;
+        stft->ctx = &threshold;
+
+        start = now_seconds();
+        out = LPSTFT.render(stft, src, 0);
+        elapsed = now_seconds() - start;
+        LPBuffer.destroy(out);
+
+        printf("%10ld %12.3f %12g ", winsize, elapsed, maxdiff);
+
+        /* Streaming a hop at a time, checked against 
+         * the input delayed by the latency */
+        LPSTFT.reset(stft);
+        stft->callback = NULL;
+        in = (lpfloat_t *)calloc(hopsize * BENCH_CHANNELS, sizeof(lpfloat_t));
+        block = (lpfloat_t *)calloc(hopsize * BENCH_CHANNELS, sizeof(lpfloat_t));
+
+        numblocks = (BENCH_SAMPLERATE * 2) / hopsize;
+        latency = winsize - hopsize;
+        budget = (double)hopsize / BENCH_SAMPLERATE;
+        elapsed = maxelapsed = maxdiff = 0;
+        for(b=0; b < numblocks; b++) {
+            memcpy(in, src->data + b * hopsize * BENCH_CHANNELS, hopsize * BENCH_CHANNELS * sizeof(lpfloat_t));
+
+            start = now_seconds();
+            LPSTFT.process(stft, in, block);
+            start = now_seconds() - start;
+            elapsed += start;
+            maxelapsed = fmax(maxelapsed, start);
+
+            for(i=0; i < hopsize * BENCH_CHANNELS; i++) {
+                if(b * hopsize + i / BENCH_CHANNELS < latency) continue;
+                maxdiff = fmax(maxdiff, fabs(block[i] - src->data[b * hopsize * BENCH_CHANNELS + i - latency * BENCH_CHANNELS]));
+            }
+        }
+
+        printf("%14.2f %14.2f %9.2f%%  (stream max diff %g)\n", elapsed / numblocks * 1e6, maxelapsed * 1e6, (elapsed / numblocks / budget) * 100, maxdiff);
+
+        free(in);
+        free(block);
+        LPSTFT.destroy(stft);
+    }
+
+    LPBuffer.destroy(src);
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "pippi.h"
+
+#define BLOCKSIZE 4096
+
+int main() {
+    lpsoundfile_stream_t * stream;
+    lpbuffer_t * block;
+    lpbuffer_t * out;
+    lpbuffer_t * mapped;
+    size_t read, pos, i;
+
+    /* Read the file a block at a time, starting halfway through */
+    stream = LPSoundFile.open("examples/linus.wav");
+    if(stream == NULL) return 1;
+
+    block = LPBuffer.create(BLOCKSIZE, stream->channels, stream->samplerate);
+    out = LPBuffer.create(stream->length / 2 + 1, stream->channels, stream->samplerate);
+
+    LPSoundFile.seek(stream, stream->length / 2);
+    pos = 0;
+    while((read = LPSoundFile.read_frames_into(stream, block, BLOCKSIZE)) > 0) {
+        for(i=0; i < read * stream->channels; i++) {
+            out->data[pos * stream->channels + i] = block->data[i];
+        }
+        pos += read;
+    }
+
+    LPSoundFile.write("renders/streamsoundfile-out.wav", out);
+
+    /* Float WAVs in the native sample format can be mapped without copying */
+    mapped = LPSoundFile.map("renders/streamsoundfile-out.wav");
+    if(mapped != NULL) {
+        printf("mapped %ld frames, peak %f\n", mapped->length, (double)LPBuffer.mag(mapped));
+        LPSoundFile.unmap(mapped);
+    } else {
+        printf("sample format differs from lpfloat_t, not mapped\n");
+    }
+
+    LPSoundFile.close(stream);
+    LPBuffer.destroy(block);
+    LPBuffer.destroy(out);
+
+    return 0;
+}
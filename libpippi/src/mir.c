@@ -13,17 +13,62 @@
  */
 
 void yin_difference_function(lpyin_t * yin) {
-    int j, tau, pos;
-    lpfloat_t tmp, s1, s2;
+    size_t i, k, m, fftsize;
+    int tau, window;
+    lpfloat_t * frame, * real, * imag;
+    lpfloat_t ar, ai, br, bi, xr, xi, yr, yi;
+    lpfloat_t e0, e, d;
+
+    /* The last framesize samples, oldest first */
+    frame = yin->block->data + yin->block->pos;
+    window = yin->tau_max;
+    fftsize = yin->fftsize;
+    real = yin->real;
+    imag = yin->imag;
+
+    /* The frame goes in the real part and the window 
+     * at its head goes in the imaginary part, so one 
+     * forward transform covers both. */
+    for(i=0; i < fftsize; i++) {
+        real[i] = (i < (size_t)yin->framesize) ? frame[i] : 0;
+        imag[i] = (i < (size_t)window) ? frame[i] : 0;
+    }
+
+    spectral_fft(fftsize, yin->bitrev, yin->cos_table, yin->sin_table, real, imag, 0);
+
+    /* Split bins k and m = fftsize - k into the frame (x) 
+     * and window (y) spectrums and replace both with 
+     * conj(Y) * X, the spectrum of their cross-correlation. */
+    for(k=0; k <= fftsize / 2; k++) {
+        m = (fftsize - k) & (fftsize - 1);
+        ar = real[k]; ai = imag[k];
+        br = real[m]; bi = imag[m];
+
+        xr = 0.5f * (ar + br); xi = 0.5f * (ai - bi);
+        yr = 0.5f * (ai + bi); yi = 0.5f * (br - ar);
+        real[k] = xr * yr + xi * yi;
+        imag[k] = xi * yr - xr * yi;
+
+        /* X and Y are hermitian, so bin m is the conjugate */
+        real[m] = real[k];
+        imag[m] = -imag[k];
+    }
+
+    spectral_fft(fftsize, yin->bitrev, yin->cos_table, yin->sin_table, real, imag, 1);
+
+    /* d(tau) = e(0) + e(tau) - 2r(tau) where e(tau) is the 
+     * energy of the window starting at tau, kept as a running sum */
+    e0 = 0;
+    for(tau=0; tau < window; tau++) {
+        e0 += frame[tau] * frame[tau];
+    }
 
-    pos = yin->block->pos - 1;
+    e = e0;
+    yin->tmp->data[0] = 0;
     for(tau=1; tau < yin->tau_max; tau++) {
-        for(j=0; j < yin->tau_max; j++) {
-            s1 = yin->block->data[(pos + j) % yin->block->length];
-            s2 = yin->block->data[(pos + j + tau) % yin->block->length];
-            tmp = s1 - s2;
-            yin->tmp->data[tau] += tmp * tmp;
-        }
+        e += frame[tau + window - 1] * frame[tau + window - 1] - frame[tau - 1] * frame[tau - 1];
+        d = e0 + e - 2 * real[tau] / fftsize;
+        yin->tmp->data[tau] = (d > 0) ? d : 0;
     }
 }
 
@@ -32,9 +77,10 @@ void yin_cumulative_mean_normalized_difference_function(lpyin_t * yin) {
     int i;
 
     prev = 0;
+    yin->tmp->data[0] = 1;
     for(i=1; i < yin->tau_max; i++) {
         denominator = yin->tmp->data[i] + prev;
-        value = (yin->tmp->data[i] * i) / denominator;
+        value = (denominator > 0) ? (yin->tmp->data[i] * i) / denominator : 1;
         prev = denominator;
         yin->tmp->data[i] = value;
     }
@@ -48,20 +94,24 @@ lpfloat_t yin_get_pitch(lpyin_t * yin) {
             while(tau + 1 < yin->tau_max && yin->tmp->data[tau + 1] < yin->tmp->data[tau]) {
                 tau += 1;
             }
-            return (lpfloat_t)yin->samplerate / tau;
+            yin->last_pitch = (lpfloat_t)yin->samplerate / tau;
+            return yin->last_pitch;
         }
         tau += 1;
     }
 
     /* unvoiced */
-    return yin->last_pitch;
+    return (yin->last_pitch > 0) ? yin->last_pitch : yin->fallback;
 }
 
 lpfloat_t yin_process(lpyin_t * yin, lpfloat_t sample) {
     lpfloat_t p;
+
+    /* Write each sample twice so the frame never wraps */
     yin->block->data[yin->block->pos] = sample;
+    yin->block->data[yin->block->pos + yin->framesize] = sample;
     yin->block->pos += 1;
-    yin->block->pos = yin->block->pos % yin->block->length;
+    yin->block->pos = yin->block->pos % yin->framesize;
 
     if(yin->elapsed >= yin->stepsize) {
         yin_difference_function(yin);
@@ -69,13 +119,29 @@ lpfloat_t yin_process(lpyin_t * yin, lpfloat_t sample) {
         p = yin_get_pitch(yin);
         yin->elapsed = 0;
     } else {
-        p = yin->last_pitch;
+        p = (yin->last_pitch > 0) ? yin->last_pitch : yin->fallback;
     }
 
     yin->elapsed += 1;
     return p;
 }
 
+/* Tracks a block of mono input, writing the pitch for 
+ * each sample to out if it isn't NULL. Returns the pitch 
+ * at the end of the block. */
+lpfloat_t yin_process_block(lpyin_t * yin, const lpfloat_t * in, size_t length, lpfloat_t * out) {
+    size_t i;
+    lpfloat_t p;
+
+    p = (yin->last_pitch > 0) ? yin->last_pitch : yin->fallback;
+    for(i=0; i < length; i++) {
+        p = yin_process(yin, in[i]);
+        if(out != NULL) out[i] = p;
+    }
+
+    return p;
+}
+
 lpyin_t * yin_create(int blocksize, int samplerate) {
     lpfloat_t f0_max, f0_min;
     lpyin_t * yin;
@@ -89,11 +155,20 @@ lpyin_t * yin_create(int blocksize, int samplerate) {
     yin->stepsize = blocksize / 4;
     yin->tau_min = (int)(samplerate / f0_max);
     yin->tau_max = (int)(samplerate / f0_min);
+    yin->framesize = yin->tau_max * 2;
 
-    yin->block = LPBuffer.create(yin->blocksize, 1, samplerate);
+    /* Lags up to framesize fit without wrapping around */
+    yin->fftsize = 1;
+    while(yin->fftsize < (size_t)yin->framesize) yin->fftsize <<= 1;
+
+    spectral_fft_tables(yin->fftsize, &yin->bitrev, &yin->cos_table, &yin->sin_table);
+    yin->real = (lpfloat_t *)LPMemoryPool.alloc(yin->fftsize, sizeof(lpfloat_t));
+    yin->imag = (lpfloat_t *)LPMemoryPool.alloc(yin->fftsize, sizeof(lpfloat_t));
+
+    yin->block = LPBuffer.create(yin->framesize * 2, 1, samplerate);
     yin->tmp = LPBuffer.create(yin->tau_max, 1, samplerate);
     yin->fallback = 0.f; /* Fallback pitch in hz for output values before any pitch is detected */
-    yin->last_pitch = yin->fallback;
+    yin->last_pitch = 0.f;
     yin->threshold = 0.85f;
     yin->offset = 0;
     yin->elapsed = 0;
@@ -102,8 +177,13 @@ lpyin_t * yin_create(int blocksize, int samplerate) {
 }
 
 void yin_destroy(lpyin_t * yin) {
-    LPMemoryPool.free(yin->tmp);
-    LPMemoryPool.free(yin->block);
+    LPMemoryPool.free(yin->bitrev);
+    LPMemoryPool.free(yin->cos_table);
+    LPMemoryPool.free(yin->sin_table);
+    LPMemoryPool.free(yin->real);
+    LPMemoryPool.free(yin->imag);
+    LPBuffer.destroy(yin->tmp);
+    LPBuffer.destroy(yin->block);
     LPMemoryPool.free(yin);
 }
 
@@ -308,10 +388,253 @@ void crossingfollower_destroy(lpcrossingfollower_t * crossing) {
 }
 
 
+/* SPECTRAL FEATURES
+ * *****************/
+
+/* The bins of one contrast band. The peak and valley 
+ * are the means of the quantile loudest and quietest 
+ * bins in [start, end). */
+typedef struct lpcontrastband_t {
+    size_t start;
+    size_t end;
+    size_t quantile;
+} lpcontrastband_t;
+
+static int spectralfeatures_compare(const void * a, const void * b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Bands follow librosa.feature.spectral_contrast: each one 
+ * reaches down to the last bin of the band below, and all 
+ * but the top band drop their last bin. */
+static void spectralfeatures_contrast_bands(lpcontrastband_t * bands, size_t numbins, int samplerate, int winsize) {
+    double binfreq, low, high;
+    size_t first, last, count;
+    int b;
+
+    binfreq = (double)samplerate / winsize;
+    for(b=0; b < LPCONTRAST_BANDS; b++) {
+        low = (b == 0) ? 0 : LPCONTRAST_FMIN * pow(2, b-1);
+        high = LPCONTRAST_FMIN * pow(2, b);
+
+        first = (size_t)ceil(low / binfreq);
+        last = (size_t)floor(high / binfreq);
+        if(last >= numbins) last = numbins - 1;
+        if(b == LPCONTRAST_BANDS - 1) last = numbins - 1;
+
+        /* Nothing in this band below nyquist */
+        if(first > last || first >= numbins) {
+            bands[b].start = bands[b].end = bands[b].quantile = 0;
+            continue;
+        }
+
+        if(b > 0 && first > 0) first -= 1;
+        count = last - first + 1;
+
+        bands[b].start = first;
+        bands[b].end = (b < LPCONTRAST_BANDS - 1) ? last : last + 1;
+        bands[b].quantile = (size_t)fmax(1, rint(LPCONTRAST_QUANTILE * count));
+        if(bands[b].quantile > bands[b].end - bands[b].start) bands[b].quantile = bands[b].end - bands[b].start;
+    }
+}
+
+/* Computes every descriptor for one frame from its magnitude 
+ * spectrum. Contrast peaks and valleys are kept in dB here, 
+ * and clamped over the whole sound once all frames are done. */
+static void spectralfeatures_frame(
+    lpspectralfeatures_t * features, 
+    size_t frame, 
+    const double * mag, 
+    size_t numbins, 
+    const lpcontrastband_t * bands, 
+    double * sorted, 
+    double * peaks, 
+    double * valleys
+) {
+    double binfreq, total, norm, weighted, centroid, spread, deviation;
+    double cumulative, threshold, power, logsum, powersum, peak, valley;
+    size_t k, q, count;
+    int b;
+
+    binfreq = (double)features->samplerate / features->winsize;
+
+    total = weighted = logsum = powersum = 0;
+    for(k=0; k < numbins; k++) {
+        total += mag[k];
+        weighted += mag[k] * k * binfreq;
+
+        power = fmax(1e-10, mag[k] * mag[k]);
+        logsum += log(power);
+        powersum += power;
+    }
+
+    /* Silent frames are left unnormalized, like librosa does */
+    norm = (total > 0) ? total : 1;
+    centroid = weighted / norm;
+
+    spread = 0;
+    for(k=0; k < numbins; k++) {
+        deviation = k * binfreq - centroid;
+        spread += mag[k] * deviation * deviation;
+    }
+
+    threshold = LPROLLOFF_PERCENT * total;
+    cumulative = 0;
+    for(k=0; k < numbins-1; k++) {
+        cumulative += mag[k];
+        if(cumulative >= threshold) break;
+    }
+
+    features->centroid[frame] = (lpfloat_t)centroid;
+    features->bandwidth[frame] = (lpfloat_t)sqrt(spread / norm);
+    features->rolloff[frame] = (lpfloat_t)(k * binfreq);
+    features->flatness[frame] = (lpfloat_t)(exp(logsum / numbins) / (powersum / numbins));
+
+    for(b=0; b < LPCONTRAST_BANDS; b++) {
+        peak = valley = 0;
+        count = bands[b].end - bands[b].start;
+        if(count > 0) {
+            memcpy(sorted, mag + bands[b].start, count * sizeof(double));
+            qsort(sorted, count, sizeof(double), spectralfeatures_compare);
+            for(q=0; q < bands[b].quantile; q++) {
+                valley += sorted[q];
+                peak += sorted[count - 1 - q];
+            }
+            valley /= bands[b].quantile;
+            peak /= bands[b].quantile;
+        }
+
+        peaks[b * features->numframes + frame] = 10 * log10(fmax(1e-10, peak));
+        valleys[b * features->numframes + frame] = 10 * log10(fmax(1e-10, valley));
+    }
+}
+
+/* Frames are real, so two of them go through each transform: 
+ * one as the real part and the next as the imaginary part. 
+ * Their spectra are separated again using the conjugate 
+ * symmetry of real signals. The vendored fft only takes 
+ * doubles, so the work buffers are doubles regardless of 
+ * lpfloat_t. Sounds with more than one channel are summed 
+ * to mono first. */
+lpspectralfeatures_t * spectralfeatures_analyze_frames(const lpfloat_t * frames, size_t length, int channels, int samplerate, int winsize) {
+    lpspectralfeatures_t * features;
+    lpcontrastband_t bands[LPCONTRAST_BANDS];
+    double * mono, * window, * real, * imag, * maga, * magb, * sorted, * peaks, * valleys;
+    double maxpeak, maxvalley, zr, zi, wr, wi;
+    size_t numbins, frame, i, k, j;
+    long start, pos;
+    int c;
+
+    features = (lpspectralfeatures_t *)LPMemoryPool.alloc(1, sizeof(lpspectralfeatures_t));
+    features->winsize = winsize;
+    features->hopsize = (winsize >= 4) ? winsize / 4 : 1;
+    features->samplerate = samplerate;
+    features->numframes = 1 + length / features->hopsize;
+
+    features->centroid = (lpfloat_t *)LPMemoryPool.alloc(features->numframes, sizeof(lpfloat_t));
+    features->bandwidth = (lpfloat_t *)LPMemoryPool.alloc(features->numframes, sizeof(lpfloat_t));
+    features->flatness = (lpfloat_t *)LPMemoryPool.alloc(features->numframes, sizeof(lpfloat_t));
+    features->rolloff = (lpfloat_t *)LPMemoryPool.alloc(features->numframes, sizeof(lpfloat_t));
+    features->contrast = (lpfloat_t *)LPMemoryPool.alloc(LPCONTRAST_BANDS * features->numframes, sizeof(lpfloat_t));
+
+    numbins = winsize / 2 + 1;
+    mono = (double *)LPMemoryPool.alloc(length + 1, sizeof(double));
+    window = (double *)LPMemoryPool.alloc(winsize, sizeof(double));
+    real = (double *)LPMemoryPool.alloc(winsize, sizeof(double));
+    imag = (double *)LPMemoryPool.alloc(winsize, sizeof(double));
+    maga = (double *)LPMemoryPool.alloc(numbins, sizeof(double));
+    magb = (double *)LPMemoryPool.alloc(numbins, sizeof(double));
+    sorted = (double *)LPMemoryPool.alloc(numbins, sizeof(double));
+    peaks = (double *)LPMemoryPool.alloc(LPCONTRAST_BANDS * features->numframes, sizeof(double));
+    valleys = (double *)LPMemoryPool.alloc(LPCONTRAST_BANDS * features->numframes, sizeof(double));
+
+    for(i=0; i < length; i++) {
+        mono[i] = 0;
+        for(c=0; c < channels; c++) {
+            mono[i] += (double)frames[i * channels + c];
+        }
+    }
+
+    /* Periodic hann */
+    for(i=0; i < (size_t)winsize; i++) {
+        window[i] = 0.5 - 0.5 * cos(2.0 * PI * i / winsize);
+    }
+
+    spectralfeatures_contrast_bands(bands, numbins, samplerate, winsize);
+
+    for(frame=0; frame < features->numframes; frame += 2) {
+        for(i=0; i < (size_t)winsize; i++) {
+            start = (long)(frame * features->hopsize) - winsize / 2;
+
+            pos = start + (long)i;
+            real[i] = (pos >= 0 && pos < (long)length) ? mono[pos] * window[i] : 0;
+
+            pos += features->hopsize;
+            imag[i] = (frame + 1 < features->numframes && pos >= 0 && pos < (long)length) ? mono[pos] * window[i] : 0;
+        }
+
+        Fft_transform(real, imag, winsize);
+
+        for(k=0; k < numbins; k++) {
+            j = (winsize - k) % winsize;
+            zr = real[k]; zi = imag[k];
+            wr = real[j]; wi = imag[j];
+            maga[k] = 0.5 * sqrt((zr + wr) * (zr + wr) + (zi - wi) * (zi - wi));
+            magb[k] = 0.5 * sqrt((zr - wr) * (zr - wr) + (zi + wi) * (zi + wi));
+        }
+
+        spectralfeatures_frame(features, frame, maga, numbins, bands, sorted, peaks, valleys);
+        if(frame + 1 < features->numframes) {
+            spectralfeatures_frame(features, frame + 1, magb, numbins, bands, sorted, peaks, valleys);
+        }
+    }
+
+    /* Peaks and valleys are each clamped to 80dB below 
+     * their loudest value anywhere in the sound */
+    maxpeak = maxvalley = -INFINITY;
+    for(i=0; i < LPCONTRAST_BANDS * features->numframes; i++) {
+        maxpeak = fmax(maxpeak, peaks[i]);
+        maxvalley = fmax(maxvalley, valleys[i]);
+    }
+
+    for(i=0; i < LPCONTRAST_BANDS * features->numframes; i++) {
+        features->contrast[i] = (lpfloat_t)(fmax(peaks[i], maxpeak - 80) - fmax(valleys[i], maxvalley - 80));
+    }
+
+    LPMemoryPool.free(mono);
+    LPMemoryPool.free(window);
+    LPMemoryPool.free(real);
+    LPMemoryPool.free(imag);
+    LPMemoryPool.free(maga);
+    LPMemoryPool.free(magb);
+    LPMemoryPool.free(sorted);
+    LPMemoryPool.free(peaks);
+    LPMemoryPool.free(valleys);
+
+    return features;
+}
+
+lpspectralfeatures_t * spectralfeatures_analyze(lpbuffer_t * snd, int winsize) {
+    return spectralfeatures_analyze_frames(snd->data, snd->length, snd->channels, snd->samplerate, winsize);
+}
+
+void spectralfeatures_destroy(lpspectralfeatures_t * features) {
+    LPMemoryPool.free(features->centroid);
+    LPMemoryPool.free(features->bandwidth);
+    LPMemoryPool.free(features->flatness);
+    LPMemoryPool.free(features->rolloff);
+    LPMemoryPool.free(features->contrast);
+    LPMemoryPool.free(features);
+}
+
+
 
-const lpmir_pitch_factory_t LPPitchTracker = { yin_create, yin_process, yin_destroy };
+const lpmir_pitch_factory_t LPPitchTracker = { yin_create, yin_process, yin_process_block, yin_destroy };
 const lpmir_onset_factory_t LPOnsetDetector = { coyote_create, coyote_process, coyote_destroy };
 const lpmir_envelopefollower_factory_t LPEnvelopeFollower = { envelopefollower_create, envelopefollower_process, envelopefollower_destroy };
 const lpmir_peakfollower_factory_t LPPeakFollower = { peakfollower_create, peakfollower_process, peakfollower_destroy };
 const lpmir_crossingfollower_factory_t LPCrossingFollower = { crossingfollower_create, crossingfollower_process, crossingfollower_destroy };
+const lpmir_spectralfeatures_factory_t LPSpectralFeatures = { spectralfeatures_analyze, spectralfeatures_analyze_frames, spectralfeatures_destroy };
 
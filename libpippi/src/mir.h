@@ -2,7 +2,24 @@
 #define LP_MIR_H
 
 #include "pippicore.h"
-
+#include "spectral.h"
+#include "fft/fft.h"
+
+/* Spectral contrast is measured in LPCONTRAST_BANDS - 1 
+ * octave bands starting at LPCONTRAST_FMIN, plus one band 
+ * below it. These match librosa's defaults. */
+#define LPCONTRAST_BANDS 7
+#define LPCONTRAST_FMIN 200.0
+#define LPCONTRAST_QUANTILE 0.02
+#define LPROLLOFF_PERCENT 0.85
+
+/* The difference function is measured over a window of 
+ * tau_max samples at every lag up to tau_max, so each step 
+ * looks at the last framesize = 2 * tau_max samples. The 
+ * input history is mirrored, so those are always contiguous 
+ * at block->data + block->pos. The cross term of the 
+ * difference function is an autocorrelation done with one 
+ * FFT each way, and the energy terms are running sums. */
 typedef struct lpyin_t {
     lpbuffer_t * block;
     int samplerate;
@@ -18,6 +35,15 @@ typedef struct lpyin_t {
 
     int tau_max;
     int tau_min;
+    int framesize;
+
+    /* FFT tables and scratch of fftsize */
+    size_t fftsize;
+    size_t * bitrev;
+    lpfloat_t * cos_table;
+    lpfloat_t * sin_table;
+    lpfloat_t * real;
+    lpfloat_t * imag;
 } lpyin_t;
 
 /**
@@ -105,6 +131,25 @@ typedef struct lpenvelopefollower_t {
 } lpenvelopefollower_t;
 
 
+/* Spectral descriptors for every frame of a sound, all 
+ * computed from one STFT. Frames use a hann window with 
+ * a hop of winsize / 4, and are centered on their hop 
+ * with zero padding at either end, so there are 
+ * 1 + length / hopsize of them -- the same framing 
+ * librosa uses by default. Contrast holds one row of 
+ * numframes values for each band. */
+typedef struct lpspectralfeatures_t {
+    size_t numframes;
+    int winsize;
+    int hopsize;
+    int samplerate;
+    lpfloat_t * centroid;
+    lpfloat_t * bandwidth;
+    lpfloat_t * flatness;
+    lpfloat_t * rolloff;
+    lpfloat_t * contrast;
+} lpspectralfeatures_t;
+
 typedef struct lpmir_crossingfollower_factory_t {
     lpcrossingfollower_t * (*create)();
     void (*process)(lpcrossingfollower_t *, lpfloat_t);
@@ -126,6 +171,7 @@ typedef struct lpmir_envelopefollower_factory_t {
 typedef struct lpmir_pitch_factory_t {
     lpyin_t * (*yin_create)(int, int);
     lpfloat_t (*yin_process)(lpyin_t *, lpfloat_t);
+    lpfloat_t (*yin_process_block)(lpyin_t *, const lpfloat_t *, size_t, lpfloat_t *);
     void (*yin_destroy)(lpyin_t *);
 } lpmir_pitch_factory_t;
 
@@ -135,11 +181,18 @@ typedef struct lpmir_onset_factory_t {
     void (*coyote_destory)(lpcoyote_t * od);
 } lpmir_onset_factory_t;
 
+typedef struct lpmir_spectralfeatures_factory_t {
+    lpspectralfeatures_t * (*analyze)(lpbuffer_t * snd, int winsize);
+    lpspectralfeatures_t * (*analyze_frames)(const lpfloat_t * frames, size_t length, int channels, int samplerate, int winsize);
+    void (*destroy)(lpspectralfeatures_t * features);
+} lpmir_spectralfeatures_factory_t;
+
 
 extern const lpmir_pitch_factory_t LPPitchTracker;
 extern const lpmir_onset_factory_t LPOnsetDetector;
 extern const lpmir_envelopefollower_factory_t LPEnvelopeFollower;
 extern const lpmir_peakfollower_factory_t LPPeakFollower;
 extern const lpmir_crossingfollower_factory_t LPCrossingFollower;
+extern const lpmir_spectralfeatures_factory_t LPSpectralFeatures;
 
 #endif
@@ -2,10 +2,11 @@
 
 lpblnosc_t * create_blnosc(lpbuffer_t * buf, lpfloat_t minfreq, lpfloat_t maxfreq);
 lpfloat_t process_blnosc(lpblnosc_t * osc);
+void process_block_blnosc(lpblnosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * amp);
 lpbuffer_t * render_blnosc(lpblnosc_t * osc, size_t length, lpbuffer_t * amp, int channels);
 void destroy_blnosc(lpblnosc_t * osc);
 
-const lpblnosc_factory_t LPBLNOsc = { create_blnosc, process_blnosc, render_blnosc, destroy_blnosc };
+const lpblnosc_factory_t LPBLNOsc = { create_blnosc, process_blnosc, process_block_blnosc, render_blnosc, destroy_blnosc };
 
 lpblnosc_t * create_blnosc(lpbuffer_t * buf, lpfloat_t minfreq, lpfloat_t maxfreq) {
     lpblnosc_t* osc = (lpblnosc_t*)LPMemoryPool.alloc(1, sizeof(lpblnosc_t));
@@ -53,6 +54,48 @@ lpfloat_t process_blnosc(lpblnosc_t * osc) {
     return sample;
 }
 
+/* Renders nframes into out. The frequency is still chosen 
+ * at random on every cycle, so only an amp block is taken, 
+ * which may be NULL for unity gain. The gate is set when a 
+ * cycle ended at any point in the block. */
+void process_block_blnosc(lpblnosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * amp) {
+    lpfloat_t phase, phaseinc, boundry, sample, f;
+    lpfloat_t * data;
+    size_t i, idxa;
+    int c, channels, gate;
+
+    if(nframes == 0) return;
+
+    data = osc->buf->data;
+    channels = osc->buf->channels;
+    boundry = osc->buf->length-1;
+    phase = osc->phase;
+    phaseinc = osc->phaseinc;
+    gate = 0;
+
+    for(i=0; i < nframes; i++) {
+        f = phase - (int)phase;
+        idxa = (size_t)phase * channels;
+
+        sample = 0.f;
+        for(c=0; c < channels; c++) {
+            sample += (1.f - f) * data[idxa + c] + (f * data[idxa + channels + c]);
+        }
+
+        out[i] = (amp != NULL) ? sample * amp[i] : sample;
+
+        phase += phaseinc * osc->freq;
+        if(phase >= boundry) {
+            phase -= boundry;
+            gate = 1;
+            osc->freq = LPRand.rand(osc->minfreq, osc->maxfreq);
+        }
+    }
+
+    osc->phase = phase;
+    osc->gate = gate;
+}
+
 lpbuffer_t * render_blnosc(lpblnosc_t * osc, size_t length, lpbuffer_t * amp, int channels) {
     lpbuffer_t * out;
     lpfloat_t _amp, sample;
@@ -3,10 +3,11 @@
 
 lpphasorosc_t * create_phasorosc(void);
 lpfloat_t process_phasorosc(lpphasorosc_t * osc);
+void process_block_phasorosc(lpphasorosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp);
 lpbuffer_t * render_phasorosc(lpphasorosc_t * osc, size_t length, lpbuffer_t * freq, lpbuffer_t * amp, int channels);
 void destroy_phasorosc(lpphasorosc_t * osc);
 
-const lpphasorosc_factory_t LPPhasorOsc = { create_phasorosc, process_phasorosc, render_phasorosc, destroy_phasorosc };
+const lpphasorosc_factory_t LPPhasorOsc = { create_phasorosc, process_phasorosc, process_block_phasorosc, render_phasorosc, destroy_phasorosc };
 
 lpphasorosc_t * create_phasorosc(void) {
     lpphasorosc_t * osc = (lpphasorosc_t *)LPMemoryPool.alloc(1, sizeof(lpphasorosc_t));
@@ -22,6 +23,37 @@ lpfloat_t process_phasorosc(lpphasorosc_t* osc) {
     return osc->phase * 2.f - 1.f;
 }
 
+/* Renders nframes into out. The freq and amp blocks hold a 
+ * value per frame, or may be NULL to use osc->freq and unity gain. */
+void process_block_phasorosc(lpphasorosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp) {
+    lpfloat_t phase, isr;
+    size_t i;
+
+    if(nframes == 0) return;
+
+    phase = osc->phase;
+    isr = 1.0f / osc->samplerate;
+
+    for(i=0; i < nframes; i++) {
+        phase += ((freq != NULL) ? freq[i] : osc->freq) * isr;
+        while(phase >= 1) phase -= 1.0f;
+        out[i] = phase;
+    }
+
+    if(amp != NULL) {
+        for(i=0; i < nframes; i++) {
+            out[i] = (out[i] * 2.f - 1.f) * amp[i];
+        }
+    } else {
+        for(i=0; i < nframes; i++) {
+            out[i] = out[i] * 2.f - 1.f;
+        }
+    }
+
+    osc->phase = phase;
+    if(freq != NULL) osc->freq = freq[nframes-1];
+}
+
 lpbuffer_t * render_phasorosc(lpphasorosc_t * osc, size_t length, lpbuffer_t * freq, lpbuffer_t * amp, int channels) {
     lpbuffer_t * out;
     lpfloat_t sample, _amp;
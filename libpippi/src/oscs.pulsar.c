@@ -98,6 +98,135 @@ lpfloat_t process_pulsarosc(lppulsarosc_t * p) {
     return sample * mod;
 }
 
+/* The tables the block path reads from, with the same 
+ * arithmetic as LPInterpolation.linear so both paths agree */
+typedef struct lppulsartable_t {
+    lpbuffer_t * a;
+    lpbuffer_t * b;
+    lpfloat_t morphfrac;
+    int morph;
+} lppulsartable_t;
+
+static inline lpfloat_t pulsar_read(const lpbuffer_t * buf, lpfloat_t phase) {
+    lpfloat_t frac;
+    size_t i;
+
+    if(buf->range == 1) return buf->data[0];
+
+    frac = phase - (int)phase;
+    i = (int)phase;
+
+    if(i >= buf->boundry) return 0;
+
+    return (1.0f - frac) * buf->data[i] + (frac * buf->data[i+1]);
+}
+
+static inline lpfloat_t pulsar_lookup(const lppulsartable_t * t, lpfloat_t pos) {
+    lpfloat_t a, b;
+
+    if(!t->morph) return pulsar_read(t->a, pos);
+
+    a = pulsar_read(t->a, pos * t->a->length);
+    b = pulsar_read(t->b, pos * t->b->length);
+    return (1.0 - t->morphfrac) * a + (t->morphfrac * b);
+}
+
+/* Picks the tables to read for the whole block. The morph 
+ * position doesn't move within a block, so the pair of 
+ * tables and the fraction between them are fixed. */
+static void pulsar_table_setup(lppulsartable_t * t, lpstack_t * stack, lpfloat_t morphpos) {
+    int morphmul, morphidx;
+
+    if(stack->length == 1) {
+        t->morph = 0;
+        t->a = stack->stack[0];
+        t->b = NULL;
+        t->morphfrac = 0;
+        return;
+    }
+
+    morphmul = stack->length-1 > 1 ? stack->length-1 : 1;
+    morphpos *= morphmul;
+    morphidx = (int)morphpos;
+
+    t->morph = 1;
+    t->a = stack->stack[morphidx];
+    t->b = stack->stack[morphidx+1];
+    t->morphfrac = morphpos - morphidx;
+}
+
+/* Renders nframes into out. The freq and amp blocks hold a 
+ * value per frame, or may be NULL to use p->freq and unity 
+ * gain. The phases are carried in locals and the tables to 
+ * read are picked once for the block. */
+void process_block_pulsarosc(lppulsarosc_t * p, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp) {
+    lppulsartable_t wt, win;
+    lpfloat_t ipw, isr, inc, sample, mod, burst, wtphase, winphase, burstphase;
+    lpfloat_t winlength, burstlength;
+    int * burstdata;
+    size_t i;
+
+    assert(p->wts != NULL);
+    assert(p->wins != NULL);
+
+    if(nframes == 0) return;
+
+    ipw = (p->pulsewidth > 0) ? 1.0/p->pulsewidth : 0.f;
+    isr = 1.f / p->samplerate;
+
+    pulsar_table_setup(&wt, p->wts, lpwv(p->wts->pos, 0, 1));
+    pulsar_table_setup(&win, p->wins, p->wins->pos);
+
+    wtphase = p->wts->phase;
+    winphase = p->wins->phase;
+    winlength = p->wins->length;
+
+    burstdata = NULL;
+    burstphase = 0;
+    burstlength = 0;
+    if(p->burst != NULL) {
+        burstdata = p->burst->data;
+        burstphase = p->burst->phase;
+        burstlength = p->burst->length;
+    }
+
+    for(i=0; i < nframes; i++) {
+        sample = 0.f;
+        mod = 0.f;
+        burst = 1.f;
+
+        if(burstdata != NULL && burstphase < burstlength) {
+            burst = burstdata[(int)burstphase];
+        }
+
+        if(p->saturation < 1.f && LPRand.rand(0.f, 1.f) > p->saturation) {
+            burst = 0; 
+        }
+
+        if(ipw > 0 && burst > 0) {
+            sample = pulsar_lookup(&wt, wtphase * ipw);
+            mod = pulsar_lookup(&win, winphase * ipw);
+        }
+
+        inc = isr * ((freq != NULL) ? freq[i] : p->freq);
+        wtphase += inc;
+        winphase += inc;
+
+        if(p->burst != NULL && winphase >= winlength) burstphase += 1;
+
+        if(wtphase >= 1.f) wtphase -= 1.f;
+        if(winphase >= 1.f) winphase -= 1.f;
+        if(p->burst != NULL && burstphase >= burstlength) burstphase -= burstlength;
+
+        out[i] = (amp != NULL) ? sample * mod * amp[i] : sample * mod;
+    }
+
+    p->wts->phase = wtphase;
+    p->wins->phase = winphase;
+    if(p->burst != NULL) p->burst->phase = burstphase;
+    if(freq != NULL) p->freq = freq[nframes-1];
+}
+
 void destroy_pulsarosc(lppulsarosc_t* p) {
     LPBuffer.destroy_stack(p->wts);
     LPBuffer.destroy_stack(p->wins);
@@ -106,4 +235,4 @@ void destroy_pulsarosc(lppulsarosc_t* p) {
 }
 
 
-const lppulsarosc_factory_t LPPulsarOsc = { create_pulsarosc, process_pulsarosc, destroy_pulsarosc };
+const lppulsarosc_factory_t LPPulsarOsc = { create_pulsarosc, process_pulsarosc, process_block_pulsarosc, destroy_pulsarosc };
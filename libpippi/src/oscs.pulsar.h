@@ -17,6 +17,7 @@ typedef struct lppulsarosc_t {
 typedef struct lppulsarosc_factory_t {
     lppulsarosc_t * (*create)(void);
     lpfloat_t (*process)(lppulsarosc_t *);
+    void (*process_block)(lppulsarosc_t *, lpfloat_t *, size_t, const lpfloat_t *, const lpfloat_t *);
     void (*destroy)(lppulsarosc_t*);
 } lppulsarosc_factory_t;
 
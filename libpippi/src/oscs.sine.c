@@ -3,10 +3,19 @@
 
 lpsineosc_t * create_sineosc(void);
 lpfloat_t process_sineosc(lpsineosc_t * osc);
+void process_block_sineosc(lpsineosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp);
 lpbuffer_t * render_sineosc(lpsineosc_t * osc, size_t length, lpbuffer_t * freq, lpbuffer_t * amp, int channels);
 void destroy_sineosc(lpsineosc_t * osc);
 
-const lpsineosc_factory_t LPSineOsc = { create_sineosc, process_sineosc, render_sineosc, destroy_sineosc };
+lposcbank_t * create_oscbank(size_t numpartials, lpfloat_t samplerate);
+void set_partial_oscbank(lposcbank_t * bank, size_t partial, lpfloat_t freq, lpfloat_t amp, lpfloat_t phase);
+void set_envelope_oscbank(lposcbank_t * bank, size_t partial, int target, const lpfloat_t * times, const lpfloat_t * values, size_t numpoints);
+void render_block_oscbank(lposcbank_t * bank, lpfloat_t * out, size_t nframes);
+lpbuffer_t * render_oscbank(lposcbank_t * bank, size_t length, int channels);
+void destroy_oscbank(lposcbank_t * bank);
+
+const lpsineosc_factory_t LPSineOsc = { create_sineosc, process_sineosc, process_block_sineosc, render_sineosc, destroy_sineosc };
+const lposcbank_factory_t LPOscBank = { create_oscbank, set_partial_oscbank, set_envelope_oscbank, render_block_oscbank, render_oscbank, destroy_oscbank };
 
 lpsineosc_t * create_sineosc(void) {
     lpsineosc_t * osc = (lpsineosc_t *)LPMemoryPool.alloc(1, sizeof(lpsineosc_t));
@@ -30,22 +39,83 @@ lpfloat_t process_sineosc(lpsineosc_t* osc) {
     return sample;
 }
 
+/* sin(2 * PI * phase) for a phase in [0, 1) without a libm call.
+ * The phase is folded into a quarter turn and the taylor series 
+ * is taken to the 13th power, which is within 1e-9 of sin(). */
+static inline lpfloat_t fastsin_sineosc(lpfloat_t phase) {
+    lpfloat_t x, x2;
+
+    x = phase - (lpfloat_t)0.5;
+    x = (lpfloat_t)copysign((lpfloat_t)0.25 - (lpfloat_t)fabs((lpfloat_t)0.25 - (lpfloat_t)fabs(x)), x);
+    x *= (lpfloat_t)-PI2;
+    x2 = x * x;
+
+    return x * (1 + x2 * ((lpfloat_t)(-1.0/6) + x2 * ((lpfloat_t)(1.0/120) + x2 * ((lpfloat_t)(-1.0/5040) 
+             + x2 * ((lpfloat_t)(1.0/362880) + x2 * ((lpfloat_t)(-1.0/39916800) + x2 * (lpfloat_t)(1.0/6227020800.0)))))));
+}
+
+/* The fractional part of a phase, also for negative phases */
+static inline lpfloat_t wrap_phase_sineosc(lpfloat_t phase) {
+    phase -= (int)phase;
+    return phase + (lpfloat_t)(phase < 0);
+}
+
+/* Renders nframes into out. The freq and amp blocks hold a 
+ * value per frame, or may be NULL to use osc->freq and unity 
+ * gain. The phases are accumulated first, so the second pass 
+ * has no loop carried state and can be vectorized. */
+void process_block_sineosc(lpsineosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp) {
+    lpfloat_t phase, isr;
+    size_t i;
+
+    if(nframes == 0) return;
+
+    phase = osc->phase;
+    isr = 1.0f / osc->samplerate;
+
+    for(i=0; i < nframes; i++) {
+        out[i] = phase;
+        phase += ((freq != NULL) ? freq[i] : osc->freq) * isr;
+        while(phase >= 1) phase -= 1.0f;
+        while(phase < 0) phase += 1.0f;
+    }
+
+    if(amp != NULL) {
+        for(i=0; i < nframes; i++) {
+            out[i] = fastsin_sineosc(out[i]) * amp[i];
+        }
+    } else {
+        for(i=0; i < nframes; i++) {
+            out[i] = fastsin_sineosc(out[i]);
+        }
+    }
+
+    osc->phase = phase;
+    if(freq != NULL) osc->freq = freq[nframes-1];
+}
+
 lpbuffer_t * render_sineosc(lpsineosc_t * osc, size_t length, lpbuffer_t * freq, lpbuffer_t * amp, int channels) {
     lpbuffer_t * out;
-    lpfloat_t sample, _amp;
-    size_t i;
+    lpfloat_t freqblock[LPSINEOSC_RENDER_BLOCKSIZE];
+    lpfloat_t ampblock[LPSINEOSC_RENDER_BLOCKSIZE];
+    lpfloat_t block[LPSINEOSC_RENDER_BLOCKSIZE];
+    size_t i, j, n;
     int c;
-    float pos;
 
-    pos = 0.f;
     out = LPBuffer.create(length, channels, osc->samplerate);
-    for(i=0; i < length; i++) {
-        pos = (float)i/length;
-        osc->freq = LPInterpolation.linear_pos(freq, pos);
-        _amp = LPInterpolation.linear_pos(amp, pos);
-        sample = process_sineosc(osc) * _amp;
-        for(c=0; c < channels; c++) {
-            out->data[i * channels + c] = sample;
+    for(i=0; i < length; i += n) {
+        n = (length - i < LPSINEOSC_RENDER_BLOCKSIZE) ? length - i : LPSINEOSC_RENDER_BLOCKSIZE;
+        for(j=0; j < n; j++) {
+            freqblock[j] = LPInterpolation.linear_pos(freq, (float)(i+j)/length);
+            ampblock[j] = LPInterpolation.linear_pos(amp, (float)(i+j)/length);
+        }
+
+        process_block_sineosc(osc, block, n, freqblock, ampblock);
+
+        for(j=0; j < n; j++) {
+            for(c=0; c < channels; c++) {
+                out->data[(i+j) * channels + c] = block[j];
+            }
         }
     }
 
@@ -56,4 +126,156 @@ void destroy_sineosc(lpsineosc_t * osc) {
     LPMemoryPool.free(osc);
 }
 
+lposcbank_t * create_oscbank(size_t numpartials, lpfloat_t samplerate) {
+    lposcbank_t * bank = (lposcbank_t *)LPMemoryPool.alloc(1, sizeof(lposcbank_t));
+    bank->numpartials = numpartials;
+    bank->samplerate = samplerate;
+    bank->pos = 0;
+    bank->phases = (lpfloat_t *)LPMemoryPool.alloc(numpartials, sizeof(lpfloat_t));
+    bank->freqs = (lpfloat_t *)LPMemoryPool.alloc(numpartials, sizeof(lpfloat_t));
+    bank->amps = (lpfloat_t *)LPMemoryPool.alloc(numpartials, sizeof(lpfloat_t));
+    bank->freq_envs = (lposcbank_env_t *)LPMemoryPool.alloc(numpartials, sizeof(lposcbank_env_t));
+    bank->amp_envs = (lposcbank_env_t *)LPMemoryPool.alloc(numpartials, sizeof(lposcbank_env_t));
+    return bank;
+}
+
+void set_partial_oscbank(lposcbank_t * bank, size_t partial, lpfloat_t freq, lpfloat_t amp, lpfloat_t phase) {
+    assert(partial < bank->numpartials);
+    bank->freqs[partial] = freq;
+    bank->amps[partial] = amp;
+    bank->phases[partial] = phase - (int)phase;
+}
+
+/* The envelope value at a frame no earlier than the last one asked for */
+static lpfloat_t read_env_oscbank(lposcbank_env_t * env, lpfloat_t frame) {
+    lpfloat_t t0, t1;
+
+    while(env->cursor + 1 < env->numpoints && env->times[env->cursor + 1] <= frame) env->cursor += 1;
+
+    if(frame <= env->times[0]) return env->values[0];
+    if(env->cursor + 1 >= env->numpoints) return env->values[env->numpoints-1];
+
+    t0 = env->times[env->cursor];
+    t1 = env->times[env->cursor + 1];
+    return env->values[env->cursor] + (env->values[env->cursor + 1] - env->values[env->cursor]) * ((frame - t0) / (t1 - t0));
+}
+
+/* Copies the breakpoints into the bank, replacing any 
+ * envelope already on that target. Times must be ascending. 
+ * The envelope holds its first value before the first time 
+ * and its last value after the last. */
+void set_envelope_oscbank(lposcbank_t * bank, size_t partial, int target, const lpfloat_t * times, const lpfloat_t * values, size_t numpoints) {
+    lposcbank_env_t * env;
+    size_t i;
+
+    assert(partial < bank->numpartials);
+    env = (target == LPOSCBANK_FREQ) ? &bank->freq_envs[partial] : &bank->amp_envs[partial];
+
+    if(env->numpoints > 0) {
+        LPMemoryPool.free(env->times);
+        LPMemoryPool.free(env->values);
+        env->numpoints = 0;
+    }
+
+    env->cursor = 0;
+    if(numpoints == 0) return;
+
+    env->times = (lpfloat_t *)LPMemoryPool.alloc(numpoints, sizeof(lpfloat_t));
+    env->values = (lpfloat_t *)LPMemoryPool.alloc(numpoints, sizeof(lpfloat_t));
+    for(i=0; i < numpoints; i++) {
+        env->times[i] = times[i];
+        env->values[i] = values[i];
+    }
+    env->numpoints = numpoints;
+
+    /* The partial starts where the envelope is now */
+    if(target == LPOSCBANK_FREQ) {
+        bank->freqs[partial] = read_env_oscbank(env, bank->pos);
+    } else {
+        bank->amps[partial] = read_env_oscbank(env, bank->pos);
+    }
+}
+
+/* Renders the sum of the partials into nframes of out */
+void render_block_oscbank(lposcbank_t * bank, lpfloat_t * out, size_t nframes) {
+    lpfloat_t freq1, amp1, inc, dinc, damp, phase, amp, end;
+    lpfloat_t isr, * block;
+    size_t i, n, p, start;
+    const lpsimd_kernels_t * simd;
+
+    isr = 1.0f / bank->samplerate;
+    simd = lpsimd_kernels();
 
+    for(i=0; i < nframes; i++) out[i] = 0;
+
+    for(start=0; start < nframes; start += n) {
+        n = (nframes - start < LPOSCBANK_BLOCKSIZE) ? nframes - start : LPOSCBANK_BLOCKSIZE;
+        block = out + start;
+        end = (lpfloat_t)(bank->pos + n);
+
+        for(p=0; p < bank->numpartials; p++) {
+            freq1 = (bank->freq_envs[p].numpoints > 0) ? read_env_oscbank(&bank->freq_envs[p], end) : bank->freqs[p];
+            amp1 = (bank->amp_envs[p].numpoints > 0) ? read_env_oscbank(&bank->amp_envs[p], end) : bank->amps[p];
+
+            /* Ramp from this block's freq and amp to the next */
+            inc = bank->freqs[p] * isr;
+            dinc = (freq1 - bank->freqs[p]) * isr / n;
+            damp = (amp1 - bank->amps[p]) / n;
+            phase = bank->phases[p];
+            amp = bank->amps[p];
+
+            /* The increment ramps by dinc every frame, so the 
+             * kernel sums the series for the phase of each frame */
+            if(amp != 0 || amp1 != 0) simd->add_sines(block, n, phase, inc, dinc, amp, damp);
+
+            bank->phases[p] = wrap_phase_sineosc(phase + n * inc + (lpfloat_t)(n * (n - 1) / 2) * dinc);
+            bank->freqs[p] = freq1;
+            bank->amps[p] = amp1;
+        }
+
+        bank->pos += n;
+    }
+}
+
+lpbuffer_t * render_oscbank(lposcbank_t * bank, size_t length, int channels) {
+    lpbuffer_t * out;
+    lpfloat_t block[LPOSCBANK_BLOCKSIZE];
+    size_t i, j, n;
+    int c;
+
+    out = LPBuffer.create(length, channels, bank->samplerate);
+    for(i=0; i < length; i += n) {
+        n = (length - i < LPOSCBANK_BLOCKSIZE) ? length - i : LPOSCBANK_BLOCKSIZE;
+        render_block_oscbank(bank, block, n);
+        for(j=0; j < n; j++) {
+            for(c=0; c < channels; c++) {
+                out->data[(i+j) * channels + c] = block[j];
+            }
+        }
+    }
+
+    return out;
+}
+
+void destroy_oscbank(lposcbank_t * bank) {
+    size_t p;
+
+    for(p=0; p < bank->numpartials; p++) {
+        if(bank->freq_envs[p].numpoints > 0) {
+            LPMemoryPool.free(bank->freq_envs[p].times);
+            LPMemoryPool.free(bank->freq_envs[p].values);
+        }
+
+        if(bank->amp_envs[p].numpoints > 0) {
+            LPMemoryPool.free(bank->amp_envs[p].times);
+            LPMemoryPool.free(bank->amp_envs[p].values);
+        }
+    }
+
+    LPMemoryPool.free(bank->phases);
+    LPMemoryPool.free(bank->freqs);
+    LPMemoryPool.free(bank->amps);
+    LPMemoryPool.free(bank->freq_envs);
+    LPMemoryPool.free(bank->amp_envs);
+    LPMemoryPool.free(bank);
+}
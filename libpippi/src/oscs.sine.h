@@ -3,6 +3,14 @@
 
 #include "pippicore.h"
 
+#define LPSINEOSC_RENDER_BLOCKSIZE 64
+#define LPOSCBANK_BLOCKSIZE 64
+
+enum LPOscBankTargets {
+    LPOSCBANK_FREQ,
+    LPOSCBANK_AMP
+};
+
 typedef struct lpsineosc_t {
     lpfloat_t phase;
     lpfloat_t freq;
@@ -12,10 +20,48 @@ typedef struct lpsineosc_t {
 typedef struct lpsineosc_factory_t {
     lpsineosc_t * (*create)(void);
     lpfloat_t (*process)(lpsineosc_t *);
+    void (*process_block)(lpsineosc_t *, lpfloat_t *, size_t, const lpfloat_t *, const lpfloat_t *);
     lpbuffer_t * (*render)(lpsineosc_t*, size_t, lpbuffer_t *, lpbuffer_t *, int);
     void (*destroy)(lpsineosc_t *);
 } lpsineosc_factory_t;
 
+/* A breakpoint envelope for one partial of a bank. Times 
+ * are in frames from the start of the bank's clock. */
+typedef struct lposcbank_env_t {
+    lpfloat_t * times;
+    lpfloat_t * values;
+    size_t numpoints;
+    size_t cursor;
+} lposcbank_env_t;
+
+/* A bank of sine partials for additive synthesis. The state 
+ * of each partial lives in parallel arrays, and a block is 
+ * rendered one partial at a time with the phase and amp of 
+ * each frame in closed form, and summed into the block by 
+ * the add_sines lpsimd kernel. Envelopes are 
+ * sampled once per LPOSCBANK_BLOCKSIZE frames and ramped 
+ * linearly in between. */
+typedef struct lposcbank_t {
+    size_t numpartials;
+    lpfloat_t samplerate;
+    size_t pos;
+    lpfloat_t * phases;
+    lpfloat_t * freqs;
+    lpfloat_t * amps;
+    lposcbank_env_t * freq_envs;
+    lposcbank_env_t * amp_envs;
+} lposcbank_t;
+
+typedef struct lposcbank_factory_t {
+    lposcbank_t * (*create)(size_t, lpfloat_t);
+    void (*set_partial)(lposcbank_t *, size_t, lpfloat_t, lpfloat_t, lpfloat_t);
+    void (*set_envelope)(lposcbank_t *, size_t, int, const lpfloat_t *, const lpfloat_t *, size_t);
+    void (*render_block)(lposcbank_t *, lpfloat_t *, size_t);
+    lpbuffer_t * (*render)(lposcbank_t *, size_t, int);
+    void (*destroy)(lposcbank_t *);
+} lposcbank_factory_t;
+
 extern const lpsineosc_factory_t LPSineOsc;
+extern const lposcbank_factory_t LPOscBank;
 
 #endif
@@ -2,10 +2,11 @@
 
 lptableosc_t * create_tableosc(lpbuffer_t * buf);
 lpfloat_t process_tableosc(lptableosc_t * osc);
+void process_block_tableosc(lptableosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp);
 lpbuffer_t * render_tableosc(lptableosc_t * osc, size_t length, lpbuffer_t * amp, int channels);
 void destroy_tableosc(lptableosc_t * osc);
 
-const lptableosc_factory_t LPTableOsc = { create_tableosc, process_tableosc, render_tableosc, destroy_tableosc };
+const lptableosc_factory_t LPTableOsc = { create_tableosc, process_tableosc, process_block_tableosc, render_tableosc, destroy_tableosc };
 
 lptableosc_t * create_tableosc(lpbuffer_t * buf) {
     lptableosc_t* osc = (lptableosc_t*)LPMemoryPool.alloc(1, sizeof(lptableosc_t));
@@ -50,6 +51,48 @@ lpfloat_t process_tableosc(lptableosc_t * osc) {
     return sample;
 }
 
+/* Renders nframes of the table summed to mono into out. The 
+ * freq and amp blocks hold a value per frame, or may be NULL 
+ * to use osc->freq and unity gain. The gate is set when the 
+ * table wrapped at any point in the block. */
+void process_block_tableosc(lptableosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp) {
+    lpfloat_t phase, phaseinc, boundry, sample, f;
+    lpfloat_t * data;
+    size_t i, idxa;
+    int c, channels, gate;
+
+    if(nframes == 0) return;
+
+    data = osc->buf->data;
+    channels = osc->buf->channels;
+    boundry = osc->buf->length-1;
+    phase = osc->phase;
+    phaseinc = osc->phaseinc;
+    gate = 0;
+
+    for(i=0; i < nframes; i++) {
+        f = phase - (int)phase;
+        idxa = (size_t)phase * channels;
+
+        sample = 0.f;
+        for(c=0; c < channels; c++) {
+            sample += (1.f - f) * data[idxa + c] + (f * data[idxa + channels + c]);
+        }
+
+        out[i] = (amp != NULL) ? sample * amp[i] : sample;
+
+        phase += phaseinc * ((freq != NULL) ? freq[i] : osc->freq);
+        if(phase >= boundry) {
+            phase -= boundry;
+            gate = 1;
+        }
+    }
+
+    osc->phase = phase;
+    osc->gate = gate;
+    if(freq != NULL) osc->freq = freq[nframes-1];
+}
+
 lpbuffer_t * render_tableosc(lptableosc_t * osc, size_t length, lpbuffer_t * amp, int channels) {
     lpbuffer_t * out;
     lpfloat_t _amp, sample;
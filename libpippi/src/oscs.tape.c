@@ -2,6 +2,7 @@
 
 lptapeosc_t * create_tapeosc(lpbuffer_t * buf, lpfloat_t range);
 void process_tapeosc(lptapeosc_t * osc);
+void process_block_tapeosc(lptapeosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * speed, const lpfloat_t * amp);
 void rewind_tapeosc(lptapeosc_t * osc);
 lpbuffer_t * render_tapeosc(lptapeosc_t * osc, size_t length, lpbuffer_t * amp, int channels);
 void destroy_tapeosc(lptapeosc_t * osc);
@@ -9,6 +10,7 @@ void destroy_tapeosc(lptapeosc_t * osc);
 const lptapeosc_factory_t LPTapeOsc = { 
     create_tapeosc, 
     process_tapeosc, 
+    process_block_tapeosc, 
     rewind_tapeosc, 
     render_tapeosc, 
     destroy_tapeosc 
@@ -76,6 +78,59 @@ void process_tapeosc(lptapeosc_t * osc) {
     }
 }
 
+/* Renders nframes of interleaved frames with the channels 
+ * of the tape into out. The speed and amp blocks hold a value 
+ * per frame, or may be NULL to use osc->speed and unity gain. 
+ * current_frame holds the last frame and the gate is set when 
+ * the tape looped at any point in the block. */
+void process_block_tapeosc(lptapeosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * speed, const lpfloat_t * amp) {
+    lpfloat_t * data;
+    lpfloat_t phase, ipw, f, boundry, last, gain;
+    size_t i, idxa;
+    int c, channels, gate;
+
+    if(nframes == 0) return;
+
+    ipw = 1.f;
+    if(osc->pulsewidth > 0) ipw = 1.0f/osc->pulsewidth;
+
+    data = osc->buf->data;
+    channels = osc->buf->channels;
+    boundry = osc->range + osc->start;
+    last = osc->buf->length - 1;
+    gate = 0;
+
+    for(i=0; i < nframes; i++) {
+        phase = osc->phase * ipw;
+        gain = (amp != NULL) ? amp[i] : 1.f;
+
+        if(ipw == 0.f || phase >= last) {
+            for(c=0; c < channels; c++) {
+                out[i * channels + c] = 0.f;
+            }
+        } else {
+            f = phase - (int)phase;
+            idxa = (size_t)phase * channels;
+            for(c=0; c < channels; c++) {
+                out[i * channels + c] = ((1.f - f) * data[idxa + c] + (f * data[idxa + channels + c])) * gain;
+            }
+        }
+
+        osc->phase += (speed != NULL) ? speed[i] : osc->speed;
+        if(osc->phase >= boundry) {
+            osc->phase = osc->start;
+            gate = 1;
+        }
+    }
+
+    for(c=0; c < channels; c++) {
+        osc->current_frame->data[c] = out[(nframes-1) * channels + c];
+    }
+
+    osc->gate = gate;
+    if(speed != NULL) osc->speed = speed[nframes-1];
+}
+
 lpbuffer_t * render_tapeosc(lptapeosc_t * osc, size_t length, lpbuffer_t * amp, int channels) {
     lpbuffer_t * out;
     lpfloat_t _amp;
@@ -19,6 +19,7 @@ typedef struct lptapeosc_t {
 typedef struct lptapeosc_factory_t {
     lptapeosc_t * (*create)(lpbuffer_t *, lpfloat_t);
     void (*process)(lptapeosc_t *);
+    void (*process_block)(lptapeosc_t *, lpfloat_t *, size_t, const lpfloat_t *, const lpfloat_t *);
     void (*rewind)(lptapeosc_t *);
     lpbuffer_t * (*render)(lptapeosc_t *, size_t, lpbuffer_t *, int);
     void (*destroy)(lptapeosc_t *);
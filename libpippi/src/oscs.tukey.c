@@ -3,10 +3,11 @@
 
 lptukeyosc_t * create_tukeyosc(void);
 lpfloat_t process_tukeyosc(lptukeyosc_t * osc);
+void process_block_tukeyosc(lptukeyosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp);
 lpbuffer_t * render_tukeyosc(lptukeyosc_t * osc, size_t length, lpbuffer_t * freq, lpbuffer_t * amp, int channels);
 void destroy_tukeyosc(lptukeyosc_t * osc);
 
-const lptukeyosc_factory_t LPTukeyOsc = { create_tukeyosc, process_tukeyosc, render_tukeyosc, destroy_tukeyosc };
+const lptukeyosc_factory_t LPTukeyOsc = { create_tukeyosc, process_tukeyosc, process_block_tukeyosc, render_tukeyosc, destroy_tukeyosc };
 
 lptukeyosc_t * create_tukeyosc(void) {
     lptukeyosc_t * osc = (lptukeyosc_t *)LPMemoryPool.alloc(1, sizeof(lptukeyosc_t));
@@ -50,6 +51,45 @@ lpfloat_t process_tukeyosc(lptukeyosc_t* osc) {
     return sample;
 }
 
+/* Renders nframes into out. The freq and amp blocks hold a 
+ * value per frame, or may be NULL to use osc->freq and unity 
+ * gain. The shape is read once per block. */
+void process_block_tukeyosc(lptukeyosc_t * osc, lpfloat_t * out, size_t nframes, const lpfloat_t * freq, const lpfloat_t * amp) {
+    lpfloat_t a, halfshape, phase, direction, isr, sample;
+    size_t i;
+
+    if(nframes == 0) return;
+
+    if(osc->shape < 0.00001f) osc->shape = 0.00001f;
+    if(osc->shape > 1.f) osc->shape = 1.f;
+
+    a = PI2 / osc->shape;
+    halfshape = osc->shape / 2.f;
+    phase = osc->phase;
+    direction = osc->direction;
+    isr = 1.0f / osc->samplerate;
+
+    for(i=0; i < nframes; i++) {
+        if(phase <= halfshape) {
+            sample = 0.5f * (1.f + cos(a * (phase - halfshape)));
+        } else if(phase < 1 - halfshape) {
+            sample = 1.f;
+        } else {
+            sample = 0.5f * (1.f + cos(a * (phase - 1.f + halfshape)));
+        }
+
+        out[i] = sample * direction * ((amp != NULL) ? amp[i] : 1.f);
+
+        phase += isr * ((freq != NULL) ? freq[i] : osc->freq) * 2.f;
+        if(phase > 1.f) direction *= -1;
+        while(phase >= 1.f) phase -= 1.f;
+    }
+
+    osc->phase = phase;
+    osc->direction = (int)direction;
+    if(freq != NULL) osc->freq = freq[nframes-1];
+}
+
 lpbuffer_t * render_tukeyosc(lptukeyosc_t * osc, size_t length, lpbuffer_t * freq, lpbuffer_t * amp, int channels) {
     lpbuffer_t * out;
     lpfloat_t sample, _amp;
@@ -1,5 +1,17 @@
 #include "pippicore.h"
 
+#include <stdatomic.h>
+
+#if !defined(LP_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LP_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#if !defined(LP_NO_SIMD) && defined(__ARM_NEON) && (defined(LP_FLOAT) || defined(__aarch64__))
+#define LP_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 
 /* Forward declarations */
 void rand_preseed(void);
@@ -294,6 +306,780 @@ void destroy_array(lparray_t * array) {
     }
 }
 
+/* SIMD kernels
+ * 
+ * The buffer ops hand their contiguous inner 
+ * loops to one of these kernel sets. Every set 
+ * does the same arithmetic in the same order 
+ * as the scalar reference, so results match it 
+ * exactly, apart from min, max and mag when 
+ * the input contains NaNs.
+ * */
+#define LPSIMD_BLOCKSIZE 256
+#define LPINT16_SCALE 32767.f
+#define LPINT24_SCALE 8388607.f
+
+void lpsimd_scalar_multiply(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i;
+    for(i=0; i < n; i++) a[i] *= b[i];
+}
+
+void lpsimd_scalar_add(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i;
+    for(i=0; i < n; i++) a[i] += b[i];
+}
+
+void lpsimd_scalar_multiply_scalar(lpfloat_t * a, size_t n, lpfloat_t b) {
+    size_t i;
+    for(i=0; i < n; i++) a[i] *= b;
+}
+
+void lpsimd_scalar_scale(lpfloat_t * a, size_t n, lpfloat_t from_min, lpfloat_t from_diff, lpfloat_t to_diff, lpfloat_t to_min) {
+    size_t i;
+    for(i=0; i < n; i++) a[i] = ((a[i] - from_min) / from_diff) * to_diff + to_min;
+}
+
+void lpsimd_scalar_clip(lpfloat_t * a, size_t n, lpfloat_t minval, lpfloat_t maxval) {
+    size_t i;
+    for(i=0; i < n; i++) a[i] = fmin(fmax(a[i], minval), maxval);
+}
+
+lpfloat_t lpsimd_scalar_min(const lpfloat_t * a, size_t n) {
+    lpfloat_t out;
+    size_t i;
+    if(n == 0) return 0.f;
+    out = a[0];
+    for(i=1; i < n; i++) out = fmin(a[i], out);
+    return out;
+}
+
+lpfloat_t lpsimd_scalar_max(const lpfloat_t * a, size_t n) {
+    lpfloat_t out;
+    size_t i;
+    if(n == 0) return 0.f;
+    out = a[0];
+    for(i=1; i < n; i++) out = fmax(a[i], out);
+    return out;
+}
+
+lpfloat_t lpsimd_scalar_mag(const lpfloat_t * a, size_t n) {
+    lpfloat_t out = 0.f;
+    size_t i;
+    for(i=0; i < n; i++) out = fmax(fabs(a[i]), out);
+    return out;
+}
+
+void lpsimd_scalar_to_float32(const lpfloat_t * a, float * out, size_t n) {
+    size_t i;
+    for(i=0; i < n; i++) out[i] = (float)a[i];
+}
+
+void lpsimd_scalar_to_int16(const lpfloat_t * a, int16_t * out, size_t n) {
+    lpfloat_t x;
+    size_t i;
+    for(i=0; i < n; i++) {
+        x = (lpfloat_t)fmin(fmax(a[i], -1.f), 1.f) * LPINT16_SCALE;
+        out[i] = (int16_t)lrint((double)x);
+    }
+}
+
+void lpsimd_scalar_to_int24(const lpfloat_t * a, int32_t * out, size_t n) {
+    lpfloat_t x;
+    size_t i;
+    for(i=0; i < n; i++) {
+        x = (lpfloat_t)fmin(fmax(a[i], -1.f), 1.f) * LPINT24_SCALE;
+        out[i] = (int32_t)lrint((double)x);
+    }
+}
+
+/* The sine polynomial constants, shared by every kernel set */
+#define LPSIN_C3 ((lpfloat_t)(-1.0/6))
+#define LPSIN_C5 ((lpfloat_t)(1.0/120))
+#define LPSIN_C7 ((lpfloat_t)(-1.0/5040))
+#define LPSIN_C9 ((lpfloat_t)(1.0/362880))
+#define LPSIN_C11 ((lpfloat_t)(-1.0/39916800))
+#define LPSIN_C13 ((lpfloat_t)(1.0/6227020800.0))
+
+/* The frames from start to n of add_sines. The SIMD sets 
+ * finish their tails here, so k keeps counting from start. */
+static void lpsimd_scalar_add_sines_from(lpfloat_t * out, size_t start, size_t n, lpfloat_t phase, lpfloat_t inc, lpfloat_t dinc, lpfloat_t amp, lpfloat_t damp) {
+    lpfloat_t p, x, x2, kf;
+    size_t k;
+
+    for(k=start; k < n; k++) {
+        /* Wrap the phase into [0, 1) */
+        kf = (lpfloat_t)k;
+        p = phase + kf * inc + kf * (kf - 1) * (lpfloat_t)0.5 * dinc;
+        p -= (lpfloat_t)(int)p;
+        p += (lpfloat_t)(p < 0);
+
+        /* Fold into a quarter turn and take the taylor series 
+         * to the 13th power, as LPSineOsc's block path does */
+        x = p - (lpfloat_t)0.5;
+        x = (lpfloat_t)copysign((lpfloat_t)0.25 - (lpfloat_t)fabs((lpfloat_t)0.25 - (lpfloat_t)fabs(x)), x);
+        x *= (lpfloat_t)-PI2;
+        x2 = x * x;
+        x = x * (1 + x2 * (LPSIN_C3 + x2 * (LPSIN_C5 + x2 * (LPSIN_C7 + x2 * (LPSIN_C9 + x2 * (LPSIN_C11 + x2 * LPSIN_C13))))));
+
+        out[k] += x * (amp + kf * damp);
+    }
+}
+
+void lpsimd_scalar_add_sines(lpfloat_t * out, size_t n, lpfloat_t phase, lpfloat_t inc, lpfloat_t dinc, lpfloat_t amp, lpfloat_t damp) {
+    lpsimd_scalar_add_sines_from(out, 0, n, phase, inc, dinc, amp, damp);
+}
+
+const lpsimd_kernels_t LPSIMDScalar = { "scalar", lpsimd_scalar_multiply, lpsimd_scalar_add, lpsimd_scalar_multiply_scalar, lpsimd_scalar_scale, lpsimd_scalar_clip, lpsimd_scalar_min, lpsimd_scalar_max, lpsimd_scalar_mag, lpsimd_scalar_to_float32, lpsimd_scalar_to_int16, lpsimd_scalar_to_int24, lpsimd_scalar_add_sines };
+
+#ifdef LP_SIMD_X86
+/* x86 kernels. SSE2 is always there on x86_64, AVX2 
+ * is checked for at runtime. Each kernel is compiled 
+ * for its own target, so the library itself does not 
+ * need to be built with -mavx2. */
+#ifdef LP_FLOAT
+#define LPSSE_WIDTH 4
+#define LPAVX_WIDTH 8
+typedef __m128 lpsse_t;
+typedef __m256 lpavx_t;
+#define lpsse_load _mm_loadu_ps
+#define lpsse_store _mm_storeu_ps
+#define lpsse_set1 _mm_set1_ps
+#define lpsse_add _mm_add_ps
+#define lpsse_sub _mm_sub_ps
+#define lpsse_mul _mm_mul_ps
+#define lpsse_div _mm_div_ps
+#define lpsse_min _mm_min_ps
+#define lpsse_max _mm_max_ps
+#define lpsse_andnot _mm_andnot_ps
+#define lpsse_and _mm_and_ps
+#define lpsse_or _mm_or_ps
+#define lpsse_cmplt _mm_cmplt_ps
+#define lpsse_trunc(x) _mm_cvtepi32_ps(_mm_cvttps_epi32(x))
+#define lpavx_load _mm256_loadu_ps
+#define lpavx_store _mm256_storeu_ps
+#define lpavx_set1 _mm256_set1_ps
+#define lpavx_add _mm256_add_ps
+#define lpavx_sub _mm256_sub_ps
+#define lpavx_mul _mm256_mul_ps
+#define lpavx_div _mm256_div_ps
+#define lpavx_min _mm256_min_ps
+#define lpavx_max _mm256_max_ps
+#define lpavx_andnot _mm256_andnot_ps
+#define lpavx_and _mm256_and_ps
+#define lpavx_or _mm256_or_ps
+#define lpavx_cmplt(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define lpavx_trunc(x) _mm256_cvtepi32_ps(_mm256_cvttps_epi32(x))
+#else
+#define LPSSE_WIDTH 2
+#define LPAVX_WIDTH 4
+typedef __m128d lpsse_t;
+typedef __m256d lpavx_t;
+#define lpsse_load _mm_loadu_pd
+#define lpsse_store _mm_storeu_pd
+#define lpsse_set1 _mm_set1_pd
+#define lpsse_add _mm_add_pd
+#define lpsse_sub _mm_sub_pd
+#define lpsse_mul _mm_mul_pd
+#define lpsse_div _mm_div_pd
+#define lpsse_min _mm_min_pd
+#define lpsse_max _mm_max_pd
+#define lpsse_andnot _mm_andnot_pd
+#define lpsse_and _mm_and_pd
+#define lpsse_or _mm_or_pd
+#define lpsse_cmplt _mm_cmplt_pd
+#define lpsse_trunc(x) _mm_cvtepi32_pd(_mm_cvttpd_epi32(x))
+#define lpavx_load _mm256_loadu_pd
+#define lpavx_store _mm256_storeu_pd
+#define lpavx_set1 _mm256_set1_pd
+#define lpavx_add _mm256_add_pd
+#define lpavx_sub _mm256_sub_pd
+#define lpavx_mul _mm256_mul_pd
+#define lpavx_div _mm256_div_pd
+#define lpavx_min _mm256_min_pd
+#define lpavx_max _mm256_max_pd
+#define lpavx_andnot _mm256_andnot_pd
+#define lpavx_and _mm256_and_pd
+#define lpavx_or _mm256_or_pd
+#define lpavx_cmplt(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define lpavx_trunc(x) _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(x))
+#endif
+
+#define LPSSE __attribute__((target("sse2")))
+#define LPAVX __attribute__((target("avx2")))
+
+LPSSE void lpsimd_sse2_multiply(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i = 0;
+    for(; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        lpsse_store(a + i, lpsse_mul(lpsse_load(a + i), lpsse_load(b + i)));
+    }
+    lpsimd_scalar_multiply(a + i, b + i, n - i);
+}
+
+LPSSE void lpsimd_sse2_add(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i = 0;
+    for(; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        lpsse_store(a + i, lpsse_add(lpsse_load(a + i), lpsse_load(b + i)));
+    }
+    lpsimd_scalar_add(a + i, b + i, n - i);
+}
+
+LPSSE void lpsimd_sse2_multiply_scalar(lpfloat_t * a, size_t n, lpfloat_t b) {
+    lpsse_t vb = lpsse_set1(b);
+    size_t i = 0;
+    for(; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        lpsse_store(a + i, lpsse_mul(lpsse_load(a + i), vb));
+    }
+    lpsimd_scalar_multiply_scalar(a + i, n - i, b);
+}
+
+LPSSE void lpsimd_sse2_scale(lpfloat_t * a, size_t n, lpfloat_t from_min, lpfloat_t from_diff, lpfloat_t to_diff, lpfloat_t to_min) {
+    lpsse_t vfrom_min = lpsse_set1(from_min);
+    lpsse_t vfrom_diff = lpsse_set1(from_diff);
+    lpsse_t vto_diff = lpsse_set1(to_diff);
+    lpsse_t vto_min = lpsse_set1(to_min);
+    size_t i = 0;
+    for(; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        lpsse_store(a + i, lpsse_add(lpsse_mul(lpsse_div(lpsse_sub(lpsse_load(a + i), vfrom_min), vfrom_diff), vto_diff), vto_min));
+    }
+    lpsimd_scalar_scale(a + i, n - i, from_min, from_diff, to_diff, to_min);
+}
+
+/* max(x, minval) gives minval for a NaN x, like fmax */
+LPSSE void lpsimd_sse2_clip(lpfloat_t * a, size_t n, lpfloat_t minval, lpfloat_t maxval) {
+    lpsse_t vmin = lpsse_set1(minval);
+    lpsse_t vmax = lpsse_set1(maxval);
+    size_t i = 0;
+    for(; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        lpsse_store(a + i, lpsse_min(lpsse_max(lpsse_load(a + i), vmin), vmax));
+    }
+    lpsimd_scalar_clip(a + i, n - i, minval, maxval);
+}
+
+LPSSE lpfloat_t lpsimd_sse2_min(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPSSE_WIDTH];
+    lpfloat_t out;
+    lpsse_t vout;
+    size_t i = 0;
+    int l;
+
+    if(n < LPSSE_WIDTH) return lpsimd_scalar_min(a, n);
+
+    vout = lpsse_load(a);
+    for(i=LPSSE_WIDTH; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        vout = lpsse_min(lpsse_load(a + i), vout);
+    }
+
+    lpsse_store(lanes, vout);
+    out = lanes[0];
+    for(l=1; l < LPSSE_WIDTH; l++) out = fmin(lanes[l], out);
+    for(; i < n; i++) out = fmin(a[i], out);
+    return out;
+}
+
+LPSSE lpfloat_t lpsimd_sse2_max(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPSSE_WIDTH];
+    lpfloat_t out;
+    lpsse_t vout;
+    size_t i = 0;
+    int l;
+
+    if(n < LPSSE_WIDTH) return lpsimd_scalar_max(a, n);
+
+    vout = lpsse_load(a);
+    for(i=LPSSE_WIDTH; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        vout = lpsse_max(lpsse_load(a + i), vout);
+    }
+
+    lpsse_store(lanes, vout);
+    out = lanes[0];
+    for(l=1; l < LPSSE_WIDTH; l++) out = fmax(lanes[l], out);
+    for(; i < n; i++) out = fmax(a[i], out);
+    return out;
+}
+
+LPSSE lpfloat_t lpsimd_sse2_mag(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPSSE_WIDTH];
+    lpfloat_t out;
+    lpsse_t vout = lpsse_set1(0.f);
+    lpsse_t sign = lpsse_set1(-0.f);
+    size_t i = 0;
+    int l;
+
+    for(; i + LPSSE_WIDTH <= n; i += LPSSE_WIDTH) {
+        vout = lpsse_max(lpsse_andnot(sign, lpsse_load(a + i)), vout);
+    }
+
+    lpsse_store(lanes, vout);
+    out = 0.f;
+    for(l=0; l < LPSSE_WIDTH; l++) out = fmax(lanes[l], out);
+    return fmax(lpsimd_scalar_mag(a + i, n - i), out);
+}
+
+LPAVX void lpsimd_avx2_multiply(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i = 0;
+    for(; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        lpavx_store(a + i, lpavx_mul(lpavx_load(a + i), lpavx_load(b + i)));
+    }
+    lpsimd_scalar_multiply(a + i, b + i, n - i);
+}
+
+LPAVX void lpsimd_avx2_add(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i = 0;
+    for(; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        lpavx_store(a + i, lpavx_add(lpavx_load(a + i), lpavx_load(b + i)));
+    }
+    lpsimd_scalar_add(a + i, b + i, n - i);
+}
+
+LPAVX void lpsimd_avx2_multiply_scalar(lpfloat_t * a, size_t n, lpfloat_t b) {
+    lpavx_t vb = lpavx_set1(b);
+    size_t i = 0;
+    for(; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        lpavx_store(a + i, lpavx_mul(lpavx_load(a + i), vb));
+    }
+    lpsimd_scalar_multiply_scalar(a + i, n - i, b);
+}
+
+LPAVX void lpsimd_avx2_scale(lpfloat_t * a, size_t n, lpfloat_t from_min, lpfloat_t from_diff, lpfloat_t to_diff, lpfloat_t to_min) {
+    lpavx_t vfrom_min = lpavx_set1(from_min);
+    lpavx_t vfrom_diff = lpavx_set1(from_diff);
+    lpavx_t vto_diff = lpavx_set1(to_diff);
+    lpavx_t vto_min = lpavx_set1(to_min);
+    size_t i = 0;
+    for(; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        lpavx_store(a + i, lpavx_add(lpavx_mul(lpavx_div(lpavx_sub(lpavx_load(a + i), vfrom_min), vfrom_diff), vto_diff), vto_min));
+    }
+    lpsimd_scalar_scale(a + i, n - i, from_min, from_diff, to_diff, to_min);
+}
+
+LPAVX void lpsimd_avx2_clip(lpfloat_t * a, size_t n, lpfloat_t minval, lpfloat_t maxval) {
+    lpavx_t vmin = lpavx_set1(minval);
+    lpavx_t vmax = lpavx_set1(maxval);
+    size_t i = 0;
+    for(; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        lpavx_store(a + i, lpavx_min(lpavx_max(lpavx_load(a + i), vmin), vmax));
+    }
+    lpsimd_scalar_clip(a + i, n - i, minval, maxval);
+}
+
+LPAVX lpfloat_t lpsimd_avx2_min(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPAVX_WIDTH];
+    lpfloat_t out;
+    lpavx_t vout;
+    size_t i = 0;
+    int l;
+
+    if(n < LPAVX_WIDTH) return lpsimd_scalar_min(a, n);
+
+    vout = lpavx_load(a);
+    for(i=LPAVX_WIDTH; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        vout = lpavx_min(lpavx_load(a + i), vout);
+    }
+
+    lpavx_store(lanes, vout);
+    out = lanes[0];
+    for(l=1; l < LPAVX_WIDTH; l++) out = fmin(lanes[l], out);
+    for(; i < n; i++) out = fmin(a[i], out);
+    return out;
+}
+
+LPAVX lpfloat_t lpsimd_avx2_max(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPAVX_WIDTH];
+    lpfloat_t out;
+    lpavx_t vout;
+    size_t i = 0;
+    int l;
+
+    if(n < LPAVX_WIDTH) return lpsimd_scalar_max(a, n);
+
+    vout = lpavx_load(a);
+    for(i=LPAVX_WIDTH; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        vout = lpavx_max(lpavx_load(a + i), vout);
+    }
+
+    lpavx_store(lanes, vout);
+    out = lanes[0];
+    for(l=1; l < LPAVX_WIDTH; l++) out = fmax(lanes[l], out);
+    for(; i < n; i++) out = fmax(a[i], out);
+    return out;
+}
+
+LPAVX lpfloat_t lpsimd_avx2_mag(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPAVX_WIDTH];
+    lpfloat_t out;
+    lpavx_t vout = lpavx_set1(0.f);
+    lpavx_t sign = lpavx_set1(-0.f);
+    size_t i = 0;
+    int l;
+
+    for(; i + LPAVX_WIDTH <= n; i += LPAVX_WIDTH) {
+        vout = lpavx_max(lpavx_andnot(sign, lpavx_load(a + i)), vout);
+    }
+
+    lpavx_store(lanes, vout);
+    out = 0.f;
+    for(l=0; l < LPAVX_WIDTH; l++) out = fmax(lanes[l], out);
+    return fmax(lpsimd_scalar_mag(a + i, n - i), out);
+}
+
+/* Clip, scale and round samples to 32 bit ints, rounding 
+ * to nearest even like lrint in the default rounding mode */
+LPSSE __m128i lpsimd_sse2_quantize4(const lpfloat_t * a, lpsse_t lo, lpsse_t hi, lpsse_t scale) {
+#ifdef LP_FLOAT
+    return _mm_cvtps_epi32(lpsse_mul(lpsse_min(lpsse_max(lpsse_load(a), lo), hi), scale));
+#else
+    __m128i x0, x1;
+    x0 = _mm_cvtpd_epi32(lpsse_mul(lpsse_min(lpsse_max(lpsse_load(a), lo), hi), scale));
+    x1 = _mm_cvtpd_epi32(lpsse_mul(lpsse_min(lpsse_max(lpsse_load(a + 2), lo), hi), scale));
+    return _mm_unpacklo_epi64(x0, x1);
+#endif
+}
+
+LPSSE void lpsimd_sse2_to_float32(const lpfloat_t * a, float * out, size_t n) {
+    size_t i = 0;
+#ifdef LP_FLOAT
+    for(; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_loadu_ps(a + i));
+    }
+#else
+    for(; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(a + i)), _mm_cvtpd_ps(_mm_loadu_pd(a + i + 2))));
+    }
+#endif
+    lpsimd_scalar_to_float32(a + i, out + i, n - i);
+}
+
+LPSSE void lpsimd_sse2_to_int16(const lpfloat_t * a, int16_t * out, size_t n) {
+    lpsse_t lo = lpsse_set1(-1.f);
+    lpsse_t hi = lpsse_set1(1.f);
+    lpsse_t scale = lpsse_set1(LPINT16_SCALE);
+    __m128i x0, x1;
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        x0 = lpsimd_sse2_quantize4(a + i, lo, hi, scale);
+        x1 = lpsimd_sse2_quantize4(a + i + 4, lo, hi, scale);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(x0, x1));
+    }
+    lpsimd_scalar_to_int16(a + i, out + i, n - i);
+}
+
+LPSSE void lpsimd_sse2_to_int24(const lpfloat_t * a, int32_t * out, size_t n) {
+    lpsse_t lo = lpsse_set1(-1.f);
+    lpsse_t hi = lpsse_set1(1.f);
+    lpsse_t scale = lpsse_set1(LPINT24_SCALE);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        _mm_storeu_si128((__m128i *)(out + i), lpsimd_sse2_quantize4(a + i, lo, hi, scale));
+    }
+    lpsimd_scalar_to_int24(a + i, out + i, n - i);
+}
+
+LPAVX __m256i lpsimd_avx2_quantize8(const lpfloat_t * a, lpavx_t lo, lpavx_t hi, lpavx_t scale) {
+#ifdef LP_FLOAT
+    return _mm256_cvtps_epi32(lpavx_mul(lpavx_min(lpavx_max(lpavx_load(a), lo), hi), scale));
+#else
+    __m128i x0, x1;
+    x0 = _mm256_cvtpd_epi32(lpavx_mul(lpavx_min(lpavx_max(lpavx_load(a), lo), hi), scale));
+    x1 = _mm256_cvtpd_epi32(lpavx_mul(lpavx_min(lpavx_max(lpavx_load(a + 4), lo), hi), scale));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(x0), x1, 1);
+#endif
+}
+
+LPAVX void lpsimd_avx2_to_float32(const lpfloat_t * a, float * out, size_t n) {
+    size_t i = 0;
+#ifdef LP_FLOAT
+    for(; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_loadu_ps(a + i));
+    }
+#else
+    for(; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(a + i)));
+    }
+
+    /* No ymm register is written here, so the compiler 
+     * doesn't clear the upper halves on its own, which 
+     * otherwise slows down any SSE code that follows */
+    _mm256_zeroupper();
+#endif
+    lpsimd_scalar_to_float32(a + i, out + i, n - i);
+}
+
+/* packs works within 128 bit lanes, so the 
+ * middle quarters come out swapped */
+LPAVX void lpsimd_avx2_to_int16(const lpfloat_t * a, int16_t * out, size_t n) {
+    lpavx_t lo = lpavx_set1(-1.f);
+    lpavx_t hi = lpavx_set1(1.f);
+    lpavx_t scale = lpavx_set1(LPINT16_SCALE);
+    __m256i x0, x1;
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+        x0 = lpsimd_avx2_quantize8(a + i, lo, hi, scale);
+        x1 = lpsimd_avx2_quantize8(a + i + 8, lo, hi, scale);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(x0, x1), 0xD8));
+    }
+    lpsimd_scalar_to_int16(a + i, out + i, n - i);
+}
+
+LPAVX void lpsimd_avx2_to_int24(const lpfloat_t * a, int32_t * out, size_t n) {
+    lpavx_t lo = lpavx_set1(-1.f);
+    lpavx_t hi = lpavx_set1(1.f);
+    lpavx_t scale = lpavx_set1(LPINT24_SCALE);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256((__m256i *)(out + i), lpsimd_avx2_quantize8(a + i, lo, hi, scale));
+    }
+    lpsimd_scalar_to_int24(a + i, out + i, n - i);
+}
+
+/* The frame index of each lane is stepped in a vector, 
+ * which stays exact for n below 2^24 (floats) or 2^53 */
+#define LPSIMD_ADD_SINES(PREFIX, WIDTH) \
+    lpfloat_t ks[WIDTH]; \
+    PREFIX##_t vphase = PREFIX##_set1(phase); \
+    PREFIX##_t vinc = PREFIX##_set1(inc); \
+    PREFIX##_t vdinc = PREFIX##_set1(dinc); \
+    PREFIX##_t vamp = PREFIX##_set1(amp); \
+    PREFIX##_t vdamp = PREFIX##_set1(damp); \
+    PREFIX##_t sign = PREFIX##_set1(-0.f); \
+    PREFIX##_t half = PREFIX##_set1(0.5f); \
+    PREFIX##_t quarter = PREFIX##_set1(0.25f); \
+    PREFIX##_t one = PREFIX##_set1(1.f); \
+    PREFIX##_t step = PREFIX##_set1((lpfloat_t)WIDTH); \
+    PREFIX##_t k, p, x, x2; \
+    size_t i; \
+    for(i=0; i < WIDTH; i++) ks[i] = (lpfloat_t)i; \
+    k = PREFIX##_load(ks); \
+    for(i=0; i + WIDTH <= n; i += WIDTH) { \
+        p = PREFIX##_mul(PREFIX##_mul(k, PREFIX##_sub(k, one)), half); \
+        p = PREFIX##_add(PREFIX##_add(vphase, PREFIX##_mul(k, vinc)), PREFIX##_mul(p, vdinc)); \
+        p = PREFIX##_sub(p, PREFIX##_trunc(p)); \
+        p = PREFIX##_add(p, PREFIX##_and(PREFIX##_cmplt(p, PREFIX##_set1(0.f)), one)); \
+        x = PREFIX##_sub(p, half); \
+        x = PREFIX##_or(PREFIX##_sub(quarter, PREFIX##_andnot(sign, PREFIX##_sub(quarter, PREFIX##_andnot(sign, x)))), PREFIX##_and(sign, x)); \
+        x = PREFIX##_mul(x, PREFIX##_set1((lpfloat_t)-PI2)); \
+        x2 = PREFIX##_mul(x, x); \
+        p = PREFIX##_add(PREFIX##_set1(LPSIN_C11), PREFIX##_mul(x2, PREFIX##_set1(LPSIN_C13))); \
+        p = PREFIX##_add(PREFIX##_set1(LPSIN_C9), PREFIX##_mul(x2, p)); \
+        p = PREFIX##_add(PREFIX##_set1(LPSIN_C7), PREFIX##_mul(x2, p)); \
+        p = PREFIX##_add(PREFIX##_set1(LPSIN_C5), PREFIX##_mul(x2, p)); \
+        p = PREFIX##_add(PREFIX##_set1(LPSIN_C3), PREFIX##_mul(x2, p)); \
+        x = PREFIX##_mul(x, PREFIX##_add(one, PREFIX##_mul(x2, p))); \
+        x = PREFIX##_mul(x, PREFIX##_add(vamp, PREFIX##_mul(k, vdamp))); \
+        PREFIX##_store(out + i, PREFIX##_add(PREFIX##_load(out + i), x)); \
+        k = PREFIX##_add(k, step); \
+    } \
+    lpsimd_scalar_add_sines_from(out, i, n, phase, inc, dinc, amp, damp);
+
+LPSSE void lpsimd_sse2_add_sines(lpfloat_t * out, size_t n, lpfloat_t phase, lpfloat_t inc, lpfloat_t dinc, lpfloat_t amp, lpfloat_t damp) {
+    LPSIMD_ADD_SINES(lpsse, LPSSE_WIDTH)
+}
+
+LPAVX void lpsimd_avx2_add_sines(lpfloat_t * out, size_t n, lpfloat_t phase, lpfloat_t inc, lpfloat_t dinc, lpfloat_t amp, lpfloat_t damp) {
+    LPSIMD_ADD_SINES(lpavx, LPAVX_WIDTH)
+}
+
+#undef LPSIMD_ADD_SINES
+
+const lpsimd_kernels_t LPSIMDSSE2 = { "sse2", lpsimd_sse2_multiply, lpsimd_sse2_add, lpsimd_sse2_multiply_scalar, lpsimd_sse2_scale, lpsimd_sse2_clip, lpsimd_sse2_min, lpsimd_sse2_max, lpsimd_sse2_mag, lpsimd_sse2_to_float32, lpsimd_sse2_to_int16, lpsimd_sse2_to_int24, lpsimd_sse2_add_sines };
+const lpsimd_kernels_t LPSIMDAVX2 = { "avx2", lpsimd_avx2_multiply, lpsimd_avx2_add, lpsimd_avx2_multiply_scalar, lpsimd_avx2_scale, lpsimd_avx2_clip, lpsimd_avx2_min, lpsimd_avx2_max, lpsimd_avx2_mag, lpsimd_avx2_to_float32, lpsimd_avx2_to_int16, lpsimd_avx2_to_int24, lpsimd_avx2_add_sines };
+#endif
+
+#ifdef LP_SIMD_NEON
+/* NEON kernels. NEON is part of the baseline on aarch64, 
+ * where both float and double vectors are available. 
+ * 32-bit ARM only has float vectors, so double builds 
+ * there stay on the scalar kernels. */
+#ifdef LP_FLOAT
+#define LPNEON_WIDTH 4
+typedef float32x4_t lpneon_t;
+#define lpneon_load vld1q_f32
+#define lpneon_store vst1q_f32
+#define lpneon_set1 vdupq_n_f32
+#define lpneon_add vaddq_f32
+#define lpneon_sub vsubq_f32
+#define lpneon_mul vmulq_f32
+#define lpneon_min vminnmq_f32
+#define lpneon_max vmaxnmq_f32
+#define lpneon_abs vabsq_f32
+#else
+#define LPNEON_WIDTH 2
+typedef float64x2_t lpneon_t;
+#define lpneon_load vld1q_f64
+#define lpneon_store vst1q_f64
+#define lpneon_set1 vdupq_n_f64
+#define lpneon_add vaddq_f64
+#define lpneon_sub vsubq_f64
+#define lpneon_mul vmulq_f64
+#define lpneon_min vminnmq_f64
+#define lpneon_max vmaxnmq_f64
+#define lpneon_abs vabsq_f64
+#endif
+
+void lpsimd_neon_multiply(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i = 0;
+    for(; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+        lpneon_store(a + i, lpneon_mul(lpneon_load(a + i), lpneon_load(b + i)));
+    }
+    lpsimd_scalar_multiply(a + i, b + i, n - i);
+}
+
+void lpsimd_neon_add(lpfloat_t * a, const lpfloat_t * b, size_t n) {
+    size_t i = 0;
+    for(; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+        lpneon_store(a + i, lpneon_add(lpneon_load(a + i), lpneon_load(b + i)));
+    }
+    lpsimd_scalar_add(a + i, b + i, n - i);
+}
+
+void lpsimd_neon_multiply_scalar(lpfloat_t * a, size_t n, lpfloat_t b) {
+    lpneon_t vb = lpneon_set1(b);
+    size_t i = 0;
+    for(; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+        lpneon_store(a + i, lpneon_mul(lpneon_load(a + i), vb));
+    }
+    lpsimd_scalar_multiply_scalar(a + i, n - i, b);
+}
+
+/* 32-bit NEON has no vector divide, so scale 
+ * goes through the scalar kernel there */
+void lpsimd_neon_scale(lpfloat_t * a, size_t n, lpfloat_t from_min, lpfloat_t from_diff, lpfloat_t to_diff, lpfloat_t to_min) {
+    size_t i = 0;
+#ifdef __aarch64__
+    lpneon_t vfrom_min = lpneon_set1(from_min);
+    lpneon_t vfrom_diff = lpneon_set1(from_diff);
+    lpneon_t vto_diff = lpneon_set1(to_diff);
+    lpneon_t vto_min = lpneon_set1(to_min);
+    for(; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+#ifdef LP_FLOAT
+        lpneon_store(a + i, lpneon_add(lpneon_mul(vdivq_f32(lpneon_sub(lpneon_load(a + i), vfrom_min), vfrom_diff), vto_diff), vto_min));
+#else
+        lpneon_store(a + i, lpneon_add(lpneon_mul(vdivq_f64(lpneon_sub(lpneon_load(a + i), vfrom_min), vfrom_diff), vto_diff), vto_min));
+#endif
+    }
+#endif
+    lpsimd_scalar_scale(a + i, n - i, from_min, from_diff, to_diff, to_min);
+}
+
+/* The NEON minnm/maxnm instructions follow fmin/fmax NaN handling */
+void lpsimd_neon_clip(lpfloat_t * a, size_t n, lpfloat_t minval, lpfloat_t maxval) {
+    lpneon_t vmin = lpneon_set1(minval);
+    lpneon_t vmax = lpneon_set1(maxval);
+    size_t i = 0;
+    for(; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+        lpneon_store(a + i, lpneon_min(lpneon_max(lpneon_load(a + i), vmin), vmax));
+    }
+    lpsimd_scalar_clip(a + i, n - i, minval, maxval);
+}
+
+lpfloat_t lpsimd_neon_min(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPNEON_WIDTH];
+    lpfloat_t out;
+    lpneon_t vout;
+    size_t i = 0;
+    int l;
+
+    if(n < LPNEON_WIDTH) return lpsimd_scalar_min(a, n);
+
+    vout = lpneon_load(a);
+    for(i=LPNEON_WIDTH; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+        vout = lpneon_min(lpneon_load(a + i), vout);
+    }
+
+    lpneon_store(lanes, vout);
+    out = lanes[0];
+    for(l=1; l < LPNEON_WIDTH; l++) out = fmin(lanes[l], out);
+    for(; i < n; i++) out = fmin(a[i], out);
+    return out;
+}
+
+lpfloat_t lpsimd_neon_max(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPNEON_WIDTH];
+    lpfloat_t out;
+    lpneon_t vout;
+    size_t i = 0;
+    int l;
+
+    if(n < LPNEON_WIDTH) return lpsimd_scalar_max(a, n);
+
+    vout = lpneon_load(a);
+    for(i=LPNEON_WIDTH; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+        vout = lpneon_max(lpneon_load(a + i), vout);
+    }
+
+    lpneon_store(lanes, vout);
+    out = lanes[0];
+    for(l=1; l < LPNEON_WIDTH; l++) out = fmax(lanes[l], out);
+    for(; i < n; i++) out = fmax(a[i], out);
+    return out;
+}
+
+lpfloat_t lpsimd_neon_mag(const lpfloat_t * a, size_t n) {
+    lpfloat_t lanes[LPNEON_WIDTH];
+    lpfloat_t out;
+    lpneon_t vout = lpneon_set1(0.f);
+    size_t i = 0;
+    int l;
+
+    for(; i + LPNEON_WIDTH <= n; i += LPNEON_WIDTH) {
+        vout = lpneon_max(lpneon_abs(lpneon_load(a + i)), vout);
+    }
+
+    lpneon_store(lanes, vout);
+    out = 0.f;
+    for(l=0; l < LPNEON_WIDTH; l++) out = fmax(lanes[l], out);
+    return fmax(lpsimd_scalar_mag(a + i, n - i), out);
+}
+
+/* Format conversion and add_sines stay on the scalar kernels for now */
+const lpsimd_kernels_t LPSIMDNeon = { "neon", lpsimd_neon_multiply, lpsimd_neon_add, lpsimd_neon_multiply_scalar, lpsimd_neon_scale, lpsimd_neon_clip, lpsimd_neon_min, lpsimd_neon_max, lpsimd_neon_mag, lpsimd_scalar_to_float32, lpsimd_scalar_to_int16, lpsimd_scalar_to_int24, lpsimd_scalar_add_sines };
+#endif
+
+static const lpsimd_kernels_t * lpsimd_detect(void) {
+#if defined(LP_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return &LPSIMDAVX2;
+    if(__builtin_cpu_supports("sse2")) return &LPSIMDSSE2;
+    return &LPSIMDScalar;
+#elif defined(LP_SIMD_NEON)
+    return &LPSIMDNeon;
+#else
+    return &LPSIMDScalar;
+#endif
+}
+
+/* Pick the best kernel set for this CPU. Worker threads 
+ * may make the first call together: each detects the same 
+ * set, and the pointer is published atomically. */
+const lpsimd_kernels_t * lpsimd_kernels(void) {
+    static _Atomic(const lpsimd_kernels_t *) kernels = NULL;
+    const lpsimd_kernels_t * k;
+
+    k = atomic_load_explicit(&kernels, memory_order_acquire);
+    if(k != NULL) return k;
+
+    k = lpsimd_detect();
+    atomic_store_explicit(&kernels, k, memory_order_release);
+    return k;
+}
+
+/* List every kernel set this CPU can run, 
+ * starting with the scalar reference */
+int lpsimd_list(const lpsimd_kernels_t ** sets, int maxsets) {
+    int count = 0;
+
+    if(count < maxsets) sets[count++] = &LPSIMDScalar;
+
+#if defined(LP_SIMD_X86)
+    __builtin_cpu_init();
+    if(count < maxsets && __builtin_cpu_supports("sse2")) sets[count++] = &LPSIMDSSE2;
+    if(count < maxsets && __builtin_cpu_supports("avx2")) sets[count++] = &LPSIMDAVX2;
+#elif defined(LP_SIMD_NEON)
+    if(count < maxsets) sets[count++] = &LPSIMDNeon;
+#endif
+
+    return count;
+}
+
 /* Buffer
  * */
 lpbuffer_t * create_buffer(size_t length, int channels, int samplerate) {
@@ -394,8 +1180,6 @@ void clear_buffer(lpbuffer_t * buf) {
 }
 
 void scale_buffer(lpbuffer_t * buf, lpfloat_t from_min, lpfloat_t from_max, lpfloat_t to_min, lpfloat_t to_max) {
-    size_t i;
-    int c, idx;
     lpfloat_t from_diff, to_diff;
 
     to_diff = to_max - to_min;;
@@ -411,59 +1195,19 @@ void scale_buffer(lpbuffer_t * buf, lpfloat_t from_min, lpfloat_t from_max, lpfl
      */
     assert(from_diff != 0);
 
-    for(i=0; i < buf->length; i++) {
-        for(c=0; c < buf->channels; c++) {
-            idx = i * buf->channels + c;
-            buf->data[idx] = ((buf->data[idx] - from_min) / from_diff) * to_diff + to_min;
-        }
-    }
+    lpsimd_kernels()->scale(buf->data, buf->length * buf->channels, from_min, from_diff, to_diff, to_min);
 }
 
 lpfloat_t min_buffer(lpbuffer_t * buf) {
-    lpfloat_t out = 0.f;
-    size_t i;
-    int c;
-
-    for(i=0; i < buf->length; i++) {
-        for(c=0; c < buf->channels; c++) {
-            if(i==0 && c==0) {
-                out = buf->data[i * buf->channels + c];
-                continue;
-            }
-            out = fmin(buf->data[i * buf->channels + c], out);
-        }
-    }
-    return out;
+    return lpsimd_kernels()->min(buf->data, buf->length * buf->channels);
 }
 
 lpfloat_t max_buffer(lpbuffer_t * buf) {
-    lpfloat_t out = 0.f;
-    size_t i;
-    int c;
-
-    for(i=0; i < buf->length; i++) {
-        for(c=0; c < buf->channels; c++) {
-            if(i==0 && c==0) {
-                out = buf->data[i * buf->channels + c];
-                continue;
-            }
-            out = fmax(buf->data[i * buf->channels + c], out);
-        }
-    }
-    return out;
+    return lpsimd_kernels()->max(buf->data, buf->length * buf->channels);
 }
 
 lpfloat_t mag_buffer(lpbuffer_t * buf) {
-    lpfloat_t out = 0.f;
-    size_t i;
-    int c;
-
-    for(i=0; i < buf->length; i++) {
-        for(c=0; c < buf->channels; c++) {
-            out = fmax(fabs(buf->data[i * buf->channels + c]), out);
-        }
-    }
-    return out;
+    return lpsimd_kernels()->mag(buf->data, buf->length * buf->channels);
 }
 
 void pan_stereo_constant(lpfloat_t pos, lpfloat_t left_in, lpfloat_t right_in, lpfloat_t * left_out, lpfloat_t * right_out) {
@@ -574,6 +1318,13 @@ void multiply_buffer(lpbuffer_t * a, lpbuffer_t * b) {
     size_t length, i;
     int c, j;
     length = (a->length <= b->length) ? a->length : b->length;
+
+    /* Matching layouts can be treated as one flat run of samples */
+    if(a->channels == b->channels) {
+        lpsimd_kernels()->multiply(a->data, b->data, length * a->channels);
+        return;
+    }
+
     for(i=0; i < length; i++) {
         for(c=0; c < a->channels; c++) {
             j = c % b->channels;
@@ -583,13 +1334,7 @@ void multiply_buffer(lpbuffer_t * a, lpbuffer_t * b) {
 }
 
 void scalar_multiply_buffer(lpbuffer_t * a, lpfloat_t b) {
-    size_t i;
-    int c;
-    for(i=0; i < a->length; i++) {
-        for(c=0; c < a->channels; c++) {
-            a->data[i * a->channels + c] *= b;
-        }
-    }
+    lpsimd_kernels()->multiply_scalar(a->data, a->length * a->channels, b);
 }
 
 lpbuffer_t * concat_buffers(lpbuffer_t * a, lpbuffer_t * b) {
@@ -620,6 +1365,13 @@ void add_buffers(lpbuffer_t * a, lpbuffer_t * b) {
     size_t length, i;
     int c, j;
     length = (a->length <= b->length) ? a->length : b->length;
+
+    /* Matching layouts can be treated as one flat run of samples */
+    if(a->channels == b->channels) {
+        lpsimd_kernels()->add(a->data, b->data, length * a->channels);
+        return;
+    }
+
     for(i=0; i < length; i++) {
         for(c=0; c < a->channels; c++) {
             j = c % b->channels;
@@ -725,19 +1477,40 @@ int buffers_are_close(lpbuffer_t * a, lpbuffer_t * b, int d) {
 
 
 void env_buffer(lpbuffer_t * buf, lpbuffer_t * env) {
+    lpfloat_t block[LPSIMD_BLOCKSIZE];
+    const lpsimd_kernels_t * kernels;
     lpfloat_t pos, value;
-    size_t i;
+    size_t i, j, blockframes, numframes;
     int c;
 
     assert(env->length > 0);
     assert(env->channels == 1);
 
-    for(i=0; i < buf->length; i++) {
-        pos = (lpfloat_t)i / buf->length;
-        value = interpolate_linear_pos(env, pos);
-        for(c=0; c < buf->channels; c++) {
-            buf->data[i * buf->channels + c] *= value;
+    if(buf->channels > LPSIMD_BLOCKSIZE) {
+        for(i=0; i < buf->length; i++) {
+            pos = (lpfloat_t)i / buf->length;
+            value = interpolate_linear_pos(env, pos);
+            for(c=0; c < buf->channels; c++) {
+                buf->data[i * buf->channels + c] *= value;
+            }
         }
+        return;
+    }
+
+    /* Interpolate the envelope a block of frames at a time, 
+     * then apply the whole block with one multiply */
+    kernels = lpsimd_kernels();
+    blockframes = LPSIMD_BLOCKSIZE / buf->channels;
+    for(i=0; i < buf->length; i += blockframes) {
+        numframes = (buf->length - i < blockframes) ? buf->length - i : blockframes;
+        for(j=0; j < numframes; j++) {
+            pos = (lpfloat_t)(i + j) / buf->length;
+            value = interpolate_linear_pos(env, pos);
+            for(c=0; c < buf->channels; c++) {
+                block[j * buf->channels + c] = value;
+            }
+        }
+        kernels->multiply(buf->data + i * buf->channels, block, numframes * buf->channels);
     }
 }
 
@@ -1044,11 +1817,7 @@ void cut_into_buffer(lpbuffer_t * buf, lpbuffer_t * out, size_t start, size_t le
 }
 
 void clip_buffer(lpbuffer_t * buf, lpfloat_t minval, lpfloat_t maxval) {
-    size_t i, elements;
-    elements = buf->length * buf->channels;
-    for(i=0; i < elements; i++) {
-        buf->data[i] = fmin(fmax(buf->data[i], minval), maxval);
-    }
+    lpsimd_kernels()->clip(buf->data, buf->length * buf->channels, minval, maxval);
 }
 
 lpbuffer_t * cut_buffer(lpbuffer_t * buf, size_t start, size_t length) {
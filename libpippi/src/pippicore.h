@@ -247,6 +247,34 @@ typedef struct lpbuffer_factory_t {
     void (*destroy_stack)(lpstack_t *);
 } lpbuffer_factory_t;
 
+/* Contiguous kernels behind the buffer arithmetic 
+ * and sample format conversion. The to_int* kernels 
+ * clip to -1..1 and round to the nearest integer; 
+ * to_int24 leaves 24 bit values in 32 bit ints. 
+ * add_sines adds a sine partial with a linear freq 
+ * and amp ramp into out: frame k gets the sine of 
+ * phase + k * inc + k * (k - 1) / 2 * dinc turns, 
+ * scaled by amp + k * damp. 
+ * The scalar set is the reference implementation; 
+ * lpsimd_kernels() picks the fastest set the CPU 
+ * supports at runtime. Build with LP_NO_SIMD to use 
+ * only the scalar set. */
+typedef struct lpsimd_kernels_t {
+    const char * name;
+    void (*multiply)(lpfloat_t * a, const lpfloat_t * b, size_t n);
+    void (*add)(lpfloat_t * a, const lpfloat_t * b, size_t n);
+    void (*multiply_scalar)(lpfloat_t * a, size_t n, lpfloat_t b);
+    void (*scale)(lpfloat_t * a, size_t n, lpfloat_t from_min, lpfloat_t from_diff, lpfloat_t to_diff, lpfloat_t to_min);
+    void (*clip)(lpfloat_t * a, size_t n, lpfloat_t minval, lpfloat_t maxval);
+    lpfloat_t (*min)(const lpfloat_t * a, size_t n);
+    lpfloat_t (*max)(const lpfloat_t * a, size_t n);
+    lpfloat_t (*mag)(const lpfloat_t * a, size_t n);
+    void (*to_float32)(const lpfloat_t * a, float * out, size_t n);
+    void (*to_int16)(const lpfloat_t * a, int16_t * out, size_t n);
+    void (*to_int24)(const lpfloat_t * a, int32_t * out, size_t n);
+    void (*add_sines)(lpfloat_t * out, size_t n, lpfloat_t phase, lpfloat_t inc, lpfloat_t dinc, lpfloat_t amp, lpfloat_t damp);
+} lpsimd_kernels_t;
+
 typedef struct lpringbuffer_factory_t {
     lpbuffer_t * (*create)(size_t, int, int);
     void (*fill)(lpbuffer_t *, lpbuffer_t *, int);
@@ -315,6 +343,10 @@ extern const lpwavetable_factory_t LPWavetable;
 extern const lpwindow_factory_t LPWindow;
 extern const lpfx_factory_t LPFX;
 
+extern const lpsimd_kernels_t LPSIMDScalar;
+const lpsimd_kernels_t * lpsimd_kernels(void);
+int lpsimd_list(const lpsimd_kernels_t ** sets, int maxsets);
+
 extern lprand_t LPRand;
 extern const lpparam_factory_t LPParam;
 extern lpmemorypool_factory_t LPMemoryPool;
@@ -1,76 +1,444 @@
 #include "soundfile.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #define DR_WAV_IMPLEMENTATION
 #include "dr_libs/dr_wav.h"
 
 #define LP_SOUNDFILE_BUFSIZE 1024
+#define LP_SOUNDFILE_WRITE_BLOCKSIZE 65536
+
+/* A mapped soundfile: the buffer handed out 
+ * comes first so unmap can find the mapping */
+typedef struct lpsoundfile_map_t {
+    lpbuffer_t buf;
+    void * base;
+    size_t size;
+} lpsoundfile_map_t;
+
+lpsoundfile_stream_t * open_soundfile_stream(const char * path) {
+    lpsoundfile_stream_t * stream;
+    drwav * wav;
+
+    wav = (drwav *)LPMemoryPool.alloc(1, sizeof(drwav));
+    if(!drwav_init_file(wav, path, NULL)) {
+        LPMemoryPool.free(wav);
+        return NULL;
+    }
+
+    stream = (lpsoundfile_stream_t *)LPMemoryPool.alloc(1, sizeof(lpsoundfile_stream_t));
+    stream->decoder = (void *)wav;
+    stream->length = (size_t)wav->totalPCMFrameCount;
+    stream->pos = 0;
+    stream->channels = (int)wav->channels;
+    stream->samplerate = (int)wav->sampleRate;
+#ifdef LP_FLOAT
+    stream->decodebuf = NULL;
+#else
+    stream->decodebuf = (float *)LPMemoryPool.alloc(LP_SOUNDFILE_BUFSIZE * stream->channels, sizeof(float));
+#endif
+
+    return stream;
+}
+
+/* Reads up to numframes frames into the start of buf, 
+ * and returns the number of frames read, which is 
+ * less than numframes at the end of the file. */
+size_t read_soundfile_stream_frames_into(lpsoundfile_stream_t * stream, lpbuffer_t * buf, size_t numframes) {
+    drwav * wav = (drwav *)stream->decoder;
+    size_t count = 0;
+#ifndef LP_FLOAT
+    size_t chunk, read, i;
+#endif
+
+    assert(buf->channels == stream->channels);
+    assert(buf->length >= numframes);
+
+#ifdef LP_FLOAT
+    /* Decode straight into the buffer */
+    count = (size_t)drwav_read_pcm_frames_f32(wav, numframes, buf->data);
+#else
+    while(count < numframes) {
+        chunk = (numframes - count < LP_SOUNDFILE_BUFSIZE) ? numframes - count : LP_SOUNDFILE_BUFSIZE;
+        read = (size_t)drwav_read_pcm_frames_f32(wav, chunk, stream->decodebuf);
+        for(i=0; i < read * stream->channels; i++) {
+            buf->data[count * stream->channels + i] = (lpfloat_t)stream->decodebuf[i];
+        }
+
+        count += read;
+        if(read < chunk) break;
+    }
+#endif
+
+    stream->pos += count;
+    return count;
+}
+
+int seek_soundfile_stream(lpsoundfile_stream_t * stream, size_t frame) {
+    if(frame > stream->length) return -1;
+    if(!drwav_seek_to_pcm_frame((drwav *)stream->decoder, frame)) return -1;
+    stream->pos = frame;
+    return 0;
+}
+
+void close_soundfile_stream(lpsoundfile_stream_t * stream) {
+    drwav_uninit((drwav *)stream->decoder);
+    LPMemoryPool.free(stream->decoder);
+    LPMemoryPool.free(stream->decodebuf);
+    LPMemoryPool.free(stream);
+}
+
+/* Maps the sample data of a WAV file whose samples are 
+ * already stored as lpfloat_t (32 bit float WAVs when built 
+ * with LP_FLOAT, 64 bit float WAVs otherwise) and returns 
+ * it as a read-only buffer without copying anything. 
+ * Pages are only read from disk when they're touched.
+ *
+ * Returns NULL for any other format, or when the data 
+ * chunk isn't aligned for lpfloat_t access, in which case 
+ * use a stream or LPSoundFile.read instead.
+ *
+ * Mapped buffers must be released with LPSoundFile.unmap 
+ * and never written to or passed to LPBuffer.destroy. */
+lpbuffer_t * map_soundfile(const char * path) {
+    lpsoundfile_map_t * map;
+    struct stat st;
+    drwav wav;
+    size_t offset, length;
+    int channels, samplerate;
+    void * base;
+    int fd;
+
+    if(!drwav_init_file(&wav, path, NULL)) return NULL;
+    offset = (size_t)wav.dataChunkDataPos;
+    length = (size_t)wav.totalPCMFrameCount;
+    channels = (int)wav.channels;
+    samplerate = (int)wav.sampleRate;
+
+    if(wav.translatedFormatTag != DR_WAVE_FORMAT_IEEE_FLOAT 
+        || wav.bitsPerSample != sizeof(lpfloat_t) * 8
+        || offset % sizeof(lpfloat_t) != 0
+    ) {
+        drwav_uninit(&wav);
+        return NULL;
+    }
+    drwav_uninit(&wav);
+
+    if((fd = open(path, O_RDONLY)) < 0) return NULL;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < offset + length * channels * sizeof(lpfloat_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) return NULL;
+
+    /* Mostly read front to back */
+    madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    map = (lpsoundfile_map_t *)LPMemoryPool.alloc(1, sizeof(lpsoundfile_map_t));
+    map->base = base;
+    map->size = (size_t)st.st_size;
+    map->buf.data = (lpfloat_t *)((char *)base + offset);
+    map->buf.length = length;
+    map->buf.channels = channels;
+    map->buf.samplerate = samplerate;
+    map->buf.phase = 0.f;
+    map->buf.boundry = length - 1;
+    map->buf.range = length;
+    map->buf.pos = 0;
+    map->buf.onset = 0;
+    map->buf.is_looping = 0;
+
+    return &map->buf;
+}
+
+void unmap_soundfile(lpbuffer_t * buf) {
+    lpsoundfile_map_t * map = (lpsoundfile_map_t *)buf;
+    munmap(map->base, map->size);
+    LPMemoryPool.free(map);
+}
 
 lpbuffer_t * read_soundfile(const char * path) {
-    unsigned int channels;
-    unsigned int samplerate;
+    lpsoundfile_stream_t * stream;
     lpbuffer_t * out;
-    drwav_uint64 frames;
-    float * data;
-    drwav_uint64 i;
-    unsigned int c;
 
-    data = (float *)drwav_open_file_and_read_pcm_frames_f32(path, &channels, &samplerate, &frames, NULL);
-    if (data == NULL) {
+    stream = open_soundfile_stream(path);
+    if(stream == NULL) {
         printf("Error: could not open file: %s", path);
         exit(EXIT_FAILURE);
     }
 
-    out = LPBuffer.create(frames, channels, samplerate);
-    for(i=0; i < frames; i++) {
-        for(c=0; c < channels; c++) {
-            out->data[i * channels + c] = data[i * channels + c];
+    /* Decode a chunk at a time straight into the 
+     * output, instead of into a second full copy */
+    out = LPBuffer.create(stream->length, stream->channels, stream->samplerate);
+    read_soundfile_stream_frames_into(stream, out, stream->length);
+    close_soundfile_stream(stream);
+
+    return out;
+}
+
+/* Background writer state for threaded writers */
+typedef struct lpsoundfile_worker_t {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned char * block;
+    size_t numbytes;
+    int done;
+} lpsoundfile_worker_t;
+
+void * soundfile_worker_thread(void * arg) {
+    lpsoundfile_writer_t * writer = (lpsoundfile_writer_t *)arg;
+    lpsoundfile_worker_t * worker = (lpsoundfile_worker_t *)writer->worker;
+    unsigned char * block;
+    size_t numbytes, written;
+
+    pthread_mutex_lock(&worker->lock);
+    while(1) {
+        while(worker->block == NULL && !worker->done) {
+            pthread_cond_wait(&worker->cond, &worker->lock);
+        }
+
+        if(worker->block == NULL) break;
+
+        block = worker->block;
+        numbytes = worker->numbytes;
+        pthread_mutex_unlock(&worker->lock);
+
+        written = drwav_write_raw((drwav *)writer->encoder, numbytes, block);
+
+        pthread_mutex_lock(&worker->lock);
+        if(written != numbytes) writer->error = 1;
+        worker->block = NULL;
+        pthread_cond_broadcast(&worker->cond);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return NULL;
+}
+
+/* Write out the frames in the current block. A threaded 
+ * writer waits for the previous block to finish, hands 
+ * this one to the worker and switches to the other block. 
+ * Returns -1 once any block has come up short on disk: a 
+ * threaded writer only learns of it a block later. */
+int soundfile_writer_flush(lpsoundfile_writer_t * writer) {
+    lpsoundfile_worker_t * worker = (lpsoundfile_worker_t *)writer->worker;
+    size_t numbytes;
+    int error;
+
+    numbytes = writer->fill * writer->channels * writer->samplesize;
+    writer->fill = 0;
+
+    if(worker == NULL) {
+        if(!writer->error && numbytes > 0) {
+            if(drwav_write_raw((drwav *)writer->encoder, numbytes, writer->blocks[writer->current]) != numbytes) {
+                writer->error = 1;
+            }
         }
+        return (writer->error) ? -1 : 0;
     }
-    drwav_free(data, NULL);
-    return out;
+
+    /* The worker sets the error flag under its lock */
+    pthread_mutex_lock(&worker->lock);
+    while(worker->block != NULL) {
+        pthread_cond_wait(&worker->cond, &worker->lock);
+    }
+    error = writer->error;
+    if(!error && numbytes > 0) {
+        worker->block = writer->blocks[writer->current];
+        worker->numbytes = numbytes;
+        pthread_cond_broadcast(&worker->cond);
+        writer->current = !writer->current;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return (error) ? -1 : 0;
 }
 
-void write_soundfile(const char * path, lpbuffer_t * buf) {
-    int count;
-    float * tmpbuf;
-    drwav wav;
-    drwav_data_format format;
-    size_t i;
-    int c;
+/* Opens a WAV file for writing in one of the SOUNDFILE_* 
+ * formats. Returns NULL if the file can't be created. */
+lpsoundfile_writer_t * create_soundfile_writer(const char * path, int channels, int samplerate, int format, int threaded) {
+    lpsoundfile_writer_t * writer;
+    lpsoundfile_worker_t * worker;
+    drwav_data_format wavformat;
+    drwav * wav;
 
-    int channels = buf->channels;
-    tmpbuf = (float *)LPMemoryPool.alloc(LP_SOUNDFILE_BUFSIZE * buf->channels, sizeof(float));
+    assert(format >= 0 && format < NUM_SOUNDFILE_FORMATS);
 
-    format.container = drwav_container_riff;
-    format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
-    format.channels = buf->channels;
-    format.sampleRate = buf->samplerate;
-    format.bitsPerSample = 32;
+    wavformat.container = drwav_container_riff;
+    wavformat.format = (format == SOUNDFILE_FLOAT32) ? DR_WAVE_FORMAT_IEEE_FLOAT : DR_WAVE_FORMAT_PCM;
+    wavformat.channels = channels;
+    wavformat.sampleRate = samplerate;
+    wavformat.bitsPerSample = (format == SOUNDFILE_FLOAT32) ? 32 : (format == SOUNDFILE_INT24) ? 24 : 16;
 
-    drwav_init_file_write(&wav, path, &format, NULL);
+    wav = (drwav *)LPMemoryPool.alloc(1, sizeof(drwav));
+    if(!drwav_init_file_write(wav, path, &wavformat, NULL)) {
+        LPMemoryPool.free(wav);
+        return NULL;
+    }
 
-    count = 0;
+    writer = (lpsoundfile_writer_t *)LPMemoryPool.alloc(1, sizeof(lpsoundfile_writer_t));
+    writer->encoder = (void *)wav;
+    writer->worker = NULL;
+    writer->error = 0;
+    writer->length = 0;
+    writer->channels = channels;
+    writer->samplerate = samplerate;
+    writer->format = format;
+    writer->samplesize = wavformat.bitsPerSample / 8;
+    writer->blocksize = LP_SOUNDFILE_WRITE_BLOCKSIZE;
+    writer->fill = 0;
+    writer->current = 0;
+    writer->blocks[0] = (unsigned char *)LPMemoryPool.alloc(writer->blocksize * channels, writer->samplesize);
+    writer->blocks[1] = NULL;
+    writer->quantized = NULL;
 
-    for(i=0; i < buf->length; i++) {
-        for(c=0; c < channels; c++) {
-            tmpbuf[count * channels + c] = (float)buf->data[i * channels + c];
+    if(format == SOUNDFILE_INT24) {
+        writer->quantized = (int32_t *)LPMemoryPool.alloc(writer->blocksize * channels, sizeof(int32_t));
+    }
+
+    if(threaded) {
+        writer->blocks[1] = (unsigned char *)LPMemoryPool.alloc(writer->blocksize * channels, writer->samplesize);
+        worker = (lpsoundfile_worker_t *)LPMemoryPool.alloc(1, sizeof(lpsoundfile_worker_t));
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->cond, NULL);
+        worker->block = NULL;
+        worker->done = 0;
+        writer->worker = (void *)worker;
+        if(pthread_create(&worker->thread, NULL, soundfile_worker_thread, (void *)writer) != 0) {
+            /* Fall back to writing from the calling thread */
+            pthread_mutex_destroy(&worker->lock);
+            pthread_cond_destroy(&worker->cond);
+            LPMemoryPool.free(worker);
+            writer->worker = NULL;
         }
+    }
+
+    return writer;
+}
+
+/* Appends every frame of buf to the file. Returns -1 
+ * and stops writing once a write to disk fails. */
+int write_soundfile_frames(lpsoundfile_writer_t * writer, lpbuffer_t * buf) {
+    const lpsimd_kernels_t * kernels;
+    unsigned char * block;
+    lpfloat_t * src;
+    size_t pos, numframes, numsamples, i;
 
-        count++;
+    assert(buf->channels == writer->channels);
 
-        if (count >= LP_SOUNDFILE_BUFSIZE) {
-            drwav_write_pcm_frames(&wav, LP_SOUNDFILE_BUFSIZE, tmpbuf);
-            count = 0;
+    kernels = lpsimd_kernels();
+    pos = 0;
+    while(pos < buf->length) {
+        numframes = writer->blocksize - writer->fill;
+        if(buf->length - pos < numframes) numframes = buf->length - pos;
+        numsamples = numframes * writer->channels;
+        src = buf->data + pos * writer->channels;
+        block = writer->blocks[writer->current] + writer->fill * writer->channels * writer->samplesize;
+
+        switch(writer->format) {
+            case SOUNDFILE_FLOAT32:
+                kernels->to_float32(src, (float *)block, numsamples);
+                break;
+
+            case SOUNDFILE_INT16:
+                kernels->to_int16(src, (int16_t *)block, numsamples);
+                break;
+
+            case SOUNDFILE_INT24:
+                /* Quantize with the kernel, then pack down to 3 little endian bytes */
+                kernels->to_int24(src, writer->quantized, numsamples);
+                for(i=0; i < numsamples; i++) {
+                    block[i * 3] = (unsigned char)(writer->quantized[i] & 0xff);
+                    block[i * 3 + 1] = (unsigned char)((writer->quantized[i] >> 8) & 0xff);
+                    block[i * 3 + 2] = (unsigned char)((writer->quantized[i] >> 16) & 0xff);
+                }
+                break;
         }
+
+        writer->fill += numframes;
+        writer->length += numframes;
+        pos += numframes;
+
+        if(writer->fill == writer->blocksize && soundfile_writer_flush(writer) < 0) return -1;
     }
 
-    if (count != 0) {
-        drwav_write_pcm_frames(&wav, count, tmpbuf);
+    return 0;
+}
+
+/* Flushes, finishes the WAV header and frees the writer. 
+ * Returns -1 if any of the file could not be written. */
+int close_soundfile_writer(lpsoundfile_writer_t * writer) {
+    lpsoundfile_worker_t * worker = (lpsoundfile_worker_t *)writer->worker;
+    int error;
+
+    soundfile_writer_flush(writer);
+
+    if(worker != NULL) {
+        pthread_mutex_lock(&worker->lock);
+        worker->done = 1;
+        pthread_cond_broadcast(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+        pthread_join(worker->thread, NULL);
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->cond);
+        LPMemoryPool.free(worker);
     }
 
-    drwav_uninit(&wav);
-    LPMemoryPool.free(tmpbuf);
+    error = writer->error;
+    if(drwav_uninit((drwav *)writer->encoder) != DRWAV_SUCCESS) error = 1;
+
+    LPMemoryPool.free(writer->encoder);
+    LPMemoryPool.free(writer->blocks[0]);
+    LPMemoryPool.free(writer->blocks[1]);
+    LPMemoryPool.free(writer->quantized);
+    LPMemoryPool.free(writer);
+
+    return (error) ? -1 : 0;
+}
+
+/* Returns -1 if the file could not be opened or written */
+int write_soundfile_format(const char * path, lpbuffer_t * buf, int format) {
+    lpsoundfile_writer_t * writer;
+
+    writer = create_soundfile_writer(path, buf->channels, buf->samplerate, format, 0);
+    if(writer == NULL) {
+        printf("Error: could not write file: %s", path);
+        return -1;
+    }
+
+    write_soundfile_frames(writer, buf);
+    if(close_soundfile_writer(writer) < 0) {
+        printf("Error: could not write file: %s", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+void write_soundfile(const char * path, lpbuffer_t * buf) {
+    write_soundfile_format(path, buf, SOUNDFILE_FLOAT32);
 }
 
 
-const lpsoundfile_factory_t LPSoundFile = { read_soundfile, write_soundfile };
+const lpsoundfile_factory_t LPSoundFile = { 
+    read_soundfile, 
+    write_soundfile, 
+    open_soundfile_stream, 
+    read_soundfile_stream_frames_into, 
+    seek_soundfile_stream, 
+    close_soundfile_stream, 
+    map_soundfile, 
+    unmap_soundfile, 
+    write_soundfile_format, 
+    create_soundfile_writer, 
+    write_soundfile_frames, 
+    close_soundfile_writer 
+};
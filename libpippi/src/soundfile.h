@@ -3,9 +3,62 @@
 
 #include "pippicore.h"
 
+/* Reads a soundfile in chunks without loading 
+ * the whole file into memory. */
+typedef struct lpsoundfile_stream_t {
+    size_t length;
+    size_t pos;
+    int channels;
+    int samplerate;
+
+    /* decoder state and scratch space, private to soundfile.c */
+    void * decoder;
+    float * decodebuf;
+} lpsoundfile_stream_t;
+
+enum SoundFileFormats {
+    SOUNDFILE_FLOAT32,
+    SOUNDFILE_INT24,
+    SOUNDFILE_INT16,
+    NUM_SOUNDFILE_FORMATS
+};
+
+/* Writes a WAV file in large blocks, converting from 
+ * lpfloat_t with the SIMD format kernels. A threaded 
+ * writer double buffers: one block is filled while 
+ * the other is written to disk by a background thread, 
+ * so rendering and disk I/O overlap. */
+typedef struct lpsoundfile_writer_t {
+    size_t length;
+    int channels;
+    int samplerate;
+    int format;
+    int samplesize;
+
+    /* encoder, worker thread and scratch space, private to soundfile.c */
+    void * encoder;
+    void * worker;
+    int error; /* Set once a block comes up short on disk */
+    unsigned char * blocks[2];
+    int32_t * quantized;
+    size_t blocksize;
+    size_t fill;
+    int current;
+} lpsoundfile_writer_t;
+
 typedef struct lpsoundfile_factory_t {
     lpbuffer_t * (*read)(const char *);
     void (*write)(const char *, lpbuffer_t *);
+    lpsoundfile_stream_t * (*open)(const char *);
+    size_t (*read_frames_into)(lpsoundfile_stream_t *, lpbuffer_t *, size_t);
+    int (*seek)(lpsoundfile_stream_t *, size_t);
+    void (*close)(lpsoundfile_stream_t *);
+    lpbuffer_t * (*map)(const char *);
+    void (*unmap)(lpbuffer_t *);
+    int (*write_format)(const char *, lpbuffer_t *, int);
+    lpsoundfile_writer_t * (*create_writer)(const char *, int, int, int, int);
+    int (*write_frames)(lpsoundfile_writer_t *, lpbuffer_t *);
+    int (*close_writer)(lpsoundfile_writer_t *);
 } lpsoundfile_factory_t;
 
 extern const lpsoundfile_factory_t LPSoundFile;
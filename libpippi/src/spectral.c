@@ -1,62 +1,458 @@
 #include "spectral.h"
 
-/* FIXME: handle multichannel audio */
-lpbuffer_t * convolve_spectral(lpbuffer_t * src, lpbuffer_t * impulse) {
-    size_t length, i;
+/* Block size used for offline convolution 
+ * when the impulse is longer than this */
+#define LPCONVOLVER_OFFLINE_BLOCKSIZE 4096
+#define LPCONVOLVER_MIN_BLOCKSIZE 16
+
+lpconvolver_t * create_convolver(lpbuffer_t * impulse, size_t blocksize, int channels);
+void process_convolver(lpconvolver_t * conv, const lpfloat_t * in, lpfloat_t * out);
+void reset_convolver(lpconvolver_t * conv);
+void destroy_convolver(lpconvolver_t * conv);
+
+lpstft_t * create_stft(size_t winsize, size_t hopsize, int channels);
+void forward_stft(lpstft_t * stft, const lpfloat_t * frames, size_t length, long offset);
+void inverse_stft(lpstft_t * stft, lpfloat_t * frames, size_t length, long offset);
+void process_stft(lpstft_t * stft, const lpfloat_t * in, lpfloat_t * out);
+lpbuffer_t * render_stft(lpstft_t * stft, lpbuffer_t * src, size_t length);
+size_t numframes_stft(lpstft_t * stft, size_t length);
+void reset_stft(lpstft_t * stft);
+void destroy_stft(lpstft_t * stft);
+
+void spectral_fft_tables(size_t fftsize, size_t ** bitrev, lpfloat_t ** cos_table, lpfloat_t ** sin_table) {
+    size_t i, j, bits;
+
+    *bitrev = (size_t *)LPMemoryPool.alloc(fftsize, sizeof(size_t));
+    *cos_table = (lpfloat_t *)LPMemoryPool.alloc(fftsize / 2, sizeof(lpfloat_t));
+    *sin_table = (lpfloat_t *)LPMemoryPool.alloc(fftsize / 2, sizeof(lpfloat_t));
+
+    bits = 0;
+    while(((size_t)1 << bits) < fftsize) bits++;
+    for(i=0; i < fftsize; i++) {
+        (*bitrev)[i] = 0;
+        for(j=0; j < bits; j++) {
+            (*bitrev)[i] |= ((i >> j) & 1) << (bits - 1 - j);
+        }
+    }
+
+    for(i=0; i < fftsize / 2; i++) {
+        (*cos_table)[i] = (lpfloat_t)cos(2.0 * PI * i / fftsize);
+        (*sin_table)[i] = (lpfloat_t)sin(2.0 * PI * i / fftsize);
+    }
+}
+
+void spectral_fft(size_t fftsize, const size_t * bitrev, const lpfloat_t * cos_table, const lpfloat_t * sin_table, lpfloat_t * real, lpfloat_t * imag, int inverse) {
+    size_t i, j, k, size, halfsize, tablestep;
+    lpfloat_t tmp, tpre, tpim, sign;
+
+    for(i=0; i < fftsize; i++) {
+        j = bitrev[i];
+        if(j > i) {
+            tmp = real[i]; real[i] = real[j]; real[j] = tmp;
+            tmp = imag[i]; imag[i] = imag[j]; imag[j] = tmp;
+        }
+    }
+
+    sign = (inverse) ? -1.f : 1.f;
+    for(size=2; size <= fftsize; size *= 2) {
+        halfsize = size / 2;
+        tablestep = fftsize / size;
+        for(i=0; i < fftsize; i += size) {
+            for(j=i, k=0; j < i + halfsize; j++, k += tablestep) {
+                tpre =  real[j+halfsize] * cos_table[k] + sign * imag[j+halfsize] * sin_table[k];
+                tpim = -sign * real[j+halfsize] * sin_table[k] + imag[j+halfsize] * cos_table[k];
+                real[j + halfsize] = real[j] - tpre;
+                imag[j + halfsize] = imag[j] - tpim;
+                real[j] += tpre;
+                imag[j] += tpim;
+            }
+        }
+    }
+}
+
+void convolver_fft(lpconvolver_t * conv, lpfloat_t * real, lpfloat_t * imag, int inverse) {
+    spectral_fft(conv->fftsize, conv->bitrev, conv->cos_table, conv->sin_table, real, imag, inverse);
+}
+
+lpconvolver_t * create_convolver(lpbuffer_t * impulse, size_t blocksize, int channels) {
+    lpconvolver_t * conv;
+    lpfloat_t * real, * imag;
+    size_t i, p, offset, numframes;
     int c;
+
+    assert(impulse->length > 0);
+    assert(impulse->channels == 1 || impulse->channels == channels);
+    assert(blocksize > 0 && (blocksize & (blocksize - 1)) == 0);
+
+    conv = (lpconvolver_t *)LPMemoryPool.alloc(1, sizeof(lpconvolver_t));
+    conv->blocksize = blocksize;
+    conv->fftsize = blocksize * 2;
+    conv->numbins = blocksize + 1;
+    conv->numpartitions = (impulse->length + blocksize - 1) / blocksize;
+    conv->channels = channels;
+    conv->impulse_channels = impulse->channels;
+
+    spectral_fft_tables(conv->fftsize, &conv->bitrev, &conv->cos_table, &conv->sin_table);
+    conv->ir_real = (lpfloat_t *)LPMemoryPool.alloc(impulse->channels * conv->numpartitions * conv->numbins, sizeof(lpfloat_t));
+    conv->ir_imag = (lpfloat_t *)LPMemoryPool.alloc(impulse->channels * conv->numpartitions * conv->numbins, sizeof(lpfloat_t));
+    conv->fdl_real = (lpfloat_t *)LPMemoryPool.alloc(channels * conv->numpartitions * conv->numbins, sizeof(lpfloat_t));
+    conv->fdl_imag = (lpfloat_t *)LPMemoryPool.alloc(channels * conv->numpartitions * conv->numbins, sizeof(lpfloat_t));
+    conv->history = (lpfloat_t *)LPMemoryPool.alloc(channels * conv->fftsize, sizeof(lpfloat_t));
+    conv->work_real = (lpfloat_t *)LPMemoryPool.alloc(conv->fftsize, sizeof(lpfloat_t));
+    conv->work_imag = (lpfloat_t *)LPMemoryPool.alloc(conv->fftsize, sizeof(lpfloat_t));
+
+    /* Each impulse partition is zero padded to the 
+     * FFT size and kept as its non-redundant half spectrum */
+    real = conv->work_real;
+    imag = conv->work_imag;
+    for(c=0; c < impulse->channels; c++) {
+        for(p=0; p < conv->numpartitions; p++) {
+            offset = p * blocksize;
+            numframes = (impulse->length - offset < blocksize) ? impulse->length - offset : blocksize;
+            for(i=0; i < conv->fftsize; i++) {
+                real[i] = (i < numframes) ? impulse->data[(offset + i) * impulse->channels + c] : 0.f;
+                imag[i] = 0.f;
+            }
+
+            convolver_fft(conv, real, imag, 0);
+
+            offset = (c * conv->numpartitions + p) * conv->numbins;
+            for(i=0; i < conv->numbins; i++) {
+                conv->ir_real[offset + i] = real[i];
+                conv->ir_imag[offset + i] = imag[i];
+            }
+        }
+    }
+
+    reset_convolver(conv);
+
+    return conv;
+}
+
+void reset_convolver(lpconvolver_t * conv) {
+    memset(conv->fdl_real, 0, conv->channels * conv->numpartitions * conv->numbins * sizeof(lpfloat_t));
+    memset(conv->fdl_imag, 0, conv->channels * conv->numpartitions * conv->numbins * sizeof(lpfloat_t));
+    memset(conv->history, 0, conv->channels * conv->fftsize * sizeof(lpfloat_t));
+    conv->fdl_pos = 0;
+}
+
+void process_convolver(lpconvolver_t * conv, const lpfloat_t * in, lpfloat_t * out) {
+    lpfloat_t * real, * imag, * history, * xr, * xi, * hr, * hi;
+    lpfloat_t scale;
+    size_t i, p, slot, blocksize, numbins;
+    int c, ic;
+
+    blocksize = conv->blocksize;
+    numbins = conv->numbins;
+    real = conv->work_real;
+    imag = conv->work_imag;
+    scale = 1.f / conv->fftsize;
+
+    for(c=0; c < conv->channels; c++) {
+        ic = (conv->impulse_channels == 1) ? 0 : c;
+
+        /* Slide the input window along by one block */
+        history = conv->history + c * conv->fftsize;
+        memmove(history, history + blocksize, blocksize * sizeof(lpfloat_t));
+        for(i=0; i < blocksize; i++) {
+            history[blocksize + i] = in[i * conv->channels + c];
+        }
+
+        for(i=0; i < conv->fftsize; i++) {
+            real[i] = history[i];
+            imag[i] = 0.f;
+        }
+
+        convolver_fft(conv, real, imag, 0);
+
+        xr = conv->fdl_real + (c * conv->numpartitions + conv->fdl_pos) * numbins;
+        xi = conv->fdl_imag + (c * conv->numpartitions + conv->fdl_pos) * numbins;
+        memcpy(xr, real, numbins * sizeof(lpfloat_t));
+        memcpy(xi, imag, numbins * sizeof(lpfloat_t));
+
+        /* Multiply each past input spectrum with 
+         * the matching impulse partition and sum */
+        memset(real, 0, numbins * sizeof(lpfloat_t));
+        memset(imag, 0, numbins * sizeof(lpfloat_t));
+        for(p=0; p < conv->numpartitions; p++) {
+            slot = (conv->fdl_pos + conv->numpartitions - p) % conv->numpartitions;
+            xr = conv->fdl_real + (c * conv->numpartitions + slot) * numbins;
+            xi = conv->fdl_imag + (c * conv->numpartitions + slot) * numbins;
+            hr = conv->ir_real + (ic * conv->numpartitions + p) * numbins;
+            hi = conv->ir_imag + (ic * conv->numpartitions + p) * numbins;
+            for(i=0; i < numbins; i++) {
+                real[i] += xr[i] * hr[i] - xi[i] * hi[i];
+                imag[i] += xr[i] * hi[i] + xi[i] * hr[i];
+            }
+        }
+
+        /* Rebuild the upper half of the spectrum from the lower */
+        for(i=1; i < blocksize; i++) {
+            real[conv->fftsize - i] = real[i];
+            imag[conv->fftsize - i] = -imag[i];
+        }
+
+        convolver_fft(conv, real, imag, 1);
+
+        /* Overlap-save: the first half is aliased, the second half is output */
+        for(i=0; i < blocksize; i++) {
+            out[i * conv->channels + c] = real[blocksize + i] * scale;
+        }
+    }
+
+    conv->fdl_pos = (conv->fdl_pos + 1) % conv->numpartitions;
+}
+
+void destroy_convolver(lpconvolver_t * conv) {
+    LPMemoryPool.free(conv->bitrev);
+    LPMemoryPool.free(conv->cos_table);
+    LPMemoryPool.free(conv->sin_table);
+    LPMemoryPool.free(conv->ir_real);
+    LPMemoryPool.free(conv->ir_imag);
+    LPMemoryPool.free(conv->fdl_real);
+    LPMemoryPool.free(conv->fdl_imag);
+    LPMemoryPool.free(conv->history);
+    LPMemoryPool.free(conv->work_real);
+    LPMemoryPool.free(conv->work_imag);
+    LPMemoryPool.free(conv);
+}
+
+lpstft_t * create_stft(size_t winsize, size_t hopsize, int channels) {
+    lpstft_t * stft;
+    lpfloat_t overlap;
+    size_t i, j;
+
+    assert(winsize > 1 && (winsize & (winsize - 1)) == 0);
+    assert(hopsize > 0 && hopsize <= winsize / 2);
+    assert(channels > 0);
+
+    stft = (lpstft_t *)LPMemoryPool.alloc(1, sizeof(lpstft_t));
+    stft->winsize = winsize;
+    stft->hopsize = hopsize;
+    stft->numbins = winsize / 2 + 1;
+    stft->channels = channels;
+
+    spectral_fft_tables(winsize, &stft->bitrev, &stft->cos_table, &stft->sin_table);
+
+    stft->window = (lpfloat_t *)LPMemoryPool.alloc(winsize, sizeof(lpfloat_t));
+    stft->real = (lpfloat_t *)LPMemoryPool.alloc(channels * stft->numbins, sizeof(lpfloat_t));
+    stft->imag = (lpfloat_t *)LPMemoryPool.alloc(channels * stft->numbins, sizeof(lpfloat_t));
+    stft->input = (lpfloat_t *)LPMemoryPool.alloc(channels * winsize, sizeof(lpfloat_t));
+    stft->output = (lpfloat_t *)LPMemoryPool.alloc(channels * winsize, sizeof(lpfloat_t));
+    stft->work_real = (lpfloat_t *)LPMemoryPool.alloc(winsize, sizeof(lpfloat_t));
+    stft->work_imag = (lpfloat_t *)LPMemoryPool.alloc(winsize, sizeof(lpfloat_t));
+
+    /* The square root of a periodic hann window is used 
+     * for both analysis and synthesis, so the product of 
+     * the two is a hann window which sums to a constant 
+     * at any hop that divides the window evenly. */
+    for(i=0; i < winsize; i++) {
+        stft->window[i] = (lpfloat_t)sqrt(0.5 - 0.5 * cos(2.0 * PI * i / winsize));
+    }
+
+    overlap = 0.f;
+    for(i=0; i < hopsize; i++) {
+        for(j=i; j < winsize; j += hopsize) {
+            overlap += stft->window[j] * stft->window[j];
+        }
+    }
+    stft->gain = (lpfloat_t)hopsize / (overlap * winsize);
+
+    reset_stft(stft);
+
+    return stft;
+}
+
+void reset_stft(lpstft_t * stft) {
+    memset(stft->real, 0, stft->channels * stft->numbins * sizeof(lpfloat_t));
+    memset(stft->imag, 0, stft->channels * stft->numbins * sizeof(lpfloat_t));
+    memset(stft->input, 0, stft->channels * stft->winsize * sizeof(lpfloat_t));
+    memset(stft->output, 0, stft->channels * stft->winsize * sizeof(lpfloat_t));
+    stft->frame = 0;
+}
+
+/* Windows winsize frames of the interleaved input 
+ * starting at offset, which may hang off either end 
+ * of the input, and fills the spectrum of each channel. */
+void forward_stft(lpstft_t * stft, const lpfloat_t * frames, size_t length, long offset) {
+    lpfloat_t * real, * imag;
+    size_t i;
+    long pos;
+    int c;
+
+    real = stft->work_real;
+    imag = stft->work_imag;
+
+    for(c=0; c < stft->channels; c++) {
+        for(i=0; i < stft->winsize; i++) {
+            pos = offset + (long)i;
+            real[i] = (pos >= 0 && (size_t)pos < length) ? frames[pos * stft->channels + c] * stft->window[i] : 0.f;
+            imag[i] = 0.f;
+        }
+
+        spectral_fft(stft->winsize, stft->bitrev, stft->cos_table, stft->sin_table, real, imag, 0);
+
+        memcpy(stft->real + c * stft->numbins, real, stft->numbins * sizeof(lpfloat_t));
+        memcpy(stft->imag + c * stft->numbins, imag, stft->numbins * sizeof(lpfloat_t));
+    }
+}
+
+/* Resynthesizes the current spectrum and adds it, 
+ * windowed, into the interleaved output at offset. */
+void inverse_stft(lpstft_t * stft, lpfloat_t * frames, size_t length, long offset) {
+    lpfloat_t * real, * imag;
+    size_t i, half;
+    long pos;
+    int c;
+
+    real = stft->work_real;
+    imag = stft->work_imag;
+    half = stft->winsize / 2;
+
+    for(c=0; c < stft->channels; c++) {
+        memcpy(real, stft->real + c * stft->numbins, stft->numbins * sizeof(lpfloat_t));
+        memcpy(imag, stft->imag + c * stft->numbins, stft->numbins * sizeof(lpfloat_t));
+
+        /* Rebuild the upper half of the spectrum from the lower */
+        for(i=1; i < half; i++) {
+            real[stft->winsize - i] = real[i];
+            imag[stft->winsize - i] = -imag[i];
+        }
+
+        spectral_fft(stft->winsize, stft->bitrev, stft->cos_table, stft->sin_table, real, imag, 1);
+
+        for(i=0; i < stft->winsize; i++) {
+            pos = offset + (long)i;
+            if(pos < 0 || (size_t)pos >= length) continue;
+            frames[pos * stft->channels + c] += real[i] * stft->window[i] * stft->gain;
+        }
+    }
+}
+
+/* Streams exactly hopsize frames of interleaved input 
+ * through the transform and returns hopsize frames of 
+ * output, delayed by winsize - hopsize frames. The 
+ * callback, if any, sees every spectrum in between. 
+ * Nothing is allocated here. */
+void process_stft(lpstft_t * stft, const lpfloat_t * in, lpfloat_t * out) {
+    size_t keep, hop;
+
+    hop = stft->hopsize * stft->channels;
+    keep = (stft->winsize - stft->hopsize) * stft->channels;
+
+    memmove(stft->input, stft->input + hop, keep * sizeof(lpfloat_t));
+    memcpy(stft->input + keep, in, hop * sizeof(lpfloat_t));
+
+    forward_stft(stft, stft->input, stft->winsize, 0);
+    if(stft->callback != NULL) stft->callback(stft, stft->frame, stft->ctx);
+    inverse_stft(stft, stft->output, stft->winsize, 0);
+
+    memcpy(out, stft->output, hop * sizeof(lpfloat_t));
+    memmove(stft->output, stft->output + hop, keep * sizeof(lpfloat_t));
+    memset(stft->output + keep, 0, hop * sizeof(lpfloat_t));
+
+    stft->frame += 1;
+}
+
+/* Offline STFT of a whole buffer. The output is length 
+ * frames long, or as long as the source if length is 0. 
+ * Frames are written every hopsize frames and read from 
+ * the matching position in the source, so a different 
+ * length stretches or squashes the sound in time. */
+lpbuffer_t * render_stft(lpstft_t * stft, lpbuffer_t * src, size_t length) {
+    lpbuffer_t * out;
+    size_t numframes;
+    long offset;
+    double stretch;
+
+    assert(src->channels == stft->channels);
+
+    if(length == 0) length = src->length;
+    out = LPBuffer.create(length, src->channels, src->samplerate);
+
+    numframes = numframes_stft(stft, length);
+    stretch = (double)src->length / length;
+
+    reset_stft(stft);
+    for(stft->frame=0; stft->frame < numframes; stft->frame++) {
+        offset = (long)(stft->frame * stft->hopsize) - (long)(stft->winsize - stft->hopsize);
+        forward_stft(stft, src->data, src->length, (long)(offset * stretch));
+        if(stft->callback != NULL) stft->callback(stft, stft->frame, stft->ctx);
+        inverse_stft(stft, out->data, length, offset);
+    }
+
+    return out;
+}
+
+/* Number of frames render_stft takes to cover length 
+ * output frames, starting winsize - hopsize frames early 
+ * so the beginning gets the full overlap. */
+size_t numframes_stft(lpstft_t * stft, size_t length) {
+    return (length + stft->winsize - stft->hopsize + stft->hopsize - 1) / stft->hopsize;
+}
+
+void destroy_stft(lpstft_t * stft) {
+    LPMemoryPool.free(stft->bitrev);
+    LPMemoryPool.free(stft->cos_table);
+    LPMemoryPool.free(stft->sin_table);
+    LPMemoryPool.free(stft->window);
+    LPMemoryPool.free(stft->real);
+    LPMemoryPool.free(stft->imag);
+    LPMemoryPool.free(stft->input);
+    LPMemoryPool.free(stft->output);
+    LPMemoryPool.free(stft->work_real);
+    LPMemoryPool.free(stft->work_imag);
+    LPMemoryPool.free(stft);
+}
+
+/* Offline convolution of any number of channels, 
+ * run through the partitioned convolver one block 
+ * at a time. */
+lpbuffer_t * convolve_spectral(lpbuffer_t * src, lpbuffer_t * impulse) {
+    lpconvolver_t * conv;
+    lpfloat_t * in, * block;
+    size_t length, blocksize, pos, i, numframes;
     lpfloat_t mag;
     lpbuffer_t * out;
-    lpbuffer_t * outa;
-    lpbuffer_t * outb;
-    lpbuffer_t * srca;
-    lpbuffer_t * srcb;
-    lpbuffer_t * impulsea;
-    lpbuffer_t * impulseb;
 
-    assert(src->channels == 1 || src->channels == 2);
-    assert(impulse->channels == 1 || impulse->channels == 2);
-    assert(impulse->channels == src->channels);
+    assert(impulse->channels == 1 || impulse->channels == src->channels);
 
     length = src->length + impulse->length + 1;
     out = LPBuffer.create(length, src->channels, src->samplerate);
 
     mag = LPBuffer.mag(src);
 
-    if(src->channels == 2) {
-        outa = LPBuffer.create(length, src->channels, src->samplerate);
-        outb = LPBuffer.create(length, src->channels, src->samplerate);
+    blocksize = LPCONVOLVER_MIN_BLOCKSIZE;
+    while(blocksize < impulse->length && blocksize < LPCONVOLVER_OFFLINE_BLOCKSIZE) blocksize *= 2;
 
-        srca = LPBuffer.create(src->length, 1, src->samplerate);
-        srcb = LPBuffer.create(src->length, 1, src->samplerate);
-        LPBuffer.split2(src, srca, srcb);
+    conv = create_convolver(impulse, blocksize, src->channels);
+    in = (lpfloat_t *)LPMemoryPool.alloc(blocksize * src->channels, sizeof(lpfloat_t));
+    block = (lpfloat_t *)LPMemoryPool.alloc(blocksize * src->channels, sizeof(lpfloat_t));
 
-        impulsea = LPBuffer.create(impulse->length, 1, src->samplerate);
-        impulseb = LPBuffer.create(impulse->length, 1, src->samplerate);
-        LPBuffer.split2(impulse, impulsea, impulseb);
+    for(pos=0; pos < length; pos += blocksize) {
+        memset(in, 0, blocksize * src->channels * sizeof(lpfloat_t));
+        if(pos < src->length) {
+            numframes = (src->length - pos < blocksize) ? src->length - pos : blocksize;
+            memcpy(in, src->data + pos * src->channels, numframes * src->channels * sizeof(lpfloat_t));
+        }
 
-        Fft_convolveReal(srca->data, impulsea->data, outa->data, length);
-        Fft_convolveReal(srcb->data, impulseb->data, outb->data, length);
+        process_convolver(conv, in, block);
 
-        for(i=0; i < length; i++) {
-            for(c=0; c < out->channels; c++) {
-                out->data[i * out->channels] = outa->data[i];
-                out->data[i * out->channels + 1] = outb->data[i];
-            }
+        numframes = (length - pos < blocksize) ? length - pos : blocksize;
+        for(i=0; i < numframes * src->channels; i++) {
+            out->data[pos * src->channels + i] = block[i];
         }
-
-        LPBuffer.destroy(outa);
-        LPBuffer.destroy(outb);
-        LPBuffer.destroy(srca);
-        LPBuffer.destroy(srcb);
-        LPBuffer.destroy(impulsea);
-        LPBuffer.destroy(impulseb);
-    } else {
-        Fft_convolveReal(src->data, impulse->data, out->data, length);
     }
 
+    LPMemoryPool.free(in);
+    LPMemoryPool.free(block);
+    destroy_convolver(conv);
+
     LPFX.norm(out, mag);
 
     return out;
 }
 
+const lpconvolver_factory_t LPConvolver = { create_convolver, process_convolver, reset_convolver, destroy_convolver };
+const lpstft_factory_t LPSTFT = { create_stft, forward_stft, inverse_stft, process_stft, render_stft, numframes_stft, reset_stft, destroy_stft };
 const lpspectral_factory_t LPSpectral = { convolve_spectral };
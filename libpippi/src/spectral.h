@@ -4,10 +4,126 @@
 #include "pippicore.h"
 #include "fft/fft.h"
 
+/* In-place radix-2 complex FFT of a power of two size over 
+ * tables made once by spectral_fft_tables. The inverse is 
+ * unscaled. Nothing is allocated per transform. */
+void spectral_fft_tables(size_t fftsize, size_t ** bitrev, lpfloat_t ** cos_table, lpfloat_t ** sin_table);
+void spectral_fft(size_t fftsize, const size_t * bitrev, const lpfloat_t * cos_table, const lpfloat_t * sin_table, lpfloat_t * real, lpfloat_t * imag, int inverse);
+
+/* Uniformly partitioned overlap-save convolver.
+ *
+ * The impulse is split into partitions of blocksize 
+ * frames, and each partition's spectrum is computed 
+ * once up front. Every call to process takes exactly 
+ * blocksize frames of interleaved input, and returns 
+ * the same number of convolved frames with no added 
+ * latency. The impulse may be mono, which is then 
+ * applied to every channel, or have one channel per 
+ * input channel. Nothing is allocated after create, 
+ * so process is safe to call from an audio callback.
+ */
+typedef struct lpconvolver_t {
+    size_t blocksize;
+    size_t fftsize;
+    size_t numbins;
+    size_t numpartitions;
+    size_t fdl_pos;
+    int channels;
+    int impulse_channels;
+
+    /* FFT tables */
+    size_t * bitrev;
+    lpfloat_t * cos_table;
+    lpfloat_t * sin_table;
+
+    /* Impulse spectra: impulse_channels * numpartitions * numbins */
+    lpfloat_t * ir_real;
+    lpfloat_t * ir_imag;
+
+    /* Frequency domain delay line of past input 
+     * spectra: channels * numpartitions * numbins */
+    lpfloat_t * fdl_real;
+    lpfloat_t * fdl_imag;
+
+    /* The last fftsize input frames of each channel */
+    lpfloat_t * history;
+
+    /* Scratch space of fftsize */
+    lpfloat_t * work_real;
+    lpfloat_t * work_imag;
+} lpconvolver_t;
+
+typedef struct lpconvolver_factory_t {
+    lpconvolver_t * (*create)(lpbuffer_t * impulse, size_t blocksize, int channels);
+    void (*process)(lpconvolver_t * conv, const lpfloat_t * in, lpfloat_t * out);
+    void (*reset)(lpconvolver_t * conv);
+    void (*destroy)(lpconvolver_t * conv);
+} lpconvolver_factory_t;
+
+/* Short-time Fourier transform with windowed overlap-add.
+ *
+ * Every frame is windowed with the square root of a hann 
+ * window on the way in and again on the way out, and the 
+ * overlap-add is scaled back to unity gain. The spectrum 
+ * of the current frame is kept in real and imag as the 
+ * numbins = winsize/2+1 non-redundant bins of each channel, 
+ * one channel after another, where a callback can change 
+ * it in place before it is resynthesized. All the frames 
+ * are allocated in create, so process is safe to call 
+ * from an audio callback.
+ */
+typedef struct lpstft_t lpstft_t;
+typedef void (*lpstft_callback_t)(lpstft_t * stft, size_t frame, void * ctx);
+
+struct lpstft_t {
+    size_t winsize;
+    size_t hopsize;
+    size_t numbins;
+    size_t frame;
+    int channels;
+
+    /* FFT tables */
+    size_t * bitrev;
+    lpfloat_t * cos_table;
+    lpfloat_t * sin_table;
+
+    lpfloat_t * window;
+    lpfloat_t gain;
+
+    /* Spectrum of the current frame: channels * numbins */
+    lpfloat_t * real;
+    lpfloat_t * imag;
+
+    /* Streaming state: the last winsize input frames, and 
+     * the overlap-add of the output, interleaved */
+    lpfloat_t * input;
+    lpfloat_t * output;
+
+    /* Scratch space of winsize */
+    lpfloat_t * work_real;
+    lpfloat_t * work_imag;
+
+    lpstft_callback_t callback;
+    void * ctx;
+};
+
+typedef struct lpstft_factory_t {
+    lpstft_t * (*create)(size_t winsize, size_t hopsize, int channels);
+    void (*forward)(lpstft_t * stft, const lpfloat_t * frames, size_t length, long offset);
+    void (*inverse)(lpstft_t * stft, lpfloat_t * frames, size_t length, long offset);
+    void (*process)(lpstft_t * stft, const lpfloat_t * in, lpfloat_t * out);
+    lpbuffer_t * (*render)(lpstft_t * stft, lpbuffer_t * src, size_t length);
+    size_t (*numframes)(lpstft_t * stft, size_t length);
+    void (*reset)(lpstft_t * stft);
+    void (*destroy)(lpstft_t * stft);
+} lpstft_factory_t;
+
 typedef struct lpspectral_factory_t {
     lpbuffer_t * (*convolve)(lpbuffer_t *, lpbuffer_t *);
 } lpspectral_factory_t;
 
+extern const lpconvolver_factory_t LPConvolver;
+extern const lpstft_factory_t LPSTFT;
 extern const lpspectral_factory_t LPSpectral;
 
 #endif
@@ -174,9 +174,28 @@ cdef extern from "spectral.h":
     extern const lpspectral_factory_t LPSpectral
 
 cdef extern from "soundfile.h":
+    cdef enum SoundFileFormats:
+        SOUNDFILE_FLOAT32,
+        SOUNDFILE_INT24,
+        SOUNDFILE_INT16,
+        NUM_SOUNDFILE_FORMATS
+
+    ctypedef struct lpsoundfile_stream_t:
+        size_t length
+        size_t pos
+        int channels
+        int samplerate
+
     ctypedef struct lpsoundfile_factory_t:
         lpbuffer_t * (*read)(const char *)
         void (*write)(const char *, lpbuffer_t *)
+        lpsoundfile_stream_t * (*open)(const char *)
+        size_t (*read_frames_into)(lpsoundfile_stream_t *, lpbuffer_t *, size_t)
+        int (*seek)(lpsoundfile_stream_t *, size_t)
+        void (*close)(lpsoundfile_stream_t *)
+        lpbuffer_t * (*map)(const char *)
+        void (*unmap)(lpbuffer_t *)
+        int (*write_format)(const char *, lpbuffer_t *, int)
 
     extern const lpsoundfile_factory_t LPSoundFile
 
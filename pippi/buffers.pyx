@@ -49,6 +49,15 @@ cdef dict PAN_METHODS = {
     'gogins': PANMETHOD_GOGINS
 }
 
+# Soundfile subtypes that have a direct WAV writer. 
+# soundfile writes WAVs as 16 bit PCM by default, so do we.
+cdef dict WAV_FORMATS = {
+    None: SOUNDFILE_INT16,
+    'PCM_16': SOUNDFILE_INT16,
+    'PCM_24': SOUNDFILE_INT24,
+    'FLOAT': SOUNDFILE_FLOAT32,
+}
+
 cdef int to_pan_method(str name):
     try:
         return PAN_METHODS[name]
@@ -963,9 +972,23 @@ cdef class SoundBuffer:
         out = LPBuffer.trim(self.buffer, start, end, threshold, window);
         return SoundBuffer.fromlpbuffer(out)
 
-    def write(self, unicode filename=None):
+    def write(self, unicode filename=None, str subtype=None):
         """ Write the contents of this buffer to disk 
             in the given audio file format. (WAV, AIFF, AU)
+
+            WAVs in the PCM_16 (default), PCM_24 or FLOAT 
+            subtypes are written straight from the buffer, 
+            other formats go through soundfile.
         """
-        sf.write(filename, np.asarray(self), self.samplerate)
+        cdef int format
+        cdef bytes path
+
+        if filename is not None and filename.lower().endswith('.wav') and subtype in WAV_FORMATS:
+            format = WAV_FORMATS[subtype]
+            path = filename.encode('utf-8')
+            if LPSoundFile.write_format(path, self.buffer, format) < 0:
+                raise IOError('Could not write soundfile to %s' % filename)
+            return
+
+        sf.write(filename, np.asarray(self), self.samplerate, subtype=subtype)
 
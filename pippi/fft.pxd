@@ -13,6 +13,36 @@ cdef extern from "fft.h":
     bool Fft_convolveReal(const double x[], const double y[], double out[], size_t n)
     bool Fft_convolveComplex(const double xreal[], const double ximag[], const double yreal[], const double yimag[], double outreal[], double outimag[], size_t n)
 
+cdef extern from "pippicore.h":
+    ctypedef double lpfloat_t
+
+cdef extern from "spectral.h":
+    cdef struct lpstft_t
+
+    ctypedef void (*lpstft_callback_t)(lpstft_t * stft, size_t frame, void * ctx) nogil
+
+    cdef struct lpstft_t:
+        size_t winsize
+        size_t hopsize
+        size_t numbins
+        size_t frame
+        int channels
+        lpfloat_t * real
+        lpfloat_t * imag
+        lpstft_callback_t callback
+        void * ctx
+
+    ctypedef struct lpstft_factory_t:
+        lpstft_t * (*create)(size_t winsize, size_t hopsize, int channels) nogil
+        void (*forward)(lpstft_t * stft, const lpfloat_t * frames, size_t length, long offset) nogil
+        void (*inverse)(lpstft_t * stft, lpfloat_t * frames, size_t length, long offset) nogil
+        void (*process)(lpstft_t * stft, const lpfloat_t * inp, lpfloat_t * out) nogil
+        size_t (*numframes)(lpstft_t * stft, size_t length) nogil
+        void (*reset)(lpstft_t * stft) nogil
+        void (*destroy)(lpstft_t * stft) nogil
+
+    extern const lpstft_factory_t LPSTFT
+
 cdef double[:] _conv(double[:] x, double[:] y)
 cpdef double[:,:] conv(double[:,:] src, double[:,:] impulse)
 
@@ -21,3 +51,6 @@ cpdef tuple to_polar(SoundBuffer real, SoundBuffer imag)
 cpdef tuple transform(SoundBuffer snd)
 cpdef SoundBuffer itransform(SoundBuffer real, SoundBuffer imag)
 cpdef SoundBuffer process(SoundBuffer snd, object blocksize=*, object length=*, object callback=*, object window=*, bool pool=*)
+
+cdef SoundBuffer _stft(SoundBuffer snd, int winsize, int hopsize, object length, lpstft_callback_t callback, void * ctx)
+cpdef SoundBuffer stft(SoundBuffer snd, int winsize=*, int hopsize=*, object length=*, object callback=*, int batchsize=*)
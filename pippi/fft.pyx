@@ -1,6 +1,7 @@
 #cython: language_level=3
 
 from libc.stdlib cimport malloc, free
+from libc.string cimport memcpy
 from libc cimport math
 
 import numpy as np
@@ -14,6 +15,9 @@ from pippi.defaults cimport DEFAULT_SAMPLERATE
 
 np.import_array()
 
+DEF DEFAULT_STFT_WINSIZE = 2048
+DEF DEFAULT_STFT_BATCHSIZE = 256
+
 cdef double[:] _conv(double[:] x, double[:] y):
     cdef size_t i = 0
     cdef size_t x_length = len(x)
@@ -218,7 +222,7 @@ cpdef SoundBuffer process(SoundBuffer snd, object blocksize=0.01, object length=
             params += [(pos, elapsed, block, callback, taper)]
             elapsed += bs/2
 
-            blocks = dsp.pool(process_block, params=params)
+        blocks = dsp.pool(process_block, params=params)
 
         for elapsed, block in blocks:
             out.dub(block, elapsed)
@@ -233,3 +237,127 @@ cpdef SoundBuffer process(SoundBuffer snd, object blocksize=0.01, object length=
             elapsed += bs/2
 
     return out
+
+cdef inline long _stft_offset(lpstft_t * s, size_t frame) nogil:
+    # Same framing as LPSTFT.render: start early enough 
+    # that the first output frame gets the full overlap
+    return <long>(frame * s.hopsize) - <long>(s.winsize - s.hopsize)
+
+cdef int _stft_hopsize(int winsize, int hopsize, int channels) except -1:
+    # LPSTFT.create only asserts these, so check them 
+    # here and fill in the default hop of a quarter window
+    if winsize <= 1 or (winsize & (winsize - 1)) != 0:
+        raise ValueError('STFT winsize must be a power of two greater than 1, got %d' % winsize)
+
+    hopsize = hopsize or winsize // 4
+    if hopsize <= 0 or hopsize > winsize // 2:
+        raise ValueError('STFT hopsize must be between 1 and winsize // 2 (%d), got %d' % (winsize // 2, hopsize))
+
+    if channels <= 0:
+        raise ValueError('STFT needs at least one channel, got %d' % channels)
+
+    return hopsize
+
+cdef SoundBuffer _stft(SoundBuffer snd, int winsize, int hopsize, object length, lpstft_callback_t callback, void * ctx):
+    """ STFT with a native callback, which runs on every frame's 
+        spectrum in place without the GIL.
+    """
+    cdef int channels = snd.channels
+    cdef double[:,::1] src = np.ascontiguousarray(snd.frames, dtype='d')
+    cdef size_t srclength = len(snd)
+    cdef size_t outlength = <size_t>(length * snd.samplerate) if length else srclength
+    cdef double[:,::1] out = np.zeros((outlength, channels), dtype='d')
+    cdef double stretch = <double>srclength / max(outlength, <size_t>1)
+    cdef lpstft_t * s
+    cdef size_t frame, numframes
+    cdef long offset
+
+    hopsize = _stft_hopsize(winsize, hopsize, channels)
+
+    if srclength == 0 or outlength == 0:
+        return SoundBuffer(np.asarray(out), channels=channels, samplerate=snd.samplerate)
+
+    s = LPSTFT.create(winsize, hopsize, channels)
+    s.callback = callback
+    s.ctx = ctx
+    numframes = LPSTFT.numframes(s, outlength)
+
+    with nogil:
+        for frame in range(numframes):
+            offset = _stft_offset(s, frame)
+            s.frame = frame
+            LPSTFT.forward(s, &src[0,0], srclength, <long>(offset * stretch))
+            if s.callback != NULL:
+                s.callback(s, frame, s.ctx)
+            LPSTFT.inverse(s, &out[0,0], outlength, offset)
+
+    LPSTFT.destroy(s)
+
+    return SoundBuffer(np.asarray(out), channels=channels, samplerate=snd.samplerate)
+
+cpdef SoundBuffer stft(SoundBuffer snd, int winsize=DEFAULT_STFT_WINSIZE, int hopsize=0, object length=None, object callback=None, int batchsize=DEFAULT_STFT_BATCHSIZE):
+    """ Short-time Fourier transform and resynthesis with windowed 
+        overlap-add. The window size must be a power of two, and the 
+        hop defaults to a quarter of it and may be at most half of it: 
+        other sizes raise a ValueError. If `length` is given in seconds 
+        the sound is stretched or squashed to fit.
+
+        The callback is called with up to `batchsize` frames at a time 
+        as `callback(pos, real, imag)`: pos is an array of each frame's 
+        position from 0 to 1, and real and imag are arrays of shape 
+        (frames, channels, winsize//2+1) holding the non-redundant bins. 
+        Change them in place, or return a new (real, imag) pair.
+    """
+    if callback is None:
+        return _stft(snd, winsize, hopsize, length, NULL, NULL)
+
+    cdef int channels = snd.channels
+    cdef double[:,::1] src = np.ascontiguousarray(snd.frames, dtype='d')
+    cdef size_t srclength = len(snd)
+    cdef size_t outlength = <size_t>(length * snd.samplerate) if length else srclength
+    cdef double[:,::1] out = np.zeros((outlength, channels), dtype='d')
+    cdef double stretch = <double>srclength / max(outlength, <size_t>1)
+    cdef lpstft_t * s
+    cdef size_t start, frame, count, numframes, spectrum
+    cdef double[:,:,::1] _real
+    cdef double[:,:,::1] _imag
+
+    hopsize = _stft_hopsize(winsize, hopsize, channels)
+
+    if srclength == 0 or outlength == 0:
+        return SoundBuffer(np.asarray(out), channels=channels, samplerate=snd.samplerate)
+
+    s = LPSTFT.create(winsize, hopsize, channels)
+    numframes = LPSTFT.numframes(s, outlength)
+    spectrum = channels * s.numbins * sizeof(double)
+    batchsize = max(1, batchsize)
+
+    real = np.zeros((batchsize, channels, s.numbins), dtype='d')
+    imag = np.zeros((batchsize, channels, s.numbins), dtype='d')
+    _real = real
+    _imag = imag
+
+    try:
+        for start in range(0, numframes, batchsize):
+            count = min(<size_t>batchsize, numframes - start)
+
+            with nogil:
+                for frame in range(count):
+                    LPSTFT.forward(s, &src[0,0], srclength, <long>(_stft_offset(s, start + frame) * stretch))
+                    memcpy(&_real[frame,0,0], s.real, spectrum)
+                    memcpy(&_imag[frame,0,0], s.imag, spectrum)
+
+            result = callback(np.arange(start, start + count) / <double>numframes, real[:count], imag[:count])
+            if result is not None:
+                np.copyto(real[:count], np.nan_to_num(result[0]))
+                np.copyto(imag[:count], np.nan_to_num(result[1]))
+
+            with nogil:
+                for frame in range(count):
+                    memcpy(s.real, &_real[frame,0,0], spectrum)
+                    memcpy(s.imag, &_imag[frame,0,0], spectrum)
+                    LPSTFT.inverse(s, &out[0,0], outlength, _stft_offset(s, start + frame))
+    finally:
+        LPSTFT.destroy(s)
+
+    return SoundBuffer(np.asarray(out), channels=channels, samplerate=snd.samplerate)
@@ -1,33 +1,187 @@
 #cython: language_level=3
 
+from concurrent.futures import ThreadPoolExecutor
+import os
+
 from pippi.wavetables cimport HANN, PHASOR, to_window, to_wavetable, Wavetable
 from pippi cimport interpolation
 from pippi.soundbuffer cimport SoundBuffer
-from libc.stdlib cimport rand, RAND_MAX, malloc, free
+from libc.stdlib cimport rand, RAND_MAX, malloc, calloc, realloc, free
+from libc.string cimport memset
 import numpy as np
 cimport cython
 from cpython cimport array
 import array
 
+# Don't split renders into regions shorter than this
+DEF MIN_REGION_FRAMES = 4096
+
+# Grains are scheduled in one serial pass which draws from rand() 
+# exactly as the old single threaded loop did, then rendered in 
+# parallel: the output is cut into contiguous regions and each thread 
+# renders every grain that overlaps its region, in schedule order. 
+# Every output frame is summed in the same order as before, so the 
+# result is identical to a serial render.
+ctypedef struct grain_t:
+    unsigned long write_pos
+    unsigned long read_pos
+    unsigned long length    # grainlength in frames
+    unsigned long written   # frames copied from the source before it ran out
+    unsigned long extent    # rows of the grain buffer read back out
+    unsigned long outlength # frames written to the output
+    long prev               # last earlier grain which wrote past `written`
+    double speed
+    double amp
+
+cdef class GrainSchedule:
+    cdef grain_t * grains
+    cdef long count
+    cdef long size
+    cdef double[:,::1] snd
+    cdef double[::1] window
+    cdef unsigned long maxlength
+    cdef unsigned long write_boundry
+    cdef int channels
+
+    def __cinit__(self):
+        self.grains = NULL
+        self.count = 0
+        self.size = 0
+
+    def __dealloc__(self):
+        free(self.grains)
+
+    cdef grain_t * add(GrainSchedule self) nogil:
+        cdef grain_t * grains
+        if self.count == self.size:
+            self.size = max(64, self.size * 2)
+            grains = <grain_t *>realloc(self.grains, self.size * sizeof(grain_t))
+            if grains == NULL:
+                return NULL
+            self.grains = grains
+        self.count += 1
+        return &self.grains[self.count-1]
+
+    def render(GrainSchedule self, double[:,:] out, unsigned long start, unsigned long end):
+        cdef double * buf = <double *>calloc(max(self.maxlength, <unsigned long>1) * self.channels, sizeof(double))
+        if buf == NULL:
+            raise MemoryError()
+
+        with nogil:
+            _render_region(self, buf, out, start, end)
+
+        free(buf)
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef inline double _window_pos(double * window, long length, double pos) nogil:
+    # Same as interpolation._linear_pos over a raw table
+    cdef double phase = pos * <double>(length-1)
+    cdef long i = <long>phase
+    cdef double frac = phase - i
+
+    if length == 1:
+        return window[0]
+    elif length < 1 or i >= length-1:
+        return 0
+
+    return (1.0 - frac) * window[i] + (frac * window[i+1])
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef void _fill_rows(GrainSchedule sched, grain_t * g, double * buf, unsigned long start, unsigned long end) nogil:
+    cdef unsigned long i
+    cdef int c
+    cdef double amp
+    for i in range(start, end):
+        amp = g.amp
+        # A one frame grain takes the start of the window
+        if g.length > 1:
+            amp *= _window_pos(&sched.window[0], sched.window.shape[0], <double>i / (g.length-1))
+        else:
+            amp *= _window_pos(&sched.window[0], sched.window.shape[0], 0)
+        for c in range(sched.channels):
+            buf[i * sched.channels + c] = sched.snd[g.read_pos+i, c] * amp
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef void _fill_grain(GrainSchedule sched, long index, double * buf) nogil:
+    """ Rebuilds the grain buffer as the serial loop left it for this 
+        grain: the grain's own frames, and past those whatever the 
+        grains before it wrote, which the resampler reads through.
+    """
+    cdef grain_t * g = &sched.grains[index]
+    cdef unsigned long cover = min(g.written, g.extent)
+    cdef long h = index - 1
+
+    _fill_rows(sched, g, buf, 0, cover)
+
+    while h >= 0 and cover < g.extent:
+        if sched.grains[h].written > cover:
+            _fill_rows(sched, &sched.grains[h], buf, cover, min(sched.grains[h].written, g.extent))
+            cover = sched.grains[h].written
+        h = sched.grains[h].prev
+
+    if cover < g.extent:
+        memset(&buf[cover * sched.channels], 0, (g.extent - cover) * sched.channels * sizeof(double))
+
 @cython.boundscheck(False)
 @cython.wraparound(False)
 @cython.cdivision(True)
-cdef double[:,:] _speed(double speed, double[:,:] original, double[:,:] out, int channels) nogil:
-    cdef unsigned int inlength = len(original)
-    cdef unsigned int outlength = len(out)
-    cdef double phase_inc = (1.0/inlength) * (inlength-1) * speed
-    cdef double phase = 0, pos = 0
-    cdef int c = 0, i = 0
+cdef inline double _grain_point(double * buf, long length, int channels, int c, double phase) nogil:
+    # Same as interpolation._linear_point over one channel of the grain buffer
+    cdef long i = <long>phase
+    cdef double frac = phase - i
+
+    if length == 1:
+        return buf[c]
+    elif length < 1 or i >= length-1:
+        return 0
 
-    for i in range(outlength):
-        for c in range(channels):
-            out[i,c] = interpolation._linear_point(original[:,c], phase)
+    return (1.0 - frac) * buf[i * channels + c] + (frac * buf[(i+1) * channels + c])
 
-        phase += phase_inc * speed
-        if phase >= inlength:
-            break
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef void _render_region(GrainSchedule sched, double * buf, double[:,:] out, unsigned long start, unsigned long end) nogil:
+    cdef long index, inlength = <long>sched.maxlength
+    cdef unsigned long i, pos
+    cdef int c
+    cdef double phase, phase_inc
+    cdef grain_t * g
 
-    return out
+    for index in range(sched.count):
+        g = &sched.grains[index]
+        if g.outlength == 0 or g.write_pos >= end or g.write_pos + g.outlength <= start:
+            continue
+
+        _fill_grain(sched, index, buf)
+
+        if g.speed == 1:
+            for i in range(max(start, g.write_pos) - g.write_pos, min(end, g.write_pos + g.outlength) - g.write_pos):
+                for c in range(sched.channels):
+                    out[g.write_pos+i, c] += buf[i * sched.channels + c]
+            continue
+
+        # The phase has to be accumulated from the start of the 
+        # grain to land on the same values as the serial render
+        phase = 0
+        phase_inc = (1.0/inlength) * (inlength-1) * g.speed
+        for i in range(g.outlength):
+            pos = g.write_pos + i
+            if pos >= end:
+                break
+
+            if pos >= start:
+                for c in range(sched.channels):
+                    out[pos, c] += _grain_point(buf, inlength, sched.channels, c, phase)
+
+            phase += phase_inc * g.speed
+            if phase >= inlength:
+                break
 
 cdef class Cloud:
     def __cinit__(self, 
@@ -78,7 +232,10 @@ cdef class Cloud:
             self.has_mask = True
             self.mask = array.array('i', mask)
 
-    def play(self, double length):
+    def play(self, double length, int threads=0):
+        """ Render the cloud. Grains are rendered in parallel across 
+            `threads` threads, or one per cpu by default.
+        """
         cdef double[:] grid = np.divide(self.grid, length)
         cdef unsigned int outframelength = <unsigned int>(self.samplerate * length)
         cdef double[:,:] out = np.zeros((outframelength, self.channels), dtype='d')
@@ -86,21 +243,22 @@ cdef class Cloud:
         cdef unsigned int read_pos=0
         cdef unsigned int grainlength
         cdef double pos = 0
-        cdef double grainpos = 0
-        cdef double panpos = 0
-        cdef double sample = 0
-        cdef double spread = 0
-        cdef double speed, amp
+        cdef double speed
         cdef unsigned int write_boundry = outframelength-1
         cdef unsigned int read_boundry = len(self.snd)-1
         cdef unsigned int masklength = 0
         cdef unsigned int count = 0
-
-        cdef double minspeed = min(self.speed)
-        cdef unsigned long maxgrainlength = <unsigned long>(max(self.grainlength) * self.samplerate)
-        cdef double[:,:] grain = np.zeros((maxgrainlength, self.channels), dtype='d')
-        cdef double[:,:] grainresamp
         cdef unsigned int resamplength
+        cdef int write_jitter
+        cdef long top = -1
+        cdef grain_t * g
+
+        cdef GrainSchedule sched = GrainSchedule()
+        sched.snd = np.ascontiguousarray(self.snd)
+        sched.window = np.ascontiguousarray(self.window)
+        sched.channels = <int>self.channels
+        sched.maxlength = <unsigned long>(max(self.grainlength) * self.samplerate)
+        sched.write_boundry = write_boundry
 
         if self.has_mask:
             masklength = <unsigned int>len(self.mask)
@@ -121,43 +279,47 @@ cdef class Cloud:
 
             speed = interpolation._linear_pos(self.speed, pos)
             read_pos = <unsigned int>(interpolation._linear_pos(self.position, pos) * (read_boundry-grainlength))
-            spread = interpolation._linear_pos(self.spread, pos)
-            panpos = (rand()/<double>RAND_MAX) * spread + (0.5 - (spread * 0.5))
-            pans = [panpos, 1-panpos]
 
-            for i in range(grainlength):
-                grainpos = <double>i / (grainlength-1)
-                amp = <double>interpolation._linear_pos(self.amp, pos)
-                amp *= interpolation._linear_pos(self.window, grainpos) 
-                if read_pos + i > read_boundry:
-                    break
+            # Panning is not applied yet, but the draw keeps the 
+            # sequence of random values the same for the next grain
+            rand()
 
-                for c in range(self.channels):
-                    panpos = pans[c % 2]
-                    grain[i,c] = self.snd[read_pos+i, c] * amp
+            g = sched.add()
+            if g == NULL:
+                raise MemoryError()
+
+            g.write_pos = write_pos
+            g.read_pos = read_pos
+            g.length = grainlength
+            g.written = 0 if read_pos > read_boundry else min(grainlength, read_boundry - read_pos + 1)
+            g.speed = speed
+            g.amp = interpolation._linear_pos(self.amp, pos)
 
             if speed != 1:
                 resamplength = <unsigned int>(grainlength * (1.0/speed))
-                grainresamp = np.zeros((resamplength, self.channels), dtype='d')
-
-                grainresamp = _speed(speed, grain, grainresamp, <int>self.channels)
-                grainlength = <unsigned int>(grainlength * (1.0/speed))
-
-                for i in range(resamplength):
-                    if write_pos+i > write_boundry:
-                        break
-
-                    for c in range(self.channels):
-                        out[write_pos+i, c] += grainresamp[i,c]
-
+                g.outlength = min(resamplength, write_boundry - write_pos + 1)
+                g.extent = min(sched.maxlength, <unsigned long>(resamplength * speed * speed) + 3)
             else:
-                for i in range(grainlength):
-                    for c in range(self.channels):
-                        out[write_pos+i, c] += grain[i,c]
+                g.outlength = grainlength
+                g.extent = grainlength
+
+            while top >= 0 and sched.grains[top].written <= g.written:
+                top = sched.grains[top].prev
+            g.prev = top
+            top = sched.count - 1
 
             pos += interpolation._linear_pos(grid, pos)
             count += 1
 
-        return SoundBuffer(out, channels=self.channels, samplerate=self.samplerate)
+        if threads <= 0:
+            threads = os.cpu_count() or 1
+        threads = max(1, min(threads, outframelength // MIN_REGION_FRAMES))
 
+        if threads == 1:
+            sched.render(out, 0, outframelength)
+        else:
+            bounds = [ outframelength * t // threads for t in range(threads+1) ]
+            with ThreadPoolExecutor(max_workers=threads) as pool:
+                list(pool.map(sched.render, [out]*threads, bounds[:-1], bounds[1:]))
 
+        return SoundBuffer(out, channels=self.channels, samplerate=self.samplerate)
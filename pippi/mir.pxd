@@ -33,18 +33,42 @@ cdef extern from "mir.h":
 
         int tau_max
         int tau_min
+        int framesize
 
     ctypedef struct lpmir_pitch_factory_t:
         lpyin_t * (*yin_create)(int, int)
         lpfloat_t (*yin_process)(lpyin_t *, lpfloat_t)
+        lpfloat_t (*yin_process_block)(lpyin_t *, const lpfloat_t *, size_t, lpfloat_t *) nogil
         void (*yin_destroy)(lpyin_t *)
 
     extern const lpmir_pitch_factory_t LPPitchTracker
 
+    cdef int LPCONTRAST_BANDS
+
+    ctypedef struct lpspectralfeatures_t:
+        size_t numframes
+        int winsize
+        int hopsize
+        int samplerate
+        lpfloat_t * centroid
+        lpfloat_t * bandwidth
+        lpfloat_t * flatness
+        lpfloat_t * rolloff
+        lpfloat_t * contrast
+
+    ctypedef struct lpmir_spectralfeatures_factory_t:
+        lpspectralfeatures_t * (*analyze)(lpbuffer_t * snd, int winsize) nogil
+        lpspectralfeatures_t * (*analyze_frames)(const lpfloat_t * frames, size_t length, int channels, int samplerate, int winsize) nogil
+        void (*destroy)(lpspectralfeatures_t * features) nogil
+
+    extern const lpmir_spectralfeatures_factory_t LPSpectralFeatures
+
 
 cdef int DEFAULT_WINSIZE
 
 cpdef np.ndarray flatten(SoundBuffer snd)
+cpdef dict features(SoundBuffer snd, int winsize=*)
+cdef dict _features(double[:, ::1] frames, int samplerate, int winsize)
 
 cdef np.ndarray _bandwidth(np.ndarray snd, int samplerate, int winsize)
 cpdef Wavetable bandwidth(SoundBuffer snd, int winsize=*)
@@ -61,7 +85,7 @@ cpdef Wavetable centroid(SoundBuffer snd, int winsize=*)
 cdef np.ndarray _contrast(np.ndarray snd, int samplerate, int winsize)
 cpdef Wavetable contrast(SoundBuffer snd, int winsize=*)
 
-cpdef Wavetable pitch(SoundBuffer snd, double tolerance=*, str method=*, int winsize=*, bint backfill=*, double autotune=*, double fallback=*)
+cpdef Wavetable pitch(SoundBuffer snd, double tolerance=*, str method=*, int winsize=*, bint backfill=*, double autotune=*, object fallback=*)
 
 cpdef list onsets(SoundBuffer snd, str method=*, int winsize=*, bint seconds=*)
 cpdef list segments(SoundBuffer snd, str method=*, int winsize=*)
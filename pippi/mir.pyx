@@ -14,50 +14,83 @@ np.import_array()
 cpdef np.ndarray flatten(SoundBuffer snd):
     return np.asarray(snd.remix(1).frames, dtype='f').flatten()
 
+cdef dict _features(double[:, ::1] frames, int samplerate, int winsize):
+    cdef lpspectralfeatures_t * f
+    cdef size_t length = frames.shape[0]
+    cdef int channels = frames.shape[1]
+    cdef const double * data = &frames[0,0] if length > 0 else NULL
+
+    with nogil:
+        f = LPSpectralFeatures.analyze_frames(data, length, channels, samplerate, winsize)
+
+    cdef size_t numframes = f.numframes
+    out = {
+        'bandwidth': np.array(<double[:numframes]>f.bandwidth).reshape(1, numframes),
+        'flatness': np.array(<double[:numframes]>f.flatness).reshape(1, numframes),
+        'rolloff': np.array(<double[:numframes]>f.rolloff).reshape(1, numframes),
+        'centroid': np.array(<double[:numframes]>f.centroid).reshape(1, numframes),
+        'contrast': np.array(<double[:LPCONTRAST_BANDS * numframes]>f.contrast).reshape(LPCONTRAST_BANDS, numframes),
+    }
+
+    LPSpectralFeatures.destroy(f)
+    return out
+
+cpdef dict features(SoundBuffer snd, int winsize=DEFAULT_WINSIZE):
+    """ Returns all the spectral descriptors of the sound, computed together from one STFT 
+        of the sound summed to mono: a dict of bandwidth, flatness, rolloff, centroid and 
+        contrast arrays, shaped like the librosa features they replace. Contrast has 7 rows 
+        (6 octave bands from 200hz plus the band below), the others have one.
+
+        Example:
+
+            f = mir.features(snd)
+            brightest = f['centroid'].max()
+
+        See libpippi/src/mir.c for implementation notes.
+    """
+    return _features(np.ascontiguousarray(snd.frames, dtype='d'), snd.samplerate, winsize)
+
 cdef np.ndarray _bandwidth(np.ndarray snd, int samplerate, int winsize):
-    import librosa
-    return librosa.feature.spectral_bandwidth(y=snd, sr=samplerate, n_fft=winsize)
+    return _features(np.ascontiguousarray(snd, dtype='d').reshape(-1, 1), samplerate, winsize)['bandwidth']
 
 cpdef Wavetable bandwidth(SoundBuffer snd, int winsize=DEFAULT_WINSIZE):
-    cdef np.ndarray wt = _bandwidth(flatten(snd), snd.samplerate, winsize)
+    cdef np.ndarray wt = features(snd, winsize)['bandwidth']
     return Wavetable(wt.transpose().astype('d').flatten())
 
 cdef np.ndarray _flatness(np.ndarray snd, int winsize):
-    import librosa
-    return librosa.feature.spectral_flatness(y=snd, n_fft=winsize)
+    # Flatness doesn't depend on the samplerate
+    return _features(np.ascontiguousarray(snd, dtype='d').reshape(-1, 1), 48000, winsize)['flatness']
 
 cpdef Wavetable flatness(SoundBuffer snd, int winsize=DEFAULT_WINSIZE):
-    cdef np.ndarray wt = _flatness(flatten(snd), winsize)
+    cdef np.ndarray wt = features(snd, winsize)['flatness']
     return Wavetable(wt.transpose().astype('d').flatten())
 
 cdef np.ndarray _rolloff(np.ndarray snd, int samplerate, int winsize):
-    import librosa
-    return librosa.feature.spectral_rolloff(y=snd, sr=samplerate, n_fft=winsize)
+    return _features(np.ascontiguousarray(snd, dtype='d').reshape(-1, 1), samplerate, winsize)['rolloff']
 
 cpdef Wavetable rolloff(SoundBuffer snd, int winsize=DEFAULT_WINSIZE):
-    cdef np.ndarray wt = _rolloff(flatten(snd), snd.samplerate, winsize)
+    cdef np.ndarray wt = features(snd, winsize)['rolloff']
     return Wavetable(wt.transpose().astype('d').flatten())
 
 cdef np.ndarray _centroid(np.ndarray snd, int samplerate, int winsize):
-    import librosa
-    return librosa.feature.spectral_centroid(y=snd, sr=samplerate, n_fft=winsize)
+    return _features(np.ascontiguousarray(snd, dtype='d').reshape(-1, 1), samplerate, winsize)['centroid']
 
 cpdef Wavetable centroid(SoundBuffer snd, int winsize=DEFAULT_WINSIZE):
-    cdef np.ndarray wt = _centroid(flatten(snd), snd.samplerate, winsize)
+    cdef np.ndarray wt = features(snd, winsize)['centroid']
     return Wavetable(wt.transpose().astype('d').flatten())
 
 cdef np.ndarray _contrast(np.ndarray snd, int samplerate, int winsize):
-    import librosa
-    return librosa.feature.spectral_contrast(y=snd, sr=samplerate, n_fft=winsize)
+    return _features(np.ascontiguousarray(snd, dtype='d').reshape(-1, 1), samplerate, winsize)['contrast']
 
 cpdef Wavetable contrast(SoundBuffer snd, int winsize=DEFAULT_WINSIZE):
-    cdef np.ndarray wt = _contrast(flatten(snd), snd.samplerate, winsize)
+    cdef np.ndarray wt = features(snd, winsize)['contrast']
     return Wavetable(wt.transpose().astype('d').flatten())
 
-cpdef Wavetable pitch(SoundBuffer snd, double tolerance=0.8, str method=None, int winsize=DEFAULT_WINSIZE, bint backfill=True, double autotune=0, double fallback=220.):
+cpdef Wavetable pitch(SoundBuffer snd, double tolerance=0.8, str method=None, int winsize=DEFAULT_WINSIZE, bint backfill=True, double autotune=0, object fallback=None):
     """ Returns a wavetable of non-zero frequencies detected which exceed the confidence threshold given. Frequencies are 
         held until the next detection to avoid zeros and outliers. Depending on the input, you may need to play with the 
         tolerance value and the window size to tune the behavior. The default detection method is `yinfast`. 
+        If a `fallback` frequency is given it is reported until the first detection, so it leads the wavetable.
 
         Example:
 
@@ -73,17 +106,26 @@ cpdef Wavetable pitch(SoundBuffer snd, double tolerance=0.8, str method=None, in
     """
 
     yin = LPPitchTracker.yin_create(4096, <int>snd.samplerate)
-    yin.fallback = <lpfloat_t>fallback
+    if fallback is not None:
+        yin.fallback = <lpfloat_t>fallback
 
     cdef list pitches = []
-    cdef float[:] src = flatten(snd)
+    cdef double[::1] src = np.ascontiguousarray(flatten(snd), dtype='d')
+    cdef size_t length = len(src)
+    cdef double[::1] out = np.zeros(length, dtype='d')
+    cdef size_t i
 
-    cdef lpfloat_t s
     cdef lpfloat_t last_p = -1
-    cdef lpfloat_t p = fallback
+    cdef lpfloat_t p
+
+    if length > 0:
+        with nogil:
+            LPPitchTracker.yin_process_block(yin, &src[0], length, &out[0])
+
+    LPPitchTracker.yin_destroy(yin)
 
-    for s in src:
-        p = LPPitchTracker.yin_process(yin, s);
+    for i in range(length):
+        p = out[i]
         if(p > 0 and p != last_p):
             last_p = p
             pitches += [ p ]
@@ -4,7 +4,7 @@
 from pippi.soundbuffer cimport SoundBuffer
 from libc.stdint cimport uint32_t, int64_t
 
-cdef extern from "soundpipe.h":
+cdef extern from "soundpipe.h" nogil:
     ctypedef struct sp_data:
         double* out;
         int sr
@@ -40,8 +40,8 @@ cdef extern from "soundpipe.h":
     int sp_buthp_init(sp_data*, sp_buthp*)
     int sp_buthp_compute(sp_data*, sp_buthp*, double*, double*)
 
-cpdef list split(SoundBuffer snd, double interval=*, object drift=*, double driftwidth=*)
-cpdef list customsplit(SoundBuffer snd, list freqs)
+cpdef list split(SoundBuffer snd, double interval=*, object drift=*, double driftwidth=*, int blocksize=*, int workers=*)
+cpdef list customsplit(SoundBuffer snd, list freqs, int blocksize=*, int workers=*)
 
 cpdef SoundBuffer spread(SoundBuffer snd, double amount=*)
 cpdef SoundBuffer smear(SoundBuffer snd, double amount=*)
@@ -1,10 +1,14 @@
 #cython: language_level=3
 
+from concurrent.futures import ThreadPoolExecutor
+import os
+
 from pippi cimport interpolation
 from pippi cimport wavetables
 from pippi import shapes
 from pippi cimport fx
 from pippi.lists cimport _scaleinplace
+cimport cython
 from libc.stdlib cimport malloc, free
 import numpy as np
 cimport numpy as np
@@ -13,9 +17,21 @@ np.import_array()
 
 DEF MINFREQ = 1.
 DEF MAXFREQ = 20000.
+DEF DEFAULT_BLOCKSIZE = 64
+
 
+cdef double[:] _control_curve(double[:] curve, int length, int blocksize):
+    cdef int numblocks = (length + blocksize - 1) // blocksize
+    cdef double[:] out = np.zeros(max(1, numblocks), dtype='d')
+    cdef int b = 0
+    for b in range(numblocks):
+        out[b] = interpolation._linear_pos(curve, <double>(b * blocksize) / length)
+    return out
 
-cdef double[:,:] _extract_band(double[:,:] snd, double[:,:] out, double[:] minfreq, double[:] maxfreq):
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef void _extract_band(double[:,:] snd, double[:] out, int c, double[:] minfreq, double[:] maxfreq, int blocksize) nogil:
     cdef sp_data* sp
     cdef sp_buthp* buthp1
     cdef sp_buthp* buthp2
@@ -23,63 +39,91 @@ cdef double[:,:] _extract_band(double[:,:] snd, double[:,:] out, double[:] minfr
     cdef sp_butlp* butlp2
 
     cdef int i = 0
-    cdef int c = 0
-    cdef double pos = 0
-
-    cdef int length = len(snd)
-    cdef int channels = snd.shape[1]
+    cdef int length = snd.shape[0]
 
     cdef double sample = 0
     cdef double filtered = 0
     cdef double output = 0
-    cdef double _minfreq, _maxfreq
+    cdef double _minfreq = 0, _maxfreq = 0
 
     sp_create(&sp)
 
-    for c in range(channels):
-        sp_buthp_create(&buthp1)
-        sp_buthp_create(&buthp2)
-        sp_buthp_init(sp, buthp1)
-        sp_buthp_init(sp, buthp2)
-
-        sp_butlp_create(&butlp1)
-        sp_butlp_create(&butlp2)
-        sp_butlp_init(sp, butlp1)
-        sp_butlp_init(sp, butlp2)
-
-        for i in range(length):
-            sample = snd[i,c]
-            pos = <double>i / length
-            _minfreq = interpolation._linear_pos(minfreq, pos)
-            _maxfreq = interpolation._linear_pos(maxfreq, pos)
-
-            if _maxfreq < MAXFREQ:
-                buthp1.freq = _maxfreq
-                buthp2.freq = _maxfreq
-                sp_buthp_compute(sp, buthp1, &sample, &filtered)
-                sp_buthp_compute(sp, buthp2, &filtered, &filtered)
-            else:
-                filtered = sample
-
-            if _minfreq > MINFREQ:
-                butlp1.freq = _minfreq
-                butlp2.freq = _minfreq
-                sp_butlp_compute(sp, butlp1, &filtered, &filtered)
-                sp_butlp_compute(sp, butlp2, &filtered, &output)
-            else:
-                output = filtered
-
-            out[i,c] = output
-
-        sp_buthp_destroy(&buthp1)
-        sp_buthp_destroy(&buthp2)
-
-        sp_butlp_destroy(&butlp1)
-        sp_butlp_destroy(&butlp2)
+    sp_buthp_create(&buthp1)
+    sp_buthp_create(&buthp2)
+    sp_buthp_init(sp, buthp1)
+    sp_buthp_init(sp, buthp2)
+
+    sp_butlp_create(&butlp1)
+    sp_butlp_create(&butlp2)
+    sp_butlp_init(sp, butlp1)
+    sp_butlp_init(sp, butlp2)
+
+    for i in range(length):
+        # Soundpipe recomputes the filter coefficients whenever 
+        # the frequency changes, so only follow the frequency 
+        # curves once per block
+        if i % blocksize == 0:
+            _minfreq = minfreq[i // blocksize]
+            _maxfreq = maxfreq[i // blocksize]
+            buthp1.freq = _maxfreq
+            buthp2.freq = _maxfreq
+            butlp1.freq = _minfreq
+            butlp2.freq = _minfreq
+
+        sample = snd[i,c]
+
+        if _maxfreq < MAXFREQ:
+            sp_buthp_compute(sp, buthp1, &sample, &filtered)
+            sp_buthp_compute(sp, buthp2, &filtered, &filtered)
+        else:
+            filtered = sample
+
+        if _minfreq > MINFREQ:
+            sp_butlp_compute(sp, butlp1, &filtered, &filtered)
+            sp_butlp_compute(sp, butlp2, &filtered, &output)
+        else:
+            output = filtered
+
+        out[i] = output
+
+    sp_buthp_destroy(&buthp1)
+    sp_buthp_destroy(&buthp2)
+
+    sp_butlp_destroy(&butlp1)
+    sp_butlp_destroy(&butlp2)
 
     sp_destroy(&sp)
 
-    return out
+def _extract_channel(double[:,:] snd, double[:] out, int c, double[:] minfreq, double[:] maxfreq, int blocksize):
+    with nogil:
+        _extract_band(snd, out, c, minfreq, maxfreq, blocksize)
+
+cdef list _extract_bands(SoundBuffer snd, list bands, int blocksize, int workers):
+    """ Filters each (minfreq, maxfreq) band out of the sound, 
+        running every band and channel in its own job across 
+        a pool of threads.
+    """
+    cdef int length = len(snd)
+    cdef int channels = snd.channels
+    # Channels are rendered into separate rows so threads working 
+    # on the same band don't write to the same cache lines
+    cdef list out = [ np.zeros((channels, length), dtype='d') for _ in bands ]
+    cdef list jobs = []
+    cdef int b, c
+
+    # Frequencies at the start of each block, read once per band
+    blocksize = max(1, blocksize)
+    bands = [ (_control_curve(minfreq, length, blocksize), _control_curve(maxfreq, length, blocksize)) for minfreq, maxfreq in bands ]
+
+    with ThreadPoolExecutor(max_workers=(workers or os.cpu_count() or 1)) as pool:
+        for b in range(len(bands)):
+            for c in range(channels):
+                jobs += [ pool.submit(_extract_channel, snd.frames, out[b][c], c, bands[b][0], bands[b][1], blocksize) ]
+
+        for job in jobs:
+            job.result()
+
+    return [ SoundBuffer(np.ascontiguousarray(band.T), channels=channels, samplerate=snd.samplerate) for band in out ]
 
 cdef double mtof(double note):
     return 2**((note-69)/12.0) * 440.0
@@ -92,15 +136,13 @@ cdef double[:] _driftfreq(double[:] freq, double[:] curve):
         freq[i] -= interpolation._linear_pos(curve, pos)
     return freq
 
-cpdef list split(SoundBuffer snd, double interval=3, object drift=None, double driftwidth=0):
-    cdef int length = len(snd)
-    cdef int channels = snd.channels
-
-    cdef list out = []
-    cdef double[:,:] band = np.zeros((length, channels), dtype='d')
-
-    cdef double[:] _minfreq
-    cdef double[:] _maxfreq
+cpdef list split(SoundBuffer snd, double interval=3, object drift=None, double driftwidth=0, int blocksize=DEFAULT_BLOCKSIZE, int workers=0):
+    """ Split the sound into bands `interval` semitones wide. Bands and 
+        channels are filtered in parallel across `workers` threads, one 
+        per cpu by default. The band edges follow the drift curve once 
+        every `blocksize` frames.
+    """
+    cdef list bands = []
     cdef double[:] _drift
 
     if drift is None:
@@ -109,57 +151,32 @@ cpdef list split(SoundBuffer snd, double interval=3, object drift=None, double d
         _drift = wavetables.to_window(drift)
         _drift = _scaleinplace(_drift, np.min(_drift), np.max(_drift), 0, driftwidth/2.0, False)
 
-    _minfreq = wavetables.to_window(0)
-    _maxfreq = _driftfreq(wavetables.to_window(mtof(interval)), _drift)
-    band = _extract_band(snd.frames, band, _minfreq, _maxfreq)
-    out += [ SoundBuffer(band.copy(), channels=channels, samplerate=snd.samplerate) ]
+    bands += [ (wavetables.to_window(0), _driftfreq(wavetables.to_window(mtof(interval)), _drift)) ]
 
     cdef double note = interval
 
     while mtof(note+interval) < MAXFREQ:
-        _minfreq = _driftfreq(wavetables.to_window(mtof(note)), _drift)
-        _maxfreq = _driftfreq(wavetables.to_window(mtof(note+interval)), _drift)
-        band = _extract_band(snd.frames, band, _minfreq, _maxfreq)
-        out += [ SoundBuffer(band.copy(), channels=channels, samplerate=snd.samplerate) ]
+        bands += [ (_driftfreq(wavetables.to_window(mtof(note)), _drift), _driftfreq(wavetables.to_window(mtof(note+interval)), _drift)) ]
         note += interval
 
     if mtof(note) < MAXFREQ:
-        _minfreq = _driftfreq(wavetables.to_window(mtof(note)), _drift)
-        _maxfreq = wavetables.to_window(MAXFREQ)
-        band = _extract_band(snd.frames, band, _minfreq, _maxfreq)
-        out += [ SoundBuffer(band.copy(), channels=channels, samplerate=snd.samplerate) ]
+        bands += [ (_driftfreq(wavetables.to_window(mtof(note)), _drift), wavetables.to_window(MAXFREQ)) ]
 
-    return out
+    return _extract_bands(snd, bands, blocksize, workers)
 
 
-cpdef list customsplit(SoundBuffer snd, list freqs):
-    cdef int length = len(snd)
-    cdef int channels = snd.channels
+cpdef list customsplit(SoundBuffer snd, list freqs, int blocksize=DEFAULT_BLOCKSIZE, int workers=0):
     cdef int i = 0
+    cdef list bands = []
 
-    cdef list out = []
-    cdef double[:,:] band = np.zeros((length, channels), dtype='d')
-
-    cdef double[:] _minfreq
-    cdef double[:] _maxfreq
-
-    _minfreq = wavetables.to_window(0)
-    _maxfreq = wavetables.to_window(freqs[0])
-    band = _extract_band(snd.frames, band, _minfreq, _maxfreq)
-    out += [ SoundBuffer(band.copy(), channels=channels, samplerate=snd.samplerate) ]
+    bands += [ (wavetables.to_window(0), wavetables.to_window(freqs[0])) ]
 
     for i in range(len(freqs)-1):
-        _minfreq = wavetables.to_window(freqs[i])
-        _maxfreq = wavetables.to_window(freqs[i+1])
-        band = _extract_band(snd.frames, band, _minfreq, _maxfreq)
-        out += [ SoundBuffer(band.copy(), channels=channels, samplerate=snd.samplerate) ]
+        bands += [ (wavetables.to_window(freqs[i]), wavetables.to_window(freqs[i+1])) ]
 
-    _minfreq = wavetables.to_window(freqs[-1])
-    _maxfreq = wavetables.to_window(MAXFREQ)
-    band = _extract_band(snd.frames, band, _minfreq, _maxfreq)
-    out += [ SoundBuffer(band.copy(), channels=channels, samplerate=snd.samplerate) ]
+    bands += [ (wavetables.to_window(freqs[-1]), wavetables.to_window(MAXFREQ)) ]
 
-    return out
+    return _extract_bands(snd, bands, blocksize, workers)
 
 cpdef SoundBuffer spread(SoundBuffer snd, double amount=0.5):
     cdef SoundBuffer out = SoundBuffer(length=snd.dur, channels=snd.channels, samplerate=snd.samplerate)
@@ -0,0 +1,42 @@
+#cython: language_level=3
+
+from pippi.soundbuffer cimport SoundBuffer
+
+cdef extern from "pippicore.h":
+    ctypedef double lpfloat_t
+
+    ctypedef struct lpbuffer_t:
+        lpfloat_t * data
+        size_t length
+        int samplerate
+        int channels
+
+cdef extern from "oscs.sine.h":
+    cdef enum LPOscBankTargets:
+        LPOSCBANK_FREQ,
+        LPOSCBANK_AMP
+
+    ctypedef struct lposcbank_t:
+        size_t numpartials
+        lpfloat_t samplerate
+        size_t pos
+
+    ctypedef struct lposcbank_factory_t:
+        lposcbank_t * (*create)(size_t, lpfloat_t)
+        void (*set_partial)(lposcbank_t *, size_t, lpfloat_t, lpfloat_t, lpfloat_t)
+        void (*set_envelope)(lposcbank_t *, size_t, int, const lpfloat_t *, const lpfloat_t *, size_t)
+        void (*render_block)(lposcbank_t *, lpfloat_t *, size_t) nogil
+        lpbuffer_t * (*render)(lposcbank_t *, size_t, int)
+        void (*destroy)(lposcbank_t *)
+
+    extern const lposcbank_factory_t LPOscBank
+
+cdef class OscBank:
+    cdef lposcbank_t * bank
+
+    cdef public int channels
+    cdef public int samplerate
+    cdef public size_t numpartials
+
+    cdef void _set_envelope(OscBank self, size_t partial, int target, object points)
+    cpdef SoundBuffer play(OscBank self, double length=*)
@@ -0,0 +1,80 @@
+#cython: language_level=3
+
+import numpy as np
+from pippi.soundbuffer cimport SoundBuffer
+from pippi.defaults cimport DEFAULT_CHANNELS, DEFAULT_SAMPLERATE
+
+cdef class OscBank:
+    """ A bank of sine partials for additive synthesis, rendered 
+        together in blocks by libpippi's LPOscBank.
+
+        Freqs, amps and phases may be a single value shared by every 
+        partial or a sequence with one value per partial.
+
+        Freq and amp envelopes are optional lists with an entry for 
+        each partial: either None or a sequence of (seconds, value) 
+        breakpoints. Breakpoint times count from the start of the 
+        first call to play, and each call carries on from where the 
+        last one ended.
+
+            partials = [ 55 * (i+1) for i in range(1000) ]
+            envs = [ [(0, 0), (0.01, 1/(i+1)), (2, 0)] for i in range(1000) ]
+            out = OscBank(partials, amp_envs=envs).play(2)
+    """
+    def __cinit__(
+            self, 
+            object freqs=440.0, 
+            object amps=1.0, 
+            object phases=0.0, 
+            list freq_envs=None, 
+            list amp_envs=None, 
+            int channels=DEFAULT_CHANNELS, 
+            int samplerate=DEFAULT_SAMPLERATE
+        ):
+
+        cdef double[::1] _freqs = np.atleast_1d(np.asarray(freqs, dtype='d')).copy()
+        cdef size_t numpartials = len(_freqs)
+        cdef double[::1] _amps = np.broadcast_to(np.asarray(amps, dtype='d'), (numpartials,)).copy()
+        cdef double[::1] _phases = np.broadcast_to(np.asarray(phases, dtype='d'), (numpartials,)).copy()
+        cdef size_t p
+
+        self.numpartials = numpartials
+        self.channels = channels
+        self.samplerate = samplerate
+        self.bank = LPOscBank.create(numpartials, <lpfloat_t>samplerate)
+
+        for p in range(numpartials):
+            LPOscBank.set_partial(self.bank, p, _freqs[p], _amps[p], _phases[p])
+
+        if freq_envs is not None:
+            for p, points in enumerate(freq_envs[:numpartials]):
+                self._set_envelope(p, LPOSCBANK_FREQ, points)
+
+        if amp_envs is not None:
+            for p, points in enumerate(amp_envs[:numpartials]):
+                self._set_envelope(p, LPOSCBANK_AMP, points)
+
+    def __dealloc__(self):
+        if self.bank != NULL:
+            LPOscBank.destroy(self.bank)
+
+    cdef void _set_envelope(OscBank self, size_t partial, int target, object points):
+        if points is None or len(points) == 0:
+            return
+
+        cdef double[:,::1] _points = np.ascontiguousarray(points, dtype='d').reshape(-1, 2)
+        cdef double[::1] times = np.multiply(_points[:,0], self.samplerate)
+        cdef double[::1] values = np.ascontiguousarray(_points[:,1])
+
+        LPOscBank.set_envelope(self.bank, partial, target, &times[0], &values[0], len(times))
+
+    cpdef SoundBuffer play(OscBank self, double length=1):
+        cdef size_t framelength = <size_t>(length * self.samplerate)
+        cdef double[::1] out = np.zeros(framelength, dtype='d')
+
+        if framelength > 0:
+            with nogil:
+                LPOscBank.render_block(self.bank, &out[0], framelength)
+
+        frames = np.repeat(np.asarray(out).reshape(-1, 1), self.channels, axis=1)
+        return SoundBuffer(frames, channels=self.channels, samplerate=self.samplerate)
@@ -8,6 +8,7 @@ from pippi.fold import Fold
 from pippi.fm import FM
 from pippi.osc import Osc
 from pippi.osc2d import Osc2d
+from pippi.oscbank import OscBank
 from pippi.pulsar import Pulsar
 from pippi.pulsar2d import Pulsar2d
 from pippi.pluck import Pluck
@@ -105,6 +105,7 @@ cdef extern from "oscs.pulsar.h":
     ctypedef struct lppulsarosc_factory_t:
         lppulsarosc_t * (*create)()
         lpfloat_t (*process)(lppulsarosc_t *)
+        void (*process_block)(lppulsarosc_t *, lpfloat_t *, size_t, const lpfloat_t *, const lpfloat_t *)
         void (*destroy)(lppulsarosc_t*)
 
     cdef extern const lppulsarosc_factory_t LPPulsarOsc
@@ -21,11 +21,21 @@ from pippi import graph
 from pippi.defaults cimport DEFAULT_SAMPLERATE, DEFAULT_CHANNELS, DEFAULT_SOUNDFILE, PI
 from pippi cimport grains
 from pippi cimport soundpipe
+from pippi.buffers cimport lpbuffer_t, LPSoundFile, SOUNDFILE_FLOAT32, SOUNDFILE_INT24, SOUNDFILE_INT16
 
 np.import_array()
 
 cdef double VSPEED_MIN = 0.0001
 
+# Soundfile subtypes that have a direct WAV writer. 
+# soundfile writes WAVs as 16 bit PCM by default, so do we.
+cdef dict WAV_FORMATS = {
+    None: SOUNDFILE_INT16,
+    'PCM_16': SOUNDFILE_INT16,
+    'PCM_24': SOUNDFILE_INT24,
+    'FLOAT': SOUNDFILE_FLOAT32,
+}
+
 
 cdef double[:,:] _pan(double[:,:] out, int length, int channels, double[:] _pos, int method):
     cdef double left = 0.5
@@ -1165,10 +1175,14 @@ cdef class SoundBuffer:
     def towavetable(SoundBuffer self, *args, **kwargs):
         return Wavetable(self, *args, **kwargs)
 
-    def write(self, unicode filename=None):
+    def write(self, unicode filename=None, str subtype=None):
         """ Write the contents of this buffer to disk 
             in the given audio file format. 
 
+            WAVs in the PCM_16 (default), PCM_24 or FLOAT 
+            subtypes are written straight from the frames, 
+            other formats and subtypes go through libsndfile.
+
             Supported formats via libsndfile:
                 AIFF - AIFF (Apple/SGI)
                 AU - AU (Sun/NeXT)
@@ -1197,9 +1211,24 @@ cdef class SoundBuffer:
                 XI - XI (FastTracker 2)
 
         """
+        cdef lpbuffer_t buf
+        cdef bytes path
+
+        # Contiguous frames can go straight to the WAV writer
+        if filename is not None and filename.lower().endswith('.wav') and subtype in WAV_FORMATS \
+            and len(self.frames) > 0 and self.frames.is_c_contig():
+            buf.data = &self.frames[0,0]
+            buf.length = len(self.frames)
+            buf.channels = self.channels
+            buf.samplerate = self.samplerate
+            path = filename.encode('utf-8')
+            if LPSoundFile.write_format(path, &buf, WAV_FORMATS[subtype]) < 0:
+                raise IOError('Could not write soundfile to %s' % filename)
+            return
+
         with warnings.catch_warnings():
             warnings.simplefilter('ignore')
-            sf.write(filename, np.asarray(self.frames), self.samplerate)
+            sf.write(filename, np.asarray(self.frames), self.samplerate, subtype=subtype)
 
 
 cpdef object rebuild_buffer(double[:,:] frames, int channels, int samplerate):
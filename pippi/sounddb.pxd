@@ -5,3 +5,5 @@ cdef class SoundDB:
     cdef object db
     cdef object c
     cdef str path
+    cdef str columnpath
+    cdef object index
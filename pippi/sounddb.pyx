@@ -1,8 +1,10 @@
 #cython: language_level=3
 
+from concurrent.futures import ThreadPoolExecutor
 import contextlib
 import os
 from pathlib import Path
+import shutil
 import sqlite3
 
 import numpy as np
@@ -17,6 +19,215 @@ np.import_array()
 sqlite3.register_adapter(np.ndarray, lambda a: a.tobytes())
 sqlite3.register_converter('BUFFER', lambda b: np.frombuffer(b))
 
+# Per-frame feature curves live in a sidecar directory next 
+# to the database, with one flat file of float32 per feature. 
+# Each sound's frames are a contiguous run in every file, 
+# starting at its frame_offset row in the sounds table, so 
+# the files can be memory mapped and scanned as columns 
+# without touching sqlite. Contrast has one value per band 
+# for every frame.
+FEATURES = ('bandwidth', 'flatness', 'rolloff', 'centroid', 'contrast')
+FEATURE_WIDTHS = {'bandwidth': 1, 'flatness': 1, 'rolloff': 1, 'centroid': 1, 'contrast': 7}
+FEATURE_DTYPE = np.dtype('<f4')
+
+SOUND_COLUMNS = ('filename', 'offset', 'channels', 'samplerate', 'duration', 'magnitude', 'frame_offset', 'numframes') + tuple(
+    '%s_%s' % (f, stat) for f in FEATURES for stat in ('min', 'max', 'avg')
+)
+
+DEFAULT_BATCHSIZE = 512
+
+cdef tuple _analyze(object item):
+    cdef SoundBuffer snd
+    cdef dict features
+    cdef list row
+
+    sound, filename, offset = item
+    if isinstance(sound, SoundBuffer):
+        snd = sound
+    else:
+        filename = filename or str(sound)
+        snd = SoundBuffer(filename=str(sound))
+
+    features = mir.features(snd, mir.DEFAULT_WINSIZE)
+
+    row = [filename or '', offset or 0, snd.channels, snd.samplerate, snd.dur, snd.mag]
+    for f in FEATURES:
+        row += [ np.min(features[f]), np.max(features[f]), np.average(features[f]) ]
+
+    # Curves go to the sidecar frame-major
+    curves = { f: np.ascontiguousarray(features[f].transpose(), dtype=FEATURE_DTYPE) for f in FEATURES }
+
+    return row, curves
+
+def _analyze_item(item):
+    return _analyze(item)
+
+# The nearest neighbour index is inverted-file style: vectors of 
+# summary stats are standardized, clustered with k-means, and 
+# each query only scans the lists whose centroids are closest 
+# to it. The vectors, their ids and their list assignments are 
+# append-only files in the sidecar, so new sounds are added to 
+# the index as they are ingested without rebuilding it.
+INDEX_DIMS = ('duration', 'magnitude') + tuple('%s_%s' % (f, stat) for f in FEATURES for stat in ('min', 'max', 'avg'))
+INDEX_KMEANS_ITERATIONS = 12
+INDEX_TRAINING_PER_LIST = 64
+DEFAULT_NPROBE = 8
+
+cdef class SoundIndex:
+    cdef object path
+    cdef public tuple dims
+    cdef object mean
+    cdef object std
+    cdef object centroids
+
+    # Vectors grouped by list, with the start of each list in bounds
+    cdef object vectors
+    cdef object ids
+    cdef object bounds
+    cdef size_t size
+    cdef bint stale
+
+    def __cinit__(SoundIndex self, object path):
+        self.path = Path(path)
+        self.stale = True
+
+    def _file(SoundIndex self, str name):
+        return str(self.path / ('index.%s' % name))
+
+    def exists(SoundIndex self):
+        return os.path.exists(self._file('npz'))
+
+    def load(SoundIndex self):
+        meta = np.load(self._file('npz'))
+        self.dims = tuple(str(d) for d in meta['dims'])
+        self.mean = meta['mean']
+        self.std = meta['std']
+        self.centroids = meta['centroids']
+        self.stale = True
+
+    def build(SoundIndex self, object ids, object vectors, tuple dims, int nlist=0):
+        """ Trains the lists on the given vectors and writes a new index. 
+            nlist defaults to about the square root of the number of vectors.
+        """
+        cdef int i, n = len(vectors)
+
+        vectors = np.asarray(vectors, dtype='d').reshape(n, len(dims))
+        self.dims = dims
+        self.mean = vectors.mean(0) if n > 0 else np.zeros(len(dims))
+        self.std = vectors.std(0) if n > 0 else np.ones(len(dims))
+        self.std[self.std == 0] = 1
+
+        z = ((vectors - self.mean) / self.std).astype(FEATURE_DTYPE)
+        nlist = max(1, min(n, nlist or int(np.sqrt(n))))
+
+        # Lloyd's iterations on a sample of the vectors
+        rng = np.random.default_rng(0)
+        sample = z[rng.choice(n, min(n, nlist * INDEX_TRAINING_PER_LIST), replace=False)] if n > 0 else z
+        self.centroids = sample[rng.choice(len(sample), nlist, replace=False)].copy() if n > 0 else np.zeros((1, len(dims)), dtype=FEATURE_DTYPE)
+        for i in range(INDEX_KMEANS_ITERATIONS):
+            assigned = self._assign(sample)
+            for c in range(len(self.centroids)):
+                members = sample[assigned == c]
+                if len(members) > 0:
+                    self.centroids[c] = members.mean(0)
+
+        np.savez(self._file('npz'), dims=np.array(dims), mean=self.mean, std=self.std, centroids=self.centroids)
+        for name in ('ids', 'lists', 'vectors'):
+            with contextlib.suppress(FileNotFoundError):
+                os.remove(self._file(name))
+
+        self.insert(ids, vectors)
+
+    def _assign(SoundIndex self, object z):
+        # Squared distances to every centroid, without the |z|^2 term which doesn't change the order
+        d = (self.centroids * self.centroids).sum(1) - 2 * (z @ self.centroids.T)
+        return np.argmin(d, 1).astype('<i4')
+
+    def _trim(SoundIndex self):
+        """ Cuts the index files back to the rows all of them hold, so an 
+            insert cut short can't leave later appends misaligned. Returns 
+            the number of rows left.
+        """
+        cdef dict rowsizes = {'ids': 8, 'lists': 4, 'vectors': len(self.dims) * FEATURE_DTYPE.itemsize}
+        cdef dict sizes = { name: os.path.getsize(self._file(name)) if os.path.exists(self._file(name)) else 0 for name in rowsizes }
+        cdef size_t rows = min(sizes[name] // rowsizes[name] for name in rowsizes)
+
+        for name in rowsizes:
+            if sizes[name] > rows * rowsizes[name]:
+                os.truncate(self._file(name), rows * rowsizes[name])
+
+        return rows
+
+    def insert(SoundIndex self, object ids, object vectors):
+        """ Appends vectors to the lists their nearest centroids belong to """
+        if len(ids) == 0:
+            return
+
+        self._trim()
+        vectors = np.asarray(vectors, dtype='d').reshape(len(ids), len(self.dims))
+        z = ((vectors - self.mean) / self.std).astype(FEATURE_DTYPE)
+
+        with open(self._file('ids'), 'ab') as f:
+            f.write(np.asarray(ids, dtype='<i8').tobytes())
+        with open(self._file('lists'), 'ab') as f:
+            f.write(self._assign(z).tobytes())
+        with open(self._file('vectors'), 'ab') as f:
+            f.write(z.tobytes())
+
+        self.stale = True
+
+    def _regroup(SoundIndex self):
+        if not self.stale:
+            return
+
+        self.size = self._trim()
+        ids = np.fromfile(self._file('ids'), dtype='<i8') if self.size > 0 else np.zeros(0, dtype='<i8')
+        lists = np.fromfile(self._file('lists'), dtype='<i4') if self.size > 0 else np.zeros(0, dtype='<i4')
+        vectors = np.fromfile(self._file('vectors'), dtype=FEATURE_DTYPE).reshape(-1, len(self.dims)) if self.size > 0 else np.zeros((0, len(self.dims)), dtype=FEATURE_DTYPE)
+
+        order = np.argsort(lists, kind='stable')
+        self.ids = ids[order]
+        self.vectors = np.ascontiguousarray(vectors[order])
+        self.bounds = np.searchsorted(lists[order], np.arange(len(self.centroids) + 1))
+        self.stale = False
+
+    def last_id(SoundIndex self):
+        self._regroup()
+        return int(self.ids.max()) if self.size > 0 else 0
+
+    def search(SoundIndex self, dict target, dict weights=None, int k=50, int nprobe=DEFAULT_NPROBE):
+        """ Returns (ids, distances) of the k nearest vectors to the target, 
+            which maps dimension names to values. Dimensions missing from 
+            the target are ignored. Distances are in standard deviations.
+        """
+        cdef int i
+
+        self._regroup()
+
+        q = np.zeros(len(self.dims))
+        w = np.zeros(len(self.dims))
+        for i, d in enumerate(self.dims):
+            if d in target:
+                q[i] = (target[d] - self.mean[i]) / self.std[i]
+                w[i] = 1 if weights is None else weights.get(d, 1)
+
+        if self.size == 0 or not w.any():
+            return np.zeros(0, dtype='<i8'), np.zeros(0)
+
+        coarse = ((self.centroids - q)**2 * w).sum(1)
+        probes = np.argsort(coarse)[:max(1, nprobe)]
+        rows = np.concatenate([ np.arange(self.bounds[p], self.bounds[p+1]) for p in probes ])
+        if len(rows) == 0:
+            return np.zeros(0, dtype='<i8'), np.zeros(0)
+
+        dist = ((self.vectors[rows] - q)**2 * w).sum(1)
+        k = min(k, len(rows))
+        nearest = np.argpartition(dist, k - 1)[:k]
+        nearest = nearest[np.argsort(dist[nearest])]
+
+        return self.ids[rows[nearest]], np.sqrt(dist[nearest])
+
+
 
 cdef class SoundDB:
     def __cinit__(SoundDB self, object snd=None, object filename=None, object offset=None, str dbname=None, str dbpath=None, bint overwrite=False):
@@ -28,15 +239,20 @@ cdef class SoundDB:
 
         fullpath = Path(dbpath) / dbname
 
+        columnpath = Path(dbpath) / ('%s.features' % dbname)
+
         if fullpath.exists() and overwrite:
             with contextlib.suppress(FileNotFoundError):
                 os.remove(fullpath)
+            shutil.rmtree(columnpath, ignore_errors=True)
         
         init = False
         if not fullpath.exists():
             init = True
 
         self.path = str(fullpath)
+        self.columnpath = str(columnpath)
+        columnpath.mkdir(parents=True, exist_ok=True)
 
         self.db = sqlite3.connect(self.path)
         self.db.row_factory = sqlite3.Row
@@ -45,15 +261,15 @@ cdef class SoundDB:
         if init:
             self.setup()
 
+        self._sync_columns()
+
+        self.index = SoundIndex(self.columnpath)
+        if self.index.exists():
+            self.index.load()
+            self._update_index()
+
         if isinstance(snd, list):
-            f = filename or ''
-            o = offset or 0
-            for i, s in enumerate(snd):
-                if isinstance(filename, list):
-                    f = filename[i]
-                if isinstance(offset, list):
-                    o = offset[i]
-                self.ingest(s, f, o)
+            self.ingest_many(snd, filename, offset)
 
         elif isinstance(snd, SoundBuffer):
             self.ingest(snd, filename or '', offset or 0)
@@ -68,11 +284,14 @@ cdef class SoundDB:
             duration REAL, 
             magnitude REAL, 
 
-            bandwidth BUFFER, bandwidth_min REAL, bandwidth_max REAL, bandwidth_avg REAL, 
-            flatness BUFFER, flatness_min REAL, flatness_max REAL, flatness_avg REAL, 
-            rolloff BUFFER, rolloff_min REAL, rolloff_max REAL, rolloff_avg REAL, 
-            centroid BUFFER, centroid_min REAL, centroid_max REAL, centroid_avg REAL, 
-            contrast BUFFER, contrast_min REAL, contrast_max REAL, contrast_avg REAL)
+            frame_offset INTEGER,
+            numframes INTEGER,
+
+            bandwidth_min REAL, bandwidth_max REAL, bandwidth_avg REAL, 
+            flatness_min REAL, flatness_max REAL, flatness_avg REAL, 
+            rolloff_min REAL, rolloff_max REAL, rolloff_avg REAL, 
+            centroid_min REAL, centroid_max REAL, centroid_avg REAL, 
+            contrast_min REAL, contrast_max REAL, contrast_avg REAL)
         """
         self.c.execute(sql)
         self.db.commit()
@@ -114,44 +333,174 @@ cdef class SoundDB:
         ))
         self.db.commit()
 
+    def _sync_columns(SoundDB self):
+        """ Cuts any frames not referenced by the sounds table off the ends 
+            of the column files, which is left behind if an ingest was 
+            interrupted between writing the curves and committing the rows.
+        """
+        # Databases from before the sidecar kept curves as blobs in the table
+        if 'frame_offset' not in [ c['name'] for c in self.c.execute("PRAGMA table_info(sounds)") ]:
+            self.c.execute("ALTER TABLE sounds ADD COLUMN frame_offset INTEGER")
+            self.c.execute("ALTER TABLE sounds ADD COLUMN numframes INTEGER")
+            self.db.commit()
+
+        r = self.c.execute("SELECT MAX(frame_offset + numframes) FROM sounds").fetchone()
+        cdef size_t numframes = r[0] or 0
+
+        for f in FEATURES:
+            path = self._column_path(f)
+            with open(path, 'ab') as col:
+                size = numframes * FEATURE_WIDTHS[f] * FEATURE_DTYPE.itemsize
+                if col.tell() > size:
+                    col.truncate(size)
+
+    def _column_path(SoundDB self, str feature):
+        return str(Path(self.columnpath) / ('%s.f32' % feature))
+
+    def _write_batch(SoundDB self, list results):
+        """ Appends the curves of a batch of analyzed sounds to the column 
+            files, then inserts their rows in one transaction.
+        """
+        cdef size_t frame_offset = os.path.getsize(self._column_path('centroid')) // FEATURE_DTYPE.itemsize
+        cdef list rows = []
+
+        for f in FEATURES:
+            with open(self._column_path(f), 'ab') as col:
+                for _, curves in results:
+                    col.write(curves[f].tobytes())
+
+        for row, curves in results:
+            numframes = len(curves['centroid'])
+            rows += [ row[:6] + [frame_offset, numframes] + row[6:] ]
+            frame_offset += numframes
+
+        with self.db:
+            self.db.executemany("INSERT INTO sounds (%s) VALUES (%s)" % (', '.join(SOUND_COLUMNS), ', '.join(['?']*len(SOUND_COLUMNS))), rows)
+
+        self._update_index()
+
+    def _index_vectors(SoundDB self, str where='', tuple params=()):
+        r = self.c.execute("SELECT id, %s FROM sounds %s ORDER BY id" % (', '.join(self.index.dims), where), params).fetchall()
+        ids = np.array([ row[0] for row in r ], dtype='<i8')
+        vectors = np.array([ tuple(row)[1:] for row in r ], dtype='d')
+        return ids, np.nan_to_num(vectors)
+
+    def _update_index(SoundDB self):
+        """ Adds any sounds the index hasn't seen yet """
+        if not self.index.exists():
+            return
+
+        ids, vectors = self._index_vectors('WHERE id > ?', (self.index.last_id(),))
+        self.index.insert(ids, vectors)
+
+    def build_index(SoundDB self, object dims=None, int nlist=0):
+        """ Builds the nearest neighbour index over the summary stats of 
+            every sound, which is kept up to date on ingest from then on. 
+            `dims` may limit it to some of the stat columns, by default 
+            duration, magnitude and the min, max and average of each 
+            feature. `nlist` sets the number of lists the sounds are 
+            clustered into, by default about the square root of their count.
+        """
+        dims = tuple(dims or INDEX_DIMS)
+        for d in dims:
+            if d not in INDEX_DIMS:
+                raise ValueError('Cannot index %s. Choose from: %s' % (d, ', '.join(INDEX_DIMS)))
+
+        self.index.dims = dims
+        ids, vectors = self._index_vectors()
+        self.index.build(ids, vectors, dims, nlist)
+
+    def nearest(SoundDB self, object target, int k=50, dict weights=None, int nprobe=DEFAULT_NPROBE):
+        """ Finds the k sounds closest to the target, and returns a list of 
+            (id, filename, offset, distance) tuples from nearest to farthest. 
+
+            The target may be a dict of stat columns to match, like 
+            {'centroid_avg': 2000, 'flatness_avg': 0.1}, in which case only 
+            those dimensions count toward the distance, or a SoundBuffer, 
+            which is analyzed and matched on every indexed dimension. 
+            Optional weights scale the dimensions by name. Raising nprobe 
+            searches more of the index, trading speed for recall.
+
+            Example:
+
+                db.build_index()
+                for sound_id, filename, offset, distance in db.nearest({'centroid_avg': 2000}, k=10):
+                    ...
+        """
+        cdef list out = []
+
+        if not self.index.exists():
+            self.build_index()
+
+        if isinstance(target, SoundBuffer):
+            row, _ = _analyze((target, None, 0))
+            target = dict(zip(SOUND_COLUMNS[:6] + SOUND_COLUMNS[8:], row))
+
+        ids, distances = self.index.search(target, weights, k, nprobe)
+        if len(ids) == 0:
+            return out
+
+        r = self.c.execute("SELECT id, filename, offset FROM sounds WHERE id IN (%s)" % ', '.join(['?']*len(ids)), [ int(i) for i in ids ]).fetchall()
+        rows = { row[0]: row for row in r }
+        for sound_id, distance in zip(ids, distances):
+            row = rows.get(int(sound_id))
+            if row is not None:
+                out += [ (row[0], row[1], row[2], float(distance)) ]
+
+        return out
+
     def ingest(SoundDB self, SoundBuffer snd, str filename=None, int offset=0):
-        cdef np.ndarray vector = mir.flatten(snd)
-
-        cdef np.ndarray bandwidth = mir._bandwidth(vector, snd.samplerate, mir.DEFAULT_WINSIZE)
-        cdef double bandwidth_min = np.min(bandwidth)
-        cdef double bandwidth_max = np.max(bandwidth)
-        cdef double bandwidth_avg = np.average(bandwidth)
-
-        cdef np.ndarray flatness = mir._flatness(vector, mir.DEFAULT_WINSIZE)
-        cdef double flatness_min = np.min(flatness)
-        cdef double flatness_max = np.max(flatness)
-        cdef double flatness_avg = np.average(flatness)
-
-        cdef np.ndarray rolloff = mir._rolloff(vector, snd.samplerate, mir.DEFAULT_WINSIZE)
-        cdef double rolloff_min = np.min(rolloff)
-        cdef double rolloff_max = np.max(rolloff)
-        cdef double rolloff_avg = np.average(rolloff)
-
-        cdef np.ndarray centroid = mir._centroid(vector, snd.samplerate, mir.DEFAULT_WINSIZE)
-        cdef double centroid_min = np.min(centroid)
-        cdef double centroid_max = np.max(centroid)
-        cdef double centroid_avg = np.average(centroid)
-
-        cdef np.ndarray contrast = mir._contrast(vector, snd.samplerate, mir.DEFAULT_WINSIZE)
-        cdef double contrast_min = np.min(contrast)
-        cdef double contrast_max = np.max(contrast)
-        cdef double contrast_avg = np.average(contrast)
-
-        self.c.execute("INSERT INTO sounds VALUES (%s)" % ', '.join(['?']*27), (
-            None, filename, offset, snd.channels, snd.samplerate, snd.dur, snd.mag,
-            bandwidth, bandwidth_min, bandwidth_max, bandwidth_avg,
-            flatness, flatness_min, flatness_max, flatness_avg,
-            rolloff, rolloff_min, rolloff_max, rolloff_avg,
-            centroid, centroid_min, centroid_max, centroid_avg,
-            contrast, contrast_min, contrast_max, contrast_avg,
-        ))
+        self._write_batch([ _analyze((snd, filename, offset)) ])
 
-        self.db.commit()
+    def ingest_many(SoundDB self, object sounds, object filenames=None, object offsets=None, int workers=0, int batchsize=DEFAULT_BATCHSIZE):
+        """ Analyzes many sounds at once on a pool of threads, and writes them 
+            to the database in batches of `batchsize`, one transaction each. 
+            Sounds may be SoundBuffers or paths to sound files, which are then 
+            loaded by the workers. Feature extraction releases the GIL, so the 
+            threads run in parallel. `workers` defaults to one per CPU.
+
+            Example:
+
+                db = SoundDB(dbname='samples')
+                db.ingest_many(glob.glob('samples/**/*.wav', recursive=True))
+        """
+        sounds = list(sounds)
+        if filenames is None or isinstance(filenames, str):
+            filenames = [ filenames ] * len(sounds)
+        if offsets is None or isinstance(offsets, int):
+            offsets = [ offsets or 0 ] * len(sounds)
+
+        items = list(zip(sounds, filenames, offsets))
+        batchsize = max(1, batchsize)
+
+        with ThreadPoolExecutor(max_workers=(workers or os.cpu_count() or 1)) as pool:
+            for i in range(0, len(items), batchsize):
+                self._write_batch(list(pool.map(_analyze_item, items[i:i+batchsize])))
+
+    def columns(SoundDB self):
+        """ Returns a read-only memory map of every feature column, indexed 
+            by frame. Slice a sound's curve out with its frame_offset and 
+            numframes, or scan whole columns at once.
+        """
+        cdef dict out = {}
+        for f in FEATURES:
+            path = self._column_path(f)
+            if os.path.getsize(path) == 0:
+                out[f] = np.zeros((0, FEATURE_WIDTHS[f]), dtype=FEATURE_DTYPE)
+            else:
+                out[f] = np.memmap(path, dtype=FEATURE_DTYPE, mode='r').reshape(-1, FEATURE_WIDTHS[f])
+        return out
+
+    def curves(SoundDB self, int sound_id):
+        """ Returns the per-frame feature curves of one sound, shaped 
+            (frames, 1) or (frames, 7) for contrast.
+        """
+        r = self.c.execute("SELECT frame_offset, numframes FROM sounds WHERE id=?", (sound_id,)).fetchone()
+        if r is None or r['frame_offset'] is None:
+            return None
+
+        start, numframes = r
+        return { f: col[start:start+numframes] for f, col in self.columns().items() }
 
     def query(self, sql):
         r = self.c.execute(sql)
@@ -66,7 +66,12 @@ ext_modules = cythonize([
             include_dirs=INCLUDES,
             define_macros=MACROS
         ),
-        Extension('pippi.fft', ['modules/fft/fft.c', 'pippi/fft.pyx'], 
+        Extension('pippi.fft', [
+                'modules/fft/fft.c', 
+                'libpippi/src/pippicore.c', 
+                'libpippi/src/spectral.c', 
+                'pippi/fft.pyx'
+            ], 
             include_dirs=INCLUDES + ['modules/fft'], 
             define_macros=MACROS
         ), 
@@ -101,11 +106,13 @@ ext_modules = cythonize([
             define_macros=MACROS
         ), 
         Extension('pippi.mir', [
+                'libpippi/vendor/fft/fft.c',
                 'libpippi/src/pippicore.c', 
+                'libpippi/src/spectral.c', 
                 'libpippi/src/mir.c', 
                 'pippi/mir.pyx'
             ],
-            include_dirs=INCLUDES, 
+            include_dirs=INCLUDES + ['libpippi/vendor/fft'], 
             define_macros=MACROS
         ),
 
@@ -145,6 +152,14 @@ ext_modules = cythonize([
             include_dirs=INCLUDES,
             define_macros=MACROS
         ), 
+        Extension('pippi.oscbank', [
+                'libpippi/src/pippicore.c',
+                'libpippi/src/oscs.sine.c',
+                'pippi/oscs/oscbank.pyx'
+            ], 
+            include_dirs=INCLUDES,
+            define_macros=MACROS
+        ), 
         Extension('pippi.osc2d', ['pippi/oscs/osc2d.pyx'], 
             include_dirs=INCLUDES,
             define_macros=MACROS
@@ -186,7 +201,11 @@ ext_modules = cythonize([
             define_macros=MACROS
         ), 
 
-        Extension('pippi.soundbuffer', ['pippi/soundbuffer.pyx'], 
+        Extension('pippi.soundbuffer', [
+                'libpippi/src/pippicore.c',
+                'libpippi/src/soundfile.c',
+                'pippi/soundbuffer.pyx'
+            ], 
             include_dirs= INCLUDES + ['modules/fft'], 
             define_macros=MACROS
         ), 
@@ -1,4 +1,7 @@
 from unittest import TestCase
+
+import numpy as np
+
 from pippi import dsp, fft, fx, shapes
 
 class TestFFT(TestCase):
@@ -47,3 +50,37 @@ class TestFFT(TestCase):
         out = fft.process(snd, bs, length, callback=cb)
         out = fx.norm(out, 1)
         out.write('tests/renders/fft_process.wav')
+
+    def test_fft_stft(self):
+        snd = dsp.read('tests/sounds/guitar1s.wav')
+
+        # Resynthesis with the spectrum left alone is transparent
+        out = fft.stft(snd, 1024)
+        self.assertEqual(len(out), len(snd))
+        self.assertTrue(np.allclose(out.frames, snd.frames, atol=1e-9))
+
+        def cb(pos, real, imag):
+            self.assertEqual(real.shape, (len(pos), snd.channels, 513))
+            cutoff = int(pos[0] * 400) + 10
+            real[:,:,cutoff:] = 0
+            imag[:,:,cutoff:] = 0
+
+        out = fft.stft(snd, 1024, length=2, callback=cb, batchsize=16)
+        self.assertEqual(len(out), snd.samplerate * 2)
+        out = fx.norm(out, 1)
+        out.write('tests/renders/fft_stft.wav')
+
+    def test_fft_stft_bad_sizes(self):
+        snd = dsp.read('tests/sounds/guitar1s.wav')
+
+        with self.assertRaises(ValueError):
+            fft.stft(snd, 1000)
+
+        with self.assertRaises(ValueError):
+            fft.stft(snd, 1024, hopsize=1024)
+
+        with self.assertRaises(ValueError):
+            fft.stft(snd, 1024, hopsize=-1)
+
+        with self.assertRaises(ValueError):
+            fft.stft(snd, 1024, callback=lambda pos, real, imag: None, hopsize=600)
@@ -4,6 +4,8 @@ import shutil
 import tempfile
 from unittest import TestCase
 
+import numpy as np
+
 from pippi.soundbuffer import SoundBuffer
 from pippi import dsp, grains, grains2, fx
 
@@ -109,3 +111,43 @@ class TestCloud(TestCase):
 
         out.write('tests/renders/graincloud_grainsize.wav')
 
+
+    def test_threaded_graincloud(self):
+        sound = SoundBuffer(filename='tests/sounds/guitar1s.wav')
+
+        # No jitter, so both renders place the same grains
+        cloud = grains.Cloud(sound, 
+                grainlength=dsp.win('sinc', 0.01, 0.2), 
+                speed=dsp.wt('hann', 0.5, 3), 
+                grid=0.005,
+            )
+
+        serial = cloud.play(10, threads=1)
+        threaded = cloud.play(10, threads=4)
+
+        self.assertEqual(len(serial), len(threaded))
+        self.assertTrue(np.array_equal(serial.frames, threaded.frames))
+
+    def test_graincloud_matches_serial_reference(self):
+        # Every input is exact, so the render doesn't depend on how 
+        # windows or noise are generated. The reference was rendered 
+        # by the serial Cloud.play before it was threaded.
+        frames = ((np.arange(24000 * 2).reshape(-1, 2) * 7919) % 1000) / 500.0 - 1
+        sound = SoundBuffer(frames, samplerate=48000)
+        cloud = grains.Cloud(sound, 
+                window=[0, 0.25, 0.5, 0.75, 1, 0.75, 0.5, 0.25, 0], 
+                position=[0, 0.5, 1, 0.25], 
+                grainlength=[0.01, 0.05, 0.02], 
+                speed=[0.5, 1.5, 1, 2], 
+                grid=0.003,
+            )
+
+        reference = np.load('tests/sounds/graincloud-reference.npy')
+        for threads in (1, 4):
+            out = cloud.play(0.1, threads=threads)
+            self.assertTrue(np.array_equal(np.asarray(out.frames), reference))
+
+    def test_one_frame_grains(self):
+        sound = SoundBuffer(frames=np.ones((4800, 2)), samplerate=48000)
+        out = grains.Cloud(sound, grainlength=1/48000, grid=0.001).play(0.05)
+        self.assertFalse(np.isnan(out.frames).any())
@@ -0,0 +1,57 @@
+from unittest import TestCase
+
+import numpy as np
+
+from pippi.soundbuffer import SoundBuffer
+from pippi import mir
+
+class TestMir(TestCase):
+    def test_feature_shapes(self):
+        snd = SoundBuffer(filename='tests/sounds/guitar1s.wav')
+        features = mir.features(snd)
+        numframes = 1 + len(snd) // (mir.DEFAULT_WINSIZE // 4)
+
+        for name in ('bandwidth', 'flatness', 'rolloff', 'centroid'):
+            self.assertEqual(features[name].shape, (1, numframes))
+
+        self.assertEqual(features['contrast'].shape, (7, numframes))
+
+        self.assertEqual(len(mir.centroid(snd)), numframes)
+        self.assertEqual(len(mir.contrast(snd)), 7 * numframes)
+
+    def test_sine_centroid(self):
+        samplerate = 48000
+        freq = 1000
+        frames = np.sin(2 * np.pi * freq * np.arange(samplerate) / samplerate).reshape(-1, 1)
+        snd = SoundBuffer(frames, channels=1, samplerate=samplerate)
+        features = mir.features(snd)
+
+        # Skip the frames padded with silence at either end
+        middle = slice(4, -4)
+        self.assertTrue(np.all(np.abs(features['centroid'][0, middle] - freq) < 50))
+        self.assertTrue(np.all(features['flatness'][0, middle] < 0.01))
+        self.assertTrue(np.all(features['rolloff'][0, middle] < freq + 50))
+
+    def test_sine_pitch(self):
+        samplerate = 48000
+        frames = np.sin(2 * np.pi * 440 * np.arange(samplerate) / samplerate).reshape(-1, 1)
+        snd = SoundBuffer(frames, channels=1, samplerate=samplerate)
+        pitches = mir.pitch(snd, fallback=0)
+
+        self.assertEqual(len(pitches), 1)
+        self.assertTrue(abs(pitches[0] - 440) < 2)
+
+    def test_pitch_fallback(self):
+        samplerate = 48000
+        frames = np.sin(2 * np.pi * 330 * np.arange(samplerate) / samplerate).reshape(-1, 1)
+        snd = SoundBuffer(frames, channels=1, samplerate=samplerate)
+
+        # Nothing is reported before the first detection unless asked for
+        pitches = mir.pitch(snd)
+        self.assertTrue(abs(pitches[0] - 330) < 2)
+        self.assertFalse(np.any(np.abs(np.asarray(pitches) - 220) < 2))
+
+        pitches = mir.pitch(snd, fallback=220)
+        self.assertEqual(pitches[0], 220)
+        self.assertTrue(abs(pitches[1] - 330) < 2)
+
@@ -32,6 +32,23 @@ class TestMultiband(TestCase):
         out = fx.norm(out, 1)
         out.write('tests/renders/multiband_customsplit-reconstruct.wav')
 
+    def test_parallel_split(self):
+        g = dsp.read('tests/sounds/guitar1s.wav')
+        serial = multiband.split(g, 3, workers=1)
+        parallel = multiband.split(g, 3, workers=4)
+        self.assertEqual(len(serial), len(parallel))
+        for a, b in zip(serial, parallel):
+            self.assertTrue(np.array_equal(a.frames, b.frames))
+
+    def test_customsplit_blocksize(self):
+        g = dsp.read('tests/sounds/guitar1s.wav')
+        freqs = [dsp.win('sine', 200, 800), 3000]
+        bands = multiband.customsplit(g, freqs, blocksize=1)
+        blocked = multiband.customsplit(g, freqs, blocksize=64)
+        for a, b in zip(bands, blocked):
+            self.assertEqual(len(a), len(g))
+            self.assertTrue(np.allclose(a.frames, b.frames, atol=0.05))
+
     def test_spread(self):
         dsp.seed()
         g = dsp.read('tests/sounds/guitar1s.wav')
@@ -326,6 +326,12 @@ class TestNewBuffer(TestCase):
         sound.write(filename.format('ogg'))
         self.assertTrue(path.isfile(filename.format('ogg')))
 
+    def test_save_buffer_to_missing_directory(self):
+        sound = SoundBuffer(length=1)
+        filename = path.join(self.soundfiles, 'missing', 'test_save_to_missing_directory.wav')
+        with self.assertRaises(IOError):
+            sound.write(filename)
+
     def test_convolve_soundbuffer(self):
         sound = SoundBuffer(filename='tests/sounds/guitar1s.wav')
 
@@ -1,7 +1,7 @@
 import random
 from unittest import TestCase
 
-from pippi.oscs import Drunk, Fold, Osc, Osc2d, Pulsar, Pulsar2d, Alias, Bar, Tukey, DSS, FM, SineOsc
+from pippi.oscs import Drunk, Fold, Osc, Osc2d, OscBank, Pulsar, Pulsar2d, Alias, Bar, Tukey, DSS, FM, SineOsc
 from pippi.soundbuffer import SoundBuffer
 from pippi.wavesets import Waveset
 from pippi import dsp, fx, tune, shapes
@@ -111,6 +111,21 @@ class TestOscs(TestCase):
         out.write('tests/renders/osc_sineosc-trunc.wav')
 
 
+    def test_create_oscbank(self):
+        sr = 48000
+        out = OscBank(440, channels=1, samplerate=sr).play(1)
+        sine = np.sin(2 * np.pi * 440 * np.arange(sr) / sr)
+        self.assertTrue(np.allclose(np.asarray(out.frames)[:,0], sine, atol=1e-6))
+
+        numpartials = 1000
+        freqs = [ 55 * (i+1) % 20000 for i in range(numpartials) ]
+        amp_envs = [ [(0, 0), (dsp.rand(0.01, 0.5), 1/numpartials), (4, 0)] for _ in range(numpartials) ]
+        freq_envs = [ [(0, f), (4, f * dsp.rand(0.98, 1.02))] for f in freqs ]
+        out = OscBank(freqs, amps=0, phases=[ dsp.rand() for _ in range(numpartials) ], freq_envs=freq_envs, amp_envs=amp_envs, samplerate=sr).play(4)
+        self.assertEqual(len(out), 4 * sr)
+        self.assertEqual(out.channels, 2)
+        out.write('tests/renders/osc_oscbank.wav')
+
     def test_create_osc2d(self):
         wtA = [ random.random() for _ in range(random.randint(10, 1000)) ]
         wtB = dsp.wt([ random.random() for _ in range(random.randint(10, 1000)) ])
@@ -1,8 +1,9 @@
+import os
 from os import path
 import random
 import shutil
 import tempfile
-from unittest import TestCase
+from unittest import TestCase, skipUnless
 
 from pippi.soundbuffer import SoundBuffer
 from pippi import dsp
@@ -137,6 +138,20 @@ class TestSoundBuffer(TestCase):
         sound.write(filename.format('ogg'))
         self.assertTrue(path.isfile(filename.format('ogg')))
 
+    def test_save_buffer_to_missing_directory(self):
+        sound = SoundBuffer(length=1)
+        filename = path.join(self.soundfiles, 'missing', 'test_save_to_missing_directory.wav')
+        with self.assertRaises(IOError):
+            sound.write(filename)
+
+    @skipUnless(path.exists('/dev/full'), 'needs /dev/full')
+    def test_save_buffer_to_full_disk(self):
+        sound = SoundBuffer(length=1)
+        filename = path.join(self.soundfiles, 'test_save_to_full_disk.wav')
+        os.symlink('/dev/full', filename)
+        with self.assertRaises(IOError):
+            sound.write(filename)
+
     def test_split_into_blocks(self):
         sound = SoundBuffer(filename='tests/sounds/guitar1s.wav').cut(0, 0.11)
         blocksize = 2048
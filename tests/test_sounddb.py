@@ -0,0 +1,76 @@
+import glob
+import os
+import tempfile
+from unittest import TestCase
+
+import numpy as np
+
+from pippi.soundbuffer import SoundBuffer
+from pippi.sounddb import SoundDB
+from pippi import mir
+
+class TestSoundDB(TestCase):
+    def test_ingest_many(self):
+        filenames = sorted(glob.glob('tests/sounds/LittleTikes-*.wav'))
+
+        with tempfile.TemporaryDirectory() as dbpath:
+            db = SoundDB(dbname='littletikes', dbpath=dbpath)
+            db.ingest_many(filenames, workers=4, batchsize=5)
+
+            count, numframes = db.query('SELECT COUNT(*), SUM(numframes) FROM sounds')
+            self.assertEqual(count, len(filenames))
+
+            columns = db.columns()
+            self.assertEqual(columns['centroid'].shape, (numframes, 1))
+            self.assertEqual(columns['contrast'].shape, (numframes, 7))
+
+            # Rows keep the order they were given in
+            row = db.query('SELECT id, filename FROM sounds WHERE id=3')
+            self.assertEqual(row['filename'], filenames[2])
+
+            curves = db.curves(row['id'])
+            features = mir.features(SoundBuffer(filename=filenames[2]))
+            self.assertTrue(np.allclose(curves['centroid'][:,0], features['centroid'][0], rtol=1e-5))
+            self.assertTrue(np.allclose(curves['contrast'], features['contrast'].transpose(), rtol=1e-5))
+
+    def test_nearest(self):
+        filenames = sorted(glob.glob('tests/sounds/LittleTikes-*.wav'))
+
+        with tempfile.TemporaryDirectory() as dbpath:
+            db = SoundDB(dbname='littletikes', dbpath=dbpath)
+            db.ingest_many(filenames[:10])
+            db.build_index(nlist=3)
+
+            # Sounds ingested after the index is built are added to it
+            db.ingest_many(filenames[10:])
+
+            target = SoundBuffer(filename=filenames[-1])
+            nearest = db.nearest(target, k=3, nprobe=3)
+            self.assertEqual(len(nearest), 3)
+            self.assertEqual(nearest[0][1], filenames[-1])
+            self.assertAlmostEqual(nearest[0][3], 0, places=4)
+            self.assertTrue(nearest[0][3] <= nearest[1][3] <= nearest[2][3])
+
+            centroid = db.query('SELECT centroid_avg FROM sounds WHERE id=1')[0]
+            sound_id, filename, offset, distance = db.nearest({'centroid_avg': centroid}, k=1, nprobe=3)[0]
+            self.assertAlmostEqual(distance, 0, places=4)
+
+    def test_index_recovers_from_cut_short_insert(self):
+        filenames = sorted(glob.glob('tests/sounds/LittleTikes-*.wav'))
+
+        with tempfile.TemporaryDirectory() as dbpath:
+            db = SoundDB(dbname='littletikes', dbpath=dbpath)
+            db.ingest_many(filenames[:10])
+            db.build_index(nlist=3)
+
+            # An insert that only got as far as the ids file
+            with open(os.path.join(dbpath, 'littletikes.features', 'index.ids'), 'ab') as f:
+                f.write(np.array([99], dtype='<i8').tobytes())
+
+            db = SoundDB(dbname='littletikes', dbpath=dbpath)
+            db.ingest_many(filenames[10:])
+
+            target = SoundBuffer(filename=filenames[-1])
+            nearest = db.nearest(target, k=1, nprobe=3)
+            self.assertEqual(nearest[0][1], filenames[-1])
+            self.assertAlmostEqual(nearest[0][3], 0, places=4)